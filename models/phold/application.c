@@ -15,7 +15,9 @@ enum{
 	OPT_WC,
 	OPT_WD,
 	OPT_RD,
-	OPT_TAU
+	OPT_TAU,
+	OPT_LA,
+	OPT_REV
 };
 
 const struct argp_option model_options[] = {
@@ -30,6 +32,8 @@ const struct argp_option model_options[] = {
 		{"write-distribution", 		OPT_WD, "DOUBLE", 0, NULL, 0},
 		{"read-distribution", 		OPT_RD, "DOUBLE", 0, NULL, 0},
 		{"tau", 					OPT_TAU, "DOUBLE", 0, NULL, 0},
+		{"lookahead", 				OPT_LA, "DOUBLE", 0, NULL, 0},
+		{"reverse", 				OPT_REV, NULL, 0, NULL, 0},
 		{0}
 };
 
@@ -56,6 +60,11 @@ static error_t model_parse(int key, char *arg, struct argp_state *state) {
 		HANDLE_ARGP_CASE(OPT_WD, 	"%lf", 	write_distribution);
 		HANDLE_ARGP_CASE(OPT_RD, 	"%lf", 	read_distribution);
 		HANDLE_ARGP_CASE(OPT_TAU, 	"%lf", 	tau);
+		HANDLE_ARGP_CASE(OPT_LA, 	"%lf", 	lookahead);
+
+		case OPT_REV:
+			reverse_computation = true;
+			break;
 
 		case ARGP_KEY_SUCCESS:
 			printf("\t* ROOT-Sim's PHOLD Benchmark - Current Configuration *\n");
@@ -68,8 +77,11 @@ static error_t model_parse(int key, char *arg, struct argp_state *state) {
 					"write_distribution: %f\n"
 					"read_distribution: %f\n"
 					"tau: %f\n"
+					"lookahead: %f\n"
+					"reverse computation: %s\n"
 					"write-correction: %d\n", object_total_size, timestamp_distribution, max_size, min_size,
-					num_buffers, complete_alloc, write_distribution, read_distribution, tau, write_correction);
+					num_buffers, complete_alloc, write_distribution, read_distribution, tau, lookahead,
+					reverse_computation ? "yes" : "no", write_correction);
 			printf("\n");
 			break;
 		default:
@@ -95,7 +107,23 @@ int	object_total_size = OBJECT_TOTAL_SIZE,
 unsigned int complete_alloc = COMPLETE_ALLOC;
 double	write_distribution = WRITE_DISTRIBUTION,
 	read_distribution = READ_DISTRIBUTION,
-	tau = TAU;
+	tau = TAU,
+	lookahead = 0.0;
+bool	reverse_computation = false;
+
+
+// Only the events of the traditional benchmark can be undone
+static void ReverseEvent(unsigned int me, simtime_t now, int event_type, void *event_content, unsigned int size, void *state) {
+	(void)me;
+	(void)now;
+	(void)event_content;
+	(void)size;
+
+	lp_state_type *state_ptr = (lp_state_type*)state;
+
+	if(event_type == LOOP)
+		state_ptr->events--;
+}
 
 
 void ProcessEvent(int me, simtime_t now, int event_type, event_content_type *event_content, unsigned int size, void *state) {
@@ -140,6 +168,14 @@ void ProcessEvent(int me, simtime_t now, int event_type, event_content_type *eve
 //				state_ptr->loop_counter = GetParameterInt(event_content, "counter");
 				state_ptr->events = 0;
 
+				// Events to other LPs are never closer than this
+				if(lookahead > 0.0)
+					SetLookahead(lookahead);
+
+				// Undo LOOP events rather than restoring checkpoints
+				if(reverse_computation)
+					RegisterReverseEvent(ReverseEvent);
+
 				if(me == 0) {
 					printf("Running a traditional loop-based PHOLD benchmark with counter set to %d, %d total events per LP\n", LOOP_COUNT, COMPLETE_EVENTS);
 				}
@@ -223,7 +259,7 @@ void ProcessEvent(int me, simtime_t now, int event_type, event_content_type *eve
 				j = i;
 			}
 			state_ptr->events++;
-			timestamp = now + (simtime_t)(Expent(TAU));
+			timestamp = now + lookahead + (simtime_t)(Expent(TAU));
 			ScheduleNewEvent(me, timestamp, LOOP, NULL, 0);
 			if(Random() < 0.2)
 				ScheduleNewEvent(FindReceiver(), timestamp, LOOP, NULL, 0);
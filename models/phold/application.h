@@ -76,5 +76,7 @@ extern unsigned int
 		complete_alloc;
 extern double	write_distribution,
 		read_distribution,
-		tau;
+		tau,
+		lookahead;
+extern bool	reverse_computation;
 
@@ -77,6 +77,8 @@ int Zipf(double skew, int limit);
 // ROOT-Sim core API
 extern void (*ScheduleNewEvent)(unsigned int receiver, simtime_t timestamp, unsigned int event_type, void *event_content, unsigned int event_size);
 extern void SetState(void *new_state);
+extern void SetLookahead(simtime_t lookahead);
+extern void RegisterReverseEvent(void (*reverse)(unsigned int me, simtime_t now, int event_type, void *event_content, unsigned int size, void *state));
 
 /*********************************/
 /********TOPOLOGY*LIBRARY*********/
@@ -196,6 +198,8 @@ __attribute((weak)) extern struct _abm_settings_t{
 	const unsigned neighbour_data_size;
 	const unsigned traverse_handler;
 	const bool keep_history;
+	const simtime_t update_granularity;	//!< if positive, changes of the neighbour data are sent at most once in time windows this long
+	const bool update_diffs;		//!< with a positive update_granularity, only the changed bytes of the neighbour data are sent
 } abm_settings;
 
 int			GetNeighbourInfo	(direction_t i, unsigned int *region_id, void **data_p);
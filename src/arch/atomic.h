@@ -71,3 +71,9 @@ inline void spin_lock(spinlock_t * s);
 /// Spinlock initialization
 #define spinlock_init(s)	((s)->lock = 0)
 
+/// Hint the processor that the calling thread is busy-waiting
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()		__asm__ __volatile__("pause" ::: "memory")
+#else
+#define cpu_relax()		__asm__ __volatile__("" ::: "memory")
+#endif
@@ -34,10 +34,23 @@
  */
 
 #include <stdbool.h>
+#include <limits.h>
 #include <arch/thread.h>
 #include <core/init.h>
 #include <mm/mm.h>
 
+#if defined(OS_LINUX)
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/// Number of busy-waiting iterations before a thread waiting on a barrier yields the CPU
+#define BARRIER_SPIN_ITERATIONS		4096
+
+/// Number of times a thread waiting on a barrier yields the CPU before going to sleep
+#define BARRIER_YIELD_ITERATIONS	64
+
 /**
  * An OS-level thread id. We never do any join on worker threads, so
  * there is no need to keep track of system ids. Internally, each thread
@@ -180,9 +193,136 @@ void create_threads(unsigned short int n, void *(*start_routine)(void *), void *
 void barrier_init(barrier_t * b, int t)
 {
 	b->num_threads = t;
+	b->resize = 0;
+	atomic_set(&b->sleepers, 0);
 	thread_barrier_reset(b);
 }
 
+/**
+* This function changes the number of threads which synchronize on a thread
+* barrier. The new number is adopted when the barrier is reset by the leader
+* of the next synchronization, so that threads which are already waiting on
+* it are not affected.
+*
+* @warning This must be called by a thread which knows that no reset of the
+*          barrier is in progress, e.g. by the leader of the last synchronization.
+*          Threads which join or leave the barrier must not synchronize on it
+*          until the next synchronization has been completed.
+*
+* @param b the thread barrier to resize
+* @param t the number of threads which will synchronize on the barrier
+*/
+void barrier_resize(barrier_t * b, int t)
+{
+	b->resize = t;
+}
+
+/**
+* This function puts the calling thread to sleep, as long as the integer
+* pointed by @p addr keeps the value @p val. Spurious wakeups are possible,
+* so the caller should check the condition it is waiting for again.
+*
+* On systems where futexes are not available, the thread spins instead.
+*
+* @param addr The address of the integer to wait on
+* @param val The value which keeps the thread asleep
+*/
+void futex_wait(volatile int *addr, int val)
+{
+#if defined(OS_LINUX)
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+	while (*addr == val) ;
+#endif
+}
+
+/**
+* This function is like futex_wait(), but the calling thread sleeps at
+* most for the given time.
+*
+* On systems where futexes are not available, the thread yields the CPU once.
+*
+* @param addr The address of the integer to wait on
+* @param val The value which keeps the thread asleep
+* @param usec The maximum time to sleep, in microseconds
+*/
+void futex_wait_timeout(volatile int *addr, int val, unsigned int usec)
+{
+#if defined(OS_LINUX)
+	struct timespec timeout = {
+		.tv_sec = usec / 1000000,
+		.tv_nsec = (usec % 1000000) * 1000
+	};
+
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &timeout, NULL, 0);
+#else
+	(void)addr;
+	(void)val;
+	(void)usec;
+	thread_yield();
+#endif
+}
+
+/**
+* This function wakes up all the threads which are sleeping in futex_wait()
+* on the integer pointed by @p addr. The integer should be changed before.
+*
+* @param addr The address of the integer which threads are waiting on
+*/
+void futex_wake_all(volatile int *addr)
+{
+#if defined(OS_LINUX)
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	(void)addr;
+#endif
+}
+
+/**
+* Waits until one of the counters of a thread barrier reaches a given value.
+* The thread first busy-waits, then it starts yielding the CPU to other threads
+* and eventually it goes to sleep on the counter. Short waits are therefore not
+* slowed down, while threads sharing the CPU with others do not steal it from
+* the ones which are late at the barrier.
+*
+* @param b The thread barrier which the counter belongs to
+* @param v The counter to wait on
+* @param target The value which the counter must reach
+*/
+static void barrier_wait_for(barrier_t * b, atomic_t * v, int target)
+{
+	unsigned int i = 0;
+	int val;
+
+	while ((val = atomic_read(v)) != target) {
+		if (i < BARRIER_SPIN_ITERATIONS) {
+			cpu_relax();
+			i++;
+		} else if (i < BARRIER_SPIN_ITERATIONS + BARRIER_YIELD_ITERATIONS) {
+			thread_yield();
+			i++;
+		} else {
+			// If the counter changes after this, the waker sees us
+			atomic_inc(&b->sleepers);
+			futex_wait(&v->count, val);
+			atomic_dec(&b->sleepers);
+		}
+	}
+}
+
+/**
+* Wakes up the threads which are sleeping on a counter of a thread barrier.
+* This must be called after the counter has reached the value they wait for.
+*
+* @param b The thread barrier which the counter belongs to
+* @param v The counter which has been updated
+*/
+static inline void barrier_wake(barrier_t * b, atomic_t * v)
+{
+	if (atomic_read(&b->sleepers) > 0)
+		futex_wake_all(&v->count);
+}
+
 /**
 * This function synchronizes all the threads. After a thread leaves this function,
 * it is guaranteed that no other thread has (at least) not entered the function,
@@ -200,11 +340,14 @@ void barrier_init(barrier_t * b, int t)
 bool thread_barrier(barrier_t * b)
 {
 	// Wait for the leader to finish resetting the barrier
-	while (atomic_read(&b->barr) != -1) ;
+	barrier_wait_for(b, &b->barr, -1);
 
 	// Wait for all threads to synchronize
 	atomic_dec(&b->c1);
-	while (atomic_read(&b->c1)) ;
+	if (atomic_read(&b->c1) == 0)
+		barrier_wake(b, &b->c1);
+	else
+		barrier_wait_for(b, &b->c1, 0);
 
 	// Leader election
 	if (unlikely(atomic_inc_and_test(&b->barr))) {
@@ -213,15 +356,19 @@ bool thread_barrier(barrier_t * b)
 		atomic_dec(&b->c2);
 
 		// Wait all the other threads to leave the first part of the barrier
-		while (atomic_read(&b->c2)) ;
+		barrier_wait_for(b, &b->c2, 0);
 
 		// Reset the barrier to its initial values
 		thread_barrier_reset(b);
+		__sync_synchronize();
+		barrier_wake(b, &b->barr);
 
 		return true;
 	}
 	// I'm sync'ed!
 	atomic_dec(&b->c2);
+	if (atomic_read(&b->c2) == 0)
+		barrier_wake(b, &b->c2);
 
 	return false;
 }
@@ -53,6 +53,9 @@ typedef pthread_t tid_t;
 /// Spawn a new thread
 #define new_thread(entry, arg)	pthread_create(&os_tid, NULL, entry, arg)
 
+/// Give the CPU to another ready thread, if any
+#define thread_yield()		sched_yield()
+
 /**
  * This inline function sets the affinity of the thread which calls it.
  *
@@ -84,6 +87,9 @@ typedef HANDLE tid_t;
 /// Spawn a new thread
 #define new_thread(entry, arg)	CreateThread(NULL, 0, entry, arg, 0, &os_tid)
 
+/// Give the CPU to another ready thread, if any
+#define thread_yield()		SwitchToThread()
+
 /// Macro to set the affinity of the thread which calls it
 #define set_affinity(core) SetThreadAffinityMask(GetCurrentThread(), 1<<core)
 
@@ -106,6 +112,8 @@ typedef struct {
 	atomic_t barr;		/**< "Barrier in a barrier": this is used to wait for the leader
 				 *   to correctly reset the barrier before re-entering
 				 */
+	int resize;		///< If not zero, the number of threads which will synchronize after the next reset
+	atomic_t sleepers;	///< Number of threads which are sleeping on one of the counters
 } barrier_t;
 
 /**
@@ -165,6 +173,10 @@ typedef struct {
  * @param b The thread barrier to reset (the name, not a pointer to)
  */
 #define thread_barrier_reset(b)		do { \
+						if ((b)->resize) { \
+							(b)->num_threads = (b)->resize; \
+							(b)->resize = 0; \
+						} \
 						(atomic_set((&b->c1), (b)->num_threads)); \
 						(atomic_set((&b->c2), (b)->num_threads)); \
 						(atomic_set((&b->barr), -1)); \
@@ -176,5 +188,9 @@ extern __thread unsigned int local_tid;
 
 extern void barrier_init(barrier_t * b, int t);
 extern bool thread_barrier(barrier_t * b);
+extern void barrier_resize(barrier_t * b, int t);
+extern void futex_wait(volatile int *addr, int val);
+extern void futex_wait_timeout(volatile int *addr, int val, unsigned int usec);
+extern void futex_wake_all(volatile int *addr);
 extern void create_threads(unsigned short int n, void *(*start_routine)(void *), void *arg);
 
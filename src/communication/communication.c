@@ -33,8 +33,10 @@
 #include <float.h>
 
 #include <core/core.h>
+#include <core/init.h>
 #include <gvt/gvt.h>
 #include <queues/queues.h>
+#include <queues/xxhash.h>
 #include <communication/communication.h>
 #include <statistics/statistics.h>
 #include <scheduler/scheduler.h>
@@ -87,6 +89,9 @@ void communication_fini(void)
 		while (!list_empty(lp->queue_out)) {
 			list_pop(lp->queue_out);
 		}
+		while (!list_empty(lp->queue_lazy)) {
+			list_pop(lp->queue_lazy);
+		}
 	}
 }
 
@@ -293,6 +298,10 @@ void ParallelScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, un
 			      current->gid, event_type, MIN_VALUE_CONTROL);
 	}
 
+	// Check whether the event honours the lookahead declared by the LP
+	if (current->lookahead > 0.0)
+		check_lookahead(receiver, timestamp);
+
 	// Copy all the information into the event structure
 	pack_msg(&event, current->gid, receiver, event_type, timestamp, lvt(current), event_size, event_content);
 	event->mark = generate_mark(current);
@@ -310,6 +319,57 @@ void ParallelScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, un
 }
 
 
+/**
+ * @brief Send the pending cancellations of an LP, grouped by receiver
+ *
+ * All the headers in the queue of pending cancellations whose send time is
+ * smaller than @p horizon are turned into antimessages. Antimessages
+ * directed to the same LP are packed into a single cancel set: a negative
+ * message whose payload is the array of the marks to cancel, and whose
+ * timestamp is the minimum among the cancelled messages. The receiver
+ * handles the whole set with a single pass over its input queue and at
+ * most one rollback.
+ *
+ * Control messages are never packed together with other messages, as
+ * their type tells how the antimessage is handled at the receiver.
+ *
+ * @param lp A pointer to the LP lp_struct whose pending cancellations should be sent
+ * @param horizon Headers with a send time smaller than this are cancelled
+ */
+static void send_cancel_sets(struct lp_struct *lp, simtime_t horizon)
+{
+	msg_hdr_t *first, *hdr, *next;
+	msg_t *msg;
+	unsigned long long *marks;
+	unsigned int n;
+
+	while ((first = list_head(lp->queue_lazy)) != NULL && first->send_time < horizon) {
+		msg = get_msg_from_slab(which_slab_to_use(first->sender, first->receiver));
+		hdr_to_msg(first, msg);
+		msg->message_kind = negative;
+		marks = (unsigned long long *)msg->event_content;
+
+		n = 0;
+		hdr = first;
+		do {
+			next = list_next(hdr);
+			if (hdr == first || (hdr->receiver.to_int == msg->receiver.to_int && !is_control_msg(hdr->type))) {
+				marks[n++] = hdr->mark;
+				msg->timestamp = min(msg->timestamp, hdr->timestamp);
+				list_delete_by_content(lp->queue_lazy, hdr);
+				msg_hdr_release(hdr);
+			}
+			hdr = next;
+		} while (hdr != NULL && hdr->send_time < horizon && n < CANCEL_SET_SIZE && !is_control_msg(msg->type));
+
+		msg->size = n * sizeof(*marks);
+
+		// MPI guarantees that the antimessage is eventually received
+		Send(msg);
+	}
+}
+
+
 /**
  * @brief Send all antimessages for a certain LP
  *
@@ -317,9 +377,12 @@ void ParallelScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, un
  * a simulation time (which is associated with the time at which
  * we are rolling back.
  *
- * After that the antimessage is sent, the header is immediately removed
- * from the output queue, as MPI guarantees that the antimessage is
- * eventually received at the destination.
+ * The headers of the cancelled messages are moved from the output queue
+ * to the queue of pending cancellations. With aggressive cancellation they
+ * are sent right away, packed by receiver (see send_cancel_sets()). With
+ * lazy cancellation, the antimessage is sent later on, by
+ * flush_lazy_antimessages(), only if the re-execution does not send
+ * the very same message again.
  *
  * @param lp A pointer to the LP lp_struct for which antimessages should be sent
  * @param after_simtime The simulation time instant after which to send antimessages
@@ -327,26 +390,78 @@ void ParallelScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, un
 void send_antimessages(struct lp_struct *lp, simtime_t after_simtime)
 {
 	msg_hdr_t *anti_msg, *anti_msg_prev;
-	msg_t *msg;
 
 	if (unlikely(list_empty(lp->queue_out)))
 		return;
 
-	// Scan the output queue backwards, sending all required antimessages
+	// Scan the output queue backwards, collecting all required antimessages
 	anti_msg = list_tail(lp->queue_out);
 	while (anti_msg != NULL && anti_msg->send_time > after_simtime) {
-		msg = get_msg_from_slab(which_slab_to_use(anti_msg->sender, anti_msg->receiver));
-		hdr_to_msg(anti_msg, msg);
-		msg->message_kind = negative;
-
-		Send(msg);
-
-		// Remove the already-sent antimessage from the output queue
 		anti_msg_prev = list_prev(anti_msg);
 		list_delete_by_content(lp->queue_out, anti_msg);
-		msg_hdr_release(anti_msg);
+
+		// Pending cancellations come after the whole output queue, so the list stays sorted
+		list_insert_head(lp->queue_lazy, anti_msg);
+
 		anti_msg = anti_msg_prev;
 	}
+
+	if (rootsim_config.cancellation != CANCELLATION_LAZY)
+		send_cancel_sets(lp, INFTY);
+}
+
+
+/**
+ * @brief Send the antimessages which lazy cancellation cannot avoid anymore
+ *
+ * A message pending cancellation can be sent again only by the re-execution
+ * of an event at its send time. Once the LP has no more events to process
+ * at that time, the message is a true divergence and it is cancelled. This
+ * also ensures that the GVT never goes past a pending cancellation.
+ *
+ * This must be called after each event is processed, and after a rollback.
+ *
+ * @param lp A pointer to the LP lp_struct whose pending cancellations should be checked
+ */
+void flush_lazy_antimessages(struct lp_struct *lp)
+{
+	if (likely(list_empty(lp->queue_lazy)))
+		return;
+
+	send_cancel_sets(lp, next_event_timestamp(lp));
+}
+
+
+/**
+ * Look for a message pending cancellation which is identical to a message
+ * which is being sent. Since the receiver already has the old one, the new
+ * message is dropped, and the header of the old one is taken back.
+ *
+ * @return The header of the old message, or @c NULL if there is none
+ */
+static msg_hdr_t *match_lazy_msg(struct lp_struct *lp, msg_t *msg)
+{
+	msg_hdr_t *hdr;
+	unsigned long long hash;
+
+	if (likely(list_empty(lp->queue_lazy)))
+		return NULL;
+
+	hash = XXH64(msg->event_content, msg->size, msg->size);
+
+	// Headers are sorted by send time, the one of this message is the LP's current time
+	for (hdr = list_head(lp->queue_lazy); hdr != NULL && hdr->send_time <= msg->send_time; hdr = list_next(hdr)) {
+		if (hdr->send_time == msg->send_time && hdr->timestamp == msg->timestamp
+		    && hdr->receiver.to_int == msg->receiver.to_int && hdr->type == msg->type
+		    && hdr->hash == hash) {
+			list_delete_by_content(lp->queue_lazy, hdr);
+			msg_release(msg);
+			statistics_post_data(lp, STAT_LAZY_HIT, 1.0);
+			return hdr;
+		}
+	}
+
+	return NULL;
 }
 
 
@@ -412,6 +527,33 @@ void insert_outgoing_msg(msg_t *msg)
 }
 
 
+/**
+ * @brief Update the estimate of the LP which a sender mostly talks to
+ *
+ * This is a single-counter majority vote: the current partner gains weight
+ * when it is the receiver again, otherwise it loses weight and is replaced
+ * once its weight drops to zero. The load balancer relies on this estimate
+ * to keep LPs which communicate a lot on the same worker thread.
+ *
+ * @param lp A pointer to the sender LP's @ref lp_struct
+ * @param receiver The GID of the receiver of the message being sent
+ */
+static inline void update_comm_partner(struct lp_struct *lp, GID_t receiver)
+{
+	if (receiver.to_int == lp->gid.to_int)
+		return;
+
+	if (lp->comm_partner_weight == 0) {
+		lp->comm_partner = receiver;
+		lp->comm_partner_weight = 1;
+	} else if (lp->comm_partner.to_int == receiver.to_int) {
+		lp->comm_partner_weight++;
+	} else {
+		lp->comm_partner_weight--;
+	}
+}
+
+
 /**
  * @brief Send all pending outgoing messages
  *
@@ -435,11 +577,18 @@ void send_outgoing_msgs(struct lp_struct *lp)
 	msg_hdr_t *msg_hdr;
 
 	for (i = 0; i < lp->outgoing_buffer.size; i++) {
-		msg_hdr = get_msg_hdr_from_slab(lp);
 		msg = lp->outgoing_buffer.outgoing_msgs[i];
-		msg_to_hdr(msg_hdr, msg);
 
-		Send(msg);
+		// The receiver might still have this message, if it has not been cancelled yet
+		msg_hdr = match_lazy_msg(lp, msg);
+		if (msg_hdr == NULL) {
+			msg_hdr = get_msg_hdr_from_slab(lp);
+			msg_to_hdr(msg_hdr, msg);
+
+			update_comm_partner(lp, msg->receiver);
+
+			Send(msg);
+		}
 
 		// register the message in the sender's output queue, for antimessage management
 		list_insert(lp->queue_out, send_time, msg_hdr);
@@ -449,6 +598,41 @@ void send_outgoing_msgs(struct lp_struct *lp)
 }
 
 
+/**
+ * @brief Send all pending outgoing messages of a safe event
+ *
+ * This is the counterpart of send_outgoing_msgs() for events which have
+ * been processed below the safe horizon (see is_safe_event()). Such
+ * events are never rolled back, so the messages they generate are
+ * never cancelled, and no header is kept in the output queue.
+ *
+ * @param lp A pointer to the LP's @ref lp_struct for which we want to
+ *           finalize the event send operation.
+ */
+void send_committed_msgs(struct lp_struct *lp)
+{
+	register unsigned int i = 0;
+	msg_t *msg;
+	msg_hdr_t *msg_hdr;
+
+	for (i = 0; i < lp->outgoing_buffer.size; i++) {
+		msg = lp->outgoing_buffer.outgoing_msgs[i];
+
+		// A message which survived lazy cancellation is now committed as well
+		msg_hdr = match_lazy_msg(lp, msg);
+		if (msg_hdr != NULL) {
+			msg_hdr_release(msg_hdr);
+			continue;
+		}
+
+		update_comm_partner(lp, msg->receiver);
+		Send(msg);
+	}
+
+	lp->outgoing_buffer.size = 0;
+}
+
+
 /**
  * @brief Pack a message in a platform-level data structure
  *
@@ -540,6 +724,9 @@ void msg_to_hdr(msg_hdr_t *hdr, msg_t *msg)
 	hdr->timestamp = msg->timestamp;
 	hdr->send_time = msg->send_time;
 	hdr->mark = msg->mark;
+
+	if (rootsim_config.cancellation == CANCELLATION_LAZY)
+		hdr->hash = XXH64(msg->event_content, msg->size, msg->size);
 }
 
 
@@ -42,6 +42,15 @@
  */
 #define SLAB_MSG_SIZE		512
 
+/**
+ * @brief Maximum number of marks in a cancel set.
+ *
+ * Antimessages towards the same LP are packed into a single negative
+ * message, whose payload is the array of the marks of the messages to
+ * cancel. A cancel set always fits into a slab buffer.
+ */
+#define CANCEL_SET_SIZE		((SLAB_MSG_SIZE - sizeof(msg_t)) / sizeof(unsigned long long))
+
 /**
  * @brief Simulation Platform Control Messages
  *
@@ -72,6 +81,13 @@ enum _control_msgs {
 	MAX_VALUE_CONTROL		///< Anything after this value is considered as an impossible message
 };
 
+/// Cancellation strategies for messages sent by rolled back events
+enum cancellation_modes {
+	CANCELLATION_INVALID = 0,	/**< By convention 0 is the invalid field */
+	CANCELLATION_AGGRESSIVE,	/**< Antimessages are sent as soon as the sender is rolled back */
+	CANCELLATION_LAZY		/**< Antimessages are sent only if the re-execution does not send the same message again */
+};
+
 /// This macro tells whether a message is a control message, by its type
 #define is_control_msg(type)	(type >= MIN_VALUE_CONTROL && type != RENDEZVOUS_START)
 
@@ -134,7 +150,9 @@ extern void communication_fini(void);
 extern void Send(msg_t * msg);
 extern void insert_outgoing_msg(msg_t * msg);
 extern void send_outgoing_msgs(struct lp_struct *);
+extern void send_committed_msgs(struct lp_struct *);
 extern void send_antimessages(struct lp_struct *, simtime_t);
+extern void flush_lazy_antimessages(struct lp_struct *);
 
 extern void msg_hdr_release(msg_hdr_t * msg);
 extern msg_t *get_msg_from_slab(struct lp_struct *);
@@ -138,14 +138,18 @@ static spinlock_t gvt_reduction_lock;
  * values to be reduced across all ranks. This is a global variable
  * in which each kernel instance places its proposal for the GVT, which
  * is reduced using MPI all reduce.
+ *
+ * The second element piggybacks on the same reduction a flag telling
+ * whether the kernel instance is still running, i.e. it has not yet
+ * notified its local termination and it is not shutting down.
  */
-static simtime_t local_vt_buff;
+static simtime_t local_vt_buff[2];
 
 /**
  * This is the target temporary buffer in which MPI all reduce will
- * place the reduced GVT value.
+ * place the reduced GVT value, followed by the reduced running flag.
  */
-static simtime_t reduced_gvt;
+static simtime_t reduced_gvt[2];
 
 /**
  * A vector of MPI asynchronous operations used to communicate with all
@@ -285,6 +289,22 @@ void exit_red_phase(void)
 }
 
 
+/**
+ * @brief Make a thread adopt the colour of the other threads.
+ *
+ * A thread which has been parked has not taken part to the GVT rounds
+ * which were carried out in the meanwhile, so its colour is stale. This
+ * aligns it to the one of the master thread, which is never parked.
+ *
+ * @warning This must be called while no GVT round is in progress.
+ */
+void rejoin_phase_colour(void)
+{
+	min_outgoing_red_msg[local_tid] = INFTY;
+	threads_phase_colour[local_tid] = threads_phase_colour[0];
+}
+
+
 /**
  * @brief Join the white message reduction collective operation.
  *
@@ -420,7 +440,7 @@ void flush_white_msg_sent(void)
 
 	//sanity check
 #ifndef NDEBUG
-	for (i = 0; i < n_cores; i++) {
+	for (i = 0; i < n_active_cores; i++) {
 		if (!is_red_colour(threads_phase_colour[i]))
 			rootsim_error(true, "flushing outgoing white message counter while some thread are not in red phase\n");
 	}
@@ -514,9 +534,10 @@ void gvt_init_clear(void)
  */
 void join_gvt_redux(simtime_t local_vt)
 {
-	local_vt_buff = local_vt;
+	local_vt_buff[0] = local_vt;
+	local_vt_buff[1] = (local_vt >= 0.0 && !local_termination_notified()) ? 1.0 : 0.0;
 	lock_mpi();
-	MPI_Iallreduce(&local_vt_buff, &reduced_gvt, 1, MPI_DOUBLE, MPI_MIN, gvt_reduction_comm, &gvt_reduction_req);
+	MPI_Iallreduce(local_vt_buff, reduced_gvt, 2, MPI_DOUBLE, MPI_MIN, gvt_reduction_comm, &gvt_reduction_req);
 	unlock_mpi();
 }
 
@@ -562,7 +583,23 @@ bool gvt_redux_completed(void)
  */
 simtime_t last_reduced_gvt(void)
 {
-	return reduced_gvt;
+	return reduced_gvt[0];
+}
+
+
+/**
+ * @brief Tell whether all kernels were running at the last GVT reduction.
+ *
+ * This is reduced along with the GVT value. If it returns @c true, no
+ * kernel instance had notified its local termination when joining the
+ * last GVT reduction, so all of them will take part to the next one.
+ *
+ * @return @c true if all kernels were running at the last GVT reduction,
+ *         @c false otherwise.
+ */
+bool last_reduced_all_running(void)
+{
+	return reduced_gvt[1] > 0.0;
 }
 
 
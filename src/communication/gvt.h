@@ -89,6 +89,7 @@ void gvt_comm_init(void);
 void gvt_comm_finalize(void);
 void enter_red_phase(void);
 void exit_red_phase(void);
+void rejoin_phase_colour(void);
 void join_white_msg_redux(void);
 bool white_msg_redux_completed(void);
 void wait_white_msg_redux(void);
@@ -101,6 +102,7 @@ void gvt_init_clear(void);
 void join_gvt_redux(simtime_t local_vt);
 bool gvt_redux_completed(void);
 simtime_t last_reduced_gvt(void);
+bool last_reduced_all_running(void);
 void register_incoming_msg(const msg_t *);
 void register_outgoing_msg(const msg_t *);
 
@@ -0,0 +1,824 @@
+/**
+* @file communication/migration.c
+*
+* @brief LP migration across kernel instances
+*
+* This module moves LPs from overloaded simulation kernel instances to
+* underloaded ones in distributed simulations.
+*
+* Every @c migration_period GVT reductions, all kernels exchange their
+* committed event rate and the fraction of idle cycles of their worker
+* threads. All of them compute the very same plan out of these values:
+* if the most loaded kernel exceeds the average committed rate by more
+* than @ref MIGRATION_IMBALANCE_THRESHOLD, and the least loaded kernel
+* is at least as idle as it, some LPs are moved from the former to the
+* latter.
+*
+* The migration itself takes place when worker threads are not processing
+* events, before any new GVT reduction is started. Event messages in
+* flight across kernels are delivered beforehand, so that no message
+* needs to be forwarded to the new host of an LP. Then, LPs are packed
+* by the source kernel together with their queues and checkpoints, and
+* rebuilt by the destination kernel. DyMeLoR keeps the buffers of the
+* application in a per-LP segment, which is mapped at the same address
+* on every kernel, so pointers in the simulation state and in the logs
+* remain valid after the migration.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef HAVE_MPI
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <arch/thread.h>
+#include <communication/communication.h>
+#include <communication/gvt.h>
+#include <communication/migration.h>
+#include <communication/mpi.h>
+#include <core/timer.h>
+#include <datatypes/bitmap.h>
+#include <gvt/ccgs.h>
+#include <mm/mm.h>
+#include <mm/state.h>
+#include <queues/queues.h>
+#include <scheduler/process.h>
+#include <statistics/statistics.h>
+
+/// Load information exchanged by kernels to decide on migrations
+struct kernel_load {
+	double rate;		///< Committed events per second since the last check
+	double idle;		///< Fraction of idle cycles of worker threads since the last check
+};
+
+/// Fixed-size part of the package of a migrating LP
+struct lp_package {
+	GID_t gid;
+	short unsigned int state;
+	unsigned int ckpt_period;
+	unsigned int from_last_ckpt;
+	bool state_log_forced;
+	simtime_t lookahead;
+	void *current_base_pointer;
+	void (*ReverseEvent)(unsigned int, simtime_t, int, void *, unsigned int, void *);	///< The binary is the same on all kernels
+	unsigned long long mark;
+	numerical_state_t numerical;
+	double exponential_event_time;
+	long bound;		///< Position of the bound in the input queue, -1 if none
+	long last_processed;	///< Position of the last processed event in the input queue, -1 if none
+	size_t queue_in_len;
+	size_t queue_out_len;
+	size_t queue_lazy_len;
+	size_t queue_states_len;
+	topology_t *topology;	///< Address of the topology struct on the source kernel
+	size_t region_size;	///< Size of the checkpoint of the ABM region, 0 if none
+};
+
+/// Fixed-size part of a checkpoint in the package of a migrating LP
+struct state_package {
+	simtime_t lvt;
+	long last_event;	///< Position of the last event in the input queue, -1 if none
+	short unsigned int state;
+	void *base_pointer;
+	numerical_state_t numerical;
+	size_t log_size;
+	size_t region_size;
+};
+
+/// An entry in the list of candidates to migration
+struct lp_rate {
+	double rate;
+	struct lp_struct *lp;
+};
+
+/// Copy a buffer into a package, and move forward the package cursor
+#define pack(cursor, src, size) ({ \
+		memcpy((cursor), (src), (size)); \
+		(cursor) += (size); \
+	})
+
+/// Copy a buffer out of a package, and move forward the package cursor
+#define unpack(dst, cursor, size) ({ \
+		memcpy((dst), (cursor), (size)); \
+		(cursor) += (size); \
+	})
+
+/// MPI Communicator used to exchange load information and LP packages
+static MPI_Comm migration_comm;
+
+/// Number of committed events of each LP (indexed by gid) at the last check
+static double *committed_snapshot;
+
+/// Committed event rate of each locally-hosted LP (indexed by lid) at the last check
+static double *lp_rates;
+
+/// Number of GVT reductions since the beginning of the simulation
+static unsigned int gvt_rounds;
+
+/// Measures the time between two checks
+static timer migration_timer;
+
+/// Idle cycles of worker threads at the last check
+static double last_idle_cycles;
+
+/// Executed events at the last check
+static double last_tot_events;
+
+/// Set when kernels agree on a migration, until it has been carried out
+static volatile bool migration_pending;
+
+/// Incremented by the master thread to let worker threads start a migration
+static volatile unsigned int migration_phase;
+
+/// The last migration phase joined by the worker thread
+static __thread unsigned int local_migration_phase;
+
+/// The kernel instance from which LPs are migrated
+static unsigned int src_kernel;
+
+/// The kernel instance to which LPs are migrated
+static unsigned int dst_kernel;
+
+/// The committed event rate which should be moved from the source to the destination
+static double migration_budget;
+
+
+/**
+ * @brief Initialize the LP migration subsystem
+ *
+ * This must be called by all kernel instances, after LPs have been set up.
+ */
+void lp_migration_init(void)
+{
+	if (!lp_migration_enabled())
+		return;
+
+	MPI_Comm_dup(MPI_COMM_WORLD, &migration_comm);
+
+	committed_snapshot = rsalloc(sizeof(double) * n_prc_tot);
+	bzero(committed_snapshot, sizeof(double) * n_prc_tot);
+	lp_rates = rsalloc(sizeof(double) * n_prc_max);
+	bzero(lp_rates, sizeof(double) * n_prc_max);
+
+	timer_start(migration_timer);
+}
+
+
+/**
+ * @brief Finalize the LP migration subsystem
+ */
+void lp_migration_fini(void)
+{
+	if (!lp_migration_enabled())
+		return;
+
+	MPI_Comm_free(&migration_comm);
+	rsfree(committed_snapshot);
+	rsfree(lp_rates);
+}
+
+
+/**
+ * @brief Check whether LPs should be migrated
+ *
+ * This is called by a single worker thread of each kernel instance, after
+ * that all worker threads have adopted the GVT value reduced in the last
+ * round, and before a new round can be started. Every kernel takes part
+ * to the same checks, and the decision is the same on all of them.
+ *
+ * If a migration is decided, lp_migration_pending() returns @c true until
+ * the migration has been carried out.
+ *
+ * @param gvt The GVT value which has just been adopted
+ */
+void lp_migration_check(simtime_t gvt)
+{
+	struct kernel_load local, loads[n_ker];
+	double elapsed, committed, idle, events, mean;
+	unsigned int i, hot, cold;
+
+	if (!lp_migration_enabled())
+		return;
+
+	if (++gvt_rounds % rootsim_config.migration_period != 0)
+		return;
+
+	// A kernel which is about to shut down would not take part to the migration
+	if (!last_reduced_all_running())
+		return;
+	if (rootsim_config.simulation_time != 0 && (int)gvt >= rootsim_config.simulation_time)
+		return;
+
+	elapsed = timer_value_seconds(migration_timer);
+	timer_restart(migration_timer);
+	if (elapsed <= 0.0)
+		elapsed = 0.001;
+
+	local.rate = 0.0;
+	foreach_lp(lp) {
+		committed = statistics_get_lp_data(lp, STAT_GET_COMMITTED_LP);
+		lp_rates[lp->lid.to_int] = (committed - committed_snapshot[lp->gid.to_int]) / elapsed;
+		committed_snapshot[lp->gid.to_int] = committed;
+		local.rate += lp_rates[lp->lid.to_int];
+	}
+
+	idle = statistics_get_kernel_data(STAT_GET_IDLE_CYCLES);
+	events = statistics_get_kernel_data(STAT_GET_TOT_EVENTS);
+	local.idle = idle - last_idle_cycles;
+	if (local.idle + events - last_tot_events > 0.0)
+		local.idle /= local.idle + events - last_tot_events;
+	last_idle_cycles = idle;
+	last_tot_events = events;
+
+	lock_mpi();
+	MPI_Allgather(&local, 2, MPI_DOUBLE, loads, 2, MPI_DOUBLE, migration_comm);
+	unlock_mpi();
+
+	// From here on, all kernels compute the very same plan
+	mean = 0.0;
+	hot = cold = 0;
+	for (i = 0; i < n_ker; i++) {
+		mean += loads[i].rate;
+		if (loads[i].rate > loads[hot].rate)
+			hot = i;
+		if (loads[i].rate < loads[cold].rate)
+			cold = i;
+	}
+	mean /= n_ker;
+
+	if (hot == cold || mean <= 0.0)
+		return;
+	if (loads[hot].rate <= (1.0 + MIGRATION_IMBALANCE_THRESHOLD) * mean)
+		return;
+	// Moving work to a kernel which has no spare cycles would not help
+	if (loads[cold].idle < loads[hot].idle)
+		return;
+
+	src_kernel = hot;
+	dst_kernel = cold;
+	migration_budget = min(loads[hot].rate - mean, mean - loads[cold].rate);
+	migration_pending = true;
+}
+
+
+/**
+ * @brief Tell whether a migration has been decided and is not completed yet
+ *
+ * While this is the case, no new GVT reduction can be started and the
+ * simulation cannot be halted, as all kernels must take part to the
+ * migration.
+ *
+ * @return @c true if a migration is pending, @c false otherwise
+ */
+bool lp_migration_pending(void)
+{
+	return migration_pending;
+}
+
+
+/**
+ * @brief Let worker threads start a pending migration
+ *
+ * This is called by the master thread when a migration is pending and
+ * no other operation involving all worker threads is in progress.
+ */
+void lp_migration_start(void)
+{
+	if (migration_phase == local_migration_phase)
+		migration_phase++;
+}
+
+
+/**
+ * @brief Tell whether the calling worker thread should join a migration
+ *
+ * @return @c true if the worker thread must call migrate_LPs()
+ */
+bool lp_migration_started(void)
+{
+	return local_migration_phase != migration_phase;
+}
+
+
+/**
+ * @brief Let a worker thread skip the migrations it has missed
+ *
+ * This is called by a worker thread which has been parked, when it is
+ * woken up. Migrations carried out in the meanwhile did not involve it.
+ */
+void lp_migration_rejoin(void)
+{
+	local_migration_phase = migration_phase;
+}
+
+
+/**
+ * @brief Notify that all worker threads have completed the migration
+ */
+void lp_migration_complete(void)
+{
+	migration_pending = false;
+}
+
+
+/**
+ * Tell whether an LP can be migrated. Its buffers must sit in its own
+ * segment, and it must not be involved in synchronizations with other LPs.
+ */
+static bool can_migrate(struct lp_struct *lp)
+{
+	int i;
+	malloc_state *m_state = lp->mm->m_state;
+
+	// A pending rollback may refer to messages which were already annihilated
+	if (lp->state != LP_STATE_READY)
+		return false;
+
+	if (lp->wait_on_rendezvous != 0 || list_sizeof(lp->rendezvous_queue) > 0)
+		return false;
+
+	if (lp->outgoing_buffer.size > 0)
+		return false;
+
+	if (&topology_settings && !topology_can_migrate())
+		return false;
+
+	for (i = 0; i < m_state->num_areas; i++) {
+		if (m_state->areas[i].self_pointer != NULL && !is_segment_memory(lp, m_state->areas[i].self_pointer))
+			return false;
+	}
+
+	return true;
+}
+
+
+/// Sort candidates to migration by decreasing committed event rate
+static int compare_lp_rate(const void *a, const void *b)
+{
+	const struct lp_rate *A = a;
+	const struct lp_rate *B = b;
+
+	if (A->rate < B->rate)
+		return 1;
+	if (A->rate > B->rate)
+		return -1;
+	return (int)A->lp->gid.to_int - (int)B->lp->gid.to_int;
+}
+
+
+/**
+ * Select the LPs to migrate on the source kernel, picking the most loaded
+ * ones which fit in the budget. At least one LP per worker thread is kept.
+ *
+ * @param gids The array where the gids of the selected LPs are stored
+ * @return The number of selected LPs
+ */
+static unsigned int select_LPs(unsigned int gids[MAX_LPS_PER_MIGRATION])
+{
+	unsigned int i, n = 0, count = 0;
+	double moved = 0.0;
+	struct lp_rate *candidates = rsalloc(sizeof(struct lp_rate) * n_prc);
+
+	foreach_lp(lp) {
+		if (lp_rates[lp->lid.to_int] > 0.0 && can_migrate(lp)) {
+			candidates[n].rate = lp_rates[lp->lid.to_int];
+			candidates[n].lp = lp;
+			n++;
+		}
+	}
+
+	qsort(candidates, n, sizeof(struct lp_rate), compare_lp_rate);
+
+	for (i = 0; i < n && count < MAX_LPS_PER_MIGRATION && n_prc - count > n_cores; i++) {
+		if (moved + candidates[i].rate > migration_budget)
+			continue;
+		moved += candidates[i].rate;
+		gids[count++] = candidates[i].lp->gid.to_int;
+	}
+
+	rsfree(candidates);
+	return count;
+}
+
+
+/**
+ * Find the position of a message in the input queue of an LP. Lookups must
+ * be done in non-decreasing position order, as the search resumes from the
+ * last position found, which is kept in @p cursor and @p cursor_pos.
+ */
+static long msg_position(struct lp_struct *lp, msg_t *msg, msg_t **cursor, long *cursor_pos)
+{
+	if (msg == NULL)
+		return -1;
+
+	if (*cursor == NULL) {
+		*cursor = list_head(lp->queue_in);
+		*cursor_pos = 0;
+	}
+
+	while (*cursor != NULL && *cursor != msg) {
+		*cursor = list_next(*cursor);
+		(*cursor_pos)++;
+	}
+
+	if (unlikely(*cursor == NULL))
+		rootsim_error(true, "LP %u refers to a message which is not in its input queue\n", lp->gid.to_int);
+
+	return *cursor_pos;
+}
+
+
+/**
+ * Pack an LP and everything it owns into a contiguous buffer.
+ *
+ * @param lp The LP to pack
+ * @param size Where the size of the package is stored
+ * @return A pointer to the package, to be released with rsfree()
+ */
+static unsigned char *pack_LP(struct lp_struct *lp, size_t *size)
+{
+	struct lp_package hdr;
+	struct state_package s_hdr;
+	malloc_state *m_state = lp->mm->m_state;
+	msg_t *msg, *cursor = NULL;
+	msg_hdr_t *msg_hdr;
+	state_t *state;
+	unsigned char *region = NULL, *package, *ptr;
+	long cursor_pos = 0;
+	size_t buddy_size = 0;
+	int i;
+
+	hdr.gid = lp->gid;
+	hdr.state = lp->state;
+	hdr.ckpt_period = lp->ckpt_period;
+	hdr.from_last_ckpt = lp->from_last_ckpt;
+	hdr.state_log_forced = lp->state_log_forced;
+	hdr.lookahead = lp->lookahead;
+	hdr.ReverseEvent = lp->ReverseEvent;
+	hdr.current_base_pointer = lp->current_base_pointer;
+	hdr.mark = lp->mark;
+	memcpy(&hdr.numerical, &lp->numerical, sizeof(numerical_state_t));
+	hdr.exponential_event_time = statistics_get_lp_data(lp, STAT_GET_EVENT_TIME_LP);
+	hdr.bound = msg_position(lp, lp->bound, &cursor, &cursor_pos);
+	hdr.last_processed = msg_position(lp, lp->last_processed, &cursor, &cursor_pos);
+	hdr.queue_in_len = list_sizeof(lp->queue_in);
+	hdr.queue_out_len = list_sizeof(lp->queue_out);
+	hdr.queue_lazy_len = list_sizeof(lp->queue_lazy);
+	hdr.queue_states_len = list_sizeof(lp->queue_states);
+	hdr.topology = lp->topology;
+	hdr.region_size = 0;
+	if (lp->region != NULL) {
+		region = abm_do_full_checkpoint(lp);
+		hdr.region_size = abm_checkpoint_size(region);
+	}
+
+	// Compute the size of the package
+	*size = sizeof(hdr);
+	*size += sizeof(malloc_state) + m_state->num_areas * sizeof(malloc_area);
+	for (i = 0; i < m_state->num_areas; i++) {
+		if (m_state->areas[i].self_pointer != NULL)
+			*size += AREA_MEMORY_SIZE(&m_state->areas[i]);
+	}
+	if (lp->mm->buddy != NULL) {
+		buddy_size = (2 * lp->mm->buddy->size - 1) * sizeof(size_t);
+		*size += buddy_size;
+	}
+	if (lp->topology != NULL)
+		*size += topology_global.chkp_size;
+	*size += hdr.region_size;
+	for (msg = list_head(lp->queue_in); msg != NULL; msg = list_next(msg))
+		*size += sizeof(msg_t) + msg->size;
+	*size += (hdr.queue_out_len + hdr.queue_lazy_len) * sizeof(msg_hdr_t);
+	for (state = list_head(lp->queue_states); state != NULL; state = list_next(state)) {
+		*size += sizeof(s_hdr) + get_log_size(state->log);
+		if (&topology_settings && topology_settings.write_enabled)
+			*size += topology_global.chkp_size;
+		if (&abm_settings)
+			*size += abm_checkpoint_size(state->region_data);
+	}
+
+	if (unlikely(*size > INT_MAX))
+		rootsim_error(true, "LP %u is too large to be migrated\n", lp->gid.to_int);
+
+	package = ptr = rsalloc(*size);
+
+	// Control block and memory map
+	pack(ptr, &hdr, sizeof(hdr));
+	pack(ptr, m_state, sizeof(malloc_state));
+	pack(ptr, m_state->areas, m_state->num_areas * sizeof(malloc_area));
+	for (i = 0; i < m_state->num_areas; i++) {
+		if (m_state->areas[i].self_pointer != NULL)
+			pack(ptr, m_state->areas[i].self_pointer, AREA_MEMORY_SIZE(&m_state->areas[i]));
+	}
+	if (lp->mm->buddy != NULL)
+		pack(ptr, lp->mm->buddy->longest, buddy_size);
+
+	// Library states
+	if (lp->topology != NULL)
+		pack(ptr, lp->topology, topology_global.chkp_size);
+	if (region != NULL) {
+		pack(ptr, region, hdr.region_size);
+		ckpt_free(region);
+	}
+
+	// Queues
+	for (msg = list_head(lp->queue_in); msg != NULL; msg = list_next(msg))
+		pack(ptr, msg, sizeof(msg_t) + msg->size);
+	for (msg_hdr = list_head(lp->queue_out); msg_hdr != NULL; msg_hdr = list_next(msg_hdr))
+		pack(ptr, msg_hdr, sizeof(msg_hdr_t));
+	for (msg_hdr = list_head(lp->queue_lazy); msg_hdr != NULL; msg_hdr = list_next(msg_hdr))
+		pack(ptr, msg_hdr, sizeof(msg_hdr_t));
+
+	// Checkpoints refer to events in non-decreasing order
+	cursor = NULL;
+	for (state = list_head(lp->queue_states); state != NULL; state = list_next(state)) {
+		s_hdr.lvt = state->lvt;
+		s_hdr.last_event = msg_position(lp, state->last_event, &cursor, &cursor_pos);
+		s_hdr.state = state->state;
+		s_hdr.base_pointer = state->base_pointer;
+		memcpy(&s_hdr.numerical, &state->numerical, sizeof(numerical_state_t));
+		s_hdr.log_size = get_log_size(state->log);
+		s_hdr.region_size = &abm_settings ? abm_checkpoint_size(state->region_data) : 0;
+
+		pack(ptr, &s_hdr, sizeof(s_hdr));
+		pack(ptr, state->log, s_hdr.log_size);
+		if (&topology_settings && topology_settings.write_enabled)
+			pack(ptr, state->topology, topology_global.chkp_size);
+		if (&abm_settings)
+			pack(ptr, state->region_data, s_hdr.region_size);
+	}
+
+	assert(ptr == package + *size);
+	return package;
+}
+
+
+/**
+ * Rebuild an LP out of its package, and host it locally.
+ *
+ * @param package The package produced by pack_LP() on the source kernel
+ */
+static void unpack_LP(unsigned char *package)
+{
+	struct lp_package hdr;
+	struct state_package s_hdr;
+	struct lp_struct *lp;
+	malloc_state *m_state;
+	malloc_area *areas;
+	struct _malloc_index *index;
+	msg_t msg_meta, *msg, **msgs;
+	msg_hdr_t *msg_hdr;
+	state_t *state;
+	unsigned char *ptr = package, *region, *region_base = NULL;
+	ptrdiff_t topology_delta = 0;
+	size_t i;
+	int j;
+
+	unpack(&hdr, ptr, sizeof(hdr));
+
+	// The LP segment is mapped at the same address as on the source kernel
+	lp = initialize_lp(hdr.gid, n_prc);
+	lp->state = hdr.state;
+	lp->ckpt_period = hdr.ckpt_period;
+	lp->from_last_ckpt = hdr.from_last_ckpt;
+	lp->state_log_forced = hdr.state_log_forced;
+	lp->lookahead = hdr.lookahead;
+	lp->ReverseEvent = hdr.ReverseEvent;
+	lp->current_base_pointer = hdr.current_base_pointer;
+	lp->mark = hdr.mark;
+	memcpy(&lp->numerical, &hdr.numerical, sizeof(numerical_state_t));
+
+	// The LP will restart from the beginning of its main loop, which
+	// is where a rollback brings it as well
+	memcpy(&lp->default_context, &lp->context, sizeof(LP_context_t));
+
+	// Memory map. Chunks point to the memory of their malloc_area, which is
+	// at the same address, while malloc_areas are kept in a new array.
+	m_state = lp->mm->m_state;
+	areas = m_state->areas;
+	index = m_state->index;
+	unpack(m_state, ptr, sizeof(malloc_state));
+	areas = rsrealloc(areas, m_state->max_num_areas * sizeof(malloc_area));
+	m_state->areas = areas;
+	m_state->index = index;
+	unpack(areas, ptr, m_state->num_areas * sizeof(malloc_area));
+	for (j = 0; j < m_state->num_areas; j++) {
+		if (areas[j].self_pointer == NULL)
+			continue;
+		unpack(areas[j].self_pointer, ptr, AREA_MEMORY_SIZE(&areas[j]));
+		*(unsigned long long *)(areas[j].self_pointer) = (unsigned long long)&areas[j];
+	}
+	malloc_state_reindex(m_state);
+	if (lp->mm->buddy != NULL)
+		unpack(lp->mm->buddy->longest, ptr, (2 * lp->mm->buddy->size - 1) * sizeof(size_t));
+
+	// Library states
+	if (hdr.topology != NULL) {
+		lp->topology = rsalloc(topology_global.chkp_size);
+		unpack(lp->topology, ptr, topology_global.chkp_size);
+		topology_delta = (unsigned char *)lp->topology - (unsigned char *)hdr.topology;
+		topology_relocate(lp->topology, topology_delta);
+	}
+	if (hdr.region_size > 0) {
+		region = rsalloc(hdr.region_size);
+		unpack(region, ptr, hdr.region_size);
+		lp->region = abm_region_from_checkpoint(region);
+		rsfree(region);
+	}
+
+	// Input queue
+	msgs = rsalloc(sizeof(msg_t *) * (hdr.queue_in_len + 1));
+	for (i = 0; i < hdr.queue_in_len; i++) {
+		memcpy(&msg_meta, ptr, sizeof(msg_t));
+		if (sizeof(msg_t) + msg_meta.size <= SLAB_MSG_SIZE)
+			msg = get_msg_from_slab(lp);
+		else
+			msg = rsalloc(sizeof(msg_t) + msg_meta.size);
+		unpack(msg, ptr, sizeof(msg_t) + msg_meta.size);
+		list_insert_tail(lp->queue_in, msg);
+		msgs[i] = msg;
+	}
+	lp->bound = hdr.bound >= 0 ? msgs[hdr.bound] : NULL;
+	lp->last_processed = hdr.last_processed >= 0 ? msgs[hdr.last_processed] : NULL;
+
+	// Output queue
+	for (i = 0; i < hdr.queue_out_len; i++) {
+		msg_hdr = get_msg_hdr_from_slab(lp);
+		unpack(msg_hdr, ptr, sizeof(msg_hdr_t));
+		list_insert_tail(lp->queue_out, msg_hdr);
+	}
+	for (i = 0; i < hdr.queue_lazy_len; i++) {
+		msg_hdr = get_msg_hdr_from_slab(lp);
+		unpack(msg_hdr, ptr, sizeof(msg_hdr_t));
+		list_insert_tail(lp->queue_lazy, msg_hdr);
+	}
+
+	// Checkpoints
+	for (i = 0; i < hdr.queue_states_len; i++) {
+		unpack(&s_hdr, ptr, sizeof(s_hdr));
+
+		state = ckpt_alloc(lp, sizeof(*state));
+		state->lvt = s_hdr.lvt;
+		state->last_event = s_hdr.last_event >= 0 ? msgs[s_hdr.last_event] : NULL;
+		state->state = s_hdr.state;
+		state->base_pointer = s_hdr.base_pointer;
+		memcpy(&state->numerical, &s_hdr.numerical, sizeof(numerical_state_t));
+
+		state->log = ckpt_alloc(lp, s_hdr.log_size);
+		unpack(state->log, ptr, s_hdr.log_size);
+
+		if (&topology_settings && topology_settings.write_enabled) {
+			state->topology = ckpt_alloc(lp, topology_global.chkp_size);
+			unpack(state->topology, ptr, topology_global.chkp_size);
+			// Copies refer to the caches of the live topology struct
+			topology_relocate(state->topology, topology_delta);
+		}
+
+		if (&abm_settings) {
+			state->region_data = ckpt_alloc(lp, s_hdr.region_size);
+			unpack(state->region_data, ptr, s_hdr.region_size);
+			abm_checkpoint_relocate(state->region_data, &region_base);
+		}
+
+		list_insert_tail(lp->queue_states, state);
+	}
+
+	rsfree(msgs);
+
+	statistics_lp_arrival(lp, hdr.exponential_event_time);
+	committed_snapshot[lp->gid.to_int] = 0.0;
+
+	lps_blocks[n_prc++] = lp;
+}
+
+
+/**
+ * Release a migrated LP on the source kernel, keeping the local ids of
+ * the remaining LPs contiguous.
+ */
+static void remove_LP(struct lp_struct *lp)
+{
+	unsigned int lid = lp->lid.to_int;
+	unsigned int last = n_prc - 1;
+
+	statistics_lp_departure(lp);
+	finalize_lp(lp);
+
+	// The last LP takes the place of the departed one
+	if (lid != last) {
+		lps_blocks[lid] = lps_blocks[last];
+		lps_blocks[lid]->lid.to_int = lid;
+		lp_rates[lid] = lp_rates[last];
+	}
+	statistics_lp_relocate(last, lid);
+	ccgs_lp_relocate(last, lid);
+	lps_blocks[last] = NULL;
+	n_prc--;
+}
+
+
+/**
+ * Agree on the LPs to migrate, and move them. This is done by the master
+ * thread of each kernel.
+ */
+static void exchange_LPs(void)
+{
+	unsigned int i, count;
+	unsigned int gids[MAX_LPS_PER_MIGRATION + 1];
+	unsigned char *package;
+	size_t size;
+	int recv_size;
+	MPI_Status status;
+	GID_t gid;
+
+	gids[0] = 0;
+	if (kid == src_kernel)
+		gids[0] = select_LPs(&gids[1]);
+
+	lock_mpi();
+	MPI_Bcast(gids, MAX_LPS_PER_MIGRATION + 1, MPI_UNSIGNED, src_kernel, migration_comm);
+	unlock_mpi();
+	count = gids[0];
+
+	// All kernels must route new events towards the new hosts
+	for (i = 1; i <= count; i++)
+		kernel[gids[i]] = dst_kernel;
+
+	if (kid == src_kernel) {
+		for (i = 1; i <= count; i++) {
+			set_gid(gid, gids[i]);
+			struct lp_struct *lp = find_lp_by_gid(gid);
+
+			package = pack_LP(lp, &size);
+			lock_mpi();
+			MPI_Send(package, (int)size, MPI_BYTE, dst_kernel, gids[i], migration_comm);
+			unlock_mpi();
+			rsfree(package);
+
+			remove_LP(lp);
+		}
+	} else if (kid == dst_kernel) {
+		for (i = 1; i <= count; i++) {
+			lock_mpi();
+			MPI_Probe(src_kernel, (int)gids[i], migration_comm, &status);
+			MPI_Get_count(&status, MPI_BYTE, &recv_size);
+			package = rsalloc(recv_size);
+			MPI_Recv(package, recv_size, MPI_BYTE, src_kernel, (int)gids[i], migration_comm, MPI_STATUS_IGNORE);
+			unlock_mpi();
+
+			unpack_LP(package);
+			rsfree(package);
+		}
+	}
+
+	if (master_kernel() && count > 0 && (rootsim_config.verbose == VERBOSE_INFO || rootsim_config.verbose == VERBOSE_DEBUG))
+		printf("Migrated %u LPs from kernel %u to kernel %u\n", count, src_kernel, dst_kernel);
+}
+
+
+/**
+ * @brief Carry out a pending migration
+ *
+ * This is called by all worker threads, once lp_migration_started() tells
+ * so. When it returns, the set of locally-hosted LPs might be different,
+ * so the binding of LPs to worker threads must be recomputed.
+ */
+void migrate_LPs(void)
+{
+	local_migration_phase = migration_phase;
+
+	// Wait for all worker threads to stop processing events
+	thread_barrier(&all_thread_barrier);
+
+	if (master_thread())
+		drain_remote_msgs();
+	thread_barrier(&all_thread_barrier);
+
+	// Events extracted while draining must reach the input queues
+	process_bottom_halves();
+	thread_barrier(&all_thread_barrier);
+
+	if (master_thread())
+		exchange_LPs();
+	thread_barrier(&all_thread_barrier);
+}
+
+#endif /* HAVE_MPI */
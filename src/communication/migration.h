@@ -0,0 +1,60 @@
+/**
+* @file communication/migration.h
+*
+* @brief LP migration across kernel instances
+*
+* This module moves LPs from overloaded simulation kernel instances to
+* underloaded ones in distributed simulations. Checks and migrations are
+* carried out in between two GVT reductions.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#ifdef HAVE_MPI
+
+#include <stdbool.h>
+
+#include <core/core.h>
+#include <core/init.h>
+
+/**
+ * A migration is started only if the committed event rate of the most
+ * loaded kernel exceeds the average one by more than this fraction.
+ */
+#define MIGRATION_IMBALANCE_THRESHOLD	0.2
+
+/// Maximum number of LPs which are moved in a single migration
+#define MAX_LPS_PER_MIGRATION		64
+
+/// Tells whether LPs can be migrated in the current run
+#define lp_migration_enabled() (rootsim_config.migration_period > 0 && n_ker > 1)
+
+extern void lp_migration_init(void);
+extern void lp_migration_fini(void);
+extern void lp_migration_check(simtime_t gvt);
+extern bool lp_migration_pending(void);
+extern void lp_migration_start(void);
+extern bool lp_migration_started(void);
+extern void lp_migration_rejoin(void);
+extern void lp_migration_complete(void);
+extern void migrate_LPs(void);
+
+#endif /* HAVE_MPI */
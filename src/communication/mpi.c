@@ -38,6 +38,7 @@
 #include <communication/mpi.h>
 #include <communication/wnd.h>
 #include <communication/gvt.h>
+#include <communication/migration.h>
 #include <communication/communication.h>
 #include <queues/queues.h>
 #include <core/core.h>
@@ -99,6 +100,21 @@ static MPI_Datatype stats_mpi_t;
  */
 static MPI_Comm msg_comm;
 
+/**
+ * Number of event messages sent towards each simulation kernel instance
+ * since the last call to drain_remote_msgs().
+ */
+static atomic_t *msgs_sent_to;
+
+/**
+ * Number of event messages received from each simulation kernel instance
+ * since the last call to drain_remote_msgs().
+ */
+static atomic_t *msgs_recvd_from;
+
+/// MPI Communicator used to synchronize kernels when draining event messages
+static MPI_Comm drain_comm;
+
 
 /**
  * @brief Check if there are pending messages
@@ -174,6 +190,7 @@ void send_remote_msg(msg_t *msg)
 	unsigned int dest = find_kernel_by_gid(msg->receiver);
 
 	register_outgoing_msg(out_msg->msg);
+	atomic_inc(&msgs_sent_to[dest]);
 
 	lock_mpi();
 	MPI_Isend(((char *)out_msg->msg) + MSG_PADDING, MSG_META_SIZE + msg->size, MPI_BYTE, dest, msg->receiver.to_int, msg_comm, &out_msg->req);
@@ -247,6 +264,7 @@ void receive_remote_msgs(void)
 
 		validate_msg(msg);
 		insert_bottom_half(msg);
+		atomic_inc(&msgs_recvd_from[status.MPI_SOURCE]);
 	}
     out:
 	spin_unlock(&msgs_lock);
@@ -254,6 +272,61 @@ void receive_remote_msgs(void)
 
 
 
+/**
+ * @brief Deliver all the event messages which are in flight across kernels
+ *
+ * Once this function returns, every event message which was sent by any
+ * simulation kernel instance before entering this function has been
+ * extracted from MPI by its destination kernel, and all local outgoing
+ * queues are empty. This is needed whenever the mapping between LPs and
+ * kernels is about to change, since the destination of a message is
+ * resolved using that mapping on both sides.
+ *
+ * Each kernel tells every other one how many messages it has sent to it,
+ * then it keeps on receiving messages until it has extracted that many
+ * from each of the other kernels.
+ *
+ * @warning This is a collective operation: all kernels must call it, and
+ *          only the master thread of each kernel can do it, while the
+ *          other worker threads are not processing events.
+ */
+void drain_remote_msgs(void)
+{
+	unsigned int i;
+	unsigned int sent[n_ker], expected[n_ker];
+	bool done;
+
+	for (i = 0; i < n_ker; i++) {
+		sent[i] = atomic_read(&msgs_sent_to[i]);
+	}
+
+	lock_mpi();
+	MPI_Alltoall(sent, 1, MPI_UNSIGNED, expected, 1, MPI_UNSIGNED, drain_comm);
+	unlock_mpi();
+
+	do {
+		receive_remote_msgs();
+		prune_outgoing_queues();
+
+		done = (outgoing_queues_size() == 0);
+		for (i = 0; i < n_ker; i++) {
+			if ((unsigned int)atomic_read(&msgs_recvd_from[i]) != expected[i])
+				done = false;
+		}
+	} while (!done);
+
+	for (i = 0; i < n_ker; i++) {
+		atomic_set(&msgs_sent_to[i], 0);
+		atomic_set(&msgs_recvd_from[i], 0);
+	}
+
+	// No kernel can send new messages until everyone has done
+	lock_mpi();
+	MPI_Barrier(drain_comm);
+	unlock_mpi();
+}
+
+
 /**
  * @brief Check if all kernels have reached the termination condition
  *
@@ -309,6 +382,17 @@ void collect_termination(void)
 }
 
 
+/**
+ * @brief Check whether this kernel has notified its local termination
+ *
+ * @return @c true if broadcast_termination() has been called locally
+ */
+bool local_termination_notified(void)
+{
+	return terminated > 0;
+}
+
+
 /**
  * @brief Notify all the kernels about local termination
  *
@@ -356,6 +440,7 @@ static void reduce_stat_vector(struct stat_t *in, struct stat_t *inout, int *len
 		inout[i].gvt_round_time_min = fmin(inout[i].gvt_round_time_min, in[i].gvt_round_time_min);
 		inout[i].gvt_round_time_max = fmax(inout[i].gvt_round_time_max, in[i].gvt_round_time_max);
 		inout[i].max_resident_set += in[i].max_resident_set;
+		inout[i].arena_peak += in[i].arena_peak;
 	}
 }
 
@@ -381,7 +466,7 @@ static void reduce_stat_vector(struct stat_t *in, struct stat_t *inout, int *len
 static void stats_reduction_init(void)
 {
 	// This is a compilation time fail-safe
-	static_assert(offsetof(struct stat_t, gvt_round_time_max) == (sizeof(double) * 19), "The packing assumptions on struct stat_t are wrong or its definition has been modified");
+	static_assert(offsetof(struct stat_t, gvt_round_time_max) == (sizeof(double) * 35), "The packing assumptions on struct stat_t are wrong or its definition has been modified");
 
 	unsigned i;
 
@@ -501,6 +586,31 @@ void syncronize_all(void)
 }
 
 
+/**
+ * @brief Reduce the minimum lookahead declared by the LPs of all kernels
+ *
+ * This is called once, by the master thread of each kernel, after that all
+ * LPs have processed their INIT event.
+ *
+ * @param local_min The minimum lookahead of the LPs hosted by this kernel
+ *
+ * @return The minimum lookahead of all LPs in the simulation
+ */
+simtime_t reduce_min_lookahead(simtime_t local_min)
+{
+	simtime_t global_min;
+	MPI_Comm comm;
+
+	lock_mpi();
+	MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+	MPI_Allreduce(&local_min, &global_min, 1, MPI_DOUBLE, MPI_MIN, comm);
+	MPI_Comm_free(&comm);
+	unlock_mpi();
+
+	return global_min;
+}
+
+
 /**
  * @brief Initialize MPI subsystem
  *
@@ -544,12 +654,23 @@ void mpi_init(int *argc, char ***argv)
  */
 void inter_kernel_comm_init(void)
 {
+	unsigned int i;
+
 	spinlock_init(&msgs_lock);
 
+	msgs_sent_to = rsalloc(n_ker * sizeof(atomic_t));
+	msgs_recvd_from = rsalloc(n_ker * sizeof(atomic_t));
+	for (i = 0; i < n_ker; i++) {
+		atomic_set(&msgs_sent_to[i], 0);
+		atomic_set(&msgs_recvd_from[i], 0);
+	}
+	MPI_Comm_dup(MPI_COMM_WORLD, &drain_comm);
+
 	outgoing_window_init();
 	gvt_comm_init();
 	dist_termination_init();
 	stats_reduction_init();
+	lp_migration_init();
 }
 
 
@@ -564,6 +685,11 @@ void inter_kernel_comm_finalize(void)
 	dist_termination_finalize();
 	//outgoing_window_finalize();
 	gvt_comm_finalize();
+	lp_migration_fini();
+
+	MPI_Comm_free(&drain_comm);
+	rsfree(msgs_sent_to);
+	rsfree(msgs_recvd_from);
 }
 
 
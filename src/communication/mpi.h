@@ -51,11 +51,14 @@ void inter_kernel_comm_init(void);
 void inter_kernel_comm_finalize(void);
 void mpi_finalize(void);
 void syncronize_all(void);
+simtime_t reduce_min_lookahead(simtime_t local_min);
 void send_remote_msg(msg_t * msg);
 bool pending_msgs(int tag);
 void receive_remote_msgs(void);
+void drain_remote_msgs(void);
 bool is_request_completed(MPI_Request *);
 bool all_kernels_terminated(void);
+bool local_termination_notified(void);
 void broadcast_termination(void);
 void collect_termination(void);
 void mpi_reduce_statistics(struct stat_t *, struct stat_t *);
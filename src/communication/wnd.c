@@ -65,7 +65,7 @@ static int n_queues = 0;
  *
  * @return The total number of elements in all the local outgoing queues
  */
-static size_t outgoing_queues_size(void)
+size_t outgoing_queues_size(void)
 {
 	int i;
 	size_t size = 0;
@@ -56,6 +56,7 @@ extern void outgoing_window_init(void);
 extern void outgoing_window_finalize(void);
 extern void store_outgoing_msg(outgoing_msg * out_msg, unsigned int dest_kid);
 extern int prune_outgoing_queues(void);
+extern size_t outgoing_queues_size(void);
 extern outgoing_msg *allocate_outgoing_msg(void);
 
 #endif	/* HAVE_MPI */
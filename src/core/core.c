@@ -60,12 +60,26 @@ unsigned int n_ker;
 /// Total number of cores required for simulation
 unsigned int n_cores;
 
+/**
+ * Number of worker threads which are currently processing events. It is
+ * lower than n_cores if some worker threads have been parked because of
+ * a low simulation efficiency. Active worker threads have the lowest ids.
+ */
+unsigned int n_active_cores;
+
 /// Total number of logical processes running in the simulation
 unsigned int n_prc_tot;
 
 /// Number of logical processes hosted by the current kernel instance
 unsigned int n_prc;
 
+/**
+ * Maximum number of logical processes which the current kernel instance
+ * might host. Per-LP arrays indexed by local ids are sized with this value.
+ * It differs from n_prc only if LPs can be migrated across kernels.
+ */
+unsigned int n_prc_max;
+
 /// This global variable holds the configuration for the current simulation
 simulation_configuration rootsim_config;
 
@@ -131,6 +145,7 @@ void base_init(void)
 	struct sigaction new_act = { 0 };
 
 	barrier_init(&all_thread_barrier, n_cores);
+	n_active_cores = n_cores;
 
 	// complete the sigaction struct init
 	new_act.sa_handler = handle_signal;
@@ -308,6 +323,13 @@ void distribute_lps_on_kernels(void)
 		}
 		break;
 	}
+
+	// If LPs can be migrated, any kernel might end up hosting all of them
+	n_prc_max = n_prc;
+#ifdef HAVE_MPI
+	if (rootsim_config.migration_period > 0 && n_ker > 1)
+		n_prc_max = n_prc_tot;
+#endif
 }
 
 /**
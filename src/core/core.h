@@ -41,6 +41,7 @@
 #include <setjmp.h>
 
 #include <arch/thread.h>
+#include <lib/numerical.h>
 
 
 /// This macro expands to true if the local kernel is the master kernel
@@ -50,6 +51,7 @@
 enum {
 	SNAPSHOT_INVALID = 0,	/**< By convention 0 is the invalid field */
 	SNAPSHOT_FULL,		/**< xxx documentation */
+	SNAPSHOT_INCREMENTAL,	/**< Only the pages modified since the previous log are saved, tracked via soft-dirty bits */
 };
 
 /// Maximum number of kernels the distributed simulator can handle
@@ -169,6 +171,10 @@ typedef struct _msg_t {
 	struct _msg_t *next;
 	struct _msg_t *prev;
 
+	// Reverse computation: whether the event has been processed, and the library state right before that
+	bool processed;
+	numerical_state_t numerical;
+
 	/* Place here all members which must be transmitted over the network. It is convenient not to reorder the members
 	 * of the structure. If new members have to be addedd, place them right before the "Model data" part.*/
 
@@ -205,6 +211,7 @@ typedef struct _msg_hdr_t {
 	simtime_t timestamp;
 	simtime_t send_time;
 	unsigned long long mark;
+	unsigned long long hash;	///< Hash of the size and payload of the message, kept only for lazy cancellation
 } msg_hdr_t;
 
 
@@ -215,7 +222,9 @@ extern barrier_t all_thread_barrier;
 extern unsigned int kid,	/* Kernel ID for the local kernel */
  n_ker,				/* Total number of kernel instances */
  n_cores,			/* Total number of cores required for simulation */
+ n_active_cores,		/* Number of worker threads which are not parked */
  n_prc,				/* Number of LPs hosted by the current kernel instance */
+ n_prc_max,			/* Maximum number of LPs the current kernel instance can host */
 *kernel;
 
 extern void ProcessEvent_light(unsigned int me, simtime_t now, int event_type, void *event_content, unsigned int size, void *state);
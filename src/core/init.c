@@ -74,6 +74,8 @@ enum _opt_codes{
 	OPT_STATS = 		OPT_FIRST + PARAM_STATS,
 	OPT_STATE_SAVING = 	OPT_FIRST + PARAM_STATE_SAVING,
 	OPT_SNAPSHOT = 		OPT_FIRST + PARAM_SNAPSHOT,
+	OPT_CANCELLATION =	OPT_FIRST + PARAM_CANCELLATION,
+	OPT_CKPT_COMPRESSION =	OPT_FIRST + PARAM_CKPT_COMPRESSION,
 
 	OPT_NP,
 	OPT_NPRC,
@@ -90,6 +92,10 @@ enum _opt_codes{
 	OPT_SEED,
 	OPT_SERIAL,
 	OPT_NO_CORE_BINDING,
+	OPT_ELASTIC,
+#ifdef HAVE_MPI
+	OPT_MIGRATION_PERIOD,
+#endif
 
 #ifdef HAVE_PREEMPTION
 	OPT_PREEMPTION,
@@ -135,6 +141,18 @@ const char * const param_to_text[][5] = {
 	[OPT_SNAPSHOT - OPT_FIRST] = {
 			[SNAPSHOT_INVALID] = "invalid snapshot specification",
 			[SNAPSHOT_FULL] = "full",
+			[SNAPSHOT_INCREMENTAL] = "incremental",
+	},
+	[OPT_CANCELLATION - OPT_FIRST] = {
+			[CANCELLATION_INVALID] = "invalid cancellation specification",
+			[CANCELLATION_AGGRESSIVE] = "aggressive",
+			[CANCELLATION_LAZY] = "lazy"
+	},
+	[OPT_CKPT_COMPRESSION - OPT_FIRST] = {
+			[CKPT_COMPRESSION_INVALID] = "invalid checkpoint compression specification",
+			[CKPT_COMPRESSION_NONE] = "none",
+			[CKPT_COMPRESSION_ALWAYS] = "always",
+			[CKPT_COMPRESSION_ADAPTIVE] = "adaptive"
 	}
 };
 
@@ -159,7 +177,7 @@ static const struct argp_option argp_options[] = {
 	{"npwd",		OPT_NPWD,		0,		0,		"Non Piece-Wise-Deterministic simulation model. See manpage for accurate description", 0},
 	{"p",			OPT_P,			"VALUE",	0,		"Checkpointing interval", 0},
 	{"full",		OPT_FULL,		0,		0,		"Take only full logs", 0},
-	{"inc",			OPT_INC,		0,		0,		"Take only incremental logs (still to be released)", 0},
+	{"inc",			OPT_INC,		0,		0,		"Take incremental logs, saving the pages modified since the previous log (requires soft-dirty bits and a single worker thread per kernel)", 0},
 	{"A",			OPT_A,			0,		0,		"Autonomic subsystem: set checkpointing interval and log mode automatically at runtime (still to be released)", 0},
 	{"gvt",			OPT_GVT,		"VALUE",	0,		"Time between two GVT reductions (in milliseconds)", 0},
 	{"cktrm-mode",		OPT_CKTRM_MODE,		"TYPE",		0,		"Termination Detection mode. Supported values: normal, incremental, accurate", 0},
@@ -170,10 +188,16 @@ static const struct argp_option argp_options[] = {
 	{"verbose",		OPT_VERBOSE,		"TYPE",		0,		"Verbose execution", 0},
 	{"stats",		OPT_STATS,		"TYPE",		0,		"Level of detail in the output statistics", 0},
 	{"seed",		OPT_SEED,		"VALUE",	0,		"Manually specify the initial random seed", 0},
-	{"serial",		OPT_SERIAL,		0,		0,		"Run a serial simulation (using Calendar Queues)", 0},
+	{"serial",		OPT_SERIAL,		0,		0,		"Run a serial simulation (using a Ladder Queue)", 0},
 	{"sequential",		OPT_SERIAL,		0,		OPTION_ALIAS,	NULL, 0},
 	{"no-core-binding",	OPT_NO_CORE_BINDING,	0,		0,		"Disable the binding of threads to specific physical processing cores", 0},
+	{"cancellation",	OPT_CANCELLATION,	"TYPE",		0,		"How messages sent by rolled back events are cancelled. Supported values: aggressive, lazy", 0},
+	{"ckpt-compression",	OPT_CKPT_COMPRESSION,	"TYPE",		0,		"Compression of the logs of the model state. Supported values: none, always, adaptive", 0},
+	{"elastic",		OPT_ELASTIC,		"VALUE",	0,		"Park worker threads while the percentage of committed events is below VALUE, wake them up when it rises. 0 (default) disables it", 0},
 
+#ifdef HAVE_MPI
+	{"migration-period",	OPT_MIGRATION_PERIOD,	"VALUE",	0,		"Check every VALUE GVT reductions whether LPs should be migrated across kernels. 0 (default) disables migration", 0},
+#endif
 #ifdef HAVE_PREEMPTION
 	{"no-preemption",	OPT_PREEMPTION,		0,		0,		"Disable Preemptive Time Warp", 0},
 #endif
@@ -244,11 +268,12 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			break;
 
 		handle_string_option(OPT_SCHEDULER, rootsim_config.scheduler);
-		handle_string_option(OPT_FULL, rootsim_config.snapshot);
 		handle_string_option(OPT_CKTRM_MODE, rootsim_config.check_termination_mode);
 		handle_string_option(OPT_VERBOSE, rootsim_config.verbose);
 		handle_string_option(OPT_STATS, rootsim_config.stats);
 		handle_string_option(OPT_LPS_DISTRIBUTION, rootsim_config.lps_distribution);
+		handle_string_option(OPT_CANCELLATION, rootsim_config.cancellation);
+		handle_string_option(OPT_CKPT_COMPRESSION, rootsim_config.ckpt_compression);
 
 		case OPT_NPWD:
 			if (bitmap_check(scanned, OPT_P-OPT_FIRST)) {
@@ -270,8 +295,20 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			}
 			break;
 
+		case OPT_FULL:
+			if (bitmap_check(scanned, OPT_INC-OPT_FIRST)) {
+				conflicting_option_failure("I'm requested to take only full logs, but incremental logs are enabled already.");
+			} else {
+				rootsim_config.snapshot = SNAPSHOT_FULL;
+			}
+			break;
+
 		case OPT_INC:
-			argp_failure(state, EXIT_FAILURE, ENOSYS, "incremental state saving is not supported in stable version yet...\nAborting");
+			if (bitmap_check(scanned, OPT_FULL-OPT_FIRST)) {
+				conflicting_option_failure("I'm requested to take incremental logs, but only full logs are enabled already.");
+			} else {
+				rootsim_config.snapshot = SNAPSHOT_INCREMENTAL;
+			}
 			break;
 
 		case OPT_A:
@@ -306,6 +343,16 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			rootsim_config.core_binding = false;
 			break;
 
+		case OPT_ELASTIC:
+			rootsim_config.elastic_threshold = parse_ullong_limits(0, 99);
+			break;
+
+#ifdef HAVE_MPI
+		case OPT_MIGRATION_PERIOD:
+			rootsim_config.migration_period = parse_ullong_limits(0, INT_MAX);
+			break;
+#endif
+
 #ifdef HAVE_PREEMPTION
 		case OPT_PREEMPTION:
 			rootsim_config.disable_preemption = true;
@@ -333,6 +380,13 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			rootsim_config.set_seed = 0;
 			rootsim_config.serial = false;
 			rootsim_config.core_binding = true;
+			rootsim_config.elastic_threshold = 0;
+			rootsim_config.cancellation = CANCELLATION_AGGRESSIVE;
+			rootsim_config.ckpt_compression = CKPT_COMPRESSION_NONE;
+
+#ifdef HAVE_MPI
+			rootsim_config.migration_period = 0;
+#endif
 
 #ifdef HAVE_PREEMPTION
 			rootsim_config.disable_preemption = false;
@@ -439,6 +493,7 @@ void SystemInit(int argc, char **argv)
 	// and the order of invocation can matter!
 	base_init();
 	segment_init();
+	soft_dirty_init();
 	initialize_lps();
 	remote_memory_init();
 	statistics_init();
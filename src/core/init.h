@@ -43,6 +43,8 @@ enum param_codes {
 	PARAM_STATS,
 	PARAM_STATE_SAVING,
 	PARAM_SNAPSHOT,
+	PARAM_CANCELLATION,
+	PARAM_CKPT_COMPRESSION,
 };
 
 /*!
@@ -72,6 +74,13 @@ typedef struct _simulation_configuration {
 	bool serial;			///< If the simulation must be run serially
 	seed_type set_seed;		///< The master seed to be used in this run
 	bool core_binding;		///< Bind threads to specific core (reduce context switches and cache misses)
+	unsigned int elastic_threshold;	///< Percentage of committed events below which worker threads are parked (0 disables parking)
+	int cancellation;		///< How messages sent by rolled back events are cancelled (aggressive or lazy)
+	int ckpt_compression;		///< Whether logs of the model state are compressed (never, always, or when it pays off)
+
+#ifdef HAVE_MPI
+	unsigned int migration_period;	///< Number of GVT rounds between two LP migration checks (0 disables migration)
+#endif
 
 #ifdef HAVE_PREEMPTION
 	bool disable_preemption;	///< If compiled for preemptive Time Warp, it can be disabled at runtime
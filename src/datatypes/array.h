@@ -164,13 +164,28 @@
 		mem_area = ((unsigned char *)(mem_area)) + array_count(self) * sizeof(*array_items(self)); \
 	})
 
-#define array_load(self, mem_area) ({ \
+#define array_load(self, mem_area) array_load_spare(self, mem_area, 0)
+
+// like array_load(), but room for at least spare more items is left after the loaded ones
+#define array_load_spare(self, mem_area, spare) ({ \
 		memcpy(&array_count(self), (mem_area), sizeof(array_count(self))); \
 		(mem_area) = ((unsigned char *)(mem_area)) + sizeof(array_count(self)); \
-		array_capacity(self) = max(array_count(self), INIT_SIZE_ARRAY); \
+		array_capacity(self) = max(array_count(self) + (spare), INIT_SIZE_ARRAY); \
 		array_items(self) = rsalloc(array_capacity(self) * sizeof(*array_items(self))); \
 		memcpy(array_items(self), (mem_area), array_count(self) * sizeof(*array_items(self))); \
 		(mem_area) = ((unsigned char *)(mem_area)) + (array_count(self) * sizeof(*array_items(self))); \
 	})
 
+// like array_load(), but the already allocated items are reused when possible
+#define array_reload(self, mem_area) ({ \
+		memcpy(&array_count(self), (mem_area), sizeof(array_count(self))); \
+		(mem_area) = ((unsigned char *)(mem_area)) + sizeof(array_count(self)); \
+		if(array_count(self) > array_capacity(self)) { \
+			array_capacity(self) = array_count(self); \
+			array_items(self) = rsrealloc(array_items(self), array_capacity(self) * sizeof(*array_items(self))); \
+		} \
+		memcpy(array_items(self), (mem_area), array_count(self) * sizeof(*array_items(self))); \
+		(mem_area) = ((unsigned char *)(mem_area)) + (array_count(self) * sizeof(*array_items(self))); \
+	})
+
 #endif /* ARRAY_H_ */
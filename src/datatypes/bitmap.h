@@ -202,3 +202,45 @@ typedef unsigned char rootsim_bitmap;
 			}							\
 		}								\
 	})
+
+/*!
+ * @brief This executes a user supplied function for each run of contiguous set bits in @a bitmap.
+ * @param bitmap a pointer to the bitmap.
+ * @param bitmap_size the size of the bitmap in bytes (obtainable through bitmap_required_size())
+ * @param func a function which takes two unsigned arguments, the index of the first bit of the run and its length.
+ *
+ * Runs which span several blocks are reported as a single one, so that callers can
+ * coalesce the operations which they would otherwise carry out on each set bit.
+ *
+ *	This macro expects the number of bits in the bitmap to be a multiple of B_BITS_PER_BLOCK.
+ * 	Care to avoid side effects in the arguments because they may be evaluated more than once
+ */
+#define bitmap_foreach_run(bitmap, bitmap_size, func) ({			\
+		unsigned __i, __fnd, __len, __blocks = bitmap_size / B_BLOCK_SIZE;	\
+		unsigned __start = 0, __run = 0;				\
+		B_BLOCK_TYPE __cur_block, *__block_b = B_UNION_CAST(bitmap);	\
+		for(__i = 0; __i < __blocks; ++__i){				\
+			__cur_block = __block_b[__i];				\
+			while(__cur_block){					\
+				__fnd = B_CTZ(__cur_block);			\
+				if((__cur_block >> __fnd) == (B_BLOCK_TYPE)~0U >> __fnd){	\
+					__len = B_BITS_PER_BLOCK - __fnd;	\
+					__cur_block = 0;			\
+				} else {					\
+					__len = B_CTZ((B_BLOCK_TYPE)~(__cur_block >> __fnd));	\
+					__cur_block &= ~(((B_MASK << __len) - 1) << __fnd);	\
+				}						\
+				__fnd += __i * B_BITS_PER_BLOCK;		\
+				if(__run && __start + __run == __fnd){		\
+					__run += __len;				\
+				} else {					\
+					if(__run)				\
+						func(__start, __run);		\
+					__start = __fnd;			\
+					__run = __len;				\
+				}						\
+			}							\
+		}								\
+		if(__run)							\
+			func(__start, __run);					\
+	})
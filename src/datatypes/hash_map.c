@@ -23,223 +23,332 @@
 * @author Andrea Piccione
 *
 * This a simple hash map implementation, currently used in the abm layer.
-* It's based on a open addressing design:
-* it handles collisions through linear probing,
-* entries are reordered on insertion through robin hood hashing.
+* It's based on a open addressing design, following the "Swiss table" layout:
+* a control byte per slot tells whether the slot is empty, deleted or full and
+* in the latter case holds 7 bits of the hash. The control bytes are probed a
+* group at a time, jumping between groups with triangular probing.
+* The table grows in place: it's reallocated and its entries are then moved
+* around inside the very same buffer.
 */
 
 
+// This must come before the kernel headers, which poison malloc()
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <datatypes/hash_map.h>
 #include <mm/dymelor.h>
 #include <memory.h>
 #include <limits.h>
 
-// must be a power of two
-#define HM_INITIAL_CAPACITY 8
-#define DIB(curr_i, hash, capacity_mo) ((curr_i) >= ((hash) & (capacity_mo)) ? (curr_i) - ((hash) & (capacity_mo)) : (capacity_mo) + 1 + (curr_i) - ((hash) & (capacity_mo)))
+// the number of control bytes probed at once
+#define HM_GROUP_SIZE 16
+// must be a power of two, not smaller than a group
+#define HM_INITIAL_CAPACITY HM_GROUP_SIZE
+
+// control bytes of the slots which don't hold an entry, the full ones are in [0, 127]
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((unsigned char)((hash) & 0x7f))
+
 #define SWAP_VALUES(a, b) do{__typeof(a) _tmp = (a); (a) = (b); (b) = _tmp;}while(0)
 
 // Adapted from http://xorshift.di.unimi.it/splitmix64.c PRNG,
 // written by Sebastiano Vigna (vigna@acm.org)
-// TODO benchmark further and select a possibly better hash function
 static hash_t _get_hash(key_type_t key){
 	uint64_t z = key + 0x9e3779b97f4a7c15;
 	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
 	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
-	return (hash_t)((z ^ (z >> 31)) >> 32);
+	return z ^ (z >> 31);
 }
 
-void _hash_map_init(struct _inner_hash_map_t *_i_hmap){
-	// this is the effective capacity_minus_one
-	// this trick saves us some subtractions when we
-	// use the capacity as a bitmask to
-	// select the relevant hash bits for table indexing
-	_i_hmap->capacity_mo = HM_INITIAL_CAPACITY - 1;
-	_i_hmap->nodes = rsalloc(sizeof(struct _hash_map_node_t) * HM_INITIAL_CAPACITY);
-	memset(_i_hmap->nodes, UCHAR_MAX, sizeof(struct _hash_map_node_t) * HM_INITIAL_CAPACITY);
+// the control bytes are followed by a copy of the first group, so that a group can be loaded from any slot
+static inline unsigned char *_ctrl(struct _hash_map_table_t *table){
+	return (unsigned char *)(table + 1);
 }
 
-void _hash_map_fini(struct _inner_hash_map_t *_i_hmap){
-	rsfree(_i_hmap->nodes);
+static inline struct _hash_map_node_t *_nodes(struct _hash_map_table_t *table){
+	return (struct _hash_map_node_t *)(_ctrl(table) + table->capacity_mo + 1 + HM_GROUP_SIZE);
 }
 
-static void _hash_map_insert_hashed(struct _inner_hash_map_t *_i_hmap, struct _hash_map_node_t node){
-	struct _hash_map_node_t *nodes = _i_hmap->nodes;
-	struct _hash_map_node_t cur_node = node;
-	map_size_t capacity_mo = _i_hmap->capacity_mo;
-	// since capacity_mo is 2^n - 1 for some n
-	// this effectively is a modulo 2^n
-	map_size_t i = node.hash & capacity_mo;
-	// dib stays for distance from initial bucket
-	map_size_t dib = 0;
+static inline size_t _table_size(map_size_t capacity){
+	return sizeof(struct _hash_map_table_t) + capacity + HM_GROUP_SIZE + capacity * sizeof(struct _hash_map_node_t);
+}
 
-	// linear probing with robin hood hashing
-	// https://cs.uwaterloo.ca/research/tr/1986/CS-86-14.pdf by Pedro Celis
-	while(1){
-		if(nodes[i].elem_i == HMAP_INVALID_I){
-			// found an empty cell, put the pair here and we're done
-			nodes[i] = cur_node;
-			return;
-		} else if(dib > DIB(i, nodes[i].hash, capacity_mo)){
-			// found a "richer" cell, swap the pairs and continue looking for a hole
-			dib = DIB(i, nodes[i].hash, capacity_mo);
-			SWAP_VALUES(cur_node, nodes[i]);
+static inline map_size_t _max_count(map_size_t capacity){
+	return (map_size_t)(capacity * MAX_LOAD_FACTOR);
+}
+
+#ifdef __SSE2__
+
+// the slots of a group whose control byte matches the given value, as a bitmask
+static inline unsigned _group_match(const unsigned char *group, unsigned char ctrl){
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)group), _mm_set1_epi8((char)ctrl)));
+}
+
+// the slots of a group which are empty or deleted, as a bitmask
+static inline unsigned _group_match_free(const unsigned char *group){
+	return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#else
+
+static inline unsigned _group_match(const unsigned char *group, unsigned char ctrl){
+	unsigned i, ret = 0;
+	for(i = 0; i < HM_GROUP_SIZE; ++i)
+		ret |= (unsigned)(group[i] == ctrl) << i;
+	return ret;
+}
+
+static inline unsigned _group_match_free(const unsigned char *group){
+	unsigned i, ret = 0;
+	for(i = 0; i < HM_GROUP_SIZE; ++i)
+		ret |= (unsigned)(group[i] >> 7) << i;
+	return ret;
+}
+
+#endif
+
+static inline void _set_ctrl(struct _hash_map_table_t *table, map_size_t i, unsigned char ctrl){
+	unsigned char *ctrl_bytes = _ctrl(table);
+	ctrl_bytes[i] = ctrl;
+	// keep the copy of the first group in sync
+	if(i < HM_GROUP_SIZE)
+		ctrl_bytes[table->capacity_mo + 1 + i] = ctrl;
+}
+
+// the first empty or deleted slot in the probe sequence of a hash
+static map_size_t _find_free(struct _hash_map_table_t *table, hash_t hash){
+	const unsigned char *ctrl = _ctrl(table);
+	map_size_t capacity_mo = table->capacity_mo;
+	map_size_t i = H1(hash) & capacity_mo, step = 0;
+	unsigned match;
+
+	// there's always a free slot, since the load factor is less than one
+	while(!(match = _group_match_free(ctrl + i))){
+		step += HM_GROUP_SIZE;
+		i = (i + step) & capacity_mo;
+	}
+	return (i + __builtin_ctz(match)) & capacity_mo;
+}
+
+// the position of a slot in the probe sequence of a hash, counted in groups
+static inline map_size_t _probe_index(map_size_t i, hash_t hash, map_size_t capacity_mo){
+	return ((i - H1(hash)) & capacity_mo) / HM_GROUP_SIZE;
+}
+
+/**
+* Move the entries whose control byte is CTRL_DELETED to their place, all the other
+* slots must be empty. This is done in place: an entry is either left where it is,
+* moved to an empty slot or swapped with another entry which has still to be placed.
+*/
+static void _hash_map_rehash_in_place(struct _hash_map_table_t *table, map_size_t count){
+	const unsigned char *ctrl = _ctrl(table);
+	struct _hash_map_node_t *nodes = _nodes(table);
+	map_size_t capacity_mo = table->capacity_mo, i, new_i;
+	hash_t hash;
+
+	for(i = 0; i <= capacity_mo; ++i){
+		if(ctrl[i] != CTRL_DELETED)
+			continue;
+
+		hash = _get_hash(nodes[i].key);
+		new_i = _find_free(table, hash);
+		// the entry can't get any closer to the start of its probe sequence
+		if(_probe_index(i, hash, capacity_mo) == _probe_index(new_i, hash, capacity_mo)){
+			_set_ctrl(table, i, H2(hash));
+			continue;
+		}
+
+		if(ctrl[new_i] == CTRL_EMPTY){
+			_set_ctrl(table, new_i, H2(hash));
+			nodes[new_i] = nodes[i];
+			_set_ctrl(table, i, CTRL_EMPTY);
+		}else{
+			// the target holds an entry which has still to be placed: swap them and look at this slot again
+			_set_ctrl(table, new_i, H2(hash));
+			SWAP_VALUES(nodes[i], nodes[new_i]);
+			--i;
 		}
-		++i;
-		// modulo capacity
-		i &= capacity_mo;
-		++dib;
 	}
+	table->growth_left = _max_count(capacity_mo + 1) - count;
 }
 
-static void _hash_map_realloc_rehash(struct _inner_hash_map_t *_i_hmap, map_size_t count){
-	// helper pointers to iterate over the old array
-	struct _hash_map_node_t *rmv = _i_hmap->nodes;
-	// instantiates new array
-	_i_hmap->nodes = rsalloc(sizeof(struct _hash_map_node_t) * (_i_hmap->capacity_mo + 1));
-	memset(_i_hmap->nodes, UCHAR_MAX, sizeof(struct _hash_map_node_t) * (_i_hmap->capacity_mo + 1));
-	// rehash the old array elements
-	map_size_t i = count, j = 0;
-	while(i--){
-		while(rmv[j].elem_i == HMAP_INVALID_I)
-			++j;
-		// TODO: implement more efficient rehashing (in place rehashing)
-		_hash_map_insert_hashed(_i_hmap, rmv[j]);
-		++j;
+// turn the entries into the ones to be placed and clear the other slots
+static void _hash_map_drop_deleted(struct _hash_map_table_t *table, map_size_t capacity){
+	unsigned char *ctrl = _ctrl(table);
+	map_size_t i;
+
+	for(i = 0; i < capacity; ++i)
+		ctrl[i] = ctrl[i] < CTRL_EMPTY ? CTRL_DELETED : CTRL_EMPTY;
+}
+
+static void _hash_map_make_room(struct _inner_hash_map_t *_i_hmap, map_size_t count){
+	struct _hash_map_table_t *table = _i_hmap->table;
+	map_size_t capacity = table->capacity_mo + 1;
+
+	if(count < _max_count(capacity) / 2){
+		// most of the used slots are tombstones, we don't need more room
+		_hash_map_drop_deleted(table, capacity);
+	}else{
+		// double the table: the nodes are moved after the now larger control bytes
+		table = rsrealloc(table, _table_size(2 * capacity));
+		memmove(_ctrl(table) + 2 * capacity + HM_GROUP_SIZE, _ctrl(table) + capacity + HM_GROUP_SIZE, capacity * sizeof(struct _hash_map_node_t));
+		table->capacity_mo = 2 * capacity - 1;
+		_hash_map_drop_deleted(table, capacity);
+		memset(_ctrl(table) + capacity, CTRL_EMPTY, capacity);
+		_i_hmap->table = table;
 	}
-	// free the old array
-	rsfree(rmv);
+	memcpy(_ctrl(table) + table->capacity_mo + 1, _ctrl(table), HM_GROUP_SIZE);
+	_hash_map_rehash_in_place(table, count);
 }
 
-static void _hash_map_expand(struct _inner_hash_map_t *_i_hmap, map_size_t count){
-	// check if threshold has been reached
-	if((double)_i_hmap->capacity_mo * MAX_LOAD_FACTOR >= count)
-		return;
-	// increase map capacity (remember capacity_minus_one)
-	_i_hmap->capacity_mo = 2 * _i_hmap->capacity_mo + 1;
+static struct _hash_map_table_t *_hash_map_table_new(map_size_t capacity){
+	struct _hash_map_table_t *table = rsalloc(_table_size(capacity));
 
-	_hash_map_realloc_rehash(_i_hmap, count);
+	table->capacity_mo = capacity - 1;
+	table->growth_left = _max_count(capacity);
+	memset(_ctrl(table), CTRL_EMPTY, capacity + HM_GROUP_SIZE);
+	return table;
 }
 
-static void _hash_map_shrink(struct _inner_hash_map_t *_i_hmap, map_size_t count){
-	// check if threshold has been reached
-	if((double)_i_hmap->capacity_mo * MIN_LOAD_FACTOR <= count ||
-			_i_hmap->capacity_mo <= HM_INITIAL_CAPACITY)
-		return;
-	// decrease map capacity (remember capacity_minus_one)
-	_i_hmap->capacity_mo /= 2;
+void _hash_map_init(struct _inner_hash_map_t *_i_hmap){
+	_i_hmap->table = _hash_map_table_new(HM_INITIAL_CAPACITY);
+}
+
+void _hash_map_fini(struct _inner_hash_map_t *_i_hmap){
+	rsfree(_i_hmap->table);
+}
+
+static void _hash_map_insert_hashed(struct _hash_map_table_t *table, key_type_t key, hash_t hash, map_size_t elem_i){
+	map_size_t i = _find_free(table, hash);
 
-	_hash_map_realloc_rehash(_i_hmap, count);
+	// reusing a tombstone doesn't bring the table closer to a rehash
+	table->growth_left -= _ctrl(table)[i] == CTRL_EMPTY;
+	_set_ctrl(table, i, H2(hash));
+	_nodes(table)[i].key = key;
+	_nodes(table)[i].elem_i = elem_i;
 }
 
 void _hash_map_add(struct _inner_hash_map_t *_i_hmap, key_type_t key, map_size_t count){
-	// expand if needed
-	_hash_map_expand(_i_hmap, count);
+	if(!_i_hmap->table->growth_left)
+		_hash_map_make_room(_i_hmap, count);
 
-	struct _hash_map_node_t node = {key, _get_hash(key), count};
-	// insert the element
-	_hash_map_insert_hashed(_i_hmap, node);
+	_hash_map_insert_hashed(_i_hmap->table, key, _get_hash(key), count);
 }
 
 static map_size_t _hash_map_index_lookup(struct _inner_hash_map_t *_i_hmap, key_type_t key){
-	struct _hash_map_node_t *nodes = _i_hmap->nodes;
-	map_size_t capacity_mo = _i_hmap->capacity_mo;
+	struct _hash_map_table_t *table = _i_hmap->table;
+	const unsigned char *ctrl = _ctrl(table);
+	const struct _hash_map_node_t *nodes = _nodes(table);
+	map_size_t capacity_mo = table->capacity_mo;
+	hash_t hash = _get_hash(key);
+	map_size_t i = H1(hash) & capacity_mo, step = 0, j;
+	unsigned match;
 
-	hash_t cur_hash = _get_hash(key);
-	map_size_t i = cur_hash & capacity_mo;
-	map_size_t dib = 0;
-
-	do{
-		if(nodes[i].elem_i == HMAP_INVALID_I){
-			// we found a hole where we expected something, the pair hasn't been found
+	while(1){
+		match = _group_match(ctrl + i, H2(hash));
+		//  the more expensive comparison with the key is done only on the matching control bytes
+		while(match){
+			j = (i + __builtin_ctz(match)) & capacity_mo;
+			if(nodes[j].key == key)
+				return j;
+			match &= match - 1;
+		}
+		// an empty slot ends the probe sequence: the insertion would have stopped there
+		if(_group_match(ctrl + i, CTRL_EMPTY))
 			return HMAP_INVALID_I;
-		//  the more expensive comparison with the key is done only if necessary
-		} else if(nodes[i].hash == cur_hash && nodes[i].key == key)
-			// we found a pair with coinciding keys, return the index
-			return i;
-		++i;
-		i &= capacity_mo;
-		++dib;
-	}while(dib <= DIB(i, nodes[i].hash, capacity_mo));
-	// we found a node- with lower DIB than expected: the wanted key isn't here
-	// (else it would have finished here during its insertion).
-	return UINT_MAX;
+		step += HM_GROUP_SIZE;
+		i = (i + step) & capacity_mo;
+	}
 }
 
 unsigned _hash_map_lookup(struct _inner_hash_map_t *_i_hmap, unsigned long long key){
 	// find the index of the wanted key
 	map_size_t i = _hash_map_index_lookup(_i_hmap, key);
 	// return the pair if successful
-	return i == UINT_MAX ? UINT_MAX : _i_hmap->nodes[i].elem_i;
+	return i == HMAP_INVALID_I ? HMAP_INVALID_I : _nodes(_i_hmap->table)[i].elem_i;
 }
 
 void _hash_map_update_i(struct _inner_hash_map_t *_i_hmap, unsigned long long key, map_size_t new_i){
 	// find the index of the wanted key
 	map_size_t i = _hash_map_index_lookup(_i_hmap, key);
 	// update the pair if successful
-	if(i != UINT_MAX)
-		_i_hmap->nodes[i].elem_i = new_i;
+	if(i != HMAP_INVALID_I)
+		_nodes(_i_hmap->table)[i].elem_i = new_i;
+}
+
+static void _hash_map_shrink(struct _inner_hash_map_t *_i_hmap, map_size_t count){
+	struct _hash_map_table_t *old = _i_hmap->table, *table;
+	const unsigned char *ctrl = _ctrl(old);
+	const struct _hash_map_node_t *nodes = _nodes(old);
+	map_size_t capacity = old->capacity_mo + 1, i;
+
+	// check if threshold has been reached
+	if(capacity * MIN_LOAD_FACTOR <= count || capacity <= HM_INITIAL_CAPACITY)
+		return;
+
+	// this is rare enough to just insert the entries in a new table
+	table = _hash_map_table_new(capacity / 2);
+	for(i = 0; i < capacity; ++i){
+		if(ctrl[i] < CTRL_EMPTY)
+			_hash_map_insert_hashed(table, nodes[i].key, _get_hash(nodes[i].key), nodes[i].elem_i);
+	}
+	rsfree(old);
+	_i_hmap->table = table;
 }
 
 void _hash_map_remove(struct _inner_hash_map_t *_i_hmap, unsigned long long key, map_size_t cur_count){
+	struct _hash_map_table_t *table = _i_hmap->table;
+	const unsigned char *ctrl = _ctrl(table);
+	map_size_t capacity_mo = table->capacity_mo;
+	unsigned empty_before, empty_after;
 	// find the index of the wanted key
 	map_size_t i = _hash_map_index_lookup(_i_hmap, key);
 	// if unsuccessful we're done, nothing to remove here!
-	if(i == UINT_MAX) return;
-
-	struct _hash_map_node_t *nodes = _i_hmap->nodes;
-	map_size_t capacity_mo = _i_hmap->capacity_mo;
-	map_size_t j = i;
-	// backward shift to restore the table state as if the insertion never happened:
-	// http://codecapsule.com/2013/11/17/robin-hood-hashing-backward-shift-deletion by Emmanuel Goossaert
-	do{ // the first iteration is necessary since the removed element is always overwritten somehow
-		++j;
-		j &= capacity_mo;
-	}while(nodes[j].elem_i != UINT_MAX && DIB(j, nodes[j].hash, capacity_mo) != 0);
-	// we finally found out the end of the displaced sequence of nodes,
-	// since we either found an empty slot or we found a node residing in his correct position
-
-	--j; // we now point to the last element to move
-	j &= capacity_mo;
-
-	if(j >= i){
-		// we simply move the nodes one slot back
-		memmove(&nodes[i], &nodes[i + 1], (j - i) * sizeof(struct _hash_map_node_t));
+	if(i == HMAP_INVALID_I) return;
+
+	// if no group containing this slot has ever been full, no probe sequence
+	// went past it, so it can be emptied instead of leaving a tombstone
+	empty_before = _group_match(ctrl + ((i - HM_GROUP_SIZE) & capacity_mo), CTRL_EMPTY);
+	empty_after = _group_match(ctrl + i, CTRL_EMPTY);
+	if(empty_before && empty_after && (unsigned)__builtin_ctz(empty_after) + (unsigned)(__builtin_clz(empty_before) - (32 - HM_GROUP_SIZE)) < HM_GROUP_SIZE){
+		_set_ctrl(table, i, CTRL_EMPTY);
+		++table->growth_left;
 	}else{
-		// we wrapped around the table: move the first part back
-		memmove(&nodes[i], &nodes[i + 1], (capacity_mo - i) * sizeof(struct _hash_map_node_t));
-		// move the first node to the last slot in the table
-		memcpy(&nodes[capacity_mo], &nodes[0], sizeof(struct _hash_map_node_t));
-		// move the remaining stuff at the table beginning
-		memmove(&nodes[0], &nodes[1], j * sizeof(struct _hash_map_node_t));
+		_set_ctrl(table, i, CTRL_DELETED);
 	}
 
-	// we clear the last moved slot (if we didn't move anything this clears the removed entry)
-	nodes[j].elem_i = UINT_MAX;
-
 	// shrink the table if necessary
 	_hash_map_shrink(_i_hmap, cur_count - 1);
 }
 
 size_t _hash_map_dump_size(struct _inner_hash_map_t *_i_hmap){
-	return sizeof(_i_hmap->capacity_mo) + (_i_hmap->capacity_mo + 1) * sizeof(*(_i_hmap->nodes));
+	return _table_size(_i_hmap->table->capacity_mo + 1);
 }
 
 inline unsigned char * _hash_map_dump(struct _inner_hash_map_t *_i_hmap, unsigned char *_destination){
-	*((map_size_t *)_destination) = _i_hmap->capacity_mo;
-	_destination += sizeof(map_size_t);
-	size_t table_cpy_size = (_i_hmap->capacity_mo + 1) * sizeof(*(_i_hmap->nodes));
-	memcpy(_destination, _i_hmap->nodes, table_cpy_size);
+	size_t table_cpy_size = _hash_map_dump_size(_i_hmap);
+	memcpy(_destination, _i_hmap->table, table_cpy_size);
 	_destination += table_cpy_size;
 	return _destination;
 }
 
 inline unsigned char * _hash_map_load(struct _inner_hash_map_t *_i_hmap, unsigned char *_source){
-	_i_hmap->capacity_mo = *((map_size_t *)_source);
-	_source += sizeof(map_size_t);
-	size_t table_cpy_size = (_i_hmap->capacity_mo + 1) * sizeof(*(_i_hmap->nodes));
-	_i_hmap->nodes = rsalloc(table_cpy_size);
-	memcpy(_i_hmap->nodes, _source, table_cpy_size);
+	struct _hash_map_table_t header;
+	memcpy(&header, _source, sizeof(header));
+	size_t table_cpy_size = _table_size(header.capacity_mo + 1);
+	_i_hmap->table = rsalloc(table_cpy_size);
+	memcpy(_i_hmap->table, _source, table_cpy_size);
 	_source += table_cpy_size;
 	return _source;
 }
+
+unsigned char * _hash_map_skip(unsigned char *_source){
+	struct _hash_map_table_t header;
+	memcpy(&header, _source, sizeof(header));
+	return _source + _table_size(header.capacity_mo + 1);
+}
@@ -23,9 +23,11 @@
 * @author Andrea Piccione
 *
 * This a simple hash map implementation, currently used in the abm layer.
-* It's based on a open addressing design:
-* it handles collisions through linear probing,
-* entries are reordered through robin hood hashing.
+* The elements are kept in a dense array, while an open addressing table maps
+* keys to their positions in the array. The table follows the "Swiss table" design:
+* a byte of metadata per slot holds 7 bits of the key hash, so that groups of
+* HM_GROUP_SIZE slots are probed at once with SIMD comparisons.
+* The whole table lives in a single allocation, which is also its dump format.
 * TODO 	by default __wrap_malloc and __wrap_free are used, instead
 * 	the choice of the allocation facilities should change on demand
 */
@@ -37,21 +39,27 @@
 
 // TODO DOCUMENTATION!!!
 
-#define MAX_LOAD_FACTOR 0.85
+#define MAX_LOAD_FACTOR 0.875
 #define MIN_LOAD_FACTOR 0.05
 
 typedef uint32_t map_size_t;
-typedef map_size_t hash_t;
+typedef uint64_t hash_t;
 #define HMAP_INVALID_I UINT_MAX
 typedef unsigned long long key_type_t;
 
+struct _hash_map_node_t{
+	unsigned long long key;
+	map_size_t elem_i;
+};
+
+/// the table is laid out as this header, the control bytes and the slots (struct _hash_map_node_t)
+struct _hash_map_table_t{
+	map_size_t capacity_mo;		// the capacity minus one
+	map_size_t growth_left;		// how many slots can be taken before rehashing the table
+};
+
 struct _inner_hash_map_t{
-	map_size_t capacity_mo;
-	struct _hash_map_node_t{
-		unsigned long long key;
-		hash_t hash;
-		unsigned elem_i;
-	} *nodes;
+	struct _hash_map_table_t *table;
 };
 
 // the type must have a unsigned long long variable named key
@@ -96,6 +104,14 @@ struct _inner_hash_map_t{
 		array_lazy_remove_at((hashmap).elems, __rem_i); \
 	})
 
+#define hash_map_swap_elems(hashmap, i, j) ({ \
+		__typeof__(*array_items((hashmap).elems)) __swp = array_get_at((hashmap).elems, i); \
+		array_get_at((hashmap).elems, i) = array_get_at((hashmap).elems, j); \
+		array_get_at((hashmap).elems, j) = __swp; \
+		_hash_map_update_i(&((hashmap)._i_hmap), array_get_at((hashmap).elems, i).key, i); \
+		_hash_map_update_i(&((hashmap)._i_hmap), array_get_at((hashmap).elems, j).key, j); \
+	})
+
 #define hash_map_items(hashmap) ({ \
 		assert(array_count((hashmap).elems)); \
 		__typeof__(array_items((hashmap).elems)) __ret = array_items((hashmap).elems); \
@@ -118,6 +134,11 @@ struct _inner_hash_map_t{
 		source = _hash_map_load(&((hashmap)._i_hmap), source); \
 	})
 
+// skip the dump of the table, whose elements array has already been read
+#define hash_map_skip_table(source) ({ \
+		source = _hash_map_skip(source); \
+	})
+
 
 // XXX returning and requesting a hash_map_pair_t forces a lot of ugly casts, change it somehow!
 void 		_hash_map_init	(struct _inner_hash_map_t *_i_hmap);
@@ -129,3 +150,4 @@ void 		_hash_map_update_i(struct _inner_hash_map_t *_i_hmap, unsigned long long
 inline size_t		_hash_map_dump_size(struct _inner_hash_map_t *_i_hmap);
 inline unsigned char*	_hash_map_dump(struct _inner_hash_map_t *_i_hmap, unsigned char *_destination);
 inline unsigned char*	_hash_map_load(struct _inner_hash_map_t *_i_hmap, unsigned char *_source);
+unsigned char*		_hash_map_skip(unsigned char *_source);
@@ -0,0 +1,370 @@
+/**
+* @file datatypes/ladqueue.c
+*
+* @brief Ladder Queue Implementation
+*
+* Ladder Queue with pooled nodes, used as the event set of the sequential
+* simulation engine. Refer to ladqueue.h for a description of the algorithm.
+*
+* The tiers of the ladder keep the following invariant: all events in a
+* rung come before the current bucket of the rung above it (or before
+* the start of the Top list, for the topmost rung), and all events in the
+* Bottom list come before the current bucket of the lowest rung. Hence,
+* the last bucket of each rung is open-ended, and events are always taken
+* from the lowest tier.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include <core/core.h>
+#include <datatypes/ladqueue.h>
+#include <mm/mm.h>
+
+/// A rung of the ladder: an array of unsorted buckets of equal width
+struct ladder_rung {
+	ladqueue_node **bucket;		///< Heads of the bucket lists
+	unsigned int *count;		///< Number of events in each bucket
+	unsigned int capacity;		///< Number of allocated buckets
+	unsigned int nbuckets;		///< Number of buckets in use
+	unsigned int cur;		///< The first bucket which may hold events
+	unsigned int size;		///< Number of events in the rung
+	double start;			///< Lower bound of the first bucket
+	double width;			///< Width of each bucket
+	double cur_start;		///< Lower bound of the current bucket
+};
+
+static struct ladder_rung rungs[LADQ_MAX_RUNGS];
+static unsigned int nrungs;
+
+// The Top list is unsorted, and only keeps track of its timestamp range
+static ladqueue_node *top;
+static unsigned int top_size;
+static double top_min, top_max, top_start;
+
+// The Bottom list is sorted, events are extracted from its head
+static ladqueue_node *bottom;
+static unsigned int bottom_size;
+
+// Free queue nodes, and the chunks they have been carved from
+static ladqueue_node *free_nodes;
+static ladqueue_node *pool_chunks;
+
+
+static ladqueue_node *node_alloc(void)
+{
+	ladqueue_node *chunk, *node;
+	unsigned int i;
+
+	if (unlikely(free_nodes == NULL)) {
+		// The first node of each chunk links the chunks together
+		chunk = rsalloc(sizeof(ladqueue_node) * LADQ_POOL_CHUNK);
+		chunk[0].next = pool_chunks;
+		pool_chunks = chunk;
+
+		for (i = 1; i < LADQ_POOL_CHUNK; i++) {
+			chunk[i].next = free_nodes;
+			free_nodes = &chunk[i];
+		}
+	}
+
+	node = free_nodes;
+	free_nodes = node->next;
+	return node;
+}
+
+static inline void node_release(ladqueue_node *node)
+{
+	node->next = free_nodes;
+	free_nodes = node;
+}
+
+static ladqueue_node *merge_lists(ladqueue_node *a, ladqueue_node *b)
+{
+	ladqueue_node head, *tail = &head;
+
+	while (a != NULL && b != NULL) {
+		// Ties are taken from the first list, so that sorting is stable
+		if (b->timestamp < a->timestamp) {
+			tail->next = b;
+			b = b->next;
+		} else {
+			tail->next = a;
+			a = a->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = (a != NULL ? a : b);
+
+	return head.next;
+}
+
+// Merge sort of a bucket, which is moved to the Bottom list
+static ladqueue_node *sort_list(ladqueue_node *list)
+{
+	ladqueue_node *slow, *fast, *second;
+
+	if (list == NULL || list->next == NULL)
+		return list;
+
+	slow = list;
+	fast = list->next;
+	while (fast != NULL && fast->next != NULL) {
+		slow = slow->next;
+		fast = fast->next->next;
+	}
+	second = slow->next;
+	slow->next = NULL;
+
+	return merge_lists(sort_list(list), sort_list(second));
+}
+
+static void rung_insert(struct ladder_rung *r, ladqueue_node *node)
+{
+	double pos;
+	unsigned int i;
+
+	pos = (node->timestamp - r->start) / r->width;
+	if (pos >= (double)r->nbuckets)
+		i = r->nbuckets - 1;
+	else
+		i = (unsigned int)pos;
+
+	// Rounding might place an event right before the current bucket
+	if (i < r->cur)
+		i = r->cur;
+
+	node->next = r->bucket[i];
+	r->bucket[i] = node;
+	r->count[i]++;
+	r->size++;
+}
+
+// Spread n events, whose timestamps range in [min, max], over a new lowest rung
+static void spawn_rung(ladqueue_node *list, unsigned int n, double min, double max)
+{
+	struct ladder_rung *r = &rungs[nrungs++];
+	ladqueue_node *next;
+
+	if (n > r->capacity) {
+		if (r->capacity > 0) {
+			rsfree(r->bucket);
+			rsfree(r->count);
+		}
+		r->bucket = rsalloc(sizeof(ladqueue_node *) * n);
+		r->count = rsalloc(sizeof(unsigned int) * n);
+		r->capacity = n;
+	}
+
+	memset(r->bucket, 0, sizeof(ladqueue_node *) * n);
+	memset(r->count, 0, sizeof(unsigned int) * n);
+	r->nbuckets = n;
+	r->cur = 0;
+	r->size = 0;
+	r->start = min;
+	r->width = (max - min) / n;
+	r->cur_start = min;
+
+	while (list != NULL) {
+		next = list->next;
+		rung_insert(r, list);
+		list = next;
+	}
+}
+
+static bool can_spawn_rung(unsigned int n, double min, double max)
+{
+	return n > LADQ_THRESHOLD && nrungs < LADQ_MAX_RUNGS && (max - min) / n > 0.0;
+}
+
+static void bottom_insert(ladqueue_node *node)
+{
+	ladqueue_node *traverse;
+
+	if (bottom == NULL || bottom->timestamp > node->timestamp) {
+		node->next = bottom;
+		bottom = node;
+	} else {
+		traverse = bottom;
+		while (traverse->next != NULL && traverse->next->timestamp <= node->timestamp)
+			traverse = traverse->next;
+		node->next = traverse->next;
+		traverse->next = node;
+	}
+	bottom_size++;
+
+	// Keep sorted insertions cheap by moving a long Bottom list to a new rung
+	if (unlikely(bottom_size > LADQ_THRESHOLD && nrungs < LADQ_MAX_RUNGS)) {
+		traverse = bottom;
+		while (traverse->next != NULL)
+			traverse = traverse->next;
+
+		if (can_spawn_rung(bottom_size, bottom->timestamp, traverse->timestamp)) {
+			spawn_rung(bottom, bottom_size, bottom->timestamp, traverse->timestamp);
+			bottom = NULL;
+			bottom_size = 0;
+		}
+	}
+}
+
+// Move the next bucket of events to the Bottom list. Returns false if the queue is empty.
+static bool refill_bottom(void)
+{
+	struct ladder_rung *r;
+	ladqueue_node *list, *node;
+	unsigned int n;
+	double min, max;
+
+	while (true) {
+		if (nrungs == 0) {
+			if (top == NULL)
+				return false;
+
+			list = top;
+			n = top_size;
+			min = top_min;
+			max = top_max;
+			top = NULL;
+			top_size = 0;
+			top_start = max;
+		} else {
+			r = &rungs[nrungs - 1];
+
+			while (r->bucket[r->cur] == NULL)
+				r->cur++;
+
+			list = r->bucket[r->cur];
+			n = r->count[r->cur];
+			r->bucket[r->cur] = NULL;
+			r->count[r->cur] = 0;
+			r->cur++;
+			r->cur_start = r->start + r->cur * r->width;
+			r->size -= n;
+
+			// An empty rung is removed, the rung above bounds its events from now on
+			if (r->size == 0)
+				nrungs--;
+
+			min = max = list->timestamp;
+			for (node = list->next; node != NULL; node = node->next) {
+				if (node->timestamp < min)
+					min = node->timestamp;
+				if (node->timestamp > max)
+					max = node->timestamp;
+			}
+		}
+
+		if (can_spawn_rung(n, min, max)) {
+			spawn_rung(list, n, min, max);
+			continue;
+		}
+
+		bottom = sort_list(list);
+		bottom_size = n;
+		return true;
+	}
+}
+
+void ladqueue_init(void)
+{
+	top = NULL;
+	top_size = 0;
+	top_start = -INFINITY;
+	bottom = NULL;
+	bottom_size = 0;
+	nrungs = 0;
+}
+
+void ladqueue_fini(void)
+{
+	ladqueue_node *chunk;
+	unsigned int i;
+
+	for (i = 0; i < LADQ_MAX_RUNGS; i++) {
+		if (rungs[i].capacity > 0) {
+			rsfree(rungs[i].bucket);
+			rsfree(rungs[i].count);
+		}
+	}
+	memset(rungs, 0, sizeof(rungs));
+
+	while (pool_chunks != NULL) {
+		chunk = pool_chunks;
+		pool_chunks = chunk[0].next;
+		rsfree(chunk);
+	}
+	free_nodes = NULL;
+
+	ladqueue_init();
+}
+
+void ladqueue_put(double timestamp, void *payload)
+{
+	ladqueue_node *node;
+	unsigned int i;
+
+	node = node_alloc();
+	node->timestamp = timestamp;
+	node->payload = payload;
+
+	if (timestamp >= top_start) {
+		if (top_size == 0) {
+			top_min = top_max = timestamp;
+		} else if (timestamp < top_min) {
+			top_min = timestamp;
+		} else if (timestamp > top_max) {
+			top_max = timestamp;
+		}
+
+		node->next = top;
+		top = node;
+		top_size++;
+		return;
+	}
+
+	for (i = 0; i < nrungs; i++) {
+		if (timestamp >= rungs[i].cur_start) {
+			rung_insert(&rungs[i], node);
+			return;
+		}
+	}
+
+	bottom_insert(node);
+}
+
+void *ladqueue_get(void)
+{
+	ladqueue_node *node;
+	void *payload;
+
+	if (bottom == NULL && !refill_bottom())
+		return NULL;
+
+	node = bottom;
+	bottom = node->next;
+	bottom_size--;
+
+	payload = node->payload;
+	node_release(node);
+	return payload;
+}
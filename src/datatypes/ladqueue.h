@@ -0,0 +1,62 @@
+/**
+* @file datatypes/ladqueue.h
+*
+* @brief Ladder Queue Implementation
+*
+* The Ladder Queue is a multi-tier priority queue with O(1) amortized
+* insertion and extraction which, differently from the Calendar Queue,
+* never has to be resized as a whole. Events are appended to an unsorted
+* Top list; when the events close to the head of the queue are needed,
+* they are spread over the buckets of a Rung, and buckets holding too many
+* events are in turn spread over a finer-grained child Rung. Only a small
+* bucket at a time is sorted into the Bottom list, from which events are
+* extracted.
+*
+* Queue nodes are taken from a pool which is only grown, so that the
+* steady state of the queue does not hit the memory allocator.
+*
+* As in the Calendar Queue, you cannot insert events which "happen before"
+* the last extracted event.
+*
+* For a thorough description of the algorithm, refer to:
+*
+* W. T. Tang, R. S. M. Goh, I. L.-J. Thng
+* “Ladder Queue: An O(1) Priority Queue Structure for Large-Scale Discrete
+* Event Simulation”
+* ACM TOMACS, Vol. 15, No. 3, pp. 175-204, Jul. 2005.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#define LADQ_THRESHOLD	50	///< A bucket with more events than this is spawned into a new rung
+#define LADQ_MAX_RUNGS	8	///< Maximum number of rungs in the ladder
+#define LADQ_POOL_CHUNK	4096	///< Number of queue nodes allocated at once when the pool is empty
+
+typedef struct __ladqueue_node {
+	double timestamp;		///< Timestamp associated to the event
+	void *payload;			///< A pointer to the actual content of the node
+	struct __ladqueue_node *next;	///< Intrusive link to the next node in the same tier
+} ladqueue_node;
+
+extern void ladqueue_init(void);
+extern void ladqueue_fini(void);
+extern void *ladqueue_get(void);
+extern void ladqueue_put(double, void *);
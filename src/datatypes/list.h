@@ -294,4 +294,40 @@ typedef struct rootsim_list {
 	__deleted;\
 	})
 
+/**
+ * Detach the nodes at the head of a list up to a certain point, i.e. the
+ * nodes whose key is smaller than @p key_value. Differently from list_trunc(),
+ * nodes are not released: they are prepended to @p chain, a NULL-terminated
+ * chain of nodes linked through their @c next pointer, so that they can be
+ * released later on.
+ *
+ * @return The number of detached nodes
+ */
+#define list_detach(list, key_name, key_value, chain) \
+	({\
+	rootsim_list *__l = (rootsim_list *)(list);\
+	__typeof__(list) __n;\
+	__typeof__(list) __last = NULL;\
+	unsigned int __detached = 0;\
+	size_t __key_position = my_offsetof((list), key_name);\
+	assert(__l);\
+	__n = __l->head;\
+	while(__n != NULL && get_key(__n) < (key_value)) {\
+		__detached++;\
+		__last = __n;\
+		__n = __n->next;\
+	}\
+	if(__detached > 0) {\
+		__last->next = (chain);\
+		(chain) = __l->head;\
+		__l->head = __n;\
+		if(__n != NULL)\
+			__n->prev = NULL;\
+		else\
+			__l->tail = NULL;\
+		__l->size -= __detached;\
+	}\
+	__detached;\
+	})
+
 #define list_size(list) ((rootsim_list *)(list))->size
@@ -128,8 +128,9 @@ void ccgs_compute_snapshot(state_t * time_barrier_pointer[], simtime_t gvt)
 		// TODO: realign LogState and RestoreState to be compliant with the execution in the committed portion
 
 		// Log the current state so that after we can restore it.
+		// This is a full log, which is not part of the chain of incremental logs.
 		current = lp;
-		temporary_log.log = log_state(lp);
+		temporary_log.log = log_full(lp);
 		temporary_log.state = lp->state;
 		temporary_log.base_pointer = lp->current_base_pointer;
 
@@ -180,8 +181,22 @@ void ccgs_compute_snapshot(state_t * time_barrier_pointer[], simtime_t gvt)
 
 void ccgs_init(void)
 {
-	lps_termination = rsalloc(sizeof(bool) * n_prc);
-	memset(lps_termination, 0, sizeof(bool) * n_prc);
+	lps_termination = rsalloc(sizeof(bool) * n_prc_max);
+	memset(lps_termination, 0, sizeof(bool) * n_prc_max);
+}
+
+/**
+* Move the termination flag of an LP when it is assigned a different local id.
+* This is used when LPs are migrated across kernels. The old slot is cleared,
+* so that an LP which will later take it does not inherit a stale flag.
+*
+* @param from The old local id of the LP
+* @param to The new local id of the LP
+*/
+void ccgs_lp_relocate(unsigned int from, unsigned int to)
+{
+	lps_termination[to] = lps_termination[from];
+	lps_termination[from] = false;
 }
 
 void ccgs_fini(void)
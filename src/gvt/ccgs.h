@@ -48,3 +48,4 @@ enum {
 extern inline bool ccgs_can_halt_simulation(void);
 extern void ccgs_reduce_termination(void);
 extern void ccgs_compute_snapshot(state_t * time_barrier_pointer[], simtime_t gvt);
+extern void ccgs_lp_relocate(unsigned int from, unsigned int to);
@@ -38,15 +38,28 @@
 #include <scheduler/scheduler.h>
 #include <statistics/statistics.h>
 
+/// Time budget, in microseconds, for releasing fossils at each scheduling iteration
+#define FOSSIL_BUDGET_US	20
+
+/// Number of fossils released between two checks of the time budget
+#define FOSSIL_BUDGET_STRIDE	16
+
 /// Counter for the invocations of adopt_new_gvt. This is used to determine whether a consistent state must be reconstructed
 static unsigned long long snapshot_cycles;
 
+/// Position in the LP binding block from which the next fossil collection step starts
+static __thread unsigned int fossil_cursor;
+
 /**
 * Determine which snapshots in the state queue can be free'd because are placed before the current time barrier.
 *
-* Queues are cleaned by deleting all the events the timestamp of which is STRICTLY lower than the time barrier.
+* Queues are cleaned by detaching all the events the timestamp of which is STRICTLY lower than the time barrier.
 * Since state_pointer points to an event in queue_in, the state queue must be cleaned after the input queue.
 *
+* Detached states, messages and headers are not released here: they are chained to the LP and
+* released incrementally by fossil_collection_step(), so that adopting a GVT takes a time which
+* depends only on the number of fossils, not on the cost of freeing them.
+*
 * @param lp A pointer to the lp_struct for which we want to recollect memory
 * @param time_barrier The current barrier
 */
@@ -56,34 +69,101 @@ void fossil_collection(struct lp_struct *lp, simtime_t time_barrier)
 	msg_t *last_kept_event;
 	double committed_events;
 
-	// State list must be handled specifically, as nodes point to malloc'd
-	// nodes. We therefore manually scan the list and free the memory.
-	while ((state = list_head(lp->queue_states)) != NULL
-	       && state->lvt < time_barrier) {
-		log_delete(state->log);
-		if(&topology_settings && topology_settings.write_enabled)
-			rsfree(state->topology);
-		if(&abm_settings)
-			rsfree(state->region_data);
-#ifndef NDEBUG
-		state->last_event = (void *)0xDEADBABE;
-#endif
-		list_pop(lp->queue_states);
-	}
+	// At most the fossils of one GVT round are kept around
+	if (unlikely(lp->fossil_barrier > -INFTY))
+		release_fossils(lp, NULL);
+
+	list_detach(lp->queue_states, lvt, time_barrier, lp->fossil_states);
 
 	// Determine queue pruning horizon
 	state = list_head(lp->queue_states);
 	last_kept_event = state->last_event;
 
-	// Truncate the input queue, accounting for the event which is pointed by the lastly kept state
+	// Detach the input queue, accounting for the event which is pointed by the lastly kept state
 	committed_events =
-	    (double)list_trunc(lp->queue_in, timestamp,
-			       last_kept_event->timestamp, msg_release);
+	    (double)list_detach(lp->queue_in, timestamp,
+				last_kept_event->timestamp, lp->fossil_msgs);
 	statistics_post_data(lp, STAT_COMMITTED, committed_events);
 
-	// Truncate the output queue
-	list_trunc(lp->queue_out, send_time, last_kept_event->timestamp,
-		   msg_hdr_release);
+	// Detach the output queue
+	list_detach(lp->queue_out, send_time, last_kept_event->timestamp,
+		    lp->fossil_hdrs);
+
+	lp->fossil_barrier = time_barrier;
+}
+
+/**
+* Release the fossils which fossil_collection() has detached from the queues
+* of an LP, and then the memory buffers which the LP has not used since the
+* time barrier.
+*
+* @param lp A pointer to the lp_struct whose fossils should be released
+* @param budget The start of the current fossil collection step, or @c NULL
+*        to release all the fossils regardless of the time spent
+*
+* @return @c true if all the fossils of the LP have been released
+*/
+bool release_fossils(struct lp_struct *lp, timer *budget)
+{
+	state_t *state;
+	msg_t *msg;
+	msg_hdr_t *hdr;
+	unsigned int released = 0;
+
+	while (lp->fossil_states != NULL || lp->fossil_msgs != NULL || lp->fossil_hdrs != NULL) {
+		if (budget != NULL && ++released % FOSSIL_BUDGET_STRIDE == 0
+		    && timer_value_micro((*budget)) >= FOSSIL_BUDGET_US)
+			return false;
+
+		if ((state = lp->fossil_states) != NULL) {
+			lp->fossil_states = state->next;
+			state_release(state);
+		}
+
+		if ((msg = lp->fossil_msgs) != NULL) {
+			lp->fossil_msgs = msg->next;
+			msg_release(msg);
+		}
+
+		if ((hdr = lp->fossil_hdrs) != NULL) {
+			lp->fossil_hdrs = hdr->next;
+			msg_hdr_release(hdr);
+		}
+	}
+
+	if (lp->fossil_barrier > -INFTY) {
+		// Actually release memory buffer allocated by the LPs and then released via free() calls
+		clean_buffers_on_gvt(lp, lp->fossil_barrier);
+		lp->fossil_barrier = -INFTY;
+	}
+
+	return true;
+}
+
+/**
+* Spend a bounded amount of time releasing the fossils of the LPs bound to
+* the current worker thread. LPs are visited round robin, so that the
+* fossils of all of them are eventually released. This is called at each
+* scheduling iteration.
+*/
+void fossil_collection_step(void)
+{
+	timer budget;
+	unsigned int visited;
+	struct lp_struct *lp;
+
+	timer_start(budget);
+
+	for (visited = 0; visited < n_prc_per_thread; visited++) {
+		if (fossil_cursor >= n_prc_per_thread)
+			fossil_cursor = 0;
+
+		lp = lps_bound_blocks[fossil_cursor];
+		if (lp->fossil_barrier > -INFTY && !release_fossils(lp, &budget))
+			return;
+
+		fossil_cursor++;
+	}
 }
 
 /**
@@ -105,10 +185,12 @@ void adopt_new_gvt(simtime_t new_gvt)
 	compute_snapshot =
 	    ((snapshot_cycles % rootsim_config.gvt_snapshot_cycles) == 0);
 
-	// Precompute the time barrier for each process
+	// Precompute the time barrier for each process, and sample the memory kept by checkpoints
 	i = 0;
 	foreach_bound_lp(lp) {
 		time_barrier_pointer[i++] = find_time_barrier(lp, new_gvt);
+		statistics_post_data(lp, STAT_ARENA_MEM, (double)ckpt_arena_memory(lp));
+		statistics_post_data(lp, STAT_ARENA_LIVE, (double)ckpt_arena_live(lp));
 	}
 
 	// If needed, call the CCGS subsystem
@@ -117,15 +199,21 @@ void adopt_new_gvt(simtime_t new_gvt)
 
 	i = 0;
 	foreach_bound_lp(lp) {
-		if (time_barrier_pointer[i] == NULL)
+		// Keep the index aligned with the LP also when it is skipped
+		if (time_barrier_pointer[i] == NULL) {
+			i++;
 			continue;
+		}
 
-		// Execute the fossil collection
+		// Detach the fossils, they are released by fossil_collection_step()
 		fossil_collection(lp, time_barrier_pointer[i]->lvt);
 
-		// Actually release memory buffer allocated by the LPs and then released via free() calls
-		clean_buffers_on_gvt(lp, time_barrier_pointer[i]->lvt);
+		if (&topology_settings)
+			topology_time_barrier(lp, time_barrier_pointer[i]->lvt);
 
 		i++;
 	}
+
+	if (&topology_settings)
+		topology_fossil_collection();
 }
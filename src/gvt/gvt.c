@@ -38,12 +38,15 @@
 #include <core/core.h>
 #include <core/init.h>
 #include <core/timer.h>
+#include <scheduler/binding.h>
+#include <scheduler/elastic.h>
 #include <scheduler/process.h>
 #include <scheduler/scheduler.h>
 #include <statistics/statistics.h>
 #include <mm/mm.h>
 #include <communication/mpi.h>
 #include <communication/gvt.h>
+#include <communication/migration.h>
 
 enum kernel_phases {
 	kphase_start,
@@ -159,7 +162,7 @@ void gvt_fini(void)
 	ccgs_fini();
 
 #ifdef HAVE_MPI
-	if ((kernel_phase == kphase_idle && !master_thread() && gvt_init_pending()) || kernel_phase == kphase_start) {
+	if ((kernel_phase == kphase_idle && !master_kernel() && gvt_init_pending()) || kernel_phase == kphase_start) {
 		join_white_msg_redux();
 		wait_white_msg_redux();
 		join_gvt_redux(-1.0);
@@ -256,7 +259,7 @@ simtime_t GVT_phases(void)
 
 		if (atomic_read(&counter_B) == 0) {
 			simtime_t agreed_vt = INFTY;
-			for (i = 0; i < n_cores; i++) {
+			for (i = 0; i < n_active_cores; i++) {
 				agreed_vt = min(local_min[i], agreed_vt);
 			}
 			return agreed_vt;
@@ -267,9 +270,31 @@ simtime_t GVT_phases(void)
 	return -1.0;
 }
 
+/**
+ * Tells whether a GVT round is being carried out in the local kernel.
+ * Worker threads reduce the GVT over the LPs bound to them, so LPs
+ * must not change thread while this is the case.
+ */
+bool gvt_round_in_progress(void)
+{
+	return kernel_phase != kphase_idle;
+}
+
 bool start_new_gvt(void)
 {
+	// Wait for LPs to be bound to their new worker threads
+	if (binding_in_progress())
+		return false;
+
+	// Worker threads are being parked or woken up
+	if (thread_resize_pending())
+		return false;
+
 #ifdef HAVE_MPI
+	// LPs are being moved across kernels, wait for them to settle
+	if (lp_migration_pending())
+		return false;
+
 	if (!master_kernel()) {
 		//Check if we received a new GVT init msg
 		return gvt_init_pending();
@@ -335,24 +360,30 @@ simtime_t gvt_operations(void)
 			commit_kvt_tkn = 1;
 			idle_tkn = 1;
 
-			atomic_set(&counter_initialized, n_cores);
-			atomic_set(&counter_kvt, n_cores);
-			atomic_set(&counter_finalized, n_cores);
+			atomic_set(&counter_initialized, n_active_cores);
+			atomic_set(&counter_kvt, n_active_cores);
+			atomic_set(&counter_finalized, n_active_cores);
 
-			atomic_set(&counter_A, n_cores);
-			atomic_set(&counter_send, n_cores);
-			atomic_set(&counter_B, n_cores);
+			atomic_set(&counter_A, n_active_cores);
+			atomic_set(&counter_send, n_active_cores);
+			atomic_set(&counter_B, n_active_cores);
 
 			kernel_phase = kphase_start;
 
+			// Idle worker threads must not delay the round
+			for (unsigned int i = 0; i < n_active_cores; i++)
+				wake_worker_thread(i);
+
 			timer_restart(gvt_timer);
 		}
 	}
 
 	/* Thread setup phase:
 	 * each thread needs to setup its own local context
-	 * before to partecipate to the new GVT round */
-	if (kernel_phase == kphase_start && thread_phase == tphase_idle) {
+	 * before to partecipate to the new GVT round.
+	 * LPs which are being handed off between threads
+	 * must have reached their new thread beforehand */
+	if (kernel_phase == kphase_start && thread_phase == tphase_idle && !handoff_in_progress()) {
 
 		// Someone has modified the GVT round (possibly me).
 		// Keep track of this update
@@ -436,6 +467,9 @@ simtime_t gvt_operations(void)
 		// get_last_gvt()
 		adopt_new_gvt(new_gvt);
 
+		// Events below the new safe horizon will not be rolled back
+		lookahead_on_gvt(new_gvt);
+
 		// Dump statistics
 		statistics_on_gvt(new_gvt);
 
@@ -446,6 +480,12 @@ simtime_t gvt_operations(void)
 
 		if (atomic_read(&counter_finalized) == 0) {
 			if (iCAS(&idle_tkn, 1, 0)) {
+#ifdef HAVE_MPI
+				// All threads are done with the round: decide
+				// on migrations before a new one is started
+				lp_migration_check(new_gvt);
+#endif
+				elastic_check(new_gvt);
 				kernel_phase = kphase_idle;
 			}
 		}
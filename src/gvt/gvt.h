@@ -33,6 +33,7 @@
 #pragma once
 
 #include <ROOT-Sim.h>
+#include <core/timer.h>
 #include <mm/state.h>
 
 /* API from gvt.c */
@@ -40,9 +41,19 @@ extern void gvt_init(void);
 extern void gvt_fini(void);
 extern simtime_t gvt_operations(void);
 inline extern simtime_t get_last_gvt(void);
+extern bool gvt_round_in_progress(void);
+
+/* API from lookahead.c */
+extern void lookahead_init(void);
+extern bool lookahead_enabled(void);
+extern void lookahead_on_gvt(simtime_t new_gvt);
+extern bool is_safe_event(msg_t *evt);
+extern void check_lookahead(GID_t receiver, simtime_t timestamp);
 
 /* API from fossil.c */
 extern void adopt_new_gvt(simtime_t);
+extern bool release_fossils(struct lp_struct *lp, timer *budget);
+extern void fossil_collection_step(void);
 
 /* API from ccgs.c */
 extern void ccgs_init(void);
@@ -0,0 +1,172 @@
+/**
+* @file gvt/lookahead.c
+*
+* @brief Lookahead-based safe event execution
+*
+* Models can declare, for each LP, a lookahead: a lower bound on the
+* difference between the timestamp of any event which the LP schedules
+* to other LPs and the timestamp of the event being processed. If every
+* LP declares it, no message with a timestamp smaller than the GVT plus
+* the minimum lookahead can be generated or cancelled anymore. Events
+* below this horizon can therefore be processed in a conservative fashion:
+* they are never rolled back, so they need neither a checkpoint nor the
+* headers of the messages they send to be kept in the output queue.
+*
+* Messages generated by events below the last GVT can still be in transit
+* towards a remote kernel when the GVT is adopted. In distributed runs the
+* horizon is therefore computed using the GVT of the previous round: all
+* those messages have been received when the next GVT is reduced.
+*
+* Events sent by an LP to itself, and events sent while processing INIT,
+* are not subject to the lookahead.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <ROOT-Sim.h>
+#include <arch/thread.h>
+#include <core/core.h>
+#include <core/init.h>
+#include <gvt/gvt.h>
+#include <scheduler/process.h>
+#include <scheduler/scheduler.h>
+#include <communication/mpi.h>
+
+/// The minimum lookahead declared by all LPs in the simulation, 0 if some LP declared none
+static simtime_t min_lookahead;
+
+/// Events with a timestamp smaller than this can be processed safely by this worker thread
+static __thread simtime_t safe_horizon = -INFTY;
+
+/// The GVT adopted in the previous round, used to compute the horizon in distributed runs
+static __thread simtime_t previous_gvt = -INFTY;
+
+
+/**
+* This function allows an LP to declare its lookahead. It can be called
+* only while processing the INIT event. From then on, the simulation is
+* aborted if the LP schedules an event to another LP with a timestamp
+* smaller than the current one plus the lookahead.
+*
+* @param lookahead The minimum delay of the events sent to other LPs
+*/
+void SetLookahead(simtime_t lookahead)
+{
+	if (unlikely(lookahead < 0.0)) {
+		rootsim_error(true, "LP %u is declaring a negative lookahead (%f). Aborting...\n", current->gid.to_int, lookahead);
+	}
+
+	if (unlikely(current_evt == NULL || current_evt->type != INIT)) {
+		rootsim_error(true, "LP %u can declare its lookahead only while processing INIT. Aborting...\n", current->gid.to_int);
+	}
+
+	current->lookahead = lookahead;
+}
+
+
+/**
+* This function reduces the minimum lookahead over all LPs. It must be
+* called by all worker threads once all LPs have processed INIT.
+*/
+void lookahead_init(void)
+{
+	simtime_t local_min = INFTY;
+
+	if (master_thread()) {
+		foreach_lp(lp) {
+			local_min = min(local_min, lp->lookahead);
+		}
+
+#ifdef HAVE_MPI
+		if (n_ker > 1)
+			local_min = reduce_min_lookahead(local_min);
+#endif
+		min_lookahead = local_min;
+	}
+
+	thread_barrier(&all_thread_barrier);
+
+	// No event below the lookahead can arrive once INIT messages are delivered locally
+	if (lookahead_enabled() && n_ker == 1)
+		safe_horizon = min_lookahead;
+}
+
+
+/**
+* Tells whether LPs have declared a lookahead which allows to process
+* some events safely.
+*/
+bool lookahead_enabled(void)
+{
+	return min_lookahead > 0.0;
+}
+
+
+/**
+* This function moves the safe horizon forward. It is called by each worker
+* thread when it adopts a new GVT.
+*
+* @param new_gvt The GVT value which has just been adopted
+*/
+void lookahead_on_gvt(simtime_t new_gvt)
+{
+	if (!lookahead_enabled())
+		return;
+
+	if (n_ker > 1) {
+		if (previous_gvt > -INFTY)
+			safe_horizon = previous_gvt + min_lookahead;
+		previous_gvt = new_gvt;
+	} else {
+		safe_horizon = new_gvt + min_lookahead;
+	}
+}
+
+
+/**
+* Tells whether an event can be processed without the possibility of being
+* rolled back. Events which are not safe are processed optimistically.
+*
+* @param evt A pointer to the event to check, can be @c NULL
+*
+* @return @c true if the event is below the safe horizon
+*/
+bool is_safe_event(msg_t *evt)
+{
+	return evt != NULL && evt->timestamp < safe_horizon;
+}
+
+
+/**
+* This function checks that an event scheduled by the current LP honours
+* the lookahead which the LP has declared.
+*
+* @param receiver The GID of the destination LP
+* @param timestamp The timestamp of the event being scheduled
+*/
+void check_lookahead(GID_t receiver, simtime_t timestamp)
+{
+	if (receiver.to_int == current->gid.to_int || current_evt->type == INIT)
+		return;
+
+	if (unlikely(timestamp < lvt(current) + current->lookahead)) {
+		rootsim_error(true, "LP %u is scheduling an event to %u at %f, which violates its lookahead %f (Current LVT = %f). Aborting...\n",
+			      current->gid.to_int, receiver.to_int, timestamp, current->lookahead, lvt(current));
+	}
+}
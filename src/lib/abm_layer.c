@@ -29,12 +29,18 @@
 
 #include <core/init.h>
 #include <scheduler/scheduler.h>
+#include <scheduler/process.h>
+#include <mm/mm.h>
 #include <lib/topology.h>
 #include <datatypes/array.h>
 #include <datatypes/hash_map.h>
 
 #define ACTION_START INIT
 
+#ifndef ABM_INCREMENTAL_GRANULARITY
+#define ABM_INCREMENTAL_GRANULARITY 50	// Number of incremental region checkpoints before a full one is forced
+#endif
+
 #define retrieve_agent(agent_id) ({ \
 	struct _agent_abm_t *__ret = hash_map_lookup(current->region->agents_table, agent_id); \
 	if(unlikely(!__ret)) \
@@ -56,20 +62,35 @@ struct _agent_abm_t {
 	simtime_t leave_time;
 	rootsim_array(struct _visit_abm_t) future;
 	rootsim_array(struct _visit_abm_t) past;
+	bool dirty;			//! The agent has changed since the last full checkpoint of its region
 };
 
 struct _region_abm_t {
 	rootsim_hash_map(struct _agent_abm_t) agents_table;
 	unsigned long long next_mark;
+	unsigned char *base_chkp;	//! The last full checkpoint (in a checkpoint, the full one it refers to, NULL if it is a full one)
+	unsigned inc_chkps;		//! The number of incremental checkpoints taken since base_chkp
 	unsigned published_data_offset;
 	unsigned char *tracked_data;
 	unsigned chkp_size;
+	bool update_pending;		//! The changes of the tracked data will be sent at the end of the current time window
 	struct _n_info_t{
 		unsigned data_offset;
 		unsigned int src_lp;
+		unsigned remote_slot;	//! The direction which leads back here from the neighbour, where it keeps our data
 	} neighbours_info[];
 };
 
+struct _update_evt{
+	unsigned slot;			// the direction of the receiver toward the sender
+	unsigned char data[];		// the whole neighbour data, or a sequence of changed runs
+};
+
+struct _update_run{
+	unsigned offset;
+	unsigned size;
+};
+
 struct _leave_evt{
 	unsigned long long key;
 	unsigned leave_code;
@@ -93,6 +114,38 @@ static unsigned agent_dump_size(const struct _agent_abm_t *agent) {
 }
 
 
+/**
+* Release the allocations of an agent.
+*
+* @param agent A pointer to the agent
+*/
+static void agent_release(struct _agent_abm_t *agent){
+	array_fini(agent->future);
+	if(abm_settings.keep_history)
+		array_fini(agent->past);
+	rsfree(agent->user_data);
+}
+
+/**
+* Make room for an agent in a region. An optimistic execution can bring in an
+* agent which is still there (for example a straggler visit, or a spawn which
+* gets back a key already taken before a rollback): in that case the old agent
+* is replaced, since a rollback will fix things up later.
+*
+* @param region A pointer to the region struct which hosts the agent
+* @param key The key of the agent
+* @return A pointer to the agent struct, whose fields must all be set
+*/
+static struct _agent_abm_t *agent_reserve(region_abm_t *region, unsigned long long key){
+	struct _agent_abm_t *agent = hash_map_lookup(region->agents_table, key);
+
+	if(unlikely(agent != NULL)){
+		agent_release(agent);
+		return agent;
+	}
+	return hash_map_reserve_elem(region->agents_table, key);
+}
+
 /**
 * Deserialize an agent from a buffer.
 *
@@ -104,8 +157,9 @@ static struct _agent_abm_t* agent_from_buffer(const unsigned char* event_content
 	// keep track of original pointer
 	const unsigned char *buffer = event_content;
 	// allocate the memory for the visiting agent
-	struct _agent_abm_t *agent = hash_map_reserve_elem(current->region->agents_table, *((const unsigned long long *)event_content));
+	struct _agent_abm_t *agent = agent_reserve(current->region, *((const unsigned long long *)event_content));
 	agent->leave_time = -1.0;
+	agent->dirty = true;
 	// copy uuid and user data size
 	memcpy(agent, buffer, sizeof(agent->user_data_size) + sizeof(agent->key));
 	buffer += sizeof(agent->user_data_size) + sizeof(agent->key);
@@ -113,10 +167,10 @@ static struct _agent_abm_t* agent_from_buffer(const unsigned char* event_content
 	agent->user_data = rsalloc(agent->user_data_size);
 	memcpy(agent->user_data, buffer, agent->user_data_size);
 	buffer += agent->user_data_size;
-	// load the arrays
+	// load the arrays, the past visits get room for the one on_abm_visit() is going to add
 	array_load(agent->future, buffer);
 	if(abm_settings.keep_history)
-		array_load(agent->past, buffer);
+		array_load_spare(agent->past, buffer, 1);
 	else
 		memset(&agent->past, 0, sizeof(agent->past));
 
@@ -151,66 +205,387 @@ static void agent_to_buffer(struct _agent_abm_t *agent, unsigned char* buffer){
 
 
 /**
-* Checkpoint the region state, saving it into a buffer.
-* This is periodically called by the checkpointing module to save the region state.
-* The returned buffer needs to be freed.
+* Compute the size in bytes of the allocations of an agent, as they are saved in
+* a region checkpoint: the future visits, the past ones and the user data.
+*
+* @param agent A pointer to the agent
+*/
+static size_t agent_allocations_size(const struct _agent_abm_t *agent){
+	return array_dump_size(agent->future) + abm_settings.keep_history * array_dump_size(agent->past) + agent->user_data_size;
+}
+
+/**
+* Save the allocations of an agent into a region checkpoint.
+*
+* @param agent A pointer to the agent
+* @param data A pointer to the checkpoint area to fill
+* @return A pointer to the first byte past the saved allocations
+*/
+static unsigned char *agent_allocations_dump(struct _agent_abm_t *agent, unsigned char *data){
+	array_dump(agent->future, data);
+	if(abm_settings.keep_history)
+		array_dump(agent->past, data);
+	memcpy(data, agent->user_data, agent->user_data_size);
+	return data + agent->user_data_size;
+}
+
+/**
+* Skip the allocations of an agent in a region checkpoint.
+* Counts are copied out of the buffer, since they are not necessarily aligned.
+*
+* @param header A copy of the checkpointed agent struct
+* @param data A pointer to the saved allocations of the agent
+* @return A pointer to the first byte past the saved allocations
+*/
+static unsigned char *agent_allocations_skip(const struct _agent_abm_t *header, unsigned char *data){
+	unsigned count;
+
+	memcpy(&count, data, sizeof(count));
+	data += sizeof(count) + count * sizeof(struct _visit_abm_t);
+	if(abm_settings.keep_history){
+		memcpy(&count, data, sizeof(count));
+		data += sizeof(count) + count * sizeof(struct _visit_abm_t);
+	}
+	return data + header->user_data_size;
+}
+
+/**
+* Instantiate an agent of a region out of a region checkpoint.
 *
-* @param region A pointer to the region struct to be checkpointed
-* @return A malloc'ed buffer holding all the region data
+* @param region A pointer to the region struct which hosts the agent
+* @param header A copy of the checkpointed agent struct
+* @param data A pointer to the saved allocations of the agent
+* @return A pointer to the first byte past the saved allocations
 */
-unsigned char * abm_do_checkpoint(region_abm_t *region){
-	// calculate dump size
-	size_t chkp_size_tot = region->chkp_size;
-	chkp_size_tot += hash_map_dump_size(region->agents_table);
+static unsigned char *agent_load(region_abm_t *region, const struct _agent_abm_t *header, unsigned char *data){
+	struct _agent_abm_t *agent = hash_map_reserve_elem(region->agents_table, header->key);
+
+	*agent = *header;
+	array_load(agent->future, data);
+	if(abm_settings.keep_history)
+		array_load(agent->past, data);
+	agent->user_data = rsalloc(agent->user_data_size);
+	memcpy(agent->user_data, data, agent->user_data_size);
+	return data + agent->user_data_size;
+}
+
+/**
+* Bring back a hosted agent to a checkpointed state, reusing its allocations.
+*
+* @param agent A pointer to the agent
+* @param header A copy of the checkpointed agent struct
+* @param data A pointer to the saved allocations of the agent
+* @return A pointer to the first byte past the saved allocations
+*/
+static unsigned char *agent_reload(struct _agent_abm_t *agent, const struct _agent_abm_t *header, unsigned char *data){
+	array_reload(agent->future, data);
+	if(abm_settings.keep_history)
+		array_reload(agent->past, data);
+	if(agent->user_data_size != header->user_data_size){
+		agent->user_data = rsrealloc(agent->user_data, header->user_data_size);
+		agent->user_data_size = header->user_data_size;
+	}
+	memcpy(agent->user_data, data, agent->user_data_size);
+	agent->leave_time = header->leave_time;
+	agent->dirty = header->dirty;
+	return data + agent->user_data_size;
+}
+
+/**
+* Locate the agents in a full region checkpoint.
+*
+* @param data A pointer to the full checkpoint
+* @param headers_p Set to point to the checkpointed agent structs
+* @param count_p Set to the number of checkpointed agents
+* @return A pointer to the allocations of the agents, which are saved in reverse order
+*/
+static unsigned char *full_checkpoint_agents(unsigned char *data, unsigned char **headers_p, unsigned *count_p){
+	data += ((region_abm_t *)data)->chkp_size;
+	// the agents array dump
+	memcpy(count_p, data, sizeof(*count_p));
+	data += sizeof(*count_p);
+	*headers_p = data;
+	data += *count_p * sizeof(struct _agent_abm_t);
+	// the hash table dump
+	hash_map_skip_table(data);
+	return data;
+}
+
+/**
+* Save the whole region state into a buffer taken from the checkpoint arena of the LP.
+*
+* @param lp A pointer to the lp_struct of the LP whose region is to be checkpointed
+* @param size The size in bytes of the checkpoint
+* @param rebase If true, the following incremental checkpoints refer to this one
+* @return A buffer holding all the region data
+*/
+static unsigned char *region_dump(struct lp_struct *lp, size_t size, bool rebase){
+	region_abm_t *region = lp->region;
 	struct _agent_abm_t *agent;
 	unsigned i = hash_map_count(region->agents_table);
+	unsigned char *ret = ckpt_alloc(lp, size), *chk = ret;
+
+	if(rebase){
+		region->base_chkp = chk;
+		region->inc_chkps = 0;
+		while(i--)
+			hash_map_items(region->agents_table)[i].dirty = false;
+		i = hash_map_count(region->agents_table);
+	}
+
+	memcpy(ret, region, region->chkp_size);
+	((region_abm_t *)ret)->base_chkp = NULL;
+	ret += region->chkp_size;
+	hash_map_dump(region->agents_table, ret);
 	while(i--){
 		agent = &hash_map_items(region->agents_table)[i];
-		chkp_size_tot += array_dump_size(agent->future);
-		if(abm_settings.keep_history)
-			chkp_size_tot += array_dump_size(agent->past);
-		chkp_size_tot += agent->user_data_size;
+		ret = agent_allocations_dump(agent, ret);
 	}
+	assert(chk + size == ret);
+	return chk;
+}
+
+/**
+* Checkpoint the region state, saving it into a buffer.
+* This is periodically called by the checkpointing module to save the region state.
+* The returned buffer is taken from the checkpoint arena of the LP and needs to be
+* released with ckpt_free().
+*
+* A full checkpoint holds the region struct, the agents hash map and the allocations
+* of every agent. An incremental one refers to the last full checkpoint and holds the
+* region struct, the keys of the hosted agents (in their current order) and the agents
+* which changed since the full checkpoint, each one followed by its allocations.
+* Changes pile up, so that an incremental checkpoint is restored along with its full
+* one only: a new full checkpoint is taken when the changes grow too much.
+*
+* @param lp A pointer to the lp_struct of the LP whose region is to be checkpointed
+* @return A buffer holding the region data
+*/
+unsigned char * abm_do_checkpoint(struct lp_struct *lp){
+	region_abm_t *region = lp->region;
+	struct _agent_abm_t *agent;
+	unsigned i, count = hash_map_count(region->agents_table), dirty_count = 0;
+	size_t full_size, inc_size, agent_size;
+	unsigned char *ret, *chk;
+
+	// calculate the size of both kinds of dump
+	full_size = region->chkp_size + hash_map_dump_size(region->agents_table);
+	inc_size = region->chkp_size + sizeof(count) + count * sizeof(agent->key) + sizeof(dirty_count);
+	for(i = 0; i < count; ++i){
+		agent = &hash_map_items(region->agents_table)[i];
+		agent_size = agent_allocations_size(agent);
+		full_size += agent_size;
+		if(agent->dirty){
+			inc_size += sizeof(*agent) + agent_size;
+			++dirty_count;
+		}
+	}
+
+	if(region->base_chkp == NULL || region->inc_chkps >= ABM_INCREMENTAL_GRANULARITY || 2 * inc_size > full_size)
+		return region_dump(lp, full_size, true);
+
+	++region->inc_chkps;
 	// allocate and populate the checkpoint
-	unsigned char *ret = rsalloc(chkp_size_tot), *chk = ret;
+	chk = ret = ckpt_alloc(lp, inc_size);
 	memcpy(ret, region, region->chkp_size);
 	ret += region->chkp_size;
-	hash_map_dump(region->agents_table, ret);
-	i = hash_map_count(region->agents_table);
-	while(i--){
+	memcpy(ret, &count, sizeof(count));
+	ret += sizeof(count);
+	for(i = 0; i < count; ++i){
+		memcpy(ret, &hash_map_items(region->agents_table)[i].key, sizeof(agent->key));
+		ret += sizeof(agent->key);
+	}
+	memcpy(ret, &dirty_count, sizeof(dirty_count));
+	ret += sizeof(dirty_count);
+	for(i = 0; i < count; ++i){
 		agent = &hash_map_items(region->agents_table)[i];
-		array_dump(agent->future, ret);
-		if(abm_settings.keep_history)
-			array_dump(agent->past, ret);
-		memcpy(ret, agent->user_data, agent->user_data_size);
-		ret += agent->user_data_size;
+		if(!agent->dirty)
+			continue;
+		memcpy(ret, agent, sizeof(*agent));
+		ret += sizeof(*agent);
+		ret = agent_allocations_dump(agent, ret);
 	}
-	assert(chk + chkp_size_tot == ret);
+	assert(chk + inc_size == ret);
 	return chk;
 }
 
+/**
+* Save the whole region state into a buffer, without affecting the following
+* checkpoints. This is used to migrate the LP hosting the region.
+* The returned buffer needs to be released with ckpt_free().
+*
+* @param lp A pointer to the lp_struct of the LP whose region is to be saved
+* @return A buffer holding all the region data
+*/
+unsigned char *abm_do_full_checkpoint(struct lp_struct *lp){
+	region_abm_t *region = lp->region;
+	size_t size = region->chkp_size + hash_map_dump_size(region->agents_table);
+	unsigned i = hash_map_count(region->agents_table);
+
+	while(i--)
+		size += agent_allocations_size(&hash_map_items(region->agents_table)[i]);
+	return region_dump(lp, size, false);
+}
+
+/**
+* Release the agents hosted in a region, together with all their allocations.
+*
+* @param region A pointer to the region struct whose agents must be released
+*/
+static void region_release_agents(region_abm_t *region){
+	unsigned i = hash_map_count(region->agents_table);
+	while(i--)
+		agent_release(&hash_map_items(region->agents_table)[i]);
+	hash_map_fini(region->agents_table);
+}
+
 /**
 * Restore a region struct from a previously checkpointed state.
+* The agents still hosted by the region are brought back in place: when the
+* checkpoint refers to the same full checkpoint as the region does, the ones
+* which didn't change since then are left untouched.
 *
-* @param data A pointer to the region struct to be checkpointed
-* @return A malloc'ed buffer holding all the region data
+* @param data A pointer to the checkpointed state
+* @param region A pointer to the region struct to restore
 */
 void abm_restore_checkpoint(unsigned char *data, region_abm_t *region){
-	struct _agent_abm_t *agent;
+	__typeof__(region->agents_table) agents_table = region->agents_table;
+	unsigned char *base = ((region_abm_t *)data)->base_chkp ? ((region_abm_t *)data)->base_chkp : data;
+	bool same_base = base == region->base_chkp;
+	struct _agent_abm_t header, *agent;
+	unsigned char *headers, *keys, *ptr;
+	unsigned i, count;
+	size_t stride;
 
 	assert(((region_abm_t *)data)->chkp_size == region->chkp_size);
-	// free the region allocations
-	unsigned i = hash_map_count(region->agents_table);
+	// copy the region back, the agents are kept
+	memcpy(region, data, region->chkp_size);
+	region->agents_table = agents_table;
+	region->base_chkp = base;
+
+	// the agents as they were in the full checkpoint
+	ptr = full_checkpoint_agents(base, &headers, &count);
+	i = count;
 	while(i--){
-		agent = &(hash_map_items(region->agents_table)[i]);
-		array_fini(agent->future);
-		if(abm_settings.keep_history)
-			array_fini(agent->past);
-		rsfree(agent->user_data);
+		memcpy(&header, headers + i * sizeof(header), sizeof(header));
+		agent = hash_map_lookup(region->agents_table, header.key);
+		if(!agent)
+			ptr = agent_load(region, &header, ptr);
+		else if(!same_base || agent->dirty)
+			ptr = agent_reload(agent, &header, ptr);
+		else
+			ptr = agent_allocations_skip(&header, ptr);
 	}
-	hash_map_fini(region->agents_table);
+	keys = headers;
+	stride = sizeof(header);
+
+	if(base != data){
+		// the agents which changed since then
+		ptr = data + region->chkp_size;
+		memcpy(&count, ptr, sizeof(count));
+		keys = ptr + sizeof(count);
+		stride = sizeof(header.key);
+		ptr = keys + count * stride;
+		memcpy(&i, ptr, sizeof(i));
+		ptr += sizeof(i);
+		while(i--){
+			memcpy(&header, ptr, sizeof(header));
+			ptr += sizeof(header);
+			agent = hash_map_lookup(region->agents_table, header.key);
+			ptr = agent ? agent_reload(agent, &header, ptr) : agent_load(region, &header, ptr);
+		}
+	}
+
+	// the agents get back their order, users can see it through IterAgents()
+	// (the key is the first field of the agent struct, so this works for both kinds of checkpoint)
+	for(i = 0; i < count; ++i){
+		memcpy(&header.key, keys + i * stride, sizeof(header.key));
+		agent = hash_map_lookup(region->agents_table, header.key);
+		assert(agent);
+		if(agent != &hash_map_items(region->agents_table)[i])
+			hash_map_swap_elems(region->agents_table, (unsigned)(agent - hash_map_items(region->agents_table)), i);
+	}
+	// now the agents which weren't in the region are all at the end
+	while(hash_map_count(region->agents_table) > count){
+		agent = &hash_map_items(region->agents_table)[hash_map_count(region->agents_table) - 1];
+		agent_release(agent);
+		hash_map_delete_elem(region->agents_table, agent);
+	}
+}
+
+/**
+* Compute the size in bytes of a region checkpoint produced by abm_do_checkpoint().
+* Fields are copied out of the buffer, since they are not necessarily aligned.
+*
+* @param data A pointer to the checkpointed state
+* @return The size in bytes of the checkpoint
+*/
+size_t abm_checkpoint_size(const unsigned char *data){
+	unsigned char *ptr, *headers;
+	struct _agent_abm_t header;
+	unsigned count;
+
+	if(((const region_abm_t *)data)->base_chkp == NULL){
+		ptr = full_checkpoint_agents((unsigned char *)data, &headers, &count);
+		// the per agent allocations, in the same order as region_dump()
+		while(count--){
+			memcpy(&header, headers + count * sizeof(header), sizeof(header));
+			ptr = agent_allocations_skip(&header, ptr);
+		}
+	}else{
+		ptr = (unsigned char *)data + ((const region_abm_t *)data)->chkp_size;
+		memcpy(&count, ptr, sizeof(count));
+		ptr += sizeof(count) + count * sizeof(header.key);
+		memcpy(&count, ptr, sizeof(count));
+		ptr += sizeof(count);
+		while(count--){
+			memcpy(&header, ptr, sizeof(header));
+			ptr = agent_allocations_skip(&header, ptr + sizeof(header));
+		}
+	}
+	return (size_t)(ptr - data);
+}
+
+/**
+* Tell whether a region checkpoint is a full one, as opposed to an incremental one.
+*
+* @param data A pointer to the checkpointed state
+* @return true if the checkpoint can be restored on its own
+*/
+bool abm_checkpoint_is_full(const unsigned char *data){
+	return ((const region_abm_t *)data)->base_chkp == NULL;
+}
+
+/**
+* Make an incremental region checkpoint refer to a relocated copy of its full checkpoint.
+* This is used when the LP hosting the region is migrated to this kernel, for checkpoints
+* taken in order: the last full one met is the one the following incremental ones refer to.
+*
+* @param data A pointer to the checkpointed state
+* @param base_p A pointer to the last full checkpoint met, updated if data is a full one
+*/
+void abm_checkpoint_relocate(unsigned char *data, unsigned char **base_p){
+	if(abm_checkpoint_is_full(data))
+		*base_p = data;
+	else
+		((region_abm_t *)data)->base_chkp = *base_p;
+}
+
+/**
+* Instantiate a new region struct from a previously checkpointed state.
+* This is used when the LP hosting the region is migrated to this kernel.
+*
+* @param data A pointer to a full checkpoint
+* @return A pointer to the newly allocated region struct
+*/
+region_abm_t *abm_region_from_checkpoint(unsigned char *data){
+	region_abm_t *region = rsalloc(((region_abm_t *)data)->chkp_size);
+	struct _agent_abm_t *agent;
+	unsigned i;
+
+	assert(abm_checkpoint_is_full(data));
 	// copy the region back
-	memcpy(region, data, region->chkp_size);
+	memcpy(region, data, ((region_abm_t *)data)->chkp_size);
 	data += region->chkp_size;
 	//load the other allocations
 	hash_map_load(region->agents_table, data);
@@ -224,6 +599,19 @@ void abm_restore_checkpoint(unsigned char *data, region_abm_t *region){
 		memcpy(agent->user_data, data, agent->user_data_size);
 		data += agent->user_data_size;
 	}
+	// the next checkpoint must be a full one
+	region->base_chkp = NULL;
+	return region;
+}
+
+/**
+* Release a region struct and all the agents it hosts.
+*
+* @param region A pointer to the region struct to release
+*/
+void abm_region_fini(region_abm_t *region){
+	region_release_agents(region);
+	rsfree(region);
 }
 
 
@@ -274,6 +662,8 @@ void abm_layer_init(void) {
 				data_offset += abm_settings.neighbour_data_size;
 				region->neighbours_info[i].data_offset = data_offset;
 			}
+			// so that our updates can be stored by the neighbour without looking us up
+			region->neighbours_info[i].remote_slot = reverse_direction(lp->gid.to_int, i);
 		}
 		// default
 		region->tracked_data = NULL;
@@ -326,7 +716,6 @@ static void on_abm_visit(void){
 static void on_abm_leave(void){
 	struct _visit_abm_t vis;
 	unsigned char* to_send;
-	unsigned buffer_size;
 	// we search for the agent who's leaving
 	assert(current_evt->size == sizeof(struct _leave_evt));
 	struct _agent_abm_t *agent = hash_map_lookup(current->region->agents_table, ((struct _leave_evt *)current_evt->event_content)->key);
@@ -380,6 +769,7 @@ static void on_abm_leave(void){
 	if(current->gid.to_int == next_hop) {
 		// if the next chosen destination is the very same region we are already in
 		// we simply call ProcessEvent() again
+		agent->dirty = true;
 		if(array_empty(agent->future) || array_peek(agent->future).region != current->gid.to_int){
 			vis.region = current->gid.to_int;
 			vis.action = abm_settings.traverse_handler;
@@ -398,60 +788,153 @@ static void on_abm_leave(void){
 		current->ProcessEvent(current->gid.to_int, current_evt->timestamp, vis.action, current_evt->event_content, sizeof(agent->key), current->current_base_pointer);
 		switch_to_platform_mode();
 	} else {
-		buffer_size = agent_dump_size(agent);
-
-		to_send = rsalloc(buffer_size);
-
-		agent_to_buffer(agent, to_send);
-		// finally we schedule the agent
-		UncheckedScheduleNewEvent(next_hop, current_evt->timestamp, ABM_VISITING, to_send, buffer_size);
+		// we serialize the agent straight into the payload of the outgoing event
+		to_send = UncheckedReserveEvent(next_hop, current_evt->timestamp, ABM_VISITING, agent_dump_size(agent));
+		if(to_send != NULL){
+			agent_to_buffer(agent, to_send);
+			// finally we schedule the agent
+			UncheckedCommitEvent(to_send);
+		}
 		// now we can get rid of it
 		KillAgent(agent->key);
-		// remember to free that stuff if we mallocated it!
-		rsfree(to_send);
 	}
 }
 
 /**
-* Handle an update receive. This updates the corresponding entry in the region struct, which will be used to
-* serve fresh neighbour data to the user.
+* Compute the runs of bytes which changed in the neighbour data and optionally write them in a buffer.
+* Close runs are merged, when the unchanged bytes in between are cheaper to send than a new run.
+*
+* @param old The neighbour data the receivers already know
+* @param new The current neighbour data
+* @param buffer The buffer to fill with the runs, NULL to just compute the size
+* @return the size of the runs, if no buffer is given the computation stops when it reaches the neighbour data size
 */
-static void receive_update(void){
-	//if(abm_settings.neighbour_data_size != current_evt->size)
-		//rootsim_error(true, "Misuse of ABM api, regions do not agree on neighbours info size! EXITING!");
+static unsigned update_diff(const unsigned char *old, const unsigned char *new, unsigned char *buffer){
+	const unsigned size = abm_settings.neighbour_data_size;
+	struct _update_run run;
+	unsigned i = 0, last, ret = 0;
+
+	while(1){
+		// look for the next changed byte
+		while(i < size && old[i] == new[i])
+			++i;
+		if(i == size || (!buffer && ret >= size))
+			break;
+		run.offset = last = i;
+		// extend the run until we find enough unchanged bytes
+		for(++i; i < size && i - last <= sizeof(run); ++i){
+			if(old[i] != new[i])
+				last = i;
+		}
+		run.size = last + 1 - run.offset;
+		if(buffer){
+			memcpy(buffer + ret, &run, sizeof(run));
+			memcpy(buffer + ret + sizeof(run), new + run.offset, run.size);
+		}
+		ret += sizeof(run) + run.size;
+	}
+	return ret;
+}
 
+/**
+* Send the changes of the tracked data to the neighbours.
+*/
+static void publish_changes(void){
 	region_abm_t *region = current->region;
+	unsigned char* published_data = ((unsigned char *)region) + region->published_data_offset;
+	const unsigned size = abm_settings.neighbour_data_size;
+	unsigned payload_size = size;
+	struct _update_evt *upd;
+
+	// the diffs need updates delivered in order, which only the time windows guarantee
+	if(abm_settings.update_diffs && abm_settings.update_granularity > 0)
+		payload_size = min(update_diff(published_data, region->tracked_data, NULL), size);
+
+	// let's propagate the changes to other regions too
 	unsigned i = DirectionsCount();
-	while(i--){// FIXME linear search, maybe sort them at init for log search or sort by direction for constant indexing
-		if(region->neighbours_info[i].src_lp == current_evt->sender.to_int){
-			memcpy(((unsigned char *)region) + region->neighbours_info[i].data_offset, current_evt->event_content, abm_settings.neighbour_data_size);
-			return;
-		}
+	while(i--){
+		if(region->neighbours_info[i].src_lp == DIRECTION_INVALID || region->neighbours_info[i].remote_slot == DIRECTION_INVALID)
+			continue;
+
+		upd = UncheckedReserveEvent(region->neighbours_info[i].src_lp, current_evt->timestamp, ABM_UPDATE, sizeof(*upd) + payload_size);
+		if(upd == NULL)
+			continue;
+
+		upd->slot = region->neighbours_info[i].remote_slot;
+		if(payload_size == size)
+			memcpy(upd->data, region->tracked_data, size);
+		else
+			update_diff(published_data, region->tracked_data, upd->data);
+		UncheckedCommitEvent(upd);
 	}
-	rootsim_error(true, "Misuse of ABM api, unable to find neighbours info's memory area! EXITING!");
+
+	// copy the new data into the tracked one
+	memcpy(published_data, region->tracked_data, size);
+}
+
+/**
+* Handle an update receive. This updates the corresponding entry in the region struct, which will be used to
+* serve fresh neighbour data to the user. An empty update is sent by a region to itself at the end of a time
+* window, in order to publish the changes which happened in it.
+*/
+static void receive_update(void){
+	region_abm_t *region = current->region;
+	const struct _update_evt *upd = (const struct _update_evt *)current_evt->event_content;
+	const unsigned char *runs, *runs_end;
+	struct _update_run run;
+	unsigned char *data;
+
+	if(!current_evt->size){
+		region->update_pending = false;
+		if(region->tracked_data && memcmp(((unsigned char *)region) + region->published_data_offset, region->tracked_data, abm_settings.neighbour_data_size))
+			publish_changes();
+		return;
+	}
+
+	if(unlikely(upd->slot >= DirectionsCount() || region->neighbours_info[upd->slot].data_offset == UINT_MAX))
+		rootsim_error(true, "Misuse of ABM api, unable to find neighbours info's memory area! EXITING!");
+
+	data = ((unsigned char *)region) + region->neighbours_info[upd->slot].data_offset;
+	runs = upd->data;
+	runs_end = (const unsigned char *)current_evt->event_content + current_evt->size;
+
+	// the whole data is sent when it isn't larger than the changes
+	if((unsigned)(runs_end - runs) == abm_settings.neighbour_data_size){
+		memcpy(data, runs, abm_settings.neighbour_data_size);
+		return;
+	}
+
+	while(runs < runs_end){
+		memcpy(&run, runs, sizeof(run));
+		runs += sizeof(run);
+		memcpy(data + run.offset, runs, run.size);
+		runs += run.size;
+	}
+	assert(runs == runs_end);
 }
 
 /**
 * Keep updated the neighbours of changes in the tracked data. This is called after each event and boradcasts eventual
-* changes to neighbours
+* changes to neighbours. With a time granularity, the changes are sent just once at the end of the current time
+* window, so that the ones which supersede each other are coalesced.
 */
 static void update_neighbours(void){
 	region_abm_t *region = current->region;
-	unsigned char* published_data = ((unsigned char *)region) + region->published_data_offset;
+	const simtime_t granularity = abm_settings.update_granularity;
+
 	// we check whether we need to update our neighbours about some changes in the tracked data
-	if(!region->tracked_data || !memcmp(published_data, region->tracked_data, abm_settings.neighbour_data_size))
+	if(!region->tracked_data || region->update_pending || !memcmp(((unsigned char *)region) + region->published_data_offset, region->tracked_data, abm_settings.neighbour_data_size))
 		return;
 
-	// copy the new data into the tracked one
-	memcpy(published_data, region->tracked_data, abm_settings.neighbour_data_size);
-
-	// let's propagate the changes to other regions too
-	unsigned i = DirectionsCount();
-	while(i--){
-		if(region->neighbours_info[i].src_lp != DIRECTION_INVALID){
-			UncheckedScheduleNewEvent(region->neighbours_info[i].src_lp, current_evt->timestamp, ABM_UPDATE, published_data, abm_settings.neighbour_data_size);
-		}
+	if(granularity <= 0){
+		publish_changes();
+		return;
 	}
+
+	// the window starts with the first change: aligning the windows across regions would make neighbours
+	// exchange updates with the very same timestamps, rolling back each other endlessly
+	UncheckedScheduleNewEvent(current->gid.to_int, current_evt->timestamp + granularity, ABM_UPDATE, NULL, 0);
+	region->update_pending = true;
 }
 
 /**
@@ -522,13 +1005,15 @@ agent_t SpawnAgent(unsigned user_data_size) {
 
 	unsigned long long new_key = get_agent_mark(current->region);
 	// new agent
-	struct _agent_abm_t *ret = hash_map_reserve_elem(current->region->agents_table, new_key);
+	struct _agent_abm_t *ret = agent_reserve(current->region, new_key);
 
 	array_init(ret->future);
 
 	ret->user_data_size = user_data_size;
 	ret->user_data = rsalloc(user_data_size);
 	ret->key = new_key;
+	ret->leave_time = -1.0;
+	ret->dirty = true;
 
 	// we register the visit to THIS region
 	if(abm_settings.keep_history){
@@ -546,17 +1031,15 @@ void KillAgent(agent_t agent_id) {
 	switch_to_platform_mode();
 	struct _agent_abm_t *agent = retrieve_agent(agent_id);
 
-	array_fini(agent->future);
-	if(abm_settings.keep_history)
-		array_fini(agent->past);
-	rsfree(agent->user_data);
-
+	agent_release(agent);
 	hash_map_delete_elem(current->region->agents_table, agent);
 	switch_to_application_mode();
 }
 
 void * DataAgent(agent_t agent_id, unsigned *data_size_p){
 	struct _agent_abm_t *agent = retrieve_agent(agent_id);
+	// the user data may be modified through the returned pointer
+	agent->dirty = true;
 	if(data_size_p)
 		*data_size_p = agent->user_data_size;
 	return agent->user_data;
@@ -569,6 +1052,7 @@ void ScheduleNewLeaveEvent(simtime_t time, unsigned int event_type, agent_t agen
 	// we mark the agent with the intended leave time so we can later compare it
 	// to check for spurious events
 	agent->leave_time = time;
+	agent->dirty = true;
 
 	struct _leave_evt leave_evt = {agent_id, event_type};
 
@@ -617,6 +1101,7 @@ void SetVisit(agent_t agent_id, unsigned region, unsigned event_type, unsigned i
 
 	array_items(agent->future)[i].region = region;
 	array_items(agent->future)[i].action = event_type;
+	agent->dirty = true;
 }
 
 void EnqueueVisit(agent_t agent_id, unsigned region, unsigned event_type){
@@ -627,6 +1112,7 @@ void EnqueueVisit(agent_t agent_id, unsigned region, unsigned event_type){
 
 	struct _visit_abm_t visit = {region, event_type, INFINITY};
 	array_push(agent->future, visit);
+	agent->dirty = true;
 }
 
 void AddVisit(agent_t agent_id, unsigned region, unsigned event_type, unsigned i){
@@ -641,6 +1127,7 @@ void AddVisit(agent_t agent_id, unsigned region, unsigned event_type, unsigned i
 		array_push(agent->future, visit);
 	else
 		array_add_at(agent->future, i, visit);
+	agent->dirty = true;
 }
 
 void RemoveVisit(agent_t agent_id, unsigned i) {
@@ -650,4 +1137,5 @@ void RemoveVisit(agent_t agent_id, unsigned i) {
 	}
 
 	array_remove_at(agent->future, i);
+	agent->dirty = true;
 }
@@ -8,11 +8,21 @@
 #ifndef ABM_LAYER_H_
 #define ABM_LAYER_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef struct _region_abm_t region_abm_t;
 
 void 	abm_layer_init	(void);
 void 	ProcessEventABM	(void);
-unsigned char * abm_do_checkpoint(region_abm_t *region);
+struct lp_struct;
+unsigned char * abm_do_checkpoint(struct lp_struct *lp);
+unsigned char *abm_do_full_checkpoint(struct lp_struct *lp);
 void abm_restore_checkpoint(unsigned char *data, region_abm_t *old_region);
+size_t abm_checkpoint_size(const unsigned char *data);
+bool abm_checkpoint_is_full(const unsigned char *data);
+void abm_checkpoint_relocate(unsigned char *data, unsigned char **base_p);
+region_abm_t *abm_region_from_checkpoint(unsigned char *data);
+void abm_region_fini(region_abm_t *region);
 
 #endif /* ABM_LAYER_H_ */
@@ -8,6 +8,8 @@
 #ifndef __TOPOLOGY_H_
 #define __TOPOLOGY_H_
 
+#include <stddef.h>
+
 #include <lib/jsmn_helper.h>
 #include <datatypes/bitmap.h>
 
@@ -19,14 +21,34 @@ extern struct _topology_global_t{
 	unsigned directions;			/**< the number of valid directions in the topology */
 	unsigned edge; 				/**< the pre-computed edge length (if it makes sense for the current topology geometry) */
 	unsigned lp_cnt; 			/**< the number of LPs involved in the topology */
+	unsigned edges_cnt;			/**< the number of edges, i.e. the size of the per edge data such as the cost matrix */
 	enum _topology_geometry_t geometry;	/**< the topology geometry (see ROOT-Sim.h) */
+	unsigned *graph_first;			/**< where the neighbours of each region start in graph_neighbours (NULL for a complete graph or other geometries) */
+	unsigned *graph_neighbours;		/**< the neighbours of the regions of a graph, in the order of their directions */
+	unsigned *incoming_first;		/**< where the edges entering each region start in incoming (NULL if they aren't computed) */
+	unsigned *incoming;			/**< the edges entering each region, as indexes (see edge_index()) */
+	unsigned *incoming_from;		/**< the region each edge in incoming comes from */
 } topology_global;
 
+struct lp_struct;
+
 // this initializes the topology environment
 void topology_init(void);
+void topology_relocate(topology_t *topology, ptrdiff_t delta);
+
+// these keep the topology state consistent with the one of the LPs
+void *	topology_do_checkpoint		(struct lp_struct *lp);
+void 	topology_restore_checkpoint	(struct lp_struct *lp, void *ckpt);
+void 	topology_rollback		(struct lp_struct *lp, simtime_t now);
+void 	topology_time_barrier		(struct lp_struct *lp, simtime_t barrier);
+void 	topology_fossil_collection	(void);
+bool 	topology_can_migrate		(void);
 
 //used internally (also in abm_layer module) to schedule our reserved events TODO: move in a more system-like module
 void UncheckedScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, unsigned int event_type, void *event_content, unsigned int event_size);
+// the same, in two steps, so that the payload can be built straight into the event
+void *UncheckedReserveEvent(unsigned int gid_receiver, simtime_t timestamp, unsigned int event_type, unsigned int event_size);
+void UncheckedCommitEvent(void *event_content);
 
 // if the model is using a topology this gets called instead of the plain ProcessEvent
 void ProcessEventTopology(void);
@@ -40,6 +62,10 @@ void *		load_topology_file_probabilities(c_jsmntok_t *root_token, const char *js
 void *		load_topology_file_costs	(c_jsmntok_t *root_token, const char *json_base);
 void *		load_topology_file_obstacles	(c_jsmntok_t *root_token, const char *json_base);
 
+void *		load_topology_binary_probabilities(const void *values);
+void *		load_topology_binary_costs	(const void *values);
+void *		load_topology_binary_obstacles	(const void *values);
+
 topology_t *	topology_probabilities_init	(unsigned this_region_id, void *topology_data);
 topology_t *	topology_costs_init		(unsigned this_region_id, void *topology_data);
 topology_t *	topology_obstacles_init		(unsigned this_region_id, void *topology_data);
@@ -69,8 +95,34 @@ double 		compute_min_tour_obstacles	(unsigned int source, unsigned int dest, uns
 unsigned int 	find_receiver_toward_costs	(unsigned int to);
 unsigned int 	find_receiver_toward_obstacles	(unsigned int to);
 
+void		relocate_topology_costs		(topology_t *topology, ptrdiff_t delta);
+void		relocate_topology_obstacles	(topology_t *topology, ptrdiff_t delta);
+
+void		cost_store_init			(const double *topology_data);
+void		rollback_topology_costs		(struct lp_struct *lp, simtime_t now);
+void		time_barrier_topology_costs	(struct lp_struct *lp, simtime_t barrier);
+void		fossil_collection_topology_costs(void);
+bool		can_migrate_topology_costs	(void);
+
 
 unsigned int 	get_raw_receiver		(unsigned int from, direction_t direction);
+unsigned int	edge_receiver			(unsigned int edge);
+unsigned int	reverse_direction		(unsigned int from, direction_t direction);
+
+// the number of directions of a region which may lead to a neighbour
+static inline unsigned region_degree(unsigned region){
+	if(topology_global.graph_first)
+		return topology_global.graph_first[region + 1] - topology_global.graph_first[region];
+	return topology_global.directions;
+}
+
+// the index of the edge leaving a region in the given direction among the per edge data
+static inline unsigned edge_index(unsigned from, unsigned direction){
+	if(topology_global.graph_first)
+		return topology_global.graph_first[from] + direction;
+	return from * topology_global.directions + direction;
+}
+
 // the dijkstra algorithm returns a spanning tree rooted at the source with information about the parent of
 // each node: this method is needed to build the complete path of a node given such an array of previous hops
 // it's here because it's needed by both COSTS and BINARY
@@ -0,0 +1,256 @@
+/*
+ * convert.c
+ *
+ *  The rootsim-topology tool: it converts a JSON topology file into the binary format
+ *  (see format.h), which the simulator maps in memory instead of parsing it at each run.
+ */
+
+#include <ROOT-Sim.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <lib/jsmn.h>
+#include <lib/topology/format.h>
+
+/// the JSON document being converted
+static struct {
+	char *base;		/// the text of the document
+	jsmntok_t *tokens;	/// the tokens of the document
+	int tokens_cnt;		/// the number of tokens
+} json;
+
+static void fail(const char *msg, ...) {
+	va_list args;
+
+	va_start(args, msg);
+	fprintf(stderr, "rootsim-topology: ");
+	vfprintf(stderr, msg, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	exit(EXIT_FAILURE);
+}
+
+static void load_json(const char *file_name){
+	FILE *f;
+	long len;
+	jsmn_parser parser;
+
+	if((f = fopen(file_name, "r")) == NULL || fseek(f, 0L, SEEK_END) || (len = ftell(f)) < 0 || fseek(f, 0L, SEEK_SET))
+		fail("unable to read \"%s\"", file_name);
+
+	json.base = malloc(len + 1);
+	if(json.base == NULL || (len && fread(json.base, len, 1, f) != 1))
+		fail("unable to read \"%s\"", file_name);
+	json.base[len] = '\0';
+	fclose(f);
+
+	jsmn_init(&parser);
+	json.tokens_cnt = jsmn_parse(&parser, json.base, len, NULL, 0);
+	if(json.tokens_cnt <= 0)
+		fail("\"%s\" is not a properly formed JSON file", file_name);
+	json.tokens = malloc(sizeof(jsmntok_t) * json.tokens_cnt);
+	if(json.tokens == NULL)
+		fail("out of memory");
+	jsmn_init(&parser);
+	if(jsmn_parse(&parser, json.base, len, json.tokens, json.tokens_cnt) != json.tokens_cnt || json.tokens[0].type != JSMN_OBJECT)
+		fail("\"%s\" is not a properly formed JSON file", file_name);
+}
+
+// the token following the whole subtree of the given one
+static int skip_token(int i){
+	int j = i + 1;
+
+	while(j < json.tokens_cnt && json.tokens[j].start < json.tokens[i].end)
+		++j;
+	return j;
+}
+
+static bool token_is(int i, const char *str){
+	const jsmntok_t *t = &json.tokens[i];
+	size_t len = t->end - t->start;
+
+	return t->type == JSMN_STRING && strlen(str) == len && !strncmp(&json.base[t->start], str, len);
+}
+
+// the value associated with a key of the root object, -1 if the key is missing
+static int value_by_key(const char *key){
+	int i = 1, k;
+
+	for(k = 0; k < json.tokens[0].size; ++k){
+		if(token_is(i, key))
+			return i + 1;
+		i = skip_token(i + 1);
+	}
+	return -1;
+}
+
+static double parse_number(int i){
+	char buff[64], *check;
+	double ret;
+	const jsmntok_t *t = &json.tokens[i];
+	size_t size = t->end - t->start;
+
+	if(t->type != JSMN_PRIMITIVE)
+		fail("expected a number at offset %d", t->start);
+
+	size = size < sizeof(buff) - 1 ? size : sizeof(buff) - 1;
+	memcpy(buff, &json.base[t->start], size);
+	buff[size] = '\0';
+	ret = strtod(buff, &check);
+	if(check == buff)
+		fail("expected a number at offset %d", t->start);
+	return ret;
+}
+
+static uint32_t parse_unsigned(int i){
+	double value = parse_number(i);
+
+	if(value < 0 || value > UINT32_MAX || value > (uint32_t)value || value < (uint32_t)value)
+		fail("expected an unsigned integer at offset %d", json.tokens[i].start);
+	return (uint32_t)value;
+}
+
+static unsigned parse_choice(const char *key, unsigned cnt, const char *choices[cnt]){
+	int i = value_by_key(key);
+	unsigned c;
+
+	for(c = 0; i >= 0 && c < cnt; ++c){
+		if(choices[c] && token_is(i, choices[c]))
+			return c;
+	}
+	fail("invalid or missing value with key \"%s\"", key);
+	return UINT_MAX;
+}
+
+// check that a token is an array with the given count of elements and return its first element
+static int array_start(int i, unsigned expected, const char *what){
+	if(i < 0 || json.tokens[i].type != JSMN_ARRAY || (unsigned)json.tokens[i].size != expected)
+		fail("invalid or missing %s", what);
+	return i + 1;
+}
+
+static void write_data(FILE *f, const void *data, size_t size){
+	if(fwrite(data, 1, size, f) != size)
+		fail("unable to write the output file");
+}
+
+// keep the next section aligned, given the size of the current one
+static void write_padding(FILE *f, size_t size){
+	static const char padding[8];
+
+	write_data(f, padding, topology_file_align(size) - size);
+}
+
+int main(int argc, char **argv){
+	struct topology_file_header header = {TOPOLOGY_FILE_MAGIC, 0, 0, 0, 0, 0};
+	uint32_t *first = NULL, *neighbours = NULL, regions, i, j, row_len = 0;
+	void *values;
+	double value;
+	FILE *f;
+	int t, row;
+
+	const char *type_choices[] = {
+			[TOPOLOGY_COSTS] = 	"costs",
+			[TOPOLOGY_OBSTACLES] = 	"obstacles",
+			[TOPOLOGY_PROBABILITIES] = "probabilities"
+	};
+	const char *geometry_choices[] = {
+			[TOPOLOGY_HEXAGON - TOPOLOGY_GEOMETRY_OFFSET] = "hexagons",
+			[TOPOLOGY_SQUARE - TOPOLOGY_GEOMETRY_OFFSET] = 	"squares",
+			[TOPOLOGY_GRAPH - TOPOLOGY_GEOMETRY_OFFSET] = 	"graph",
+			[TOPOLOGY_STAR - TOPOLOGY_GEOMETRY_OFFSET] = 	"star",
+			[TOPOLOGY_RING - TOPOLOGY_GEOMETRY_OFFSET] = 	"ring",
+			[TOPOLOGY_BIDRING - TOPOLOGY_GEOMETRY_OFFSET] = "bidring",
+			[TOPOLOGY_TORUS - TOPOLOGY_GEOMETRY_OFFSET] = 	"torus"
+	};
+
+	if(argc != 3){
+		fprintf(stderr, "Usage: %s <topology.json> <output file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	load_json(argv[1]);
+
+	if((t = value_by_key("regions_count")) < 0)
+		fail("missing value with key \"regions_count\"");
+	header.regions_count = regions = parse_unsigned(t);
+	if(!regions)
+		fail("a topology needs at least one region");
+	header.type = parse_choice("type", sizeof(type_choices) / sizeof(*type_choices), type_choices);
+	header.geometry = parse_choice("geometry", sizeof(geometry_choices) / sizeof(*geometry_choices), geometry_choices) + TOPOLOGY_GEOMETRY_OFFSET;
+
+	// the lists of neighbours of a graph are turned in CSR form
+	if((t = value_by_key("neighbours")) >= 0){
+		if(header.geometry != TOPOLOGY_GRAPH)
+			fail("the key \"neighbours\" is supported only by the graph geometry");
+		first = malloc(sizeof(uint32_t) * (regions + 1));
+		row = array_start(t, regions, "lists of neighbours");
+		first[0] = 0;
+		for(i = 0; i < regions; ++i, row = skip_token(row)){
+			if(json.tokens[row].type != JSMN_ARRAY)
+				fail("invalid list of neighbours for region %u", i);
+			first[i + 1] = first[i] + json.tokens[row].size;
+		}
+		header.edges_count = first[regions];
+		neighbours = malloc(sizeof(uint32_t) * header.edges_count);
+		row = t + 1;
+		for(i = 0; i < regions; ++i, row = skip_token(row)){
+			for(j = first[i]; j < first[i + 1]; ++j){
+				neighbours[j] = parse_unsigned(row + 1 + j - first[i]);
+				if(neighbours[j] >= regions)
+					fail("invalid neighbour %u of region %u", neighbours[j], i);
+			}
+		}
+	}
+
+	// the values are flattened in the layout the simulator uses
+	row = array_start(value_by_key("values"), regions, "value with key \"values\"");
+	if(header.type == TOPOLOGY_OBSTACLES){
+		values = malloc(regions);
+		for(i = 0; i < regions; ++i, row = skip_token(row)){
+			value = parse_number(row);
+			// we interpret ones as obstacles, we use the double comparison to avoid warnings
+			((uint8_t *)values)[i] = value >= 1.0 && value <= 1.0;
+		}
+		header.values_count = regions;
+	}else{
+		// without the lists of neighbours every row must have the same length
+		if(!first)
+			row_len = json.tokens[row].size;
+		values = malloc(sizeof(double) * ((size_t)regions * row_len + header.edges_count + regions));
+		for(i = 0; i < regions; ++i, row = skip_token(row)){
+			// rows of probabilities start with the weight of the self loop
+			if(first)
+				row_len = first[i + 1] - first[i] + (header.type == TOPOLOGY_PROBABILITIES);
+			t = array_start(row, row_len, "array of values for a region");
+			for(j = 0; j < row_len; ++j, t = skip_token(t)){
+				value = parse_number(t);
+				if(value < 0){
+					if(header.type == TOPOLOGY_PROBABILITIES || value > -1.0 || value < -1.0)
+						fail("negative value found for region %u", i);
+					// this way we can mark an edge as non crossable
+					value = INFINITY;
+				}
+				((double *)values)[header.values_count++] = value;
+			}
+		}
+	}
+
+	if((f = fopen(argv[2], "w")) == NULL)
+		fail("unable to open \"%s\"", argv[2]);
+	write_data(f, &header, sizeof(header));
+	write_padding(f, sizeof(header));
+	if(first){
+		// the offsets and the neighbours make up a single section
+		write_data(f, first, sizeof(uint32_t) * (regions + 1));
+		write_data(f, neighbours, sizeof(uint32_t) * header.edges_count);
+		write_padding(f, sizeof(uint32_t) * ((size_t)regions + 1 + header.edges_count));
+	}
+	write_data(f, values, header.values_count * (header.type == TOPOLOGY_OBSTACLES ? sizeof(uint8_t) : sizeof(double)));
+	if(fclose(f))
+		fail("unable to write the output file");
+
+	return EXIT_SUCCESS;
+}
@@ -11,6 +11,9 @@
 #include <math.h>
 #include <stdint.h>
 
+#include <arch/atomic.h>
+#include <core/core.h>
+#include <core/init.h>
 #include <scheduler/scheduler.h>
 #include <lib/jsmn_helper.h>
 #include <lib/numerical.h>
@@ -19,16 +22,91 @@
 #include <datatypes/heap.h>
 #include <scheduler/process.h>
 
+/*
+ * The cost matrix is not replicated in each LP: every kernel keeps a single
+ * copy of it, shared by all the LPs it hosts. When the topology is writable,
+ * an update is kept as a new version of the edge cost tagged with the
+ * simulation time of the update, so that each LP reads the costs valid at its
+ * own LVT. Versions are discarded when the LP which installed them rolls
+ * back, and are folded into the matrix once they fall behind the GVT.
+ *
+ * LPs record the highest simulation time at which they have read the costs.
+ * When a version is installed or discarded, the LPs which read the costs at
+ * a later time are sent an empty TOPOLOGY_UPDATE event at the time of the
+ * version, which rolls them back if needed. Updates are conveyed to the other
+ * kernels by a single TOPOLOGY_UPDATE event, received by an anchor LP which
+ * installs the version in the copy of its kernel.
+ *
+ * Each LP caches the shortest path tree rooted in its region. Since every
+ * version bumps the generation of the store, a few changed edges would
+ * otherwise require the whole tree to be computed again: the store rather
+ * logs the edges changed by the latest generations, and the tree is updated
+ * in place from them in the fashion of Ramalingam and Reps (as done by LPA*).
+ * Ties among paths with the same cost are broken in the same way whichever
+ * way the tree is computed, since LPs refresh their trees at different times
+ * in different runs.
+ */
+
+/// the number of generations whose changed edge is kept in the log of the store
+#define COST_CHANGES_LOG	1024U
+
+/// the number of shortest path trees rooted in regions other than the reader's which are kept for later use
+#define COST_PATHS_MEMO		4U
+
+/// a shortest path tree, along with the view of the costs it reflects
+struct path_tree {
+	bool dirty;			/// true if the tree must be computed from scratch
+	bool incremental;		/// false if zero cost hops prevent updating the tree in place
+	unsigned long generation;	/// the generation of the store when the tree was computed
+	simtime_t computed_at;		/// the simulation time at which the tree was computed
+};
+
+/// a shortest path tree rooted in any region, shared by the LPs of the kernel
+struct path_memo {
+	unsigned source;		/// the root of the tree
+	struct path_tree tree;
+	struct _sum_helper_t *costs;	/// the cost of the shortest path to each region
+	unsigned *previous;		/// the previous hop of the shortest path to each region
+};
+
+/// a version of the cost of an edge
+struct cost_version {
+	simtime_t timestamp;		/// the simulation time from which the cost is valid
+	double value;			/// the cost of the edge
+	unsigned loc;			/// the index of the edge in the cost matrix
+	struct lp_struct *owner;	/// the LP which installed this version
+	struct cost_version *older;	/// the previous version of the same edge
+	struct cost_version *owner_prev, *owner_next; /// the other versions installed by the same LP, in timestamp order
+};
+
+/// the per-kernel store of the costs
+static struct {
+	double *costs;			/// the costs valid at the GVT
+	struct cost_version **versions;	/// the newest version of each edge, if any
+	rootsim_bitmap *pending;	/// the edges which have versions
+	unsigned *anchors;		/// the LP of each kernel receiving remote updates
+	unsigned long generation;	/// increased whenever a version is installed or discarded
+	simtime_t newest;		/// the highest timestamp of the versions ever installed
+	unsigned *changes;		/// the edge changed by each of the latest generations
+	bool shared;			/// whether versions are used (and the store must be locked)
+	spinlock_t lock;
+	struct path_memo memo[COST_PATHS_MEMO]; /// the trees computed for the latest sources other than the readers
+	unsigned memo_next;		/// the next entry of the memo to be replaced
+	spinlock_t memo_lock;
+} store;
+
 typedef struct _topology_t {
-	bool dirty;
+	struct path_tree paths;		/// the state of the cache of the paths from the region of this LP
+	simtime_t last_read;		/// the highest simulation time at which this LP has read the costs
+	simtime_t barrier;		/// the time of the oldest checkpoint of this LP
+	struct cost_version *owned_first, *owned_last; /// the versions installed by this LP
 	unsigned *prev_next_cache; 	/// a pointer to the cache used to speedup queries on paths (unused in probabilities topology type)
-	double data[]; 			/// the costs, probabilities or obstacles matrix (depending on the topology type)
+	struct _sum_helper_t data[]; 	/// the cache of total path costs
 } topology_t;
 
 unsigned size_checkpoint_costs(void){
 	return	sizeof(topology_t) + 							// the basic struct size
-		sizeof(double) * topology_global.directions * topology_global.lp_cnt + 	// the whole cost matrix
-		sizeof(double) * topology_global.lp_cnt + 				// the cache of total path costs to speed up queries
+		sizeof(struct _sum_helper_t) * topology_global.lp_cnt + 		// the cache of total path costs to speed up queries
 		sizeof(unsigned) * 2 * topology_global.lp_cnt; 				// the cache of previous and next hops to speed up queries
 }
 
@@ -36,7 +114,7 @@ void *load_topology_file_costs(c_jsmntok_t *root_token, const char *json_base){
 	unsigned i;
 	c_jsmntok_t *aux_tok;
 	const unsigned lp_cnt = topology_global.lp_cnt;
-	const unsigned neighbours_cnt = topology_global.directions;
+	struct _gnt_closure_t closure = GNT_CLOSURE_INITIALIZER;
 
 	// retrieve the values array
 	c_jsmntok_t *values_tok = get_value_token_by_key(root_token, json_base, root_token, "values");
@@ -44,15 +122,15 @@ void *load_topology_file_costs(c_jsmntok_t *root_token, const char *json_base){
 		rootsim_error(false, "Invalid or missing json value with key \"values\"");
 
 	// instantiates the array
-	double *ret_data = rsalloc(sizeof(double) * neighbours_cnt * lp_cnt);
+	double *ret_data = rsalloc(sizeof(double) * topology_global.edges_cnt);
 
 	// we iterate and store the costs of going into a neighbour
 	for (i = 0; i < lp_cnt; ++i) {
 		// get the token of the lp we are scanning
-		aux_tok = get_at_token(root_token, values_tok, i);
+		aux_tok = get_next_token(root_token, values_tok, &closure);
 
 		// we parse the array
-		if(!aux_tok || parse_double_array(root_token, json_base, aux_tok, neighbours_cnt, &ret_data[i * neighbours_cnt]) < 0)
+		if(!aux_tok || parse_double_array(root_token, json_base, aux_tok, region_degree(i), &ret_data[edge_index(i, 0)]) < 0)
 			rootsim_error(false, "Invalid or missing value in the current array of costs");
 	}
 
@@ -60,7 +138,7 @@ void *load_topology_file_costs(c_jsmntok_t *root_token, const char *json_base){
 	// XXX could negative costs be useful to someone?
 	// they would require non-minimal work to implement
 	// Bellman-Ford would be required
-	for (i = 0; i < neighbours_cnt * lp_cnt; ++i) {
+	for (i = 0; i < topology_global.edges_cnt; ++i) {
 		if(ret_data[i] < 0) {
 			// xxx if negative costs need to be implemented we can't do this
 			if(ret_data[i] > -1.0 || ret_data[i] < -1.0)
@@ -72,158 +150,627 @@ void *load_topology_file_costs(c_jsmntok_t *root_token, const char *json_base){
 	return ret_data;
 }
 
+void *load_topology_binary_costs(const void *values){
+	const double *costs = values;
+	unsigned i;
+
+	// non crossable edges are already infinite here
+	for (i = 0; i < topology_global.edges_cnt; ++i) {
+		if(!(costs[i] >= 0))
+			rootsim_error(true, "Negative costs are still not supported");
+	}
+	// the store makes its own copy
+	return (void *)values;
+}
+
+
+void cost_store_init(const double *topology_data){
+	unsigned i;
+	const unsigned entries = topology_global.edges_cnt;
+	GID_t gid;
+
+	store.costs = rsalloc(sizeof(double) * entries);
+	if(topology_data)
+		memcpy(store.costs, topology_data, sizeof(double) * entries);
+	else{
+		for(i = 0; i < entries; ++i)
+			store.costs[i] = 1.0;
+	}
+
+	store.shared = topology_settings.write_enabled && !rootsim_config.serial;
+	store.newest = -INFINITY;
+	spinlock_init(&store.lock);
+
+	spinlock_init(&store.memo_lock);
+	for(i = 0; i < COST_PATHS_MEMO; ++i){
+		store.memo[i].source = UINT_MAX;
+		store.memo[i].costs = rsalloc(sizeof(struct _sum_helper_t) * topology_global.lp_cnt);
+		store.memo[i].previous = rsalloc(sizeof(unsigned) * topology_global.lp_cnt);
+	}
+
+	if(!topology_settings.write_enabled)
+		return;
+
+	store.changes = rsalloc(sizeof(unsigned) * COST_CHANGES_LOG);
+	if(!store.shared)
+		return;
+
+	store.versions = rsalloc(sizeof(struct cost_version *) * entries);
+	memset(store.versions, 0, sizeof(struct cost_version *) * entries);
+	store.pending = rsalloc(bitmap_required_size(entries));
+	bitmap_initialize(store.pending, entries);
+
+	// the anchor of a kernel is the first LP it hosts (LPs are not migrated with a writable cost topology)
+	store.anchors = rsalloc(sizeof(unsigned) * n_ker);
+	for(i = 0; i < n_ker; ++i)
+		store.anchors[i] = UINT_MAX;
+	i = n_prc_tot;
+	while(i--){
+		set_gid(gid, i);
+		store.anchors[find_kernel_by_gid(gid)] = i;
+	}
+}
+
+bool can_migrate_topology_costs(void){
+	return !store.shared;
+}
+
+void relocate_topology_costs(topology_t *topology, ptrdiff_t delta){
+	// the cache lives in the same memory block as the struct
+	topology->prev_next_cache = (unsigned *)(((char *)topology->prev_next_cache) + delta);
+}
 
 topology_t *topology_costs_init(unsigned this_region_id, void *topology_data){
 	(void) this_region_id;
-	unsigned i;
-	const unsigned lp_cnt = topology_global.lp_cnt;
-	const unsigned neighbours = topology_global.directions;
+	(void) topology_data;
 
 	// instantiate the topology struct
 	topology_t *topology = rsalloc(topology_global.chkp_size);
 
 	// from now on we expect a topology based on cost to reside in a unique memory block and to have this layout in memory:
-	// BASE_STRUCT | COST MATRIX | CACHE MINIMUM COSTS | CACHE PREVIOUS HOP | CACHE NEXT HOP
-	topology->prev_next_cache = UNION_CAST(&topology->data[(neighbours + 1) * lp_cnt], unsigned *);
+	// BASE_STRUCT | CACHE MINIMUM COSTS | CACHE PREVIOUS HOP | CACHE NEXT HOP
+	topology->prev_next_cache = UNION_CAST(&topology->data[topology_global.lp_cnt], unsigned *);
 
-	if(topology_data)
-		memcpy(topology->data, topology_data, sizeof(double) * neighbours * lp_cnt);
-	else{
-		for(i = 0; i < neighbours * lp_cnt; ++i)
-			topology->data[i] = 1.0;
-	}
-	topology->dirty = true;
+	topology->paths.dirty = true;
+	topology->last_read = -INFINITY;
+	topology->barrier = -INFINITY;
+	topology->owned_first = topology->owned_last = NULL;
 
 	return topology;
 }
 
+// the cost of an edge at a given simulation time, the store must be locked if shared
+static inline double cost_at(unsigned loc, simtime_t now){
+	const struct cost_version *version;
+
+	if(!store.shared || !bitmap_check(store.pending, loc))
+		return store.costs[loc];
+
+	// versions are sorted by decreasing timestamp
+	for(version = store.versions[loc]; version != NULL; version = version->older){
+		if(version->timestamp <= now)
+			return version->value;
+	}
+	return store.costs[loc];
+}
+
+// record the edge changed by a new generation of the store, which must be locked if shared
+static inline void log_change(unsigned loc){
+	store.generation++;
+	store.changes[store.generation % COST_CHANGES_LOG] = loc;
+}
+
+// the bound is not moved forward during silent execution, so the LVT can't tell when a read or a write happens
+static inline simtime_t event_time(void){
+	return current_evt->timestamp;
+}
+
+// the current LP is about to read the costs: this must be paired with read_end()
+static inline void read_begin(topology_t *topology){
+	if(!store.shared)
+		return;
+
+	spin_lock(&store.lock);
+	if(event_time() > topology->last_read)
+		topology->last_read = event_time();
+}
+
+static inline void read_end(void){
+	if(store.shared)
+		spin_unlock(&store.lock);
+}
+
+// roll back the LPs of this kernel which read the costs after a version at time now was installed or discarded
+static void notify_readers(const struct lp_struct *writer, simtime_t now){
+	unsigned i;
+	struct lp_struct *lp;
+
+	for(i = 0; i < n_prc; ++i){
+		lp = lps_blocks[i];
+		if(lp != writer && lp->topology != NULL && lp->topology->last_read > now)
+			UncheckedScheduleNewEvent(lp->gid.to_int, now, TOPOLOGY_UPDATE, NULL, 0);
+	}
+}
+
+// the store must be locked
+static void install_version(struct lp_struct *owner, unsigned loc, double value, simtime_t now){
+	topology_t *topology = owner->topology;
+	struct cost_version *version, **link;
+
+	version = rsalloc(sizeof(*version));
+	version->timestamp = now;
+	version->value = value;
+	version->loc = loc;
+	version->owner = owner;
+
+	// the newest among versions with the same timestamp is the one which was installed last
+	link = &store.versions[loc];
+	while(*link != NULL && (*link)->timestamp > now)
+		link = &(*link)->older;
+	version->older = *link;
+	*link = version;
+	bitmap_set(store.pending, loc);
+
+	// an LP installs versions in timestamp order
+	version->owner_next = NULL;
+	version->owner_prev = topology->owned_last;
+	if(topology->owned_last != NULL)
+		topology->owned_last->owner_next = version;
+	else
+		topology->owned_first = version;
+	topology->owned_last = version;
+
+	if(now > store.newest)
+		store.newest = now;
+	log_change(loc);
+	notify_readers(owner, now);
+}
+
+// the store must be locked
+static void discard_version(struct cost_version *version){
+	topology_t *topology = version->owner->topology;
+	struct cost_version **link;
+
+	link = &store.versions[version->loc];
+	while(*link != version)
+		link = &(*link)->older;
+	*link = version->older;
+	if(store.versions[version->loc] == NULL)
+		bitmap_reset(store.pending, version->loc);
+
+	if(version->owner_prev != NULL)
+		version->owner_prev->owner_next = version->owner_next;
+	else
+		topology->owned_first = version->owner_next;
+	if(version->owner_next != NULL)
+		version->owner_next->owner_prev = version->owner_prev;
+	else
+		topology->owned_last = version->owner_prev;
+
+	rsfree(version);
+}
+
+/**
+ * Discard the versions installed by an LP after the time it is rolled back to,
+ * and roll back the LPs which might have read them. This is called at the end
+ * of the rollback, so that the notifications are sent along with the antimessages.
+ *
+ * @param lp the LP being rolled back
+ * @param now the timestamp of the last event which is not undone
+ */
+void rollback_topology_costs(struct lp_struct *lp, simtime_t now){
+	topology_t *topology = lp->topology;
+	struct lp_struct *saved_current = current;
+	simtime_t oldest = INFINITY;
+
+	if(!store.shared)
+		return;
+
+	spin_lock(&store.lock);
+	while(topology->owned_last != NULL && topology->owned_last->timestamp > now){
+		oldest = topology->owned_last->timestamp;
+		log_change(topology->owned_last->loc);
+		discard_version(topology->owned_last);
+	}
+
+	if(oldest < INFINITY){
+		current = lp;
+		notify_readers(lp, oldest);
+		current = saved_current;
+	}
+
+	if(topology->last_read > now)
+		topology->last_read = now;
+	spin_unlock(&store.lock);
+}
+
+/**
+ * Record the time barrier of an LP, namely the time of the oldest checkpoint
+ * it can still be restored to. Silent execution can read the costs back to it.
+ *
+ * @param lp the LP
+ * @param barrier the simulation time of the time barrier of the LP
+ */
+void time_barrier_topology_costs(struct lp_struct *lp, simtime_t barrier){
+	lp->topology->barrier = barrier;
+}
+
+/**
+ * Fold into the cost matrix the versions which cannot be read anymore, i.e.
+ * the ones older than the time barrier of every LP of this kernel. Every
+ * worker thread calls this after a new GVT is adopted, the ones coming later
+ * have little left to do.
+ */
+void fossil_collection_topology_costs(void){
+	unsigned i, loc;
+	struct cost_version *version, **link;
+	const unsigned entries = topology_global.edges_cnt;
+	simtime_t oldest = INFINITY;
+
+	if(!store.shared)
+		return;
+
+	// barriers are written by the threads running the LPs, stale values are just older
+	for(i = 0; i < n_prc; ++i){
+		if(lps_blocks[i]->topology != NULL && lps_blocks[i]->topology->barrier < oldest)
+			oldest = lps_blocks[i]->topology->barrier;
+	}
+
+	// store.newest is left alone and the folded edges are logged as changed:
+	// caches computed before the folded versions must still be refreshed
+	spin_lock(&store.lock);
+
+#define fold_versions(i) ({\
+		loc = (i);\
+		link = &store.versions[loc];\
+		while(*link != NULL && (*link)->timestamp >= oldest)\
+			link = &(*link)->older;\
+		if(*link != NULL){\
+			store.costs[loc] = (*link)->value;\
+			log_change(loc);\
+			while((version = *link) != NULL)\
+				discard_version(version);\
+		}})
+
+	bitmap_foreach_set(store.pending, bitmap_required_size(entries), fold_versions);
+
+#undef fold_versions
+
+	spin_unlock(&store.lock);
+}
+
+// a total order on path costs: paths with the same cost are told apart by the rounding error of their sums
+static inline int cmp_path_costs(struct _sum_helper_t a, struct _sum_helper_t b){
+	int ret = CmpSumHelpers(a, b);
+	if(!ret)
+		ret = (a.sum > b.sum) - (b.sum > a.sum);
+	if(!ret)
+		ret = (a.crt > b.crt) - (b.crt > a.crt);
+	return ret;
+}
+
+// helper structure, we use this as heap elements to keep track of vertexes status during path computations
+struct _path_h_t{
+	struct _sum_helper_t cost;
+	unsigned cell;
+};
+
+typedef rootsim_heap(struct _path_h_t) path_heap_t;
+
 // this is used in order to sort the elements of the heap
-#define __cmp_dijkstra_h(a, b) CmpSumHelpers(a.cost, b.cost)
+#define __cmp_path_h(a, b) ({\
+		int __r = cmp_path_costs((a).cost, (b).cost);\
+		__r ? __r : ((a).cell > (b).cell) - ((b).cell > (a).cell);\
+	})
+
+static const struct _sum_helper_t unreachable_cost = {INFINITY, 0};
+
 // this is costly: we try as much as possible to cache the results of this function
-static void dijkstra_costs(const topology_t *topology, unsigned int source_cell, double min_costs[RegionsCount()], unsigned int previous[RegionsCount()]) {
-	// helper structure, we use this as heap elements to keep track of vertexes status during dijkstra execution
-	struct _dijkstra_h_t{
-		struct _sum_helper_t cost;
-		unsigned cell;
-	};
-
-	const unsigned neighbours = topology_global.directions;
+// returns false if some hop didn't increase the cost of a path, so that ties may depend on the visit order
+static bool dijkstra_costs(simtime_t now, unsigned int source_cell, struct _sum_helper_t min_costs[RegionsCount()], unsigned int previous[RegionsCount()]) {
 	const unsigned lp_cnt = topology_global.lp_cnt;
-	unsigned i, receiver;
-	struct _sum_helper_t min_costs_h[lp_cnt];
-	rootsim_heap(struct _dijkstra_h_t) heap;
-	const double *costs = topology->data;
+	unsigned i, receiver, neighbours, first_edge;
+	double cost;
+	int cmp;
+	bool ordered = true;
+	path_heap_t heap;
 
-	struct _dijkstra_h_t current_scan = {{0, 0}, source_cell}, partial_scan = {0};
+	struct _path_h_t current_scan = {{0, 0}, source_cell}, partial_scan = {{0, 0}, 0};
 
 	i = lp_cnt;
 	while(i--){
-		min_costs_h[i].crt = 0;
-		min_costs_h[i].sum = INFINITY;
+		min_costs[i] = unreachable_cost;
 		previous[i] = UINT_MAX;
 	}
 
 	heap_init(heap);
 
-	min_costs_h[source_cell] = current_scan.cost;
+	min_costs[source_cell] = current_scan.cost;
 	// textbook dijkstra (keep in mind i'm not passing pointers, this stuff gets copied)
-	heap_insert(heap, current_scan, __cmp_dijkstra_h);
+	heap_insert(heap, current_scan, __cmp_path_h);
 	// while we have vertexes to process
 	while(!heap_empty(heap)) {
 		// extract the lowest one
-		current_scan = heap_extract(heap, __cmp_dijkstra_h);
+		current_scan = heap_extract(heap, __cmp_path_h);
 		// since we are not supporting decrease key on the heap we have to filter spurious duplicates
-		if(CmpSumHelpers(current_scan.cost, min_costs_h[current_scan.cell]) > 0)
+		if(cmp_path_costs(current_scan.cost, min_costs[current_scan.cell]))
 			continue;
+		neighbours = region_degree(current_scan.cell);
+		first_edge = edge_index(current_scan.cell, 0);
 		// we cycle through the neighbours of the current cell
 		for(i = 0; i < neighbours; ++i){
 			// we get the receiver cell
 			receiver = get_raw_receiver(current_scan.cell, i);
-			if(receiver == DIRECTION_INVALID || isinf(costs[current_scan.cell * neighbours + i]))
+			if(receiver == DIRECTION_INVALID)
+				continue;
+			cost = cost_at(first_edge + i, now);
+			if(isinf(cost))
 				continue;
 			// we compute the sum of the current distance plus one hop to the receiver
-			partial_scan.cost = PartialNeumaierSum(current_scan.cost, costs[current_scan.cell * neighbours + i]);
-			// if lower we have a candidate optimum for the cell
-			if(CmpSumHelpers(partial_scan.cost, min_costs_h[receiver]) < 0){
-				// set the previous cell to retrieve the path later on
-				previous[receiver] = current_scan.cell;
-				// we set the cell field on our struct
-				partial_scan.cell = receiver;
-				// refresh lowest cost found for the cell
-				min_costs_h[receiver] = partial_scan.cost;
-				// we insert this into the heap
-				heap_insert(heap, partial_scan, __cmp_dijkstra_h);
+			partial_scan.cost = PartialNeumaierSum(current_scan.cost, cost);
+			if(CmpSumHelpers(partial_scan.cost, current_scan.cost) <= 0){
+				// the receiver may have been visited already with the very same cost
+				ordered = false;
+				if(cmp_path_costs(partial_scan.cost, min_costs[receiver]) >= 0)
+					continue;
 			}
+			cmp = cmp_path_costs(partial_scan.cost, min_costs[receiver]);
+			// among paths with the same cost we keep the one coming from the lowest region
+			if(cmp > 0 || (cmp == 0 && current_scan.cell > previous[receiver]))
+				continue;
+			// set the previous cell to retrieve the path later on
+			previous[receiver] = current_scan.cell;
+			if(cmp == 0)
+				continue;
+			// we set the cell field on our struct
+			partial_scan.cell = receiver;
+			// refresh lowest cost found for the cell
+			min_costs[receiver] = partial_scan.cost;
+			// we insert this into the heap
+			heap_insert(heap, partial_scan, __cmp_path_h);
 		}
 	}
-	// we transform the sum helpers into single double value
-	i = lp_cnt;
-	while(i--){
-		min_costs[i] = ValueSumHelper(min_costs_h[i]);
+	array_fini(heap);
+	return ordered;
+}
+
+// the working set of an in place update of a shortest path tree
+struct path_update {
+	simtime_t now;
+	unsigned source;
+	struct _sum_helper_t *costs;	/// the costs of the tree, which become the ones of the updated tree
+	unsigned *previous;		/// the previous hops, which always reflect the best incoming edges
+	struct _sum_helper_t *best;	/// the cost through the best incoming edge of each region
+	path_heap_t heap;		/// the regions whose cost doesn't match the one through their best incoming edge
+};
+
+// look again for the best incoming edge of a region: returns false if the tree can't be updated in place
+static bool update_region(struct path_update *upd, unsigned cell){
+	struct _sum_helper_t partial, best = unreachable_cost;
+	struct _path_h_t scan;
+	unsigned i, from, prev = UINT_MAX;
+	double cost;
+	int cmp;
+
+	if(cell == upd->source)
+		return true;
+
+	for(i = topology_global.incoming_first[cell]; i < topology_global.incoming_first[cell + 1]; ++i){
+		from = topology_global.incoming_from[i];
+		if(isinf(upd->costs[from].sum))
+			continue;
+		cost = cost_at(topology_global.incoming[i], upd->now);
+		if(isinf(cost))
+			continue;
+		partial = PartialNeumaierSum(upd->costs[from], cost);
+		// the order of the visit would matter here (see dijkstra_costs())
+		if(CmpSumHelpers(partial, upd->costs[from]) <= 0)
+			return false;
+		cmp = cmp_path_costs(partial, best);
+		if(cmp < 0 || (cmp == 0 && from < prev)){
+			best = partial;
+			prev = from;
+		}
+	}
+
+	upd->best[cell] = best;
+	upd->previous[cell] = prev;
+	cmp = cmp_path_costs(upd->costs[cell], best);
+	if(cmp){
+		scan.cost = cmp < 0 ? upd->costs[cell] : best;
+		scan.cell = cell;
+		heap_insert(upd->heap, scan, __cmp_path_h);
 	}
+	return true;
 }
-#undef __cmp_dijsktra_h
 
-static void refresh_cache_costs(topology_t *topology){
-	if(topology->dirty){
-		const unsigned lp_cnt = topology_global.lp_cnt;
-		// computes minimum cost spanning tree rooted in the current region
-		dijkstra_costs(topology, current->gid.to_int, &topology->data[topology_global.directions*lp_cnt], topology->prev_next_cache);
-		// this sets to an uninitialized value the buffer which holds the next hop for
-		// each possible destination (we compute those on demand when asked by the user and we cache those here)
-		memset(&topology->prev_next_cache[lp_cnt], UCHAR_MAX, sizeof(unsigned) * lp_cnt);
-		topology->dirty = false;
+// update the receiver of an edge whose cost may have changed
+#define update_edge(upd, loc) ({\
+		unsigned __rcv = edge_receiver(loc);\
+		__rcv == DIRECTION_INVALID || update_region(upd, __rcv);\
+	})
+
+// whether the cost of an edge is different at the two given times (the store must be locked)
+static bool changed_between(unsigned loc, simtime_t from, simtime_t to){
+	const struct cost_version *version;
+
+	for(version = store.versions[loc]; version != NULL && version->timestamp > from; version = version->older){
+		if(version->timestamp <= to)
+			return true;
 	}
+	return false;
 }
 
-union _double_bits_trick{
-	uint64_t val_bits; 	/// needed by the bitwise XOR
-	double val;		/// the new cost value
-};
+/**
+ * Update in place a shortest path tree so that it reflects the costs visible at
+ * another time, or with a later generation of the store. Only the regions whose
+ * best incoming edge changes are visited: they are processed in the order of
+ * their costs, lowering the ones which have found a cheaper path and raising
+ * the ones whose path became more expensive, until no region is left inconsistent.
+ *
+ * @return false if the tree must be computed from scratch
+ */
+static bool update_paths_costs(const struct path_tree *tree, unsigned source, simtime_t now, struct _sum_helper_t costs[RegionsCount()], unsigned previous[RegionsCount()]){
+	const unsigned lp_cnt = topology_global.lp_cnt;
+	struct _sum_helper_t best[lp_cnt];
+	struct path_update upd = {now, source, costs, previous, best, {0}};
+	struct _path_h_t scan;
+	unsigned long gen;
+	unsigned i, loc, receiver, visits = 0;
+	bool ok = true;
+
+	if(topology_global.incoming_first == NULL || store.generation - tree->generation > COST_CHANGES_LOG)
+		return false;
+
+	// the regions which are consistent have the cost through their best incoming edge
+	memcpy(best, costs, sizeof(best));
+	heap_init(upd.heap);
+
+	for(gen = tree->generation + 1; ok && gen <= store.generation; ++gen)
+		ok = update_edge(&upd, store.changes[gen % COST_CHANGES_LOG]);
+
+	// versions installed before the tree was computed may be visible at one time only
+	if(store.shared && store.newest > min(tree->computed_at, now)){
+#define check_edge(i) ({\
+		loc = (i);\
+		if(ok && changed_between(loc, min(tree->computed_at, now), max(tree->computed_at, now)))\
+			ok = update_edge(&upd, loc);\
+	})
+		bitmap_foreach_set(store.pending, bitmap_required_size(topology_global.edges_cnt), check_edge);
+#undef check_edge
+	}
+
+	while(ok && !heap_empty(upd.heap)){
+		scan = heap_extract(upd.heap, __cmp_path_h);
+		i = scan.cell;
+		// the region was made consistent, or this is a spurious duplicate
+		if(!cmp_path_costs(costs[i], best[i]) ||
+				cmp_path_costs(scan.cost, cmp_path_costs(costs[i], best[i]) < 0 ? costs[i] : best[i]))
+			continue;
+		// beyond this point computing the tree from scratch is cheaper
+		if(++visits > lp_cnt){
+			ok = false;
+			break;
+		}
+		if(cmp_path_costs(costs[i], best[i]) > 0){
+			// a cheaper path has been found
+			costs[i] = best[i];
+		}else{
+			// the path became more expensive: the region is reached again from the best incoming edge
+			costs[i] = unreachable_cost;
+			ok = update_region(&upd, i);
+		}
+		for(loc = 0; ok && loc < region_degree(i); ++loc){
+			receiver = get_raw_receiver(i, loc);
+			if(receiver != DIRECTION_INVALID)
+				ok = update_region(&upd, receiver);
+		}
+	}
+	array_fini(upd.heap);
+	return ok;
+}
+
+// bring a shortest path tree up to date: returns true if the tree has been changed
+// this must be called between read_begin() and read_end()
+static bool refresh_paths_costs(struct path_tree *tree, unsigned source, struct _sum_helper_t costs[RegionsCount()], unsigned previous[RegionsCount()]){
+	const simtime_t now = event_time();
+
+	// the tree is still valid if no version has been installed or discarded since it was computed,
+	// and if no version became visible in between the two times
+	if(!tree->dirty && tree->generation == store.generation &&
+			(tree->computed_at == now || store.newest <= min(tree->computed_at, now)))
+		return false;
+
+	if(tree->dirty || !tree->incremental || !update_paths_costs(tree, source, now, costs, previous))
+		tree->incremental = dijkstra_costs(now, source, costs, previous);
+
+	tree->dirty = false;
+	tree->generation = store.generation;
+	tree->computed_at = now;
+	return true;
+}
+
+// this must be called between read_begin() and read_end()
+static void refresh_cache_costs(topology_t *topology){
+	// computes minimum cost spanning tree rooted in the current region
+	if(!refresh_paths_costs(&topology->paths, current->gid.to_int, topology->data, topology->prev_next_cache))
+		return;
+	// this sets to an uninitialized value the buffer which holds the next hop for
+	// each possible destination (we compute those on demand when asked by the user and we cache those here)
+	memset(&topology->prev_next_cache[topology_global.lp_cnt], UCHAR_MAX, sizeof(unsigned) * topology_global.lp_cnt);
+}
 
 struct update_topology_t{
 	long unsigned loc_i;		/// where to put the new value
-	union _double_bits_trick upd;
+	double value;			/// the new cost value
 };
 
+// the index of an edge in the cost matrix, given its source region and its direction
+static unsigned cost_edge(unsigned from, unsigned to){
+	if(unlikely(to >= region_degree(from)))
+		rootsim_error(true, "Region %u has no edge in direction %u", from, to);
+	return edge_index(from, to);
+}
+
 void set_value_topology_costs(unsigned from, unsigned to, double value){
 	topology_t *topology = current->topology;
-	struct update_topology_t to_send = {from * topology_global.directions + to, .upd = {value}};
-	// this makes sure our bitwise tricks work properly
-	static_assert(sizeof(double) == sizeof(uint64_t), "the bit operation trick on TOPOLOGY_COST updates is wrong");
-	union _double_bits_trick old = {topology->data[to_send.loc_i]};
-	// the XOR is needed in order to have a consistent state after contemporaneous update events
-	to_send.upd.val_bits ^= old.val_bits;
-
-	if(unlikely(to_send.upd.val_bits == 0))
+	const simtime_t now = event_time();
+	struct update_topology_t to_send = {cost_edge(from, to), value};
+	unsigned i;
+	bool changed;
+	double old;
+
+	if(!store.shared){
+		// nobody else can be reading the costs at an earlier time
+		store.costs[to_send.loc_i] = value;
+		log_change(to_send.loc_i);
+		return;
+	}
+
+	// the versions installed by the original execution are still there
+	if(current->state == LP_STATE_SILENT_EXEC)
+		return;
+
+	read_begin(topology);
+	old = cost_at(to_send.loc_i, now);
+	// the comparison is done this way to avoid float equality warnings
+	changed = old < value || old > value;
+	if(changed)
+		install_version(current, to_send.loc_i, value, now);
+	read_end();
+
+	if(!changed)
 		// the update is unnecessary
 		return;
-	// save the value locally
-	topology->data[to_send.loc_i] = value;
-	// send the update message to the other LPs
-	unsigned i = topology_global.lp_cnt;
-	while(i--){
-		if(i == current->gid.to_int)
-			continue;
-		UncheckedScheduleNewEvent(i, current_evt->timestamp, TOPOLOGY_UPDATE, &to_send, sizeof(to_send));
+
+	// the other kernels are told through their anchor
+	for(i = 0; i < n_ker; ++i){
+		if(i != kid && store.anchors[i] != UINT_MAX)
+			UncheckedScheduleNewEvent(store.anchors[i], now, TOPOLOGY_UPDATE, &to_send, sizeof(to_send));
 	}
-	// mark the topology as dirty
-	topology->dirty = true;
 }
 
 void update_topology_costs(void){
-	topology_t *topology = current->topology;
 	struct update_topology_t *upd_p = (struct update_topology_t *)current_evt->event_content;
-	// same ol' trick as set_value_topology_costs()
-	union _double_bits_trick *old_p = (union _double_bits_trick *)&topology->data[upd_p->loc_i];
-	// update our value through the XOR
-	old_p->val_bits ^= upd_p->upd.val_bits;
-	// mark the topology as dirty
-	topology->dirty = true;
+
+	// empty updates are only meant to roll this LP back
+	if(current_evt->size == 0 || current->state == LP_STATE_SILENT_EXEC)
+		return;
+
+	spin_lock(&store.lock);
+	install_version(current, upd_p->loc_i, upd_p->value, event_time());
+	spin_unlock(&store.lock);
 }
 
 double get_value_topology_costs(unsigned from, unsigned to){
-	return current->topology->data[from * topology_global.directions + to];
+	topology_t *topology = current->topology;
+	double ret;
+
+	read_begin(topology);
+	ret = cost_at(cost_edge(from, to), event_time());
+	read_end();
+
+	return ret;
 }
 
 bool is_reachable_costs(unsigned to){
@@ -236,7 +783,9 @@ unsigned int find_receiver_toward_costs(unsigned int to){
 	const unsigned lp_cnt = topology_global.lp_cnt;
 	const unsigned this_lp = current->gid.to_int;
 	// refresh the cache
+	read_begin(topology);
 	refresh_cache_costs(topology);
+	read_end();
 	// this is the location where we expect to find the cached next hop
 	unsigned *ret_p = &topology->prev_next_cache[lp_cnt + to];
 
@@ -267,7 +816,9 @@ double compute_min_tour_costs(unsigned int source, unsigned int dest, unsigned i
 
 	// I suppose (I HOPE!!!) the requests will be more frequent for paths starting from the region where we are staying
 	if(source == current->gid.to_int){
+		read_begin(topology);
 		refresh_cache_costs(topology); // so we cache that stuff
+		read_end();
 		// the path is built on the fly (but this is almost as costly as copying it directly)
 		if(!build_path(lp_cnt, result, topology->prev_next_cache, source, dest)){
 			// the destination is unreachable
@@ -277,17 +828,34 @@ double compute_min_tour_costs(unsigned int source, unsigned int dest, unsigned i
 		}
 		topology->prev_next_cache[lp_cnt + dest] = result[0]; // we cache the next hop value;
 		// this is the cached value for the minimum cost incurred in the path
-		return topology->data[topology_global.directions * lp_cnt + dest];
+		return ValueSumHelper(topology->data[dest]);
 	}
 
-	unsigned int previous[lp_cnt];
-	double min_costs[lp_cnt];
-	// this is not cahced, we need to execute the whole algorithm, again only for this request
-	dijkstra_costs(topology, source, min_costs, previous);
+	struct path_memo *memo = NULL;
+	unsigned i, hops;
+	double ret;
+	// this is not cached by the LP, but other LPs may have asked for paths from the same source
+	read_begin(topology);
+	spin_lock(&store.memo_lock);
+	for(i = 0; i < COST_PATHS_MEMO; ++i){
+		if(store.memo[i].source == source){
+			memo = &store.memo[i];
+			break;
+		}
+	}
+	if(memo == NULL){
+		// we replace the entries in turn
+		memo = &store.memo[store.memo_next];
+		store.memo_next = (store.memo_next + 1) % COST_PATHS_MEMO;
+		memo->source = source;
+		memo->tree.dirty = true;
+	}
+	refresh_paths_costs(&memo->tree, source, memo->costs, memo->previous);
 	// we build the path
-	if(!build_path(lp_cnt, result, previous, source, dest))
-		return -1.0;
+	hops = build_path(lp_cnt, result, memo->previous, source, dest);
+	ret = ValueSumHelper(memo->costs[dest]);
+	spin_unlock(&store.memo_lock);
+	read_end();
 
-	return min_costs[dest];
+	return hops ? ret : -1.0;
 }
-
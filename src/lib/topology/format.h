@@ -0,0 +1,36 @@
+/*
+ * format.h
+ *
+ *  The layout of binary topology files
+ */
+
+#ifndef __TOPOLOGY_FORMAT_H_
+#define __TOPOLOGY_FORMAT_H_
+
+#include <stdint.h>
+
+/// the bytes a binary topology file starts with
+#define TOPOLOGY_FILE_MAGIC	"RSTOPO1"
+
+/**
+ * The header of a binary topology file. The sections following it start at
+ * multiples of 8 bytes, so that the file can be mapped in memory and used in place:
+ * - if edges_count isn't 0, the adjacency lists of a graph in CSR form, i.e.
+ *   regions_count + 1 offsets followed by edges_count neighbour ids (uint32_t);
+ * - the values_count values of the topology, doubles for costs (non crossable edges
+ *   are infinite) and probabilities, or a uint8_t per region for obstacles (1 marks an obstacle).
+ * Numbers are stored with the byte order of the machine which wrote the file.
+ */
+struct topology_file_header {
+	char magic[8];			/**< TOPOLOGY_FILE_MAGIC */
+	uint32_t type;			/**< the topology type (see enum _topology_type_t) */
+	uint32_t geometry;		/**< the topology geometry (see enum _topology_geometry_t) */
+	uint32_t regions_count;		/**< the number of regions */
+	uint32_t edges_count;		/**< the number of edges of an explicit graph, 0 otherwise */
+	uint64_t values_count;		/**< the number of values */
+};
+
+/// round up the size of a section to keep the next one aligned
+#define topology_file_align(size) (((size) + 7) & ~(size_t)7)
+
+#endif /* __TOPOLOGY_FORMAT_H_ */
@@ -9,6 +9,7 @@
 #include <lib/topology.h>
 
 #include <math.h>
+#include <stdint.h>
 
 #include <scheduler/scheduler.h>
 #include <lib/jsmn_helper.h>
@@ -17,19 +18,28 @@
 #include <datatypes/heap.h>
 #include <scheduler/process.h>
 
+/// the number of toggled regions which are kept to update the cached paths in place
+#define OBSTACLES_TOGGLED_MAX 8
+
 /// the customised struct for TOPOLOGY_OBSTACLES representation
 typedef struct _topology_t {
 	unsigned neighbours_id[6];	/**< these are the cached neighbours IDs */
 	unsigned free_neighbours;	/**< this is the number of reachable neighbours */
 	unsigned *prev_next_cache;	/**< this is the cache of previous and next hops needed to reach a destination */
 	bool dirty;			/**< this tells is the prev_next_cache is invalidated */
+	unsigned toggled_cnt;		/**< the number of regions toggled since the prev_next_cache was computed */
+	unsigned toggled[OBSTACLES_TOGGLED_MAX]; /**< the regions toggled since the prev_next_cache was computed */
 	rootsim_bitmap data[];		/**< this is the obstacles bitmap */
 } topology_t;
 
+// the number of hops to reach each region is cached right after the previous and next hops
+#define hops_cache(topology) (&(topology)->prev_next_cache[2 * topology_global.lp_cnt])
+
 unsigned size_checkpoint_obstacles(void){
 	return 	sizeof(topology_t) + 				// the basic struct size
 		bitmap_required_size(topology_global.lp_cnt) + 	// the bitmap to hold obstacles
-		sizeof(unsigned) * 2 * topology_global.lp_cnt; 	// the cache for next and previous hops
+		sizeof(unsigned) * 2 * topology_global.lp_cnt + // the cache for next and previous hops
+		sizeof(unsigned) * topology_global.lp_cnt; 	// the cache for the hops to each region
 }
 
 // this is called once per machine after the general
@@ -55,6 +65,24 @@ void *load_topology_file_obstacles(c_jsmntok_t *root_token, const char *json_bas
 	return ret_data;
 }
 
+void *load_topology_binary_obstacles(const void *values){
+	unsigned i;
+	const uint8_t *regions = values;
+	const unsigned lp_cnt = topology_global.lp_cnt;
+	// the file has a byte per region, which we turn into the machine shared initial obstacles status
+	rootsim_bitmap *ret_data = rsalloc(bitmap_required_size(lp_cnt));
+	bitmap_initialize(ret_data, lp_cnt);
+	for (i = 0; i < lp_cnt; ++i) {
+		if(regions[i] == 1) {bitmap_set(ret_data, i);}
+	}
+	return ret_data;
+}
+
+
+void relocate_topology_obstacles(topology_t *topology, ptrdiff_t delta){
+	// the cache lives in the same memory block as the struct
+	topology->prev_next_cache = (unsigned *)(((char *)topology->prev_next_cache) + delta);
+}
 
 topology_t *topology_obstacles_init(unsigned this_region_id, void *topology_data){
 	unsigned i, lp_id;
@@ -71,7 +99,7 @@ topology_t *topology_obstacles_init(unsigned this_region_id, void *topology_data
 		bitmap_initialize(topology->data, lp_cnt);
 	}
 
-	i = topology_global.directions;
+	i = region_degree(this_region_id);
 	topology->free_neighbours = i;
 	if(topology_global.geometry != TOPOLOGY_GRAPH){
 		// we save the neighbours ids for faster accessing
@@ -82,6 +110,11 @@ topology_t *topology_obstacles_init(unsigned this_region_id, void *topology_data
 			if(lp_id == DIRECTION_INVALID || bitmap_check(topology->data, lp_id))
 				topology->free_neighbours--;
 		}
+	}else if(topology_global.graph_first){
+		// the neighbours are listed in the graph, and they can be too many to be cached here
+		while(i--)
+			if(bitmap_check(topology->data, get_raw_receiver(this_region_id, i)))
+				topology->free_neighbours--;
 	}else{
 		// in a graph directions are 1 to 1 with regions
 		while(i--)
@@ -90,24 +123,22 @@ topology_t *topology_obstacles_init(unsigned this_region_id, void *topology_data
 	}
 
 	topology->dirty = true;
+	topology->toggled_cnt = 0;
 
 	return topology;
 }
 
+// helper structure, we use this as heap elements to keep track of vertexes status during dijkstra execution
+struct _dijkstra_h_t{
+	unsigned hops;
+	unsigned cell;
+};
+
 #define __cmp_dijkstra_h(a, b) (((a).hops > (b).hops) - ((b).hops > (a).hops))
 // this is costly: we try as much as possible to cache the results of this function
-static void dijkstra_obstacles(const topology_t *topology, unsigned int source_cell, unsigned int previous[RegionsCount()]) {
-
-	// helper structure, we use this as heap elements to keep track of vertexes status during dijkstra execution
-	struct _dijkstra_h_t{
-		unsigned hops;
-		unsigned cell;
-	};
-
-	const unsigned directions = topology_global.directions;
+static void dijkstra_obstacles(const topology_t *topology, unsigned int source_cell, unsigned int previous[RegionsCount()], unsigned int min_costs[RegionsCount()]) {
 	const unsigned lp_cnt = topology_global.lp_cnt;
-	unsigned i, receiver;
-	unsigned min_costs[lp_cnt];
+	unsigned i, receiver, directions;
 	rootsim_heap(struct _dijkstra_h_t) heap;
 	const rootsim_bitmap *obstacles = topology->data;
 
@@ -133,6 +164,7 @@ static void dijkstra_obstacles(const topology_t *topology, unsigned int source_c
 			continue;
 		// we compute the sum of the current distance plus one hop to the receiver
 		partial_scan.hops = current_scan.hops + 1;
+		directions = region_degree(current_scan.cell);
 		// we cycle through the neighbours of the current cell
 		for(i = 0; i < directions; ++i){
 			// we get the receiver cell
@@ -153,19 +185,126 @@ static void dijkstra_obstacles(const topology_t *topology, unsigned int source_c
 			}
 		}
 	}
+	array_fini(heap);
+}
+
+// the shortest path to a region through its neighbours which are still reached
+static struct _dijkstra_h_t reach_again_obstacles(const unsigned hops[RegionsCount()], unsigned cell, unsigned *previous){
+	struct _dijkstra_h_t ret = {UINT_MAX, cell};
+	unsigned i, from;
+
+	*previous = UINT_MAX;
+	for(i = topology_global.incoming_first[cell]; i < topology_global.incoming_first[cell + 1]; ++i){
+		from = topology_global.incoming_from[i];
+		if(hops[from] != UINT_MAX && hops[from] + 1 < ret.hops){
+			ret.hops = hops[from] + 1;
+			*previous = from;
+		}
+	}
+	return ret;
+}
+
+/**
+ * Update in place the cached paths after some regions have been toggled.
+ * The regions reached through a new obstacle are detached from the tree and
+ * reached again from the rest of it, then the shorter paths through the freed
+ * regions are propagated.
+ */
+static void update_paths_obstacles(topology_t *topology){
+	const unsigned lp_cnt = topology_global.lp_cnt;
+	const unsigned source = current->gid.to_int;
+	const rootsim_bitmap *obstacles = topology->data;
+	unsigned *previous = topology->prev_next_cache, *hops = hops_cache(topology);
+	unsigned first_child[lp_cnt], next_sibling[lp_cnt], detached[lp_cnt];
+	unsigned i, cell, child, receiver, prev, directions, detached_cnt = 0;
+	struct _dijkstra_h_t current_scan, partial_scan;
+	rootsim_heap(struct _dijkstra_h_t) heap;
+
+	// we link the children of each region in the tree
+	i = lp_cnt;
+	while(i--)
+		first_child[i] = UINT_MAX;
+	i = lp_cnt;
+	while(i--){
+		if(previous[i] != UINT_MAX){
+			next_sibling[i] = first_child[previous[i]];
+			first_child[previous[i]] = i;
+		}
+	}
+
+	// the new obstacles are detached along with the regions reached through them
+	for(i = 0; i < topology->toggled_cnt; ++i){
+		cell = topology->toggled[i];
+		if(cell == source || !bitmap_check(obstacles, cell) || hops[cell] == UINT_MAX)
+			continue;
+		hops[cell] = UINT_MAX;
+		detached[detached_cnt++] = cell;
+	}
+	for(i = 0; i < detached_cnt; ++i){
+		cell = detached[i];
+		previous[cell] = UINT_MAX;
+		for(child = first_child[cell]; child != UINT_MAX; child = next_sibling[child]){
+			if(hops[child] != UINT_MAX){
+				hops[child] = UINT_MAX;
+				detached[detached_cnt++] = child;
+			}
+		}
+	}
+
+	heap_init(heap);
+	// the detached regions and the freed ones are reached again from their neighbours
+	for(i = 0; i < detached_cnt + topology->toggled_cnt; ++i){
+		cell = i < detached_cnt ? detached[i] : topology->toggled[i - detached_cnt];
+		if(cell == source || bitmap_check(obstacles, cell))
+			continue;
+		partial_scan = reach_again_obstacles(hops, cell, &prev);
+		if(partial_scan.hops < hops[cell]){
+			hops[cell] = partial_scan.hops;
+			previous[cell] = prev;
+			heap_insert(heap, partial_scan, __cmp_dijkstra_h);
+		}
+	}
+
+	// we propagate the shorter paths as in dijkstra_obstacles()
+	while(!heap_empty(heap)) {
+		current_scan = heap_extract(heap, __cmp_dijkstra_h);
+		if(current_scan.hops > hops[current_scan.cell])
+			continue;
+		partial_scan.hops = current_scan.hops + 1;
+		directions = region_degree(current_scan.cell);
+		for(i = 0; i < directions; ++i){
+			receiver = get_raw_receiver(current_scan.cell, i);
+			if(receiver == DIRECTION_INVALID || bitmap_check(obstacles, receiver))
+				continue;
+			if(partial_scan.hops < hops[receiver]){
+				previous[receiver] = current_scan.cell;
+				partial_scan.cell = receiver;
+				hops[receiver] = partial_scan.hops;
+				heap_insert(heap, partial_scan, __cmp_dijkstra_h);
+			}
+		}
+	}
+	array_fini(heap);
 }
 #undef __cmp_dijsktra_h
 
 static void refresh_cache_obstacles(topology_t *topology){
+	const unsigned lp_cnt = topology_global.lp_cnt;
+
 	if(topology->dirty){
-		const unsigned lp_cnt = topology_global.lp_cnt;
 		// calculate the minimum costs spanning tree
-		dijkstra_obstacles(topology, current->gid.to_int, topology->prev_next_cache);
-		// this sets to an uninitialized value the buffer which holds the next hop for
-		// each possible destination (we compute those on demand when asked by the user and we cache those here)
-		memset(&topology->prev_next_cache[lp_cnt], UCHAR_MAX, sizeof(unsigned) * lp_cnt);
-		topology->dirty = false;
+		dijkstra_obstacles(topology, current->gid.to_int, topology->prev_next_cache, hops_cache(topology));
+	}else if(topology->toggled_cnt){
+		// a few regions have changed since the last time
+		update_paths_obstacles(topology);
+	}else{
+		return;
 	}
+	// this sets to an uninitialized value the buffer which holds the next hop for
+	// each possible destination (we compute those on demand when asked by the user and we cache those here)
+	memset(&topology->prev_next_cache[lp_cnt], UCHAR_MAX, sizeof(unsigned) * lp_cnt);
+	topology->dirty = false;
+	topology->toggled_cnt = 0;
 }
 
 unsigned int find_receiver_obstacles(void) {
@@ -197,6 +336,12 @@ unsigned int find_receiver_obstacles(void) {
 		break;
 
 		case TOPOLOGY_GRAPH:
+		if(topology_global.graph_first){
+			do{
+				receiver = get_raw_receiver(sender, region_degree(sender) * Random());
+			}while(unlikely(bitmap_check(obstacles, receiver)));
+			break;
+		}
 		do{
 			receiver = (directions + 1) * Random();
 		}while(unlikely(bitmap_check(obstacles, receiver)));
@@ -222,6 +367,11 @@ static inline void toggle_bit_and_state(topology_t *topology, rootsim_bitmap *bi
 				refresh_free = 1;
 				break;
 			}
+	}else if(topology_global.graph_first){
+		// the region may be listed more than once among our neighbours
+		unsigned i = region_degree(current->gid.to_int);
+		while(i--)
+			refresh_free += get_raw_receiver(current->gid.to_int, i) == from;
 	}else{
 		refresh_free = (from != current->gid.to_int);
 	}
@@ -234,7 +384,18 @@ static inline void toggle_bit_and_state(topology_t *topology, rootsim_bitmap *bi
 		bitmap_set(bitmap, from);
 		topology->free_neighbours -= refresh_free;
 	}
-	topology->dirty = true;
+
+	if(topology->dirty)
+		return;
+	// the cached paths will be updated in place, if not too many regions are toggled
+	unsigned i = topology->toggled_cnt;
+	while(i--)
+		if(topology->toggled[i] == from)
+			return;
+	if(topology->toggled_cnt == OBSTACLES_TOGGLED_MAX || topology_global.incoming_first == NULL)
+		topology->dirty = true;
+	else
+		topology->toggled[topology->toggled_cnt++] = from;
 }
 
 void set_value_topology_obstacles(unsigned from, unsigned to, double value){
@@ -305,7 +466,7 @@ unsigned int find_receiver_toward_obstacles(unsigned int to){
 double compute_min_tour_obstacles(unsigned int source, unsigned int dest, unsigned int result[RegionsCount()]) {
 	topology_t *topology = current->topology;
 	const unsigned lp_cnt = topology_global.lp_cnt;
-	unsigned int previous[lp_cnt], hops;
+	unsigned int previous[lp_cnt], min_costs[lp_cnt], hops;
 
 	if(source == current->gid.to_int){
 		refresh_cache_obstacles(topology);
@@ -318,7 +479,7 @@ double compute_min_tour_obstacles(unsigned int source, unsigned int dest, unsign
 		return hops;
 	}
 
-	dijkstra_obstacles(topology, source, previous);
+	dijkstra_obstacles(topology, source, previous, min_costs);
 
 	if(!(hops = build_path(lp_cnt, result, previous, source, dest)))
 		return -1.0;
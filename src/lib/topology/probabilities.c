@@ -32,39 +32,51 @@ unsigned size_checkpoint_probabilities(void){
 		sizeof(double); 					// the cache of the sum of probabilities weights
 }
 
+// the exit probabilities of each region are laid out in a row, which starts with the self loop
+#define row_offset(region) (edge_index(region, 0) + (region))
+
+static void check_probabilities(const double *data){
+	unsigned i;
+	// sanity check on the values of the probability weights
+	for (i = 0; i < topology_global.edges_cnt + topology_global.lp_cnt; ++i) {
+		if(!(data[i] >= 0))
+			rootsim_error(true, "Found a negative probability weight in the topology file!");
+	}
+}
+
 void *load_topology_file_probabilities(c_jsmntok_t *root_token, const char *json_base){
 	unsigned i;
 	c_jsmntok_t *aux_tok;
 	const unsigned lp_cnt = topology_global.lp_cnt;
-
-	// number of possible exit regions for this region, we add 1 to take in consideration the self loop
-	const unsigned exit_regions = topology_global.directions + 1;
+	struct _gnt_closure_t closure = GNT_CLOSURE_INITIALIZER;
 
 	// retrieve the values array
 	c_jsmntok_t *values_tok = get_value_token_by_key(root_token, json_base, root_token, "values");
 	if(!values_tok|| values_tok->type != JSMN_ARRAY || children_count_token(root_token, values_tok) != lp_cnt)
 		rootsim_error(true, "Invalid or missing json value with key \"values\"");
 
-	// instantiates the array
-	double *ret_data = rsalloc(sizeof(double) * exit_regions * lp_cnt);
+	// instantiates the array, we add 1 to each row to take in consideration the self loop
+	double *ret_data = rsalloc(sizeof(double) * (topology_global.edges_cnt + lp_cnt));
 
 	// we get the array of tokens we are interested in
 	for(i = 0; i < lp_cnt; ++i){
-		aux_tok = get_at_token(root_token, values_tok, i);
+		aux_tok = get_next_token(root_token, values_tok, &closure);
 
 		// we parse the array
-		if(!aux_tok || parse_double_array(root_token, json_base, aux_tok, exit_regions, &ret_data[i * exit_regions]) < 0)
+		if(!aux_tok || parse_double_array(root_token, json_base, aux_tok, region_degree(i) + 1, &ret_data[row_offset(i)]) < 0)
 			rootsim_error(true, "Invalid or missing value in the array of probabilities for this region");
 	}
 
-	// sanity check on the values of the probability weights
-	for (i = 0; i < exit_regions * lp_cnt; ++i) {
-		if(ret_data[i] < 0)
-			rootsim_error(true, "Found a negative probability weight in the topology file!");
-	}
+	check_probabilities(ret_data);
 	return ret_data;
 }
 
+void *load_topology_binary_probabilities(const void *values){
+	check_probabilities(values);
+	// each LP makes its own copy of its row
+	return (void *)values;
+}
+
 
 topology_t *topology_probabilities_init(unsigned this_region_id, void *topology_data){
 	// get number of possible exit regions for this region, we add 1 to take in consideration the self loop
@@ -73,9 +85,12 @@ topology_t *topology_probabilities_init(unsigned this_region_id, void *topology_
 	// instantiate the topology struct
 	topology_t *topology = rsalloc(topology_global.chkp_size);
 
-	if(topology_data)
-		memcpy(topology->data, ((char *) topology_data) + this_region_id * exit_regions, sizeof(double) * exit_regions);
-	else{
+	if(topology_data){
+		// regions with fewer neighbours than the others get a shorter row
+		i = region_degree(this_region_id) + 1;
+		memcpy(topology->data, ((double *) topology_data) + row_offset(this_region_id), sizeof(double) * i);
+		memset(&topology->data[i], 0, sizeof(double) * (exit_regions - i));
+	}else{
 		// most models assume that you don't select the region you are from
 		topology->data[0] = 0.0;
 		for(i = 1; i < exit_regions; ++i)
@@ -140,7 +155,15 @@ bool is_reachable_probabilities(unsigned to){
 			break;
 
 		case TOPOLOGY_GRAPH:
-			return topology->data[i] > 0;
+			if(!topology_global.graph_first)
+				return topology->data[to] > 0;
+			// the weights of the neighbours follow the one of the self loop
+			i = region_degree(current->gid.to_int);
+			while(i--){
+				if(get_raw_receiver(current->gid.to_int, i) == to && topology->data[i + 1] > 0)
+					return true;
+			}
+			break;
 
 		default:
 			rootsim_error(true, "This shouldn't happen, report to maintainer");
@@ -221,6 +244,13 @@ unsigned int find_receiver_probabilities(void) {
 			break;
 
 		case TOPOLOGY_GRAPH:
+			if(topology_global.graph_first){
+				// the weights beyond the neighbours of this region are 0, so they are never selected
+				select_direction();
+
+				receiver = get_raw_receiver(sender, direction);
+				break;
+			}
 			// here we don't use the select_direction() macro because we don't map direction 0
 			// to the region we occupy because this way we simplify the logic.
 			do {
@@ -9,6 +9,10 @@
 #include <lib/topology.h>
 
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <scheduler/scheduler.h>
 #include <lib/jsmn_helper.h>
@@ -18,20 +22,25 @@
 #include <datatypes/heap.h>
 #include <scheduler/process.h>
 #include <core/init.h>
+#include <mm/mm.h>
 #include <serial/serial.h>
+#include <lib/topology/format.h>
 
 struct _topology_global_t topology_global;
 
-//used internally (also in abm_layer module) to schedule our reserved events TODO: move in a more system-like module
-void UncheckedScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, unsigned int event_type, void *event_content, unsigned int event_size){
+/// the values of a binary topology file, which are used in place (NULL if none has been loaded)
+static const void *mapped_values;
+
+// used internally (also in abm_layer module) to schedule our reserved events: the caller fills
+// the returned payload in place and then sends the event with UncheckedCommitEvent().
+// NULL is returned if the event must not be sent, the LP is re-executing already sent events
+void *UncheckedReserveEvent(unsigned int gid_receiver, simtime_t timestamp, unsigned int event_type, unsigned int event_size){
 
 	msg_t *event;
 	GID_t receiver;
 
-	if(unlikely(rootsim_config.serial)){
-		SerialScheduleNewEvent(gid_receiver, timestamp, event_type, event_content, event_size);
-		return;
-	}
+	if(unlikely(rootsim_config.serial))
+		return SerialReserveEvent(gid_receiver, timestamp, event_type, event_size);
 
 	// Internally to the platform, the receiver is a GID, while models
 	// have no difference across GIDs and LIDs. We convert here the passed
@@ -40,14 +49,14 @@ void UncheckedScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, u
 
 	// In Silent execution, we do not send again already sent messages
 	if(current->state == LP_STATE_SILENT_EXEC) {
-		return;
+		return NULL;
 	}
 
 #ifndef NDEBUG
 	// Check whether the destination LP is out of range
 	if(receiver.to_int >= n_prc_tot) { // It's unsigned, so no need to check whether it's < 0
 		rootsim_error(true, "Warning: the destination LP %u %lf %u is out of range. The event has been ignored\n", receiver.to_int, timestamp, event_type);
-		return;
+		return NULL;
 	}
 
 	// Check if the associated timestamp is negative
@@ -56,11 +65,30 @@ void UncheckedScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, u
 	}
 #endif
 
-	// Copy all the information into the event structure
-	pack_msg(&event, current->gid, receiver, event_type, timestamp, lvt(current), event_size, event_content);
+	// Copy all the information into the event structure, except the payload
+	pack_msg(&event, current->gid, receiver, event_type, timestamp, lvt(current), event_size, NULL);
 	event->mark = generate_mark(current);
 
-	insert_outgoing_msg(event);
+	return event->event_content;
+}
+
+void UncheckedCommitEvent(void *event_content){
+	if(unlikely(rootsim_config.serial)){
+		SerialCommitEvent(event_content);
+		return;
+	}
+
+	insert_outgoing_msg((msg_t *)((unsigned char *)event_content - offsetof(msg_t, event_content)));
+}
+
+void UncheckedScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, unsigned int event_type, void *event_content, unsigned int event_size){
+	void *content = UncheckedReserveEvent(gid_receiver, timestamp, event_type, event_size);
+
+	if(content == NULL)
+		return;
+
+	memcpy(content, event_content, event_size);
+	UncheckedCommitEvent(content);
 }
 
 /**
@@ -70,6 +98,13 @@ void UncheckedScheduleNewEvent(unsigned int gid_receiver, simtime_t timestamp, u
 static unsigned directions_count(void) {
 	switch (topology_global.geometry) {
 		case TOPOLOGY_GRAPH:
+			if(topology_global.graph_first){
+				// directions are bound by the largest count of neighbours
+				unsigned i, ret = 0;
+				for(i = 0; i < topology_global.lp_cnt; ++i)
+					ret = max(ret, topology_global.graph_first[i + 1] - topology_global.graph_first[i]);
+				return ret;
+			}
 			return topology_global.lp_cnt - 1;
 		case TOPOLOGY_HEXAGON:
 			return 6;
@@ -86,6 +121,78 @@ static unsigned directions_count(void) {
 	return UINT_MAX;
 }
 
+/**
+ * Utility function which sets the number of directions and the number of edges
+ * of the topology, once its geometry is known.
+ */
+static void compute_directions(void) {
+	topology_global.directions = directions_count();
+	if(topology_global.graph_first)
+		topology_global.edges_cnt = topology_global.graph_first[topology_global.lp_cnt];
+	else
+		topology_global.edges_cnt = topology_global.directions * topology_global.lp_cnt;
+}
+
+/**
+ * Sanity checks on the regions count and the type of a topology file
+ * @param lp_cnt the number of regions in the topology file
+ * @param t_type the type of the topology in the file
+ */
+static void check_topology_file(unsigned lp_cnt, enum _topology_type_t t_type) {
+	// sanity checks on the number of instantiated LPs
+	if(lp_cnt + topology_settings.out_of_topology > n_prc_tot)
+		rootsim_error(true, "This topology needs an higher number of available LPs (%lu versus %lu available LPs)", lp_cnt, n_prc_tot);
+	if(lp_cnt + topology_settings.out_of_topology < n_prc_tot)
+		rootsim_error(true, "The requested regions are fewer than the available LPs (%lu versus %lu available LPs)", lp_cnt, n_prc_tot);
+	// sanity check between the topology type requested by the model and what we found
+	if(t_type != topology_settings.type){
+		rootsim_error(true, "The specified topology has a different type from the one requested by the model");
+	}
+}
+
+/**
+ * This loads the lists of neighbours of the regions of a graph, if the topology file has them:
+ * without them any region is a neighbour of any other one.
+ * The lists are kept in CSR form, so that walking the neighbours of a region is a scan of an array.
+ */
+static void load_graph_neighbours(c_jsmntok_t *root_token, const char *json_base) {
+	unsigned i, j, *first, *neighbours;
+	c_jsmntok_t *row_tok;
+	struct _gnt_closure_t rows = GNT_CLOSURE_INITIALIZER, closure;
+	const unsigned lp_cnt = topology_global.lp_cnt;
+
+	c_jsmntok_t *neighbours_tok = get_value_token_by_key(root_token, json_base, root_token, "neighbours");
+	if(!neighbours_tok)
+		return;
+	if(topology_global.geometry != TOPOLOGY_GRAPH)
+		rootsim_error(true, "The json key \"neighbours\" is supported only by the graph geometry");
+	if(neighbours_tok->type != JSMN_ARRAY || children_count_token(root_token, neighbours_tok) != lp_cnt)
+		rootsim_error(true, "Invalid json value with key \"neighbours\" (must be an array with the neighbours of each region)");
+
+	// we count the neighbours of each region to compute where their lists start
+	first = rsalloc(sizeof(unsigned) * (lp_cnt + 1));
+	first[0] = 0;
+	for(i = 0; i < lp_cnt; ++i){
+		row_tok = get_next_token(root_token, neighbours_tok, &rows);
+		if(row_tok->type != JSMN_ARRAY)
+			rootsim_error(true, "Invalid list of neighbours for region %u", i);
+		first[i + 1] = first[i] + children_count_token(root_token, row_tok);
+	}
+	// we fill in the lists
+	neighbours = rsalloc(sizeof(unsigned) * first[lp_cnt]);
+	init_gnt_closure(&rows);
+	for(i = 0; i < lp_cnt; ++i){
+		row_tok = get_next_token(root_token, neighbours_tok, &rows);
+		init_gnt_closure(&closure);
+		for(j = first[i]; j < first[i + 1]; ++j){
+			if(parse_unsigned_token(json_base, get_next_token(root_token, row_tok, &closure), &neighbours[j]) < 0 || neighbours[j] >= lp_cnt)
+				rootsim_error(true, "Invalid neighbour found in the list of region %u", i);
+		}
+	}
+	topology_global.graph_first = first;
+	topology_global.graph_neighbours = neighbours;
+}
+
 /**
  * This loads a topology file:
  * it checks for the correctness of the JSON file,
@@ -95,7 +202,7 @@ static unsigned directions_count(void) {
  * @param file_name the path of the file containing the topology info
  * @return an opaque malloc'ed area used by the specific topology initiators
  */
-static void *load_topology_file(const char *file_name) {
+static void *load_topology_json(const char *file_name) {
 	char *json_base;
 	jsmntok_t *root_token;
 	c_jsmntok_t *t;
@@ -112,12 +219,6 @@ static void *load_topology_file(const char *file_name) {
 	// parse the regions count and check its validity
 	if(parse_unsigned_by_key(root_token, json_base, root_token, "regions_count", &lp_cnt) < 0)
 		rootsim_error(true, "Invalid or missing json value with key \"regions_count\" (must be an unsigned integer)");
-	// sanity checks on the number of instantiated LPs
-	if(lp_cnt + topology_settings.out_of_topology > n_prc_tot)
-		rootsim_error(true, "This topology needs an higher number of available LPs (%lu versus %lu available LPs)", lp_cnt, n_prc_tot);
-	if(lp_cnt + topology_settings.out_of_topology < n_prc_tot)
-		rootsim_error(true, "The requested regions are fewer than the available LPs (%lu versus %lu available LPs)", lp_cnt, n_prc_tot);
-
 	// look for the topology type
 	const char *type_choices[] = {
 			[TOPOLOGY_COSTS] = 	"costs",
@@ -129,10 +230,7 @@ static void *load_topology_file(const char *file_name) {
 	// parse the choice from the expected string value
 	if((t_type = parse_string_choice(root_token, json_base, t, sizeof(type_choices)/sizeof(const char *), type_choices)) == UINT_MAX)
 		rootsim_error(true, "Invalid or missing json value with key \"type\" (must be a recognizable string)");
-	// sanity check between the topology type requested by the model and what we found
-	if(t_type != topology_settings.type){
-		rootsim_error(true, "The specified topology has a different type from the one requested by the model");
-	}
+	check_topology_file(lp_cnt, t_type);
 
 	// look for the topology type
 	const char *geometry_choices[] = {
@@ -154,7 +252,9 @@ static void *load_topology_file(const char *file_name) {
 	// we set the known fields of the global struct
 	topology_global.geometry = geometry;
 	topology_global.lp_cnt = lp_cnt;
-	topology_global.directions = directions_count();
+	// a graph may come with the lists of neighbours
+	load_graph_neighbours(root_token, json_base);
+	compute_directions();
 	// we give control to the right specific parser
 	switch (t_type) {
 		case TOPOLOGY_PROBABILITIES:
@@ -176,6 +276,113 @@ static void *load_topology_file(const char *file_name) {
 	return ret;
 }
 
+/**
+ * This loads a binary topology file (see lib/topology/format.h) which has been mapped in memory:
+ * the lists of neighbours and the values are used in place, so the mapping is never released.
+ * @param map the mapped file
+ * @param size the size of the file
+ * @return the data used by the specific topology initiators
+ */
+static void *load_topology_binary(const char *map, size_t size) {
+	const struct topology_file_header *header = (const struct topology_file_header *)map;
+	size_t offset = sizeof(*header), values_size;
+	unsigned i;
+	void *ret = NULL;
+
+	_Static_assert(sizeof(unsigned) == sizeof(uint32_t), "The lists of neighbours can't be used in place");
+
+	if(header->type > TOPOLOGY_PROBABILITIES || header->geometry < TOPOLOGY_HEXAGON || header->geometry > TOPOLOGY_GRAPH)
+		rootsim_error(true, "The binary topology file has an invalid header");
+	check_topology_file(header->regions_count, header->type);
+	topology_global.geometry = header->geometry;
+	topology_global.lp_cnt = header->regions_count;
+
+	if(header->edges_count){
+		if(header->geometry != TOPOLOGY_GRAPH)
+			rootsim_error(true, "Lists of neighbours are supported only by the graph geometry");
+		if(offset + sizeof(uint32_t) * ((size_t)header->regions_count + 1 + header->edges_count) > size)
+			rootsim_error(true, "The binary topology file is truncated");
+		topology_global.graph_first = (unsigned *)(map + offset);
+		offset += sizeof(uint32_t) * (header->regions_count + 1);
+		topology_global.graph_neighbours = (unsigned *)(map + offset);
+		offset = topology_file_align(offset + sizeof(uint32_t) * header->edges_count);
+		// the lists are used in place, so we make sure they are consistent
+		if(topology_global.graph_first[0] != 0 || topology_global.graph_first[header->regions_count] != header->edges_count)
+			rootsim_error(true, "The binary topology file has inconsistent lists of neighbours");
+		for(i = 0; i < header->regions_count; ++i){
+			if(topology_global.graph_first[i] > topology_global.graph_first[i + 1])
+				rootsim_error(true, "The binary topology file has inconsistent lists of neighbours");
+		}
+		for(i = 0; i < header->edges_count; ++i){
+			if(topology_global.graph_neighbours[i] >= header->regions_count)
+				rootsim_error(true, "Invalid neighbour found in the binary topology file");
+		}
+	}
+	compute_directions();
+
+	// the values are laid out as the specific parsers of json files would do
+	switch (header->type) {
+		case TOPOLOGY_PROBABILITIES:
+			values_size = sizeof(double) * (topology_global.edges_cnt + topology_global.lp_cnt);
+			break;
+		case TOPOLOGY_COSTS:
+			values_size = sizeof(double) * topology_global.edges_cnt;
+			break;
+		default:
+			values_size = sizeof(uint8_t) * topology_global.lp_cnt;
+			break;
+	}
+	if(header->values_count * (header->type == TOPOLOGY_OBSTACLES ? sizeof(uint8_t) : sizeof(double)) != values_size)
+		rootsim_error(true, "The binary topology file has an unexpected number of values");
+	if(offset + values_size > size)
+		rootsim_error(true, "The binary topology file is truncated");
+
+	mapped_values = map + offset;
+	switch (header->type) {
+		case TOPOLOGY_PROBABILITIES:
+			ret = load_topology_binary_probabilities(mapped_values);
+			break;
+
+		case TOPOLOGY_COSTS:
+			ret = load_topology_binary_costs(mapped_values);
+			break;
+
+		case TOPOLOGY_OBSTACLES:
+			ret = load_topology_binary_obstacles(mapped_values);
+			break;
+	}
+	return ret;
+}
+
+/**
+ * This loads a topology file, which can be either a JSON file or a binary one
+ * (as produced by the rootsim-topology converter)
+ * @param file_name the path of the file containing the topology info
+ * @return the data used by the specific topology initiators
+ */
+static void *load_topology_file(const char *file_name) {
+	struct stat st;
+	char *map;
+	int fd;
+
+	fd = open(file_name, O_RDONLY);
+	if(fd == -1 || fstat(fd, &st) == -1)
+		rootsim_error(true, "The specified topology file at \"%s\" is either non accessible or non existing", file_name);
+
+	if((size_t)st.st_size >= sizeof(struct topology_file_header)){
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED){
+			if(!memcmp(map, TOPOLOGY_FILE_MAGIC, sizeof(TOPOLOGY_FILE_MAGIC))){
+				close(fd);
+				return load_topology_binary(map, st.st_size);
+			}
+			munmap(map, st.st_size);
+		}
+	}
+	close(fd);
+	return load_topology_json(file_name);
+}
+
 /**
  * This pre-computes the edge of the topology;
  * the <sqrt>"()" is expensive and so we cache its value
@@ -201,6 +408,51 @@ static void compute_edge(void){
 	topology_global.edge = edge;
 }
 
+/**
+ * This computes the edges entering each region, which are needed to update
+ * shortest paths in place when a writable topology changes.
+ * In a complete graph any region can be reached from any other one: the edges would take as
+ * much memory as a whole cost matrix, so we skip them and paths are always computed from scratch.
+ */
+static void compute_incoming_edges(void){
+	unsigned i, j, receiver;
+	unsigned *first;
+	const unsigned lp_cnt = topology_global.lp_cnt;
+
+	if(topology_global.geometry == TOPOLOGY_GRAPH && !topology_global.graph_first)
+		return;
+
+	first = rsalloc(sizeof(unsigned) * (lp_cnt + 1));
+	memset(first, 0, sizeof(unsigned) * (lp_cnt + 1));
+	// we count the edges entering each region
+	for(i = 0; i < lp_cnt; ++i){
+		for(j = 0; j < region_degree(i); ++j){
+			if((receiver = get_raw_receiver(i, j)) != DIRECTION_INVALID)
+				first[receiver]++;
+		}
+	}
+	// we turn the counts into the starting offsets
+	for(i = 0, j = 0; i < lp_cnt; ++i){
+		receiver = first[i];
+		first[i] = j;
+		j += receiver;
+	}
+	topology_global.incoming = rsalloc(sizeof(unsigned) * j);
+	topology_global.incoming_from = rsalloc(sizeof(unsigned) * j);
+	// we fill in the edges: once done, each offset has moved to the start of the next region
+	for(i = 0; i < lp_cnt; ++i){
+		for(j = 0; j < region_degree(i); ++j){
+			if((receiver = get_raw_receiver(i, j)) != DIRECTION_INVALID){
+				topology_global.incoming_from[first[receiver]] = i;
+				topology_global.incoming[first[receiver]++] = edge_index(i, j);
+			}
+		}
+	}
+	memmove(&first[1], first, sizeof(unsigned) * lp_cnt);
+	first[0] = 0;
+	topology_global.incoming_first = first;
+}
+
 /**
  * Initialize the topology module for each LP hosted on the machine.
  * This needs to be called right after LP basic initialization before starting to process events.
@@ -218,7 +470,7 @@ void topology_init(void) {
 	// set default values
 	topology_global.lp_cnt = n_prc_tot - topology_settings.out_of_topology;
 	topology_global.geometry = topology_settings.default_geometry;
-	topology_global.directions = directions_count();
+	compute_directions();
 	// load settings from file if specified
 	if(topology_settings.topology_path)
 		t_data = load_topology_file(topology_settings.topology_path);
@@ -236,6 +488,12 @@ void topology_init(void) {
 			topology_global.chkp_size = size_checkpoint_obstacles();
 			break;
 	}
+	// paths are updated in place only if the topology can change
+	if(topology_settings.write_enabled && topology_settings.type != TOPOLOGY_PROBABILITIES)
+		compute_incoming_edges();
+	// the cost matrix is shared by all the LPs of this kernel
+	if(topology_settings.type == TOPOLOGY_COSTS)
+		cost_store_init(t_data);
 	// initialize the topology struct
 	foreach_lp(lp){
 		if(lp->gid.to_int >= topology_global.lp_cnt){
@@ -254,8 +512,102 @@ void topology_init(void) {
 				break;
 		}
 	}
-	// free the topology data read from file
-	rsfree(t_data);
+	// free the topology data read from file, unless it's used in place
+	if(t_data != mapped_values)
+		rsfree(t_data);
+}
+
+/**
+ * Fix up the internal pointers of a topology struct which has been copied
+ * to a different address, e.g. when the owning LP is migrated.
+ *
+ * @param topology the topology struct to fix
+ * @param delta the displacement of the topology struct which the pointers refer to
+ */
+void topology_relocate(topology_t *topology, ptrdiff_t delta){
+	switch(topology_settings.type){
+		case TOPOLOGY_COSTS:
+			relocate_topology_costs(topology, delta);
+			break;
+		case TOPOLOGY_OBSTACLES:
+			relocate_topology_obstacles(topology, delta);
+			break;
+		case TOPOLOGY_PROBABILITIES:
+			// no internal pointers here
+			break;
+	}
+}
+
+/**
+ * Take a snapshot of the topology struct of an LP, to be kept in its checkpoint.
+ * The costs are kept in a multi-versioned store which is rolled back on its
+ * own, so only writable topologies of the other types need a snapshot.
+ *
+ * @param lp the LP whose topology struct is saved
+ * @return the snapshot, or NULL if there is nothing to save
+ */
+void *topology_do_checkpoint(struct lp_struct *lp){
+	void *ckpt;
+
+	if(!topology_settings.write_enabled || topology_settings.type == TOPOLOGY_COSTS)
+		return NULL;
+
+	ckpt = ckpt_alloc(lp, topology_global.chkp_size);
+	memcpy(ckpt, lp->topology, topology_global.chkp_size);
+	return ckpt;
+}
+
+/**
+ * Bring back the topology struct of an LP to a snapshot taken by topology_do_checkpoint().
+ *
+ * @param lp the LP whose topology struct is restored
+ * @param ckpt the snapshot, possibly NULL
+ */
+void topology_restore_checkpoint(struct lp_struct *lp, void *ckpt){
+	if(ckpt)
+		memcpy(lp->topology, ckpt, topology_global.chkp_size);
+}
+
+/**
+ * Undo the updates to the topology carried out by the events of an LP which are rolled back.
+ *
+ * @param lp the LP being rolled back
+ * @param now the timestamp of the last event which is not undone
+ */
+void topology_rollback(struct lp_struct *lp, simtime_t now){
+	if(topology_settings.type == TOPOLOGY_COSTS)
+		rollback_topology_costs(lp, now);
+}
+
+/**
+ * Tell the topology module the time of the oldest checkpoint an LP can still be restored to.
+ *
+ * @param lp the LP
+ * @param barrier the simulation time of the time barrier of the LP
+ */
+void topology_time_barrier(struct lp_struct *lp, simtime_t barrier){
+	if(topology_settings.type == TOPOLOGY_COSTS)
+		time_barrier_topology_costs(lp, barrier);
+}
+
+/**
+ * Release the topology data which is not needed anymore once the time
+ * barriers of the LPs have moved forward.
+ */
+void topology_fossil_collection(void){
+	if(topology_settings.type == TOPOLOGY_COSTS)
+		fossil_collection_topology_costs();
+}
+
+/**
+ * Tell whether LPs can be moved to another kernel. The versions of a writable cost
+ * topology are installed in the store of the kernels hosting their readers,
+ * so readers cannot leave it.
+ */
+bool topology_can_migrate(void){
+	if(topology_settings.type == TOPOLOGY_COSTS)
+		return can_migrate_topology_costs();
+	return true;
 }
 
 void SetValueTopology(unsigned from, unsigned to, double value) {
@@ -362,9 +714,14 @@ unsigned int NeighboursCount(unsigned region){
 	unsigned i = topology_global.directions;
 	unsigned res = 0;
 	unsigned lp_id;
-	while(i--){
-		if((lp_id = get_raw_receiver(region, i)) != DIRECTION_INVALID)
-			res++;
+	if(topology_global.graph_first){
+		// the lists of neighbours only hold valid ones
+		res = region_degree(region);
+	}else{
+		while(i--){
+			if((lp_id = get_raw_receiver(region, i)) != DIRECTION_INVALID)
+				res++;
+		}
 	}
 	switch_to_application_mode();
 	return res;
@@ -493,7 +850,10 @@ unsigned int get_raw_receiver(unsigned int from, direction_t direction) {
 			break;
 
 		case TOPOLOGY_GRAPH:
-			if(likely(direction < topology_global.lp_cnt))
+			if(topology_global.graph_first){
+				if(likely(direction < region_degree(sender)))
+					receiver = topology_global.graph_neighbours[topology_global.graph_first[sender] + direction];
+			}else if(likely(direction < topology_global.lp_cnt))
 				receiver = direction;
 			break;
 
@@ -545,6 +905,45 @@ unsigned int get_raw_receiver(unsigned int from, direction_t direction) {
 	return receiver;
 }
 
+/**
+ * Compute the id of the LP an edge leads to.
+ * @param edge the index of the edge (see edge_index())
+ * @return the id of the LP the edge leads to or INVALID_DIRECTION if the edge doesn't lead anywhere
+ */
+unsigned int edge_receiver(unsigned int edge) {
+	if(topology_global.graph_first)
+		return topology_global.graph_neighbours[edge];
+	return get_raw_receiver(edge / topology_global.directions, edge % topology_global.directions);
+}
+
+/**
+ * Compute the direction which leads back from a neighbour. If the neighbour lies in
+ * several directions, these are paired in order with the ones leading back.
+ * @param from The id of the starting point LP
+ * @param direction The direction which leads to the neighbour
+ * @return the direction of the neighbour which leads back to from or INVALID_DIRECTION if there's none
+ */
+unsigned int reverse_direction(unsigned int from, direction_t direction) {
+	const unsigned receiver = get_raw_receiver(from, direction);
+	unsigned i, nth = 0;
+
+	if(receiver == DIRECTION_INVALID)
+		return DIRECTION_INVALID;
+
+	// in a complete graph the directions are the ids of the regions
+	if(topology_global.geometry == TOPOLOGY_GRAPH && !topology_global.graph_first)
+		return from;
+
+	for(i = 0; i < direction; ++i)
+		nth += get_raw_receiver(from, i) == receiver;
+
+	for(i = 0; i < region_degree(receiver); ++i) {
+		if(get_raw_receiver(receiver, i) == from && !nth--)
+			return i;
+	}
+	return DIRECTION_INVALID;
+}
+
 unsigned int GetReceiver(unsigned int from, direction_t direction, bool reachable) {
 	unsigned receiver;
 	switch_to_platform_mode();
@@ -36,6 +36,7 @@
 #include <statistics/statistics.h>
 #include <gvt/ccgs.h>
 #include <scheduler/binding.h>
+#include <scheduler/elastic.h>
 #include <scheduler/scheduler.h>
 #include <scheduler/process.h>
 #include <gvt/gvt.h>
@@ -47,6 +48,7 @@
 
 #include <serial/serial.h>
 #include <communication/mpi.h>
+#include <communication/migration.h>
 
 #define _INIT_FROM_MAIN
 #include <core/init.h>
@@ -66,6 +68,17 @@ jmp_buf exit_jmp;
 */
 static bool end_computing(void)
 {
+#ifdef HAVE_MPI
+	// All kernels must take part to a pending migration
+	if (lp_migration_pending()) {
+		return false;
+	}
+#endif
+
+	// All active worker threads must take part to a pending change in their number
+	if (thread_resize_pending() && !simulation_error()) {
+		return false;
+	}
 
 	// Did CCGS decide to terminate the simulation?
 	if (ccgs_can_halt_simulation()) {
@@ -133,6 +146,10 @@ static void *main_simulation_loop(void *arg)
 		// Recompute the LPs-thread binding
 		rebind_LPs();
 
+		// Worker threads which are not needed sleep here
+		if (!park_worker_thread())
+			break;
+
 #ifdef HAVE_MPI
 		// Check whether we have new ingoing messages sent by remote instances
 		receive_remote_msgs();
@@ -141,8 +158,15 @@ static void *main_simulation_loop(void *arg)
 		// Forward the messages from the kernel incoming message queue to the destination LPs
 		process_bottom_halves();
 
-		// Activate one LP and process one event. Send messages produced during the events' execution
-		schedule();
+		// Activate one LP and process one event. Send messages produced during the events' execution.
+		// If there is nothing to do, back off so as not to steal the CPU from other threads
+		if (schedule())
+			idle_backoff_reset();
+		else
+			idle_backoff();
+
+		// Release some of the memory reclaimed at the last GVT rounds
+		fossil_collection_step();
 
 		my_time_barrier = gvt_operations();
 
@@ -170,6 +194,7 @@ static void *main_simulation_loop(void *arg)
 	}
 
  leave_for_error:
+	release_worker_threads();
 	thread_barrier(&all_thread_barrier);
 
 	// If we're exiting due to an error, we neatly shut down the simulation
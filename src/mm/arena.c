@@ -0,0 +1,261 @@
+/**
+* @file mm/arena.c
+*
+* @brief Per-LP checkpoint arena
+*
+* All the buffers which make up a checkpoint (the state_t node, the log of
+* the model state, and the snapshots of the topology and ABM libraries) are
+* taken from a per-LP arena. Checkpoints are taken in LVT order and are
+* released either in FIFO order by fossil collection or in LIFO order by
+* rollbacks, so the arena is a queue of large chunks from which buffers are
+* carved with a bump pointer:
+*
+* - an allocation is served from the newest chunk, or from a new one;
+* - releasing the last buffer of the newest chunk moves its bump pointer
+*   back, so that rolled back checkpoints leave no hole behind;
+* - a chunk is reclaimed as a whole as soon as all its buffers are
+*   released, which is what fossil collection does for the oldest chunks.
+*
+* The last reclaimed chunk is kept aside, so that an LP in steady state
+* does not hit the system allocator at all.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <core/core.h>
+#include <arch/atomic.h>
+#include <mm/mm.h>
+#include <scheduler/process.h>
+
+/// Size of the first chunk of an arena
+#define ARENA_MIN_CHUNK		(64 * 1024)
+
+/// Chunks are doubled in size up to this one, unless a single checkpoint is larger
+#define ARENA_MAX_CHUNK		(4 * 1024 * 1024)
+
+/// Alignment of the buffers returned by the arena
+#define ARENA_ALIGNMENT		16
+
+#define arena_align(size) (((size) + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+struct arena_chunk {
+	struct arena_chunk *prev, *next;	///< Neighbouring chunks, from the oldest to the newest
+	struct ckpt_arena *arena;		///< The arena this chunk belongs to
+	size_t size;				///< Usable bytes in the chunk
+	size_t brk;				///< Offset of the first free byte
+	size_t live;				///< Number of buffers not released yet
+	unsigned char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+/// Header placed right before each buffer
+struct arena_block {
+	struct arena_chunk *chunk;	///< The chunk the buffer has been carved from
+	size_t size;			///< Size of the buffer, including this header
+} __attribute__((aligned(ARENA_ALIGNMENT)));
+
+struct ckpt_arena {
+	struct arena_chunk *oldest, *newest;
+	struct arena_chunk *spare;	///< The last reclaimed chunk, kept for reuse
+	size_t next_chunk;		///< Size of the next chunk to allocate
+	size_t memory;			///< Bytes held in chunks, spare included
+	size_t live;			///< Bytes held by buffers not released yet
+};
+
+/// Memory held by all arenas in this kernel, and its peak value
+static size_t kernel_memory, kernel_peak;
+static spinlock_t kernel_lock;
+
+
+static void account_memory(long long bytes)
+{
+	spin_lock(&kernel_lock);
+	kernel_memory += bytes;
+	if (kernel_memory > kernel_peak)
+		kernel_peak = kernel_memory;
+	spin_unlock(&kernel_lock);
+}
+
+static struct arena_chunk *chunk_new(struct ckpt_arena *arena, size_t need)
+{
+	struct arena_chunk *chunk = arena->spare;
+	size_t size;
+
+	if (chunk != NULL && chunk->size >= need) {
+		arena->spare = NULL;
+	} else {
+		size = arena->next_chunk;
+		while (size < need)
+			size *= 2;
+		if (arena->next_chunk < ARENA_MAX_CHUNK)
+			arena->next_chunk *= 2;
+
+		chunk = rsalloc(sizeof(*chunk) + size);
+		if (unlikely(chunk == NULL))
+			rootsim_error(true, "Unable to acquire memory for checkpointing the current state (memory exhausted?)");
+		chunk->arena = arena;
+		chunk->size = size;
+		arena->memory += sizeof(*chunk) + size;
+		account_memory(sizeof(*chunk) + size);
+	}
+
+	chunk->brk = 0;
+	chunk->live = 0;
+	chunk->next = NULL;
+	chunk->prev = arena->newest;
+	if (arena->newest != NULL)
+		arena->newest->next = chunk;
+	else
+		arena->oldest = chunk;
+	arena->newest = chunk;
+
+	return chunk;
+}
+
+static void chunk_release(struct ckpt_arena *arena, struct arena_chunk *chunk)
+{
+	if (chunk->prev != NULL)
+		chunk->prev->next = chunk->next;
+	else
+		arena->oldest = chunk->next;
+	if (chunk->next != NULL)
+		chunk->next->prev = chunk->prev;
+	else
+		arena->newest = chunk->prev;
+
+	// Keep the larger chunk aside
+	if (arena->spare != NULL && arena->spare->size < chunk->size) {
+		arena->memory -= sizeof(*chunk) + arena->spare->size;
+		account_memory(-(long long)(sizeof(*chunk) + arena->spare->size));
+		rsfree(arena->spare);
+		arena->spare = NULL;
+	}
+
+	if (arena->spare == NULL) {
+		arena->spare = chunk;
+	} else {
+		arena->memory -= sizeof(*chunk) + chunk->size;
+		account_memory(-(long long)(sizeof(*chunk) + chunk->size));
+		rsfree(chunk);
+	}
+}
+
+struct ckpt_arena *ckpt_arena_init(void)
+{
+	struct ckpt_arena *arena = rsalloc(sizeof(*arena));
+
+	bzero(arena, sizeof(*arena));
+	arena->next_chunk = ARENA_MIN_CHUNK;
+	return arena;
+}
+
+void ckpt_arena_fini(struct ckpt_arena *arena)
+{
+	struct arena_chunk *chunk;
+
+	while ((chunk = arena->oldest) != NULL) {
+		arena->oldest = chunk->next;
+		rsfree(chunk);
+	}
+	if (arena->spare != NULL)
+		rsfree(arena->spare);
+
+	account_memory(-(long long)arena->memory);
+	rsfree(arena);
+}
+
+/**
+* Allocate a buffer to keep (a part of) a checkpoint of an LP.
+*
+* @param lp A pointer to the lp_struct of the LP taking the checkpoint
+* @param size The size of the buffer
+*
+* @return A pointer to the buffer, to be released with ckpt_free()
+*/
+void *ckpt_alloc(struct lp_struct *lp, size_t size)
+{
+	struct ckpt_arena *arena = lp->mm->arena;
+	struct arena_chunk *chunk = arena->newest;
+	struct arena_block *block;
+	size_t need = sizeof(struct arena_block) + arena_align(size);
+
+	if (unlikely(chunk == NULL || chunk->brk + need > chunk->size)) {
+		// An empty chunk which is too small would never be reclaimed
+		if (chunk != NULL && chunk->live == 0)
+			chunk_release(arena, chunk);
+		chunk = chunk_new(arena, need);
+	}
+
+	block = (struct arena_block *)(chunk->data + chunk->brk);
+	block->chunk = chunk;
+	block->size = need;
+
+	chunk->brk += need;
+	chunk->live++;
+	arena->live += need;
+
+	return block + 1;
+}
+
+/**
+* Release a buffer taken with ckpt_alloc(). The chunk it belongs to is
+* reclaimed as soon as it holds no other buffer.
+*
+* @param ptr A pointer to the buffer
+*/
+void ckpt_free(void *ptr)
+{
+	struct arena_block *block = (struct arena_block *)ptr - 1;
+	struct arena_chunk *chunk = block->chunk;
+	struct ckpt_arena *arena = chunk->arena;
+
+	arena->live -= block->size;
+	chunk->live--;
+
+	// Buffers released in LIFO order are given back to the chunk right away
+	if ((unsigned char *)block + block->size == chunk->data + chunk->brk)
+		chunk->brk -= block->size;
+
+	if (chunk->live == 0) {
+		if (chunk == arena->newest)
+			chunk->brk = 0;
+		else
+			chunk_release(arena, chunk);
+	}
+}
+
+/// The memory held by the arena of an LP, in bytes
+size_t ckpt_arena_memory(struct lp_struct *lp)
+{
+	return lp->mm->arena->memory;
+}
+
+/// The memory held by checkpoints of an LP which have not been released, in bytes
+size_t ckpt_arena_live(struct lp_struct *lp)
+{
+	return lp->mm->arena->live;
+}
+
+/// The peak memory held by all the checkpoint arenas of this kernel, in bytes
+size_t ckpt_arena_peak(void)
+{
+	return kernel_peak;
+}
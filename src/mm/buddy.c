@@ -217,8 +217,17 @@ void free_lp_memory(struct lp_struct *lp, void *ptr)
 {
 	size_t displacement;
 
-	displacement = (int)((char *)ptr - (char *)lp->mm->segment->base);
+	displacement = (size_t)((char *)ptr - (char *)lp->mm->segment->base);
 	spin_lock(&lp->mm->buddy->lock);
-	buddy_free(lp->mm->buddy, displacement);
+	buddy_free(lp->mm->buddy, displacement / BUDDY_GRANULARITY);
 	spin_unlock(&lp->mm->buddy->lock);
 }
+
+bool is_segment_memory(struct lp_struct *lp, const void *ptr)
+{
+	if (lp->mm->segment == NULL)
+		return false;
+
+	return (const unsigned char *)ptr >= lp->mm->segment->base &&
+	    (const unsigned char *)ptr < lp->mm->segment->base + PER_LP_PREALLOCATED_MEMORY;
+}
@@ -35,10 +35,150 @@
 #include <mm/mm.h>
 #include <core/timer.h>
 #include <core/core.h>
+#include <core/init.h>
+#include <datatypes/list.h>
 #include <scheduler/scheduler.h>
 #include <scheduler/process.h>
 #include <statistics/statistics.h>
 
+/// In adaptive mode, a log is compressed only if its content shrinks at least to this fraction
+#define COMPRESSION_MAX_RATIO	0.75
+
+/// In adaptive mode, compressing a log must not take longer than this many times taking it
+#define COMPRESSION_MAX_COST	8
+
+/// In adaptive mode, maximum number of logs taken uncompressed before trying to compress again
+#define COMPRESSION_MAX_BACKOFF	64
+
+/// Logs smaller than this are likely to stay in the caches until they are discarded, so they are not streamed
+#define STREAM_LOG_THRESHOLD	(1 << 20)
+
+/// A run of contiguous pages of the LP segment, followed by their content in an incremental log
+struct page_run {
+	size_t first;	///< Index of the first page of the run in the segment
+	size_t count;	///< Number of pages in the run
+};
+
+/// Per-thread buffers used to compress and decompress logs
+static __thread unsigned char *compress_buffer, *decompress_buffer;
+static __thread size_t compress_buffer_size, decompress_buffer_size;
+
+
+static inline void copy_to_log(void *dst, const void *src, size_t size, bool stream)
+{
+	if (stream)
+		log_copy(dst, src, size);
+	else
+		memcpy(dst, src, size);
+}
+
+
+static unsigned char *reserve_buffer(unsigned char **buffer, size_t *buffer_size, size_t size)
+{
+	if (unlikely(*buffer_size < size)) {
+		if (*buffer != NULL)
+			rsfree(*buffer);
+		*buffer_size = max(size, 2 * *buffer_size);
+		*buffer = rsalloc(*buffer_size);
+	}
+
+	return *buffer;
+}
+
+/**
+* Compress a full log which has just been taken. The content of the log is
+* compressed, while its malloc_state header is kept as it is, so that the
+* log can be inspected and packed without decompressing it.
+*
+* In adaptive mode, an LP stops compressing its logs when either the ratio
+* or the time spent compressing is not worth it, and tries again after a
+* number of logs which doubles each time compression does not pay off.
+*
+* @param lp A pointer to the lp_struct of the LP which has taken the log
+* @param ckpt The log, which must be the last buffer taken from the checkpoint arena of the LP
+* @param size The size of the log
+* @param log_time The time spent taking the log, in microseconds
+*
+* @return The log to keep, which is either @p ckpt or its compressed version
+*/
+static void *log_compress(struct lp_struct *lp, void *ckpt, size_t size, int log_time)
+{
+	struct memory_map *mm = lp->mm;
+	bool adaptive = (rootsim_config.ckpt_compression == CKPT_COMPRESSION_ADAPTIVE);
+	size_t content = size - sizeof(malloc_state), capacity, compressed;
+	unsigned char *buffer;
+	malloc_state header;
+	timer compression_timer;
+
+	if (adaptive && mm->compression_skip > 0) {
+		mm->compression_skip--;
+		return ckpt;
+	}
+
+	capacity = adaptive ? (size_t)(content * COMPRESSION_MAX_RATIO) : content - 1;
+	if (unlikely(content == 0 || capacity == 0))
+		return ckpt;
+
+	buffer = reserve_buffer(&compress_buffer, &compress_buffer_size, capacity);
+
+	timer_start(compression_timer);
+	compressed = lz_compress((unsigned char *)ckpt + sizeof(malloc_state), content, buffer, capacity);
+
+	if (adaptive) {
+		// Small logs are taken in less than the timer resolution
+		if (compressed == 0 || timer_value_micro(compression_timer) > COMPRESSION_MAX_COST * max(log_time, 1)) {
+			mm->compression_skip = mm->compression_backoff;
+			mm->compression_backoff = min(2 * mm->compression_backoff, COMPRESSION_MAX_BACKOFF);
+		} else {
+			mm->compression_backoff = 1;
+		}
+	}
+
+	if (compressed == 0)
+		return ckpt;
+
+	// The raw log is the last buffer in the arena: the compressed one takes its place
+	memcpy(&header, ckpt, sizeof(header));
+	header.compressed_size = compressed;
+	log_delete(ckpt);
+
+	ckpt = ckpt_alloc(lp, sizeof(header) + compressed);
+	memcpy(ckpt, &header, sizeof(header));
+	memcpy((unsigned char *)ckpt + sizeof(header), buffer, compressed);
+
+	statistics_post_data(lp, STAT_CKPT_SAVED, (double)(content - compressed));
+
+	return ckpt;
+}
+
+/**
+* Decompress a log produced by log_compress() into a per-thread buffer,
+* which is valid until the next log is decompressed by the same thread.
+*
+* @param ckpt The compressed log
+*
+* @return A pointer to the decompressed log
+*/
+static void *log_decompress(void *ckpt)
+{
+	malloc_state header;
+	unsigned char *buffer;
+	size_t size;
+
+	memcpy(&header, ckpt, sizeof(header));
+	header.compressed_size = 0;
+	size = get_log_size(&header);
+
+	buffer = reserve_buffer(&decompress_buffer, &decompress_buffer_size, size);
+	memcpy(buffer, &header, sizeof(header));
+
+	if (unlikely(lz_decompress((unsigned char *)ckpt + sizeof(header), ((malloc_state *)ckpt)->compressed_size,
+				   buffer + sizeof(header), size - sizeof(header)) != size - sizeof(header)))
+		rootsim_error(true, "Compressed log at %p is corrupted\n", ckpt);
+
+	return buffer;
+}
+
 /**
 * This function creates a full log of the current simulation states and returns a pointer to it.
 * The algorithm behind this function is based on packing of the really allocated memory chunks into
@@ -80,6 +220,7 @@ void *log_full(struct lp_struct *lp)
 	int i;
 	size_t size, chunk_size, bitmap_size;
 	malloc_area *m_area;
+	bool stream;
 
 	// Timers for self-tuning of the simulation platform
 	timer checkpoint_timer;
@@ -88,7 +229,10 @@ void *log_full(struct lp_struct *lp)
 	lp->mm->m_state->is_incremental = false;
 	size = get_log_size(lp->mm->m_state);
 
-	ckpt = rsalloc(size);
+	// A log which is about to be compressed is read right away, so it must not bypass the caches
+	stream = (size >= STREAM_LOG_THRESHOLD && rootsim_config.ckpt_compression == CKPT_COMPRESSION_NONE);
+
+	ckpt = ckpt_alloc(lp, size);
 
 	if (unlikely(ckpt == NULL)) {
 		rootsim_error(true, "(%d) Unable to acquire memory for checkpointing the current state (memory exhausted?)", lp->lid.to_int);
@@ -135,17 +279,17 @@ void *log_full(struct lp_struct *lp)
 		if (CHECK_LOG_MODE_BIT(m_area)) {
 
 			// If the malloc_area is almost (over a threshold) full, copy it entirely
-			memcpy(ptr, m_area->area, m_area->num_chunks * chunk_size);
+			copy_to_log(ptr, m_area->area, m_area->num_chunks * chunk_size, stream);
 			ptr = (void *)((char *)ptr + m_area->num_chunks * chunk_size);
 
 		} else {
 
-#define copy_from_area(x) ({\
-			memcpy(ptr, (void*)((char*)m_area->area + ((x) * chunk_size)), chunk_size);\
-			ptr = (void*)((char*)ptr + chunk_size);})
+#define copy_from_area(first, count) ({\
+			copy_to_log(ptr, (void*)((char*)m_area->area + ((first) * chunk_size)), (count) * chunk_size, stream);\
+			ptr = (void*)((char*)ptr + (count) * chunk_size);})
 
-			// Copy only the allocated chunks
-			bitmap_foreach_set(m_area->use_bitmap, bitmap_size, copy_from_area);
+			// Copy only the allocated chunks, contiguous ones at once
+			bitmap_foreach_run(m_area->use_bitmap, bitmap_size, copy_from_area);
 
 #undef copy_from_area
 		}
@@ -167,8 +311,105 @@ void *log_full(struct lp_struct *lp)
 	lp->mm->m_state->dirty_bitmap_size = 0;
 	lp->mm->m_state->total_inc_size = 0;
 
+	if (rootsim_config.ckpt_compression != CKPT_COMPRESSION_NONE)
+		ckpt = log_compress(lp, ckpt, size, timer_value_micro(checkpoint_timer));
+
+	statistics_post_data(lp, STAT_CKPT_TIME, (double)timer_value_micro(checkpoint_timer));
+	statistics_post_data(lp, STAT_CKPT_MEM, (double)get_log_size(ckpt));
+
+	return ckpt;
+}
+
+/// Tell whether all the malloc_areas of an LP are kept in its segment, and how many pages of the segment they span
+static bool segment_pages_in_use(struct lp_struct *lp, size_t *pages)
+{
+	malloc_state *m_state = lp->mm->m_state;
+	malloc_area *m_area;
+	size_t end;
+	int i;
+
+	*pages = 0;
+	for (i = 0; i < m_state->num_areas; i++) {
+		m_area = &m_state->areas[i];
+		if (m_area->self_pointer == NULL)
+			continue;
+		if (!is_segment_memory(lp, m_area->self_pointer))
+			return false;
+
+		end = (unsigned char *)m_area->self_pointer + AREA_MEMORY_SIZE(m_area) - lp->mm->segment->base;
+		*pages = max(*pages, (end + PAGE_SIZE - 1) / PAGE_SIZE);
+	}
+
+	return true;
+}
+
+/**
+* This function creates an incremental log of the current simulation state.
+* Besides the malloc_state and all the malloc_areas, the log keeps the pages
+* of the LP segment which have been modified since the previous log,
+* grouped in runs of contiguous pages. Bitmaps and chunks are therefore
+* restored by applying, on top of the last full log, the pages kept by all
+* the incremental logs taken after it.
+*
+* The size of the log is kept in the malloc_state saved in the log, so that
+* get_log_size() works as for the other logs: dirty_areas is the number of
+* malloc_areas, while total_inc_size is the size of the runs.
+*
+* @param lp A pointer to the lp_struct of the LP, whose malloc_areas must all be in its segment
+* @param pages The number of pages of the segment spanned by the malloc_areas
+* @return A pointer to the incremental log
+*/
+static void *log_incremental(struct lp_struct *lp, size_t pages)
+{
+	malloc_state *m_state = lp->mm->m_state, *header;
+	unsigned char *base = lp->mm->segment->base, *ptr;
+	size_t size, bitmap_size, dirty = 0, runs = 0;
+	struct page_run run;
+	void *ckpt;
+	bool stream;
+
+	timer checkpoint_timer;
+	timer_start(checkpoint_timer);
+
+	bitmap_size = bitmap_required_size(pages);
+
+#define count_run(x, n) ({			runs++;			dirty += (n);})
+
+	bitmap_foreach_run(lp->mm->dirty_pages, bitmap_size, count_run);
+
+#undef count_run
+
+	size = sizeof(malloc_state) + m_state->num_areas * sizeof(malloc_area) + runs * sizeof(struct page_run) + dirty * PAGE_SIZE;
+	stream = (size >= STREAM_LOG_THRESHOLD && rootsim_config.ckpt_compression == CKPT_COMPRESSION_NONE);
+
+	ckpt = ckpt_alloc(lp, size);
+	if (unlikely(ckpt == NULL)) {
+		rootsim_error(true, "(%d) Unable to acquire memory for checkpointing the current state (memory exhausted?)", lp->lid.to_int);
+	}
+
+	header = ckpt;
+	memcpy(header, m_state, sizeof(malloc_state));
+	header->is_incremental = true;
+	header->timestamp = lvt(lp);
+	header->dirty_areas = m_state->num_areas;
+	header->dirty_bitmap_size = 0;
+	header->total_inc_size = runs * sizeof(struct page_run) + dirty * PAGE_SIZE;
+	ptr = (unsigned char *)ckpt + sizeof(malloc_state);
+
+	memcpy(ptr, m_state->areas, m_state->num_areas * sizeof(malloc_area));
+	ptr += m_state->num_areas * sizeof(malloc_area);
+
+#define copy_run(x, n) ({			run.first = (x);			run.count = (n);			memcpy(ptr, &run, sizeof(run));			ptr += sizeof(run);			copy_to_log(ptr, base + run.first * PAGE_SIZE, run.count * PAGE_SIZE, stream);			ptr += run.count * PAGE_SIZE;})
+
+	bitmap_foreach_run(lp->mm->dirty_pages, bitmap_size, copy_run);
+
+#undef copy_run
+
+	if (rootsim_config.ckpt_compression != CKPT_COMPRESSION_NONE)
+		ckpt = log_compress(lp, ckpt, size, timer_value_micro(checkpoint_timer));
+
 	statistics_post_data(lp, STAT_CKPT_TIME, (double)timer_value_micro(checkpoint_timer));
-	statistics_post_data(lp, STAT_CKPT_MEM, (double)size);
+	statistics_post_data(lp, STAT_CKPT_MEM, (double)get_log_size(ckpt));
 
 	return ckpt;
 }
@@ -194,8 +435,31 @@ void *log_full(struct lp_struct *lp)
 */
 void *log_state(struct lp_struct *lp)
 {
+	struct memory_map *mm = lp->mm;
+	size_t pages;
+	void *ckpt;
+
 	statistics_post_data(lp, STAT_CKPT, 1.0);
-	return log_full(lp);
+
+	if (mm->dirty_pages == NULL)
+		return log_full(lp);
+
+	soft_dirty_collect();
+
+	// Areas outside of the segment are not tracked, and a full log is
+	// taken periodically to bound the number of logs to apply upon a restore
+	if (segment_pages_in_use(lp, &pages) && mm->inc_logs < INCREMENTAL_GRANULARITY) {
+		ckpt = log_incremental(lp, pages);
+		mm->inc_logs++;
+	} else {
+		ckpt = log_full(lp);
+		mm->inc_logs = 0;
+	}
+
+	// The next log starts from here
+	bitmap_initialize(mm->dirty_pages, SEGMENT_PAGES);
+
+	return ckpt;
 }
 
 /**
@@ -225,23 +489,30 @@ void *log_state(struct lp_struct *lp)
 void restore_full(struct lp_struct *lp, void *ckpt)
 {
 	void *ptr;
-	int i, original_num_areas, restored_areas;
+	int i, original_num_areas, max_num_areas, restored_areas;
 	size_t chunk_size, bitmap_size;
 	malloc_area *m_area, *new_area;
+	struct _malloc_index *index;
 
 	// Timers for simulation platform self-tuning
 	timer recovery_timer;
 	timer_start(recovery_timer);
 	restored_areas = 0;
 	ptr = ckpt;
+	if (((malloc_state *)ckpt)->compressed_size > 0)
+		ptr = log_decompress(ckpt);
 	original_num_areas = lp->mm->m_state->num_areas;
+	max_num_areas = lp->mm->m_state->max_num_areas;
 	new_area = lp->mm->m_state->areas;
+	index = lp->mm->m_state->index;
 
 	// Restore malloc_state
 	memcpy(lp->mm->m_state, ptr, sizeof(malloc_state));
 	ptr = (void *)((char *)ptr + sizeof(malloc_state));
 
 	lp->mm->m_state->areas = new_area;
+	lp->mm->m_state->max_num_areas = max_num_areas;
+	lp->mm->m_state->index = index;
 
 	// Scan areas and chunk to restore them
 	for (i = 0; i < lp->mm->m_state->num_areas; i++) {
@@ -295,11 +566,11 @@ void restore_full(struct lp_struct *lp, void *ckpt)
 			// Logged chunks are the ones associated with a used bit whose value is 1
 			// Their number is in the alloc_chunks counter
 
-#define copy_to_area(x) ({\
-		memcpy((void*)((char*)m_area->area + ((x) * chunk_size)), ptr, chunk_size);\
-		ptr = (void*)((char*)ptr + chunk_size);})
+#define copy_to_area(first, count) ({\
+		memcpy((void*)((char*)m_area->area + ((first) * chunk_size)), ptr, (count) * chunk_size);\
+		ptr = (void*)((char*)ptr + (count) * chunk_size);})
 
-			bitmap_foreach_set(m_area->use_bitmap, bitmap_size, copy_to_area);
+			bitmap_foreach_run(m_area->use_bitmap, bitmap_size, copy_to_area);
 
 #undef copy_to_area
 		}
@@ -317,7 +588,6 @@ void restore_full(struct lp_struct *lp, void *ckpt)
 			m_area->state_changed = 0;
 			m_area->next_chunk = 0;
 			m_area->last_access = lp->mm->m_state->timestamp;
-			lp->mm->m_state->areas[m_area->prev].next = m_area->idx;
 
 			RESET_LOG_MODE_BIT(m_area);
 			RESET_AREA_LOCK_BIT(m_area);
@@ -338,6 +608,135 @@ void restore_full(struct lp_struct *lp, void *ckpt)
 	lp->mm->m_state->dirty_bitmap_size = 0;
 	lp->mm->m_state->total_inc_size = 0;
 
+	malloc_state_reindex(lp->mm->m_state);
+
+	statistics_post_data(lp, STAT_RECOVERY_TIME, (double)timer_value_micro(recovery_timer));
+}
+
+/**
+* Copy back into the segment of an LP the pages kept by an incremental log.
+*
+* @param lp A pointer to the lp_struct of the LP
+* @param ckpt The incremental log
+* @return A pointer to the uncompressed log, which is valid until the next log is decompressed
+*/
+static malloc_state *restore_pages(struct lp_struct *lp, void *ckpt)
+{
+	malloc_state *header = ckpt;
+	unsigned char *ptr, *end;
+	struct page_run run;
+
+	if (header->compressed_size > 0)
+		header = log_decompress(ckpt);
+
+	ptr = (unsigned char *)header + sizeof(malloc_state) + header->num_areas * sizeof(malloc_area);
+	end = (unsigned char *)header + get_log_size(header);
+
+	while (ptr < end) {
+		memcpy(&run, ptr, sizeof(run));
+		ptr += sizeof(run);
+		memcpy(lp->mm->segment->base + run.first * PAGE_SIZE, ptr, run.count * PAGE_SIZE);
+		ptr += run.count * PAGE_SIZE;
+	}
+
+	return header;
+}
+
+/**
+* Restore the malloc_state and the malloc_areas kept by an incremental log,
+* once its pages are back in the segment. The memory of a malloc_area is
+* never released, so areas which were not in use when the log was taken
+* keep it, as restore_full() does.
+*
+* @param lp A pointer to the lp_struct of the LP
+* @param logged The uncompressed incremental log
+*/
+static void restore_malloc_state(struct lp_struct *lp, malloc_state *logged)
+{
+	malloc_state *m_state = lp->mm->m_state;
+	malloc_area *areas = m_state->areas, *logged_areas, *m_area;
+	struct _malloc_index *index = m_state->index;
+	int i, original_num_areas = m_state->num_areas, max_num_areas = m_state->max_num_areas;
+
+	logged_areas = (malloc_area *)((char *)logged + sizeof(malloc_state));
+
+	memcpy(m_state, logged, sizeof(malloc_state));
+	m_state->areas = areas;
+	m_state->max_num_areas = max_num_areas;
+	m_state->index = index;
+
+	for (i = 0; i < original_num_areas; i++) {
+		m_area = &areas[i];
+
+		if (i < logged->num_areas && logged_areas[i].alloc_chunks > 0) {
+			memcpy(m_area, &logged_areas[i], sizeof(malloc_area));
+		} else {
+			m_area->alloc_chunks = 0;
+			m_area->next_chunk = 0;
+			m_area->last_access = m_state->timestamp;
+			RESET_LOG_MODE_BIT(m_area);
+			RESET_AREA_LOCK_BIT(m_area);
+
+			// The area may have been taken into use after the log
+			if (m_area->use_bitmap != NULL)
+				memset(m_area->use_bitmap, 0, bitmap_required_size(m_area->num_chunks));
+		}
+
+		m_area->dirty_chunks = 0;
+		m_area->state_changed = 0;
+
+		if (m_area->self_pointer != NULL) {
+			memset(m_area->dirty_bitmap, 0, bitmap_required_size(m_area->num_chunks));
+			// Restored pages keep the address which the malloc_area had when they were logged
+			*(unsigned long long *)(m_area->self_pointer) = (unsigned long long)m_area;
+		}
+	}
+
+	m_state->num_areas = original_num_areas;
+	m_state->timestamp = -1;
+	m_state->is_incremental = false;
+	m_state->compressed_size = 0;
+	m_state->dirty_areas = 0;
+	m_state->dirty_bitmap_size = 0;
+	m_state->total_inc_size = 0;
+
+	malloc_state_reindex(m_state);
+}
+
+/**
+* Restore an incremental log. The last full log which precedes it in the
+* state queue is restored first, then the pages of all the incremental logs
+* up to the requested one are applied in order.
+*
+* @param lp A pointer to the lp_struct of the LP
+* @param target The node of the state queue keeping the incremental log
+*/
+static void restore_incremental(struct lp_struct *lp, state_t *target)
+{
+	state_t *state = target;
+	malloc_state *logged;
+	timer recovery_timer;
+
+	do {
+		state = list_prev(state);
+		if (unlikely(state == NULL)) {
+			rootsim_error(true, "LP %u has no full log preceding its incremental log at time %f. Aborting...\n",
+				      lp->gid.to_int, target->lvt);
+		}
+	} while (is_incremental(state->log));
+
+	restore_full(lp, state->log);
+
+	// restore_full() accounts for its own time
+	timer_start(recovery_timer);
+
+	do {
+		state = list_next(state);
+		logged = restore_pages(lp, state->log);
+	} while (state != target);
+
+	restore_malloc_state(lp, logged);
+
 	statistics_post_data(lp, STAT_RECOVERY_TIME, (double)timer_value_micro(recovery_timer));
 }
 
@@ -358,7 +757,11 @@ void restore_full(struct lp_struct *lp, void *ckpt)
 void log_restore(struct lp_struct *lp, state_t *state_queue_node)
 {
 	statistics_post_data(lp, STAT_RECOVERY, 1.0);
-	restore_full(lp, state_queue_node->log);
+
+	if (is_incremental(state_queue_node->log))
+		restore_incremental(lp, state_queue_node);
+	else
+		restore_full(lp, state_queue_node->log);
 }
 
 /**
@@ -374,6 +777,6 @@ void log_restore(struct lp_struct *lp, state_t *state_queue_node)
 void log_delete(void *ckpt)
 {
 	if (likely(ckpt != NULL)) {
-		rsfree(ckpt);
+		ckpt_free(ckpt);
 	}
 }
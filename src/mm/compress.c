@@ -0,0 +1,291 @@
+/**
+* @file mm/compress.c
+*
+* @brief Fast LZ compression of checkpoints
+*
+* A byte-oriented LZ77 codec in the spirit of LZ4, tuned for speed rather
+* than for ratio. Logs taken by DyMeLoR are made of chunks which are
+* mostly zeroed or share the same layout, so that even this simple scheme
+* gives a good reduction at a fraction of the cost of general-purpose
+* codecs.
+*
+* The compressed stream is a sequence of blocks, each made of:
+* - a token byte, keeping in the high nibble the number of literals and in
+*   the low nibble the length of the match minus LZ_MIN_MATCH. A nibble
+*   equal to 15 is followed by additional bytes to be summed to it, until
+*   a byte different from 255 is found;
+* - the literals;
+* - the 16-bit little-endian backward offset of the match, and the
+*   additional bytes of its length, if any.
+*
+* The last block has no match: the stream ends right after its literals.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <mm/mm.h>
+
+/// Shortest match which is encoded
+#define LZ_MIN_MATCH		4
+
+/// Longest backward distance of a match
+#define LZ_MAX_OFFSET		65535
+
+/// No match is looked for in the last bytes of the input
+#define LZ_LAST_LITERALS	8
+
+/// Number of bits of the hash of a 4-byte sequence
+#define LZ_HASH_BITS		12
+
+/// The search is accelerated by one byte every (1 << LZ_SKIP_TRIGGER) bytes without a match
+#define LZ_SKIP_TRIGGER		6
+
+/// The last position at which each 4-byte sequence has been seen. Stale entries are harmless, since matches are always verified.
+static __thread uint32_t lz_table[1 << LZ_HASH_BITS];
+
+
+static inline uint32_t read32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/// Length of the common prefix of two buffers, none of which goes past @p end
+static inline size_t common_length(const unsigned char *a, const unsigned char *b, const unsigned char *end)
+{
+	const unsigned char *start = b;
+	uint64_t diff;
+
+	while (b + sizeof(uint64_t) <= end) {
+		diff = read64(a) ^ read64(b);
+		if (diff != 0)
+			return b - start + (__builtin_ctzll(diff) >> 3);
+		a += sizeof(uint64_t);
+		b += sizeof(uint64_t);
+	}
+	while (b < end && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return b - start;
+}
+
+/// Write the extra bytes of a length which did not fit in its nibble
+static inline unsigned char *put_length(unsigned char *op, size_t length)
+{
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+/// Append a block to the compressed stream. Returns NULL if it does not fit before @p op_end.
+static unsigned char *put_block(unsigned char *op, unsigned char *op_end, const unsigned char *literals,
+				size_t n_literals, size_t offset, size_t match_length)
+{
+	unsigned char *token = op++;
+	size_t needed = n_literals;
+
+	if (n_literals >= 15)
+		needed += (n_literals - 15) / 255 + 1;
+	if (match_length > 0) {
+		needed += 2;
+		if (match_length - LZ_MIN_MATCH >= 15)
+			needed += (match_length - LZ_MIN_MATCH - 15) / 255 + 1;
+	}
+	if (token >= op_end || needed > (size_t)(op_end - op))
+		return NULL;
+
+	if (n_literals >= 15) {
+		*token = 15 << 4;
+		op = put_length(op, n_literals - 15);
+	} else {
+		*token = (unsigned char)(n_literals << 4);
+	}
+	memcpy(op, literals, n_literals);
+	op += n_literals;
+
+	// The last block has no match
+	if (match_length == 0)
+		return op;
+
+	*op++ = (unsigned char)(offset & 0xff);
+	*op++ = (unsigned char)(offset >> 8);
+
+	match_length -= LZ_MIN_MATCH;
+	if (match_length >= 15) {
+		*token |= 15;
+		op = put_length(op, match_length - 15);
+	} else {
+		*token |= (unsigned char)match_length;
+	}
+
+	return op;
+}
+
+/**
+* Compress a buffer. The compression is given up as soon as the output
+* would not fit in @p capacity bytes, so that callers can bound both the
+* ratio they are willing to accept and the time spent on data which does
+* not compress well.
+*
+* @param src The buffer to compress
+* @param size The size of @p src
+* @param dst The buffer which receives the compressed stream
+* @param capacity The size of @p dst
+*
+* @return The size of the compressed stream, or 0 if it does not fit in @p dst
+*/
+size_t lz_compress(const void *src, size_t size, void *dst, size_t capacity)
+{
+	const unsigned char *base = src, *end = base + size;
+	const unsigned char *ip = base, *anchor = base, *ref;
+	const unsigned char *match_limit = end - LZ_LAST_LITERALS;
+	unsigned char *op = dst, *op_end = op + capacity;
+	uint32_t sequence, h;
+	size_t length;
+
+	if (unlikely(size > UINT32_MAX))
+		return 0;
+
+	if (size > LZ_LAST_LITERALS + LZ_MIN_MATCH) {
+		while (ip + LZ_MIN_MATCH <= match_limit) {
+			sequence = read32(ip);
+			h = lz_hash(sequence);
+			ref = base + lz_table[h];
+			lz_table[h] = (uint32_t)(ip - base);
+
+			if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != sequence) {
+				ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+				continue;
+			}
+
+			length = LZ_MIN_MATCH + common_length(ref + LZ_MIN_MATCH, ip + LZ_MIN_MATCH, match_limit);
+
+			op = put_block(op, op_end, anchor, ip - anchor, ip - ref, length);
+			if (op == NULL)
+				return 0;
+
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	op = put_block(op, op_end, anchor, end - anchor, 0, 0);
+	if (op == NULL)
+		return 0;
+
+	return op - (unsigned char *)dst;
+}
+
+/// Read the extra bytes of a length which did not fit in its nibble
+static inline const unsigned char *get_length(const unsigned char *ip, const unsigned char *end, size_t *length)
+{
+	unsigned char byte;
+
+	do {
+		if (unlikely(ip >= end))
+			return NULL;
+		byte = *ip++;
+		*length += byte;
+	} while (byte == 255);
+
+	return ip;
+}
+
+/**
+* Decompress a stream produced by lz_compress().
+*
+* @param src The compressed stream
+* @param size The size of @p src
+* @param dst The buffer which receives the original data
+* @param capacity The size of @p dst
+*
+* @return The size of the original data, or 0 if the stream is corrupted
+*         or if it does not fit in @p dst
+*/
+size_t lz_decompress(const void *src, size_t size, void *dst, size_t capacity)
+{
+	const unsigned char *ip = src, *end = ip + size;
+	unsigned char *op = dst, *op_end = op + capacity, *ref;
+	size_t length, offset;
+	unsigned char token;
+
+	while (ip < end) {
+		token = *ip++;
+
+		length = token >> 4;
+		if (length == 15 && (ip = get_length(ip, end, &length)) == NULL)
+			return 0;
+		if (unlikely(ip + length > end || op + length > op_end))
+			return 0;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		if (ip == end)
+			break;
+
+		if (unlikely(ip + 2 > end))
+			return 0;
+		offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+
+		length = token & 15;
+		if (length == 15 && (ip = get_length(ip, end, &length)) == NULL)
+			return 0;
+		length += LZ_MIN_MATCH;
+
+		if (unlikely(offset == 0 || offset > (size_t)(op - (unsigned char *)dst) || op + length > op_end))
+			return 0;
+
+		// Matches can overlap with the data they produce
+		ref = op - offset;
+		if (offset >= length) {
+			memcpy(op, ref, length);
+			op += length;
+		} else {
+			while (length--)
+				*op++ = *ref++;
+		}
+	}
+
+	return op - (unsigned char *)dst;
+}
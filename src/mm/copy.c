@@ -0,0 +1,150 @@
+/**
+* @file mm/copy.c
+*
+* @brief Copy of large buffers into logs
+*
+* Logs are written once and are seldom read back: most of them are
+* discarded by fossil collection without ever being restored. Copying a
+* large state into a log with regular stores evicts from the caches the
+* state of the LP itself, and those of the other LPs bound to the same
+* worker thread. Large copies are therefore carried out with non-temporal
+* stores, which bypass the cache hierarchy.
+*
+* The widest vector extension supported by the processor is selected at
+* runtime, so that the same binary can run on any x86-64 machine.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+// This must come before the kernel headers, which poison malloc()
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <mm/mm.h>
+
+/// Copies smaller than this are carried out with memcpy()
+#define STREAM_COPY_THRESHOLD	4096
+
+typedef void (*stream_copy_fn)(unsigned char *dst, const unsigned char *src, size_t size);
+
+static void stream_copy_generic(unsigned char *dst, const unsigned char *src, size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static void stream_copy_avx2(unsigned char *dst, const unsigned char *src, size_t size)
+{
+	size_t head = (32 - ((uintptr_t)dst & 31)) & 31;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	while (size >= 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)src);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+
+		_mm256_stream_si256((__m256i *)dst, a);
+		_mm256_stream_si256((__m256i *)(dst + 32), b);
+		_mm256_stream_si256((__m256i *)(dst + 64), c);
+		_mm256_stream_si256((__m256i *)(dst + 96), d);
+		dst += 128;
+		src += 128;
+		size -= 128;
+	}
+	_mm_sfence();
+
+	memcpy(dst, src, size);
+}
+
+__attribute__((target("avx512f")))
+static void stream_copy_avx512(unsigned char *dst, const unsigned char *src, size_t size)
+{
+	size_t head = (64 - ((uintptr_t)dst & 63)) & 63;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	while (size >= 256) {
+		__m512i a = _mm512_loadu_si512((const void *)src);
+		__m512i b = _mm512_loadu_si512((const void *)(src + 64));
+		__m512i c = _mm512_loadu_si512((const void *)(src + 128));
+		__m512i d = _mm512_loadu_si512((const void *)(src + 192));
+
+		_mm512_stream_si512((void *)dst, a);
+		_mm512_stream_si512((void *)(dst + 64), b);
+		_mm512_stream_si512((void *)(dst + 128), c);
+		_mm512_stream_si512((void *)(dst + 192), d);
+		dst += 256;
+		src += 256;
+		size -= 256;
+	}
+	_mm_sfence();
+
+	memcpy(dst, src, size);
+}
+
+#endif
+
+/// The implementation in use, selected upon the first copy
+static stream_copy_fn stream_copy_impl;
+
+static stream_copy_fn stream_copy_select(void)
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return stream_copy_avx512;
+	if (__builtin_cpu_supports("avx2"))
+		return stream_copy_avx2;
+#endif
+	return stream_copy_generic;
+}
+
+/**
+* Copy a buffer into a log. Large copies bypass the caches, so the
+* destination should not be read right after the copy.
+*
+* @param dst The destination buffer, in the log
+* @param src The source buffer
+* @param size The number of bytes to copy
+*/
+void log_copy(void *dst, const void *src, size_t size)
+{
+	// Concurrent selections are harmless, they all pick the same function
+	if (unlikely(stream_copy_impl == NULL))
+		stream_copy_impl = stream_copy_select();
+
+	if (size < STREAM_COPY_THRESHOLD)
+		memcpy(dst, src, size);
+	else
+		stream_copy_impl(dst, src, size);
+}
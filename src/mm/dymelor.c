@@ -64,19 +64,73 @@ static void malloc_area_init(malloc_area * m_area, size_t size, int num_chunks)
 	atomic_set(&m_area->presence, 0);
 #endif
 
-	m_area->prev = -1;
-	m_area->next = -1;
-
 	SET_AREA_LOCK_BIT(m_area);
 
 }
 
+/// Chunk size served by the malloc_areas in a given position of the index
+#define size_class(chunk_size) (__builtin_ctzl(chunk_size) - __builtin_ctz(MIN_CHUNK_SIZE))
+
+/// Tell whether a malloc_area is a dedicated extent for an allocation larger than MAX_CHUNK_SIZE
+#define is_extent(m_area) (UNTAGGED_CHUNK_SIZE(m_area) > MAX_CHUNK_SIZE)
+
+/**
+* This function returns the number of chunks of the first malloc_area serving
+* a given chunk size. Malloc_areas of large chunks are kept small at first, so
+* that a few large allocations do not commit a huge amount of memory.
+*
+* @param chunk_size The size of the chunks of the malloc_area
+* @return The logarithm of the number of chunks
+*/
+static inline int first_area_chunks_log(size_t chunk_size)
+{
+	int chunks_log = __builtin_ctz(MIN_NUM_CHUNKS);
+
+	if (chunk_size << chunks_log > MAX_INITIAL_AREA_SIZE)
+		chunks_log = max(__builtin_ctz(MAX_INITIAL_AREA_SIZE) - __builtin_ctzl(chunk_size), 0);
+
+	return chunks_log;
+}
+
+/// Position of a malloc_area among the ones serving the same chunk size
+#define area_slot(m_area) (__builtin_ctz((m_area)->num_chunks) - first_area_chunks_log(UNTAGGED_CHUNK_SIZE(m_area)))
+
+/**
+* This function rebuilds the index of the malloc_areas of a malloc_state.
+* It must be called whenever malloc_areas are restored, moved or removed.
+*
+* @param state The malloc_state to reindex
+*/
+void malloc_state_reindex(malloc_state *state)
+{
+	struct _malloc_index *index = state->index;
+	malloc_area *m_area;
+	int i, class, slot;
+
+	memset(index->present, 0, sizeof(index->present));
+	memset(index->non_full, 0, sizeof(index->non_full));
+
+	for (i = 0; i < state->num_areas; i++) {
+		m_area = &state->areas[i];
+		if (is_extent(m_area))
+			continue;
+
+		class = size_class(UNTAGGED_CHUNK_SIZE(m_area));
+		slot = area_slot(m_area);
+
+		index->present[class] |= 1U << slot;
+		index->slot_area[class][slot] = i;
+		if (m_area->alloc_chunks < m_area->num_chunks)
+			index->non_full[class] |= 1U << slot;
+	}
+}
+
 /**
 * This function inizializes a malloc_state.
 */
 malloc_state *malloc_state_init(void)
 {
-	int i, num_chunks;
+	int i;
 	size_t chunk_size;
 	malloc_state *state;
 
@@ -87,41 +141,85 @@ malloc_state *malloc_state_init(void)
 	state->busy_areas = 0;
 	state->dirty_areas = 0;
 	state->num_areas = NUM_AREAS;
-	state->max_num_areas = MAX_NUM_AREAS;
+	state->max_num_areas = INITIAL_NUM_AREAS;
 	state->bitmap_size = 0;
 	state->dirty_bitmap_size = 0;
 	state->timestamp = -1;
 	state->is_incremental = false;
+	state->compressed_size = 0;
 
 	state->areas = (malloc_area *) rsalloc(state->max_num_areas * sizeof(malloc_area));
-	if (unlikely(state->areas == NULL)) {
+	state->index = rsalloc(sizeof(struct _malloc_index));
+	if (unlikely(state->areas == NULL || state->index == NULL)) {
 		rootsim_error(true, "Unable to allocate memory.\n");
 	}
 
 	chunk_size = MIN_CHUNK_SIZE;
-	num_chunks = MIN_NUM_CHUNKS;
 
 	for (i = 0; i < NUM_AREAS; i++) {
 
-		malloc_area_init(&state->areas[i], chunk_size, num_chunks);
+		malloc_area_init(&state->areas[i], chunk_size, 1 << first_area_chunks_log(chunk_size));
 		state->areas[i].idx = i;
 		chunk_size = chunk_size << 1;
 	}
 
+	malloc_state_reindex(state);
+
 	return state;
 }
 
-void malloc_state_wipe(malloc_state **state_ptr)
+/**
+* This function gets the memory to keep a malloc_area (its bitmaps and chunks).
+* If the LP has a buddy-managed segment, the memory is taken from there, so
+* that the malloc_area sits at an address which does not depend on the kernel
+* instance hosting the LP. Otherwise, or if the segment is exhausted, the
+* platform allocator is used.
+*
+* @param lp A pointer to the lp_struct of the LP owning the malloc_area
+* @param size The size in bytes of the memory to allocate
+* @return A pointer to the allocated memory
+*/
+static void *get_area_memory(struct lp_struct *lp, size_t size)
+{
+	void *ptr;
+
+	if (lp->mm->buddy != NULL) {
+		ptr = allocate_lp_memory(lp, size);
+		if (likely(ptr != NULL))
+			return ptr;
+	}
+
+	return rsalloc(size);
+}
+
+/**
+* This function releases the memory of a malloc_area, taken via get_area_memory().
+*
+* @param lp A pointer to the lp_struct of the LP owning the malloc_area
+* @param ptr A pointer to the memory to release
+*/
+static void release_area_memory(struct lp_struct *lp, void *ptr)
+{
+	if (is_segment_memory(lp, ptr))
+		free_lp_memory(lp, ptr);
+	else
+		rsfree(ptr);
+}
+
+void malloc_state_wipe(struct lp_struct *lp)
 {
 	int i;
-	malloc_state *state = *state_ptr;
+	malloc_state *state = lp->mm->m_state;
 
-	for (i = 0; i < NUM_AREAS; i++) {
-		rsfree(state->areas[i].self_pointer); // TODO: when reintroducing the buddy, this must be changed
+	for (i = 0; i < state->num_areas; i++) {
+		if (state->areas[i].self_pointer != NULL)
+			release_area_memory(lp, state->areas[i].self_pointer);
 	}
 
-	rsfree(*state_ptr);
-	*state_ptr = NULL;
+	rsfree(state->areas);
+	rsfree(state->index);
+	rsfree(state);
+	lp->mm->m_state = NULL;
 }
 
 /**
@@ -149,7 +247,8 @@ static size_t compute_size(size_t size)
 /**
 * Find the smallest idx associated with a free chunk in a given malloc_area.
 * This function tries to keep the chunks clustered in the beginning of the malloc_area,
-* so to enchance locality
+* so to enchance locality. Since all the chunks before next_chunk are in use, the
+* use bitmap is scanned from there, skipping whole blocks of used chunks at once.
 *
 * @author Roberto Toccaceli
 * @author Francesco Quaglia
@@ -158,145 +257,130 @@ static size_t compute_size(size_t size)
 */
 static void find_next_free(malloc_area * m_area)
 {
-	m_area->next_chunk++;
-
-	while (m_area->next_chunk < m_area->num_chunks) {
-		if (!bitmap_check(m_area->use_bitmap, m_area->next_chunk))
-			break;
-
-		m_area->next_chunk++;
-	}
-
+	B_BLOCK_TYPE *blocks = B_UNION_CAST(m_area->use_bitmap);
+	unsigned i = (unsigned)m_area->next_chunk / B_BITS_PER_BLOCK;
+	unsigned last = (unsigned)(m_area->num_chunks - 1) / B_BITS_PER_BLOCK;
+	B_BLOCK_TYPE free_chunks;
+
+	free_chunks = ~blocks[i] & (~(B_BLOCK_TYPE)0 << B_MOD_OF_BPB(m_area->next_chunk));
+	while (free_chunks == 0 && i < last)
+		free_chunks = ~blocks[++i];
+
+	// Bits past the last chunk are never set
+	if (free_chunks == 0)
+		m_area->next_chunk = m_area->num_chunks;
+	else
+		m_area->next_chunk = min((int)(i * B_BITS_PER_BLOCK + B_CTZ(free_chunks)), m_area->num_chunks);
 }
 
-void *do_malloc(struct lp_struct *lp, size_t size)
+/**
+* This function appends a new malloc_area to a malloc_state. If there is no
+* room left, the array of malloc_areas is doubled. Chunks reach their
+* malloc_area through the pointer at the beginning of its memory, which is
+* therefore updated when the malloc_areas are moved.
+*
+* @param state The malloc_state to add the malloc_area to
+* @param chunk_size The chunks' size of the malloc_area
+* @param num_chunks The number of chunks of the malloc_area
+* @return A pointer to the new malloc_area
+*/
+static malloc_area *new_area(malloc_state *state, size_t chunk_size, int num_chunks)
 {
-	malloc_area *m_area, *prev_area = NULL;
-	void *ptr;
-	size_t area_size, bitmap_size;
-
-	size = compute_size(size);
-
-	if (unlikely(size > MAX_CHUNK_SIZE)) {
-		rootsim_error(false, "Requested a memory allocation of %d but the limit is %d. Reconfigure MAX_CHUNK_SIZE. Returning NULL.\n",
-			      size, MAX_CHUNK_SIZE);
-		return NULL;
-	}
-
-	m_area = &lp->mm->m_state->areas[(int)log2(size) -
-					 (int)log2(MIN_CHUNK_SIZE)];
+	malloc_area *m_area;
+	int i;
 
-#ifndef NDEBUG
-	atomic_inc(&m_area->presence);
-	assert(atomic_read(&m_area->presence) == 1);
-#endif
+	if (unlikely(state->num_areas == state->max_num_areas)) {
+		state->max_num_areas <<= 1;
+		state->areas = rsrealloc(state->areas, state->max_num_areas * sizeof(malloc_area));
+		if (unlikely(state->areas == NULL)) {
+			rootsim_error(true, "DyMeLoR: cannot reallocate the block of malloc_area.\n");
+		}
 
-	while (m_area != NULL && m_area->alloc_chunks == m_area->num_chunks) {
-		prev_area = m_area;
-		if (m_area->next == -1) {
-			m_area = NULL;
-		} else {
-			m_area = &(lp->mm->m_state->areas[m_area->next]);
-#ifndef NDEBUG
-			atomic_inc(&m_area->presence);
-			assert(atomic_read(&m_area->presence) == 1);
-#endif
+		for (i = 0; i < state->num_areas; i++) {
+			if (state->areas[i].self_pointer != NULL)
+				*(unsigned long long *)(state->areas[i].self_pointer) = (unsigned long long)&state->areas[i];
 		}
 	}
 
-#ifndef NDEBUG
-	if (prev_area != NULL) {
-		atomic_dec(&prev_area->presence);
-	}
-#endif
+	m_area = &state->areas[state->num_areas];
+	malloc_area_init(m_area, chunk_size, num_chunks);
+	m_area->idx = state->num_areas++;
 
-	if (m_area == NULL) {
+	return m_area;
+}
 
-		printf("Initializing an additional area\n");
-		fflush(stdout);
+/**
+* This function gets the memory of a malloc_area, upon its first use.
+* Only the back pointer and the bitmaps are cleared: chunks are initialized
+* by the application level software, so large areas are not committed at once.
+*
+* @param lp A pointer to the lp_struct of the LP owning the malloc_area
+* @param m_area The malloc_area
+*/
+static void malloc_area_memory_init(struct lp_struct *lp, malloc_area *m_area)
+{
+	size_t bitmap_size = bitmap_required_size(m_area->num_chunks);
 
-		if (lp->mm->m_state->num_areas == lp->mm->m_state->max_num_areas) {
+	m_area->self_pointer = get_area_memory(lp, AREA_MEMORY_SIZE(m_area));
 
-			malloc_area *tmp = NULL;
+	if (unlikely(m_area->self_pointer == NULL)) {
+		rootsim_error(true, "Error while allocating memory.\n");
+	}
 
-			if ((lp->mm->m_state->max_num_areas << 1) > MAX_LIMIT_NUM_AREAS) {
-#ifndef NDEBUG
-				atomic_dec(&m_area->presence);
-#endif
-				return NULL;
-			}
+	bzero(m_area->self_pointer, sizeof(malloc_area *) + bitmap_size * 2);
 
-			lp->mm->m_state->max_num_areas <<= 1;
+	m_area->dirty_chunks = 0;
+	*(unsigned long long *)(m_area->self_pointer) = (unsigned long long)m_area;
 
-			rootsim_error(true, "To reimplement\n");
-//                      tmp = (malloc_area *)pool_realloc_memory(lp->mm->m_state->areas, lp->mm->m_state->max_num_areas * sizeof(malloc_area));
-			if (tmp == NULL) {
+	m_area->use_bitmap = ((unsigned char *)m_area->self_pointer + sizeof(malloc_area *));
+	m_area->dirty_bitmap = ((unsigned char *)m_area->use_bitmap + bitmap_size);
+	m_area->area = (void *)((char *)m_area->dirty_bitmap + bitmap_size);
+}
 
-				/**
-				* @todo can we find a better way to handle the realloc failure?
-				*/
-				rootsim_error(false,
-					      "DyMeLoR: cannot reallocate the block of malloc_area.\n");
-				lp->mm->m_state->max_num_areas >>= 1;
+void *do_malloc(struct lp_struct *lp, size_t size)
+{
+	malloc_state *state = lp->mm->m_state;
+	struct _malloc_index *index = state->index;
+	malloc_area *m_area;
+	void *ptr;
+	size_t bitmap_size;
+	int class, slot;
 
-#ifndef NDEBUG
-				atomic_dec(&m_area->presence);
-#endif
+	if (unlikely(size > MAX_CHUNK_SIZE - sizeof(long long))) {
+		// A dedicated extent, released by clean_buffers_on_gvt() once it is free'd
+		size = (size + sizeof(long long) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+		m_area = new_area(state, size, 1);
+		RESET_AREA_LOCK_BIT(m_area);
+	} else {
+		size = compute_size(size);
+		class = size_class(size);
+
+		if (likely(index->non_full[class] != 0)) {
+			slot = __builtin_ctz(index->non_full[class]);
+			m_area = &state->areas[index->slot_area[class][slot]];
+		} else {
+			// All the malloc_areas for this size are full: the smallest missing one is added
+			slot = index->present[class] == UINT32_MAX ? AREA_SLOTS : __builtin_ctz(~index->present[class]);
+			if (unlikely(slot == AREA_SLOTS || first_area_chunks_log(size) + slot >= 31)) {
+				rootsim_error(false, "No more malloc_areas can be added for chunks of %zu bytes. Returning NULL.\n", size);
 				return NULL;
 			}
 
-			lp->mm->m_state->areas = tmp;
+			m_area = new_area(state, size, 1 << (first_area_chunks_log(size) + slot));
+			index->present[class] |= 1U << slot;
+			index->non_full[class] |= 1U << slot;
+			index->slot_area[class][slot] = m_area->idx;
 		}
-		// Allocate a new malloc area
-		m_area = &lp->mm->m_state->areas[lp->mm->m_state->num_areas];
-
-		// The malloc area to be instantiated has twice the number of chunks wrt the last full malloc area for the same chunks size
-		malloc_area_init(m_area, size, prev_area->num_chunks << 1);
+	}
 
 #ifndef NDEBUG
-		atomic_inc(&m_area->presence);
-		assert(atomic_read(&m_area->presence) == 1);
+	atomic_inc(&m_area->presence);
+	assert(atomic_read(&m_area->presence) == 1);
 #endif
 
-		m_area->idx = lp->mm->m_state->num_areas;
-		lp->mm->m_state->num_areas++;
-		prev_area->next = m_area->idx;
-		m_area->prev = prev_area->idx;
-
-	}
-
-	if (m_area->area == NULL) {
-
-		bitmap_size = bitmap_required_size(m_area->num_chunks);
-
-		area_size = sizeof(malloc_area *) + bitmap_size * 2 + m_area->num_chunks * size;
-
-//              m_area->self_pointer = (malloc_area *)allocate_lp_memory(lp, area_size);
-		m_area->self_pointer = rsalloc(area_size);
-		bzero(m_area->self_pointer, area_size);
+	if (m_area->area == NULL)
+		malloc_area_memory_init(lp, m_area);
 
-		if (unlikely(m_area->self_pointer == NULL)) {
-			rootsim_error(true, "Error while allocating memory.\n");
-		}
-
-		m_area->dirty_chunks = 0;
-		*(unsigned long long *)(m_area->self_pointer) =
-		    (unsigned long long)m_area;
-
-		m_area->use_bitmap =
-		    ((unsigned char *)m_area->self_pointer +
-		     sizeof(malloc_area *));
-
-		m_area->dirty_bitmap =
-		    ((unsigned char *)m_area->use_bitmap + bitmap_size);
-
-		m_area->area =
-		    (void *)((char *)m_area->dirty_bitmap + bitmap_size);
-	}
-
-	if (unlikely(m_area->area == NULL)) {
-		rootsim_error(true, "Error while allocating memory.\n");
-	}
 #ifndef NDEBUG
 	if (bitmap_check(m_area->use_bitmap, m_area->next_chunk)) {
 		rootsim_error(true, "Error: reallocating an already allocated chunk at %s:%d\n");
@@ -310,13 +394,13 @@ void *do_malloc(struct lp_struct *lp, size_t size)
 	bitmap_size = bitmap_required_size(m_area->num_chunks);
 
 	if (m_area->alloc_chunks == 0) {
-		lp->mm->m_state->bitmap_size += bitmap_size;
-		lp->mm->m_state->busy_areas++;
+		state->bitmap_size += bitmap_size;
+		state->busy_areas++;
 	}
 
 	if (m_area->state_changed == 0) {
-		lp->mm->m_state->dirty_bitmap_size += bitmap_size;
-		lp->mm->m_state->dirty_areas++;
+		state->dirty_bitmap_size += bitmap_size;
+		state->dirty_areas++;
 	}
 
 	m_area->state_changed = 1;
@@ -325,19 +409,16 @@ void *do_malloc(struct lp_struct *lp, size_t size)
 	if (!CHECK_LOG_MODE_BIT(m_area)) {
 		if ((double)m_area->alloc_chunks / (double)m_area->num_chunks > MAX_LOG_THRESHOLD) {
 			SET_LOG_MODE_BIT(m_area);
-			lp->mm->m_state->total_log_size += (m_area->num_chunks - (m_area->alloc_chunks - 1)) * size;
+			state->total_log_size += (m_area->num_chunks - (m_area->alloc_chunks - 1)) * size;
 		} else
-			lp->mm->m_state->total_log_size += size;
+			state->total_log_size += size;
 	}
-	//~ int chk_size = m_area->chunk_size;
-	//~ RESET_BIT_AT(chk_size, 0);
-	//~ RESET_BIT_AT(chk_size, 1);
 
 	m_area->alloc_chunks++;
 	find_next_free(m_area);
 
-	// TODO: togliere
-	memset(ptr, 0xe8, size);
+	if (m_area->alloc_chunks == m_area->num_chunks && !is_extent(m_area))
+		index->non_full[size_class(size)] &= ~(1U << area_slot(m_area));
 
 	// Keep track of the malloc_area which this chunk belongs to
 	*(unsigned long long *)ptr = (unsigned long long)m_area->self_pointer;
@@ -351,8 +432,6 @@ void *do_malloc(struct lp_struct *lp, size_t size)
 
 void do_free(struct lp_struct *lp, void *ptr)
 {
-	(void)lp;
-
 	malloc_area *m_area = NULL;
 	int idx;
 	size_t chunk_size, bitmap_size;
@@ -390,7 +469,8 @@ void do_free(struct lp_struct *lp, void *ptr)
 
 	bitmap_size = bitmap_required_size(m_area->num_chunks);
 
-	m_area->alloc_chunks--;
+	if (m_area->alloc_chunks-- == m_area->num_chunks && !is_extent(m_area))
+		lp->mm->m_state->index->non_full[size_class(chunk_size)] |= 1U << area_slot(m_area);
 
 	if (m_area->alloc_chunks == 0) {
 		lp->mm->m_state->bitmap_size -= bitmap_size;
@@ -536,6 +616,9 @@ size_t get_log_size(malloc_state * logged_state)
 	if (unlikely(logged_state == NULL))
 		return 0;
 
+	if (logged_state->compressed_size > 0)
+		return sizeof(malloc_state) + logged_state->compressed_size;
+
 	if (is_incremental(logged_state)) {
 		return sizeof(malloc_state) +
 		    logged_state->dirty_areas * sizeof(malloc_area) +
@@ -649,7 +732,7 @@ void *__wrap_realloc(void *ptr, size_t size)
 
 	// The size could be greater than the real request, but it does not matter since the realloc specific requires that
 	// is copied at least the smaller buffer size between the new and the old one
-	old_size = UNTAGGED_CHUNK_SIZE(m_area);
+	old_size = UNTAGGED_CHUNK_SIZE(m_area) - sizeof(long long);
 
 	new_buffer = __wrap_malloc(size);
 
@@ -697,6 +780,7 @@ void *__wrap_calloc(size_t nmemb, size_t size)
 void clean_buffers_on_gvt(struct lp_struct *lp, simtime_t time_barrier)
 {
 	int i;
+	bool compacted = false;
 	malloc_area *m_area;
 	malloc_state *state = lp->mm->m_state;
 
@@ -710,8 +794,7 @@ void clean_buffers_on_gvt(struct lp_struct *lp, simtime_t time_barrier)
 
 			if (m_area->self_pointer != NULL) {
 
-				//free_lp_memory(lp, m_area->self_pointer);
-				rsfree(m_area->self_pointer);
+				release_area_memory(lp, m_area->self_pointer);
 
 				m_area->use_bitmap = NULL;
 				m_area->dirty_bitmap = NULL;
@@ -719,30 +802,25 @@ void clean_buffers_on_gvt(struct lp_struct *lp, simtime_t time_barrier)
 				m_area->area = NULL;
 				m_area->state_changed = 0;
 
-				// Set the pointers
-				if (m_area->prev != -1)
-					state->areas[m_area->prev].next = m_area->next;
-				if (m_area->next != -1)
-					state->areas[m_area->next].prev = m_area->prev;
-
 				// Swap, if possible
 				if (i < state->num_areas - 1) {
 					memcpy(m_area, &state->areas[state->num_areas - 1], sizeof(malloc_area));
 					m_area->idx = i;
-					if (m_area->prev != -1)
-						state->areas[m_area->prev].next = m_area->idx;
-					if (m_area->next != -1)
-						state->areas[m_area->next].prev = m_area->idx;
 
 					// Update the self pointer
-					*(long long *)m_area->self_pointer = (long long)m_area;
+					if (m_area->self_pointer != NULL)
+						*(long long *)m_area->self_pointer = (long long)m_area;
 
 					// The swapped area will now be checked
 					i--;
 				}
 				// Decrement the expected number of areas
 				state->num_areas--;
+				compacted = true;
 			}
 		}
 	}
+
+	if (compacted)
+		malloc_state_reindex(state);
 }
@@ -50,18 +50,16 @@
 #define MASK 0x00000001		// Mask used to check, set and unset bits
 
 #define MIN_CHUNK_SIZE 128	// Size (in bytes) of the smallest chunk provideable by DyMeLoR
-#define MAX_CHUNK_SIZE 4194304	// Size (in bytes) of the biggest one. Notice that if this number
-				// is too large, performance (and memory usage) might be affected.
-				// If it is too small, large amount of memory requests by the
-				// application level software (i.e, larger than this number)
-				// will fail, as DyMeLoR will not be able to handle them!
-
-#define NUM_AREAS (log2(MAX_CHUNK_SIZE) - log2(MIN_CHUNK_SIZE) + 1)	// Number of initial malloc_areas available (will be increased at runtime if needed)
-#define MAX_NUM_AREAS (NUM_AREAS * 32)	// Maximum number of allocatable malloc_areas. If MAX_NUM_AREAS
-				// malloc_areas are filled at runtime, subsequent malloc() requests
-				// by the application level software will fail.
-#define MAX_LIMIT_NUM_AREAS MAX_NUM_AREAS
-#define MIN_NUM_CHUNKS 512	// Minimum number of chunks per malloc_area
+#define MAX_CHUNK_SIZE 4194304	// Size (in bytes) of the biggest one. Larger memory requests by the
+				// application level software are served by dedicated malloc_areas
+				// (extents) holding a single chunk, whose size is rounded up to
+				// the page size rather than to a power of two.
+
+#define NUM_AREAS (__builtin_ctz(MAX_CHUNK_SIZE) - __builtin_ctz(MIN_CHUNK_SIZE) + 1)	// Number of chunk sizes, i.e. of initial malloc_areas
+#define INITIAL_NUM_AREAS (NUM_AREAS * 2)	// Initial room for malloc_areas, doubled at runtime when needed
+#define AREA_SLOTS 32		// Maximum number of malloc_areas for each chunk size. The k-th one has 2^k times the chunks of the first one.
+#define MIN_NUM_CHUNKS 512	// Number of chunks of the first malloc_area for a chunk size...
+#define MAX_INITIAL_AREA_SIZE 1048576	// ...unless they would take more than this, then fewer (but at least one) are used
 #define MAX_NUM_CHUNKS 4096	// Maximum number of chunks per malloc_area
 
 #define MAX_LOG_THRESHOLD 1.7	// Threshold to check if a malloc_area is underused TODO: retest
@@ -89,6 +87,10 @@
 
 #define UNTAGGED_CHUNK_SIZE(m_area)	(((malloc_area*)(m_area))->chunk_size & ~((MASK << 0) | (MASK << 1)))
 
+// Size of the memory which keeps a malloc_area, i.e. its back pointer, its bitmaps and its chunks
+#define AREA_MEMORY_SIZE(m_area)	(sizeof(malloc_area *) + 2 * bitmap_required_size(((malloc_area*)(m_area))->num_chunks) + \
+					 ((malloc_area*)(m_area))->num_chunks * UNTAGGED_CHUNK_SIZE(m_area))
+
 #define POWEROF2(x) (1UL << (1 + (63 - __builtin_clzl((x) - 1))))
 #define IS_POWEROF2(x) ((x) != 0 && ((x) & ((x) - 1)) == 0)
 
@@ -109,15 +111,21 @@ struct _malloc_area {
 	rootsim_bitmap *use_bitmap;
 	rootsim_bitmap *dirty_bitmap;
 	void *area;
-	int prev;
-	int next;
 };
 
 typedef struct _malloc_area malloc_area;
 
+/// Index of the malloc_areas serving each chunk size, used to find one with free chunks in O(1)
+struct _malloc_index {
+	uint32_t present[NUM_AREAS];			///< Bit k is set if the k-th malloc_area of a chunk size exists
+	uint32_t non_full[NUM_AREAS];			///< Bit k is set if the k-th malloc_area of a chunk size has free chunks
+	int slot_area[NUM_AREAS][AREA_SLOTS];		///< Position in the areas array of the k-th malloc_area of a chunk size
+};
+
 /// Definition of the memory map
 struct _malloc_state {
 	bool is_incremental;	///< Tells if it is an incremental log or a full one (when used for logging)
+	size_t compressed_size;	///< Size of the compressed content following the header, 0 if the log is not compressed
 	size_t total_log_size;
 	size_t total_inc_size;
 	size_t bitmap_size;
@@ -128,6 +136,7 @@ struct _malloc_state {
 	int dirty_areas;
 	simtime_t timestamp;
 	struct _malloc_area *areas;
+	struct _malloc_index *index;	///< Not part of the logged state: it is rebuilt via malloc_state_reindex() upon a restore
 };
 
 typedef struct _malloc_state malloc_state;
@@ -151,11 +160,13 @@ extern size_t get_inc_log_size(void *);
 extern int get_granularity(void);
 extern size_t dirty_size(unsigned int, void *, double *);
 extern malloc_state *malloc_state_init(void);
-extern void malloc_state_wipe(malloc_state **);
+extern void malloc_state_wipe(struct lp_struct *);
+extern void malloc_state_reindex(malloc_state *);
 extern void *do_malloc(struct lp_struct *, size_t);
 extern void do_free(struct lp_struct *, void *ptr);
 extern void *allocate_lp_memory(struct lp_struct *, size_t);
 extern void free_lp_memory(struct lp_struct *, void *);
+extern bool is_segment_memory(struct lp_struct *, const void *);
 
 // Checkpointing API
 extern void *log_full(struct lp_struct *);
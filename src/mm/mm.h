@@ -79,9 +79,15 @@ struct memory_map {
 	struct buddy *buddy;
 	struct slab_chain *slab;
 	struct segment *segment;
+	struct ckpt_arena *arena;
+	unsigned int compression_skip;		///< Logs to be taken uncompressed before trying to compress again
+	unsigned int compression_backoff;	///< Value of compression_skip when compression does not pay off the next time
+	rootsim_bitmap *dirty_pages;		///< Pages of the segment modified since the last log, if incremental logs are taken
+	unsigned int inc_logs;			///< Number of incremental logs taken since the last full one
 };
 
 #define PER_LP_PREALLOCATED_MEMORY (262144L * PAGE_SIZE)	// This should be power of 2 multiplied by a page size. This is 1GB per LP.
+#define SEGMENT_PAGES (PER_LP_PREALLOCATED_MEMORY / PAGE_SIZE)
 #define BUDDY_GRANULARITY PAGE_SIZE	// This is the smallest chunk released by the buddy in bytes. PER_LP_PREALLOCATED_MEMORY/BUDDY_GRANULARITY must be integer and a power of 2
 
 extern bool allocator_init(void);
@@ -100,3 +106,20 @@ void buddy_destroy(struct buddy *);
 extern struct slab_chain *slab_init(const size_t itemsize);
 extern void *slab_alloc(struct slab_chain *const sch);
 extern void slab_free(struct slab_chain *const sch, const void *const addr);
+extern void slab_destroy(const struct slab_chain *const sch);
+
+extern struct ckpt_arena *ckpt_arena_init(void);
+extern void ckpt_arena_fini(struct ckpt_arena *arena);
+extern void *ckpt_alloc(struct lp_struct *lp, size_t size);
+extern void ckpt_free(void *ptr);
+extern size_t ckpt_arena_memory(struct lp_struct *lp);
+extern size_t ckpt_arena_live(struct lp_struct *lp);
+extern size_t ckpt_arena_peak(void);
+
+extern void log_copy(void *dst, const void *src, size_t size);
+
+extern void soft_dirty_init(void);
+extern void soft_dirty_collect(void);
+
+extern size_t lz_compress(const void *src, size_t size, void *dst, size_t capacity);
+extern size_t lz_decompress(const void *src, size_t size, void *dst, size_t capacity);
@@ -32,10 +32,14 @@
 #include <fcntl.h>
 #include <sys/types.h>
 
+#include <core/init.h>
 #include <mm/mm.h>
 #include <mm/ecs.h>
 #include <arch/x86/linux/cross_state_manager/cross_state_manager.h>
 #include <scheduler/process.h>
+#ifdef HAVE_MPI
+#include <communication/migration.h>
+#endif
 
 size_t __page_size = 0;
 
@@ -139,18 +143,63 @@ void segment_init(void)
 
 void initialize_memory_map(struct lp_struct *lp)
 {
+	// Incremental logs are made of the pages of the segment modified since
+	// the previous log. A serial simulation takes no log at all.
+	bool incremental = (rootsim_config.snapshot == SNAPSHOT_INCREMENTAL && !rootsim_config.serial);
+	bool use_segment = incremental;
+
 	lp->mm = rsalloc(sizeof(struct memory_map));
 
-	lp->mm->segment = NULL;	//get_segment(lp->gid);
-	lp->mm->buddy = NULL;	//buddy_new(lp, PER_LP_PREALLOCATED_MEMORY / BUDDY_GRANULARITY);
+	lp->mm->segment = NULL;
+	lp->mm->buddy = NULL;
+	lp->mm->dirty_pages = NULL;
+
+#ifdef HAVE_MPI
+	// An LP which can be migrated must find its buffers at the very same
+	// addresses on any kernel, so DyMeLoR takes them from the per-LP segment.
+	use_segment = use_segment || lp_migration_enabled();
+#endif
+
+	if (use_segment) {
+		lp->mm->segment = get_segment(lp->gid);
+		lp->mm->buddy = buddy_new(lp, PER_LP_PREALLOCATED_MEMORY / BUDDY_GRANULARITY);
+	}
+
+	if (incremental) {
+		lp->mm->dirty_pages = rsalloc(bitmap_required_size(SEGMENT_PAGES));
+		bitmap_initialize(lp->mm->dirty_pages, SEGMENT_PAGES);
+	}
+
+	// The first log is a full one
+	lp->mm->inc_logs = INCREMENTAL_GRANULARITY;
+
 	lp->mm->slab = slab_init(SLAB_MSG_SIZE);
 	lp->mm->m_state = malloc_state_init();
+	lp->mm->arena = ckpt_arena_init();
+	lp->mm->compression_skip = 0;
+	lp->mm->compression_backoff = 1;
 }
 
 void finalize_memory_map(struct lp_struct *lp)
 {
-	malloc_state_wipe(&lp->mm->m_state);
-	//buddy_destroy(lp->mm->buddy);
-	// No free segment function here!
+	malloc_state_wipe(lp);
+
+	slab_destroy(lp->mm->slab);
+	rsfree(lp->mm->slab);
+
+	ckpt_arena_fini(lp->mm->arena);
+
+	if (lp->mm->dirty_pages != NULL)
+		rsfree(lp->mm->dirty_pages);
+
+	if (lp->mm->buddy != NULL)
+		buddy_destroy(lp->mm->buddy);
+
+	if (lp->mm->segment != NULL) {
+		if (unlikely(munmap(lp->mm->segment->base, PER_LP_PREALLOCATED_MEMORY) == -1))
+			perror("munmap");
+		rsfree(lp->mm->segment);
+	}
+
 	rsfree(lp->mm);
 }
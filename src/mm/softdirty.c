@@ -0,0 +1,180 @@
+/**
+* @file mm/softdirty.c
+*
+* @brief Tracking of the pages written by LPs via soft-dirty bits
+*
+* On Linux, the kernel sets the soft-dirty bit of a page table entry
+* whenever the page is written. The bits can be read from /proc/self/pagemap,
+* and they are cleared by writing "4" to /proc/self/clear_refs. Looking at the
+* bits of the pages of the per-LP segments tells which pages have been
+* modified since the previous log, without instrumenting the model and
+* without any kernel module.
+*
+* Bits can only be cleared for the whole process at once. Before doing it,
+* the bits of all the LPs hosted by the kernel are accumulated in per-LP
+* bitmaps, which therefore keep the pages modified since the last log of
+* each LP. This is correct only if no LP memory is written while the bits
+* are being collected, so incremental logs require a single worker thread
+* per kernel.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <core/core.h>
+#include <core/init.h>
+#include <mm/mm.h>
+#include <scheduler/process.h>
+
+/// Bit of a pagemap entry telling that the page has been written since the bits were last cleared
+#define PAGEMAP_SOFT_DIRTY	(1ULL << 55)
+
+/// Number of pagemap entries read at a time
+#define PAGEMAP_BATCH		512
+
+static int pagemap_fd = -1;
+static int clear_refs_fd = -1;
+
+
+static bool read_pagemap(const void *address, uint64_t *entries, size_t count)
+{
+	off_t offset = (off_t)((uintptr_t)address / PAGE_SIZE * sizeof(uint64_t));
+
+	return pread(pagemap_fd, entries, count * sizeof(uint64_t), offset) == (ssize_t)(count * sizeof(uint64_t));
+}
+
+
+static bool clear_soft_dirty(void)
+{
+	return write(clear_refs_fd, "4", 1) == 1;
+}
+
+
+/**
+* Check that the kernel keeps soft-dirty bits. Kernels built without
+* CONFIG_MEM_SOFT_DIRTY accept writes to clear_refs, but always report
+* clean pages.
+*/
+static bool soft_dirty_supported(void)
+{
+	volatile unsigned char *page;
+	uint64_t entry = 0;
+	bool ret = false;
+
+	page = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (page == MAP_FAILED)
+		return false;
+
+	*page = 1;
+	if (clear_soft_dirty()) {
+		*page = 2;
+		ret = read_pagemap((const void *)page, &entry, 1) && (entry & PAGEMAP_SOFT_DIRTY);
+	}
+
+	munmap((void *)page, PAGE_SIZE);
+	return ret;
+}
+
+
+/**
+* Set up the tracking of the pages written by LPs, if incremental logs
+* are requested. If the kernel does not support soft-dirty bits, the
+* simulation falls back to full logs.
+*/
+void soft_dirty_init(void)
+{
+	if (rootsim_config.snapshot != SNAPSHOT_INCREMENTAL)
+		return;
+
+	if (n_cores > 1) {
+		rootsim_error(true, "Incremental logs require a single worker thread per kernel, as soft-dirty bits are cleared for the whole process. Aborting...\n");
+	}
+
+	pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+	clear_refs_fd = open("/proc/self/clear_refs", O_WRONLY);
+
+	if (pagemap_fd == -1 || clear_refs_fd == -1 || !soft_dirty_supported()) {
+		rootsim_error(false, "The kernel does not support soft-dirty bits, taking full logs only\n");
+		if (pagemap_fd != -1)
+			close(pagemap_fd);
+		if (clear_refs_fd != -1)
+			close(clear_refs_fd);
+		pagemap_fd = clear_refs_fd = -1;
+		rootsim_config.snapshot = SNAPSHOT_FULL;
+	}
+}
+
+
+/// Accumulate the soft-dirty bits of the pages keeping the malloc_areas of an LP into its bitmap
+static void collect_lp(struct lp_struct *lp)
+{
+	malloc_state *m_state = lp->mm->m_state;
+	malloc_area *m_area;
+	uint64_t entries[PAGEMAP_BATCH];
+	size_t page, pages, batch, i;
+	int j;
+
+	for (j = 0; j < m_state->num_areas; j++) {
+		m_area = &m_state->areas[j];
+		if (m_area->self_pointer == NULL || !is_segment_memory(lp, m_area->self_pointer))
+			continue;
+
+		page = ((unsigned char *)m_area->self_pointer - lp->mm->segment->base) / PAGE_SIZE;
+		pages = (AREA_MEMORY_SIZE(m_area) + PAGE_SIZE - 1) / PAGE_SIZE;
+
+		while (pages > 0) {
+			batch = min(pages, (size_t)PAGEMAP_BATCH);
+			if (unlikely(!read_pagemap(lp->mm->segment->base + page * PAGE_SIZE, entries, batch))) {
+				rootsim_error(true, "Unable to read the soft-dirty bits of LP %u. Aborting...\n", lp->gid.to_int);
+			}
+
+			for (i = 0; i < batch; i++) {
+				if (entries[i] & PAGEMAP_SOFT_DIRTY)
+					bitmap_set(lp->mm->dirty_pages, page + i);
+			}
+
+			page += batch;
+			pages -= batch;
+		}
+	}
+}
+
+
+/**
+* Bring up to date the bitmaps of the pages modified by the LPs hosted by
+* this kernel, and clear the soft-dirty bits. Once this returns, the bitmap
+* of an LP which is about to take a log tells the pages modified since its
+* previous log, and it can be reset.
+*/
+void soft_dirty_collect(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < n_prc; i++) {
+		if (lps_blocks[i] != NULL && lps_blocks[i]->mm->dirty_pages != NULL)
+			collect_lp(lps_blocks[i]);
+	}
+
+	if (unlikely(!clear_soft_dirty())) {
+		rootsim_error(true, "Unable to clear the soft-dirty bits. Aborting...\n");
+	}
+}
@@ -39,6 +39,7 @@
 #include <core/init.h>
 #include <core/timer.h>
 #include <datatypes/list.h>
+#include <gvt/gvt.h>
 #include <scheduler/process.h>
 #include <scheduler/scheduler.h>
 #include <mm/state.h>
@@ -63,6 +64,15 @@ bool LogState(struct lp_struct *lp)
 	// Keep track of the invocations to LogState
 	lp->from_last_ckpt++;
 
+	// LPs relying on reverse computation are never restored from a log.
+	// A state is taken once per GVT round, to prune the queues and to
+	// check for termination.
+	if (lp->ReverseEvent != NULL && !lp->state_log_forced) {
+		if (list_tail(lp->queue_states)->lvt >= get_last_gvt())
+			return take_snapshot;
+		lp->state_log_forced = true;
+	}
+
 	if (lp->state_log_forced) {
 		lp->state_log_forced = false;
 		lp->from_last_ckpt = 0;
@@ -94,7 +104,7 @@ bool LogState(struct lp_struct *lp)
 	if (take_snapshot) {
 
 		// Allocate the state buffer
-		new_state = rsalloc(sizeof(*new_state));
+		new_state = ckpt_alloc(lp, sizeof(*new_state));
 
 		// Associate the checkpoint with current LVT and last-executed event
 		new_state->lvt = lvt(lp);
@@ -111,14 +121,12 @@ bool LogState(struct lp_struct *lp)
 		memcpy(&new_state->numerical, &lp->numerical,
 		       sizeof(numerical_state_t));
 
-		if(&topology_settings && topology_settings.write_enabled){
-			new_state->topology = rsalloc(topology_global.chkp_size);
-			memcpy(new_state->topology, lp->topology,
-					topology_global.chkp_size);
-		}
+		new_state->topology = NULL;
+		if(&topology_settings)
+			new_state->topology = topology_do_checkpoint(lp);
 
 		if(&abm_settings){
-			new_state->region_data = abm_do_checkpoint(lp->region);
+			new_state->region_data = abm_do_checkpoint(lp);
 		}
 
 		// Link the new checkpoint to the state chain
@@ -129,6 +137,23 @@ bool LogState(struct lp_struct *lp)
 	return take_snapshot;
 }
 
+/**
+* Release a checkpoint taken by LogState(). The buffers are released in the
+* reverse order of their allocation, so that the checkpoint arena of the LP
+* can reuse their space right away when the checkpoint is the last one.
+*
+* @param state A pointer to the checkpoint, which must not be in the state queue anymore
+*/
+void state_release(state_t *state)
+{
+	if(&abm_settings)
+		ckpt_free(state->region_data);
+	if(state->topology != NULL)
+		ckpt_free(state->topology);
+	log_delete(state->log);
+	ckpt_free(state);
+}
+
 void RestoreState(struct lp_struct *lp, state_t * restore_state)
 {
 	// Restore simulation model buffers
@@ -142,10 +167,8 @@ void RestoreState(struct lp_struct *lp, state_t * restore_state)
 	memcpy(&lp->numerical, &restore_state->numerical,
 	       sizeof(numerical_state_t));
 
-	if(&topology_settings && topology_settings.write_enabled){
-		memcpy(lp->topology, restore_state->topology,
-				topology_global.chkp_size);
-	}
+	if(&topology_settings)
+		topology_restore_checkpoint(lp, restore_state->topology);
 
 	if(&abm_settings)
 		abm_restore_checkpoint(restore_state->region_data, lp->region);
@@ -205,6 +228,63 @@ unsigned int silent_execution(struct lp_struct *lp, msg_t *evt, msg_t *final_evt
 	return events;
 }
 
+/**
+* This function undoes the events processed by a LP after a given one, by
+* calling in reverse order the handler registered via RegisterReverseEvent().
+* The state of the numerical library is brought back to the value it had
+* before each undone event, both while the handler runs and once it has
+* returned. Events annihilated by an antimessage after having
+* been processed are released here, once they have been undone.
+*
+* @param lp A pointer to the LP's lp_struct whose events must be undone
+* @param final_evt A pointer to the last event which should *not* be undone
+*
+* @return The number of events undone
+*/
+unsigned int reverse_execution(struct lp_struct *lp, msg_t *final_evt)
+{
+	unsigned int events = 0;
+	msg_t *evt, *prev;
+
+	// Stragglers can be interleaved with processed events, which are the only ones to be undone
+	evt = lp->last_processed;
+	while (evt != NULL && evt != final_evt) {
+		prev = list_prev(evt);
+
+		if (evt->processed) {
+			evt->processed = false;
+
+			// The handler draws the same random numbers which the event drew
+			memcpy(&lp->numerical, &evt->numerical, sizeof(numerical_state_t));
+
+			if (likely(reprocess_control_msg(evt))) {
+				current = lp;
+				current_evt = evt;
+				switch_to_application_mode();
+				lp->ReverseEvent(lp->gid.to_int, evt->timestamp, evt->type,
+						 evt->event_content, evt->size,
+						 lp->current_base_pointer);
+				switch_to_platform_mode();
+				events++;
+			}
+
+			memcpy(&lp->numerical, &evt->numerical, sizeof(numerical_state_t));
+
+			if (evt->message_kind == negative) {
+				list_delete_by_content(lp->queue_in, evt);
+				msg_release(evt);
+			}
+		}
+
+		evt = prev;
+	}
+
+	lp->last_processed = final_evt;
+	current = NULL;
+	current_evt = NULL;
+	return events;
+}
+
 /**
 * This function rolls back the execution of a certain LP. The point where the
 * execution is rolled back is identified by the event pointed by the rollback_bound
@@ -245,23 +325,30 @@ void rollback(struct lp_struct *lp)
 	while (restore_state != NULL && restore_state->lvt > last_correct_event->timestamp) {	// It's > rather than >= because we have already taken into account simultaneous events
 		s = restore_state;
 		restore_state = list_prev(restore_state);
-		log_delete(s->log);
-#ifndef NDEBUG
-		s->last_event = (void *)0xBABEBEEF;
-#endif
 		list_delete_by_content(lp->queue_states, s);
+		state_release(s);
 	}
-	// Restore the simulation state and correct the state base pointer
-	RestoreState(lp, restore_state);
 
-	last_restored_event = restore_state->last_event;
-	reprocessed_events = silent_execution(lp, last_restored_event, last_correct_event);
-	statistics_post_data(lp, STAT_SILENT, (double)reprocessed_events);
+	if (lp->ReverseEvent != NULL) {
+		// Undo the wrongly processed events, no state has to be restored
+		reverse_execution(lp, last_correct_event);
+	} else {
+		// Restore the simulation state and correct the state base pointer
+		RestoreState(lp, restore_state);
+
+		last_restored_event = restore_state->last_event;
+		reprocessed_events = silent_execution(lp, last_restored_event, last_correct_event);
+		statistics_post_data(lp, STAT_SILENT, (double)reprocessed_events);
+	}
 
 	// TODO: silent execution resets the LP state to the previous
 	// value, so it should be the last function to be called within rollback()
 	// Control messages must be rolled back as well
 	rollback_control_message(lp, last_correct_event->timestamp);
+
+	// Updates to shared topology data are undone here, as they are not part of the LP state
+	if(&topology_settings)
+		topology_rollback(lp, last_correct_event->timestamp);
 }
 
 /**
@@ -282,6 +369,7 @@ void rollback(struct lp_struct *lp)
 state_t *find_time_barrier(struct lp_struct *lp, simtime_t simtime)
 {
 	state_t *barrier_state;
+	bool full_log = false, full_region = !&abm_settings;
 
 	if (unlikely(D_EQUAL(simtime, 0.0))) {
 		return list_head(lp->queue_states);
@@ -293,18 +381,20 @@ state_t *find_time_barrier(struct lp_struct *lp, simtime_t simtime)
 	while (barrier_state != NULL && barrier_state->lvt >= simtime) {
 		barrier_state = list_prev(barrier_state);
 	}
-	if (barrier_state == NULL) {
-		barrier_state = list_head(lp->queue_states);
-	}
 
-/*
-	// TODO Search for the first full log before the gvt
-	while(true) {
-		if(is_incremental(current->log) == false)
+	// Incremental logs can be restored only along with the full log they follow,
+	// and incremental region checkpoints along with the full one they refer to
+	while (barrier_state != NULL) {
+		full_log = full_log || !is_incremental(barrier_state->log);
+		full_region = full_region || abm_checkpoint_is_full(barrier_state->region_data);
+		if (full_log && full_region)
 			break;
-	  	current = list_prev(current);
+		barrier_state = list_prev(barrier_state);
+	}
+
+	if (barrier_state == NULL) {
+		barrier_state = list_head(lp->queue_states);
 	}
-*/
 
 	return barrier_state;
 }
@@ -323,6 +413,33 @@ void SetState(void *new_state)
 	current->current_base_pointer = new_state;
 }
 
+/**
+* This function allows an LP to register a handler which undoes the effects
+* of its events, so that it is rolled back by reverse computation rather than
+* by restoring a checkpoint. The handler receives the same arguments as
+* ProcessEvent(), with the state as it was right after the event, and must
+* not schedule new events. The numerical library is restored by the platform:
+* while the handler runs, it returns the same values which the event drew.
+* The handler can be registered only while processing INIT.
+*
+* Reverse computation is not available if the topology or the agent-based
+* layer keep a state which is changed by events.
+*
+* @param reverse The handler which undoes an event
+*/
+void RegisterReverseEvent(void (*reverse)(unsigned int me, simtime_t now, int event_type, void *event_content, unsigned int size, void *state))
+{
+	if (unlikely(current_evt == NULL || current_evt->type != INIT)) {
+		rootsim_error(true, "LP %u can register its reverse handler only while processing INIT. Aborting...\n", current->gid.to_int);
+	}
+
+	if (unlikely(&abm_settings || (&topology_settings && topology_settings.write_enabled))) {
+		rootsim_error(true, "Reverse computation cannot be used with a writable topology or with agents. Aborting...\n");
+	}
+
+	current->ReverseEvent = reverse;
+}
+
 /**
 * This function sets the checkpoint mode
 *
@@ -45,6 +45,13 @@ enum {
 	STATE_SAVING_PERIODIC		/**< Periodic State Saving checkpointing interval */
 };
 
+enum {
+	CKPT_COMPRESSION_INVALID = 0,	/**< By convention 0 is the invalid field */
+	CKPT_COMPRESSION_NONE,		/**< Logs are kept as they are taken */
+	CKPT_COMPRESSION_ALWAYS,	/**< Logs are compressed whenever this makes them smaller */
+	CKPT_COMPRESSION_ADAPTIVE	/**< Logs are compressed as long as compression pays off */
+};
+
 /// Structure for LP's state
 typedef struct _state_t {
 	// Pointers to chain this structure to the state queue
@@ -76,6 +83,7 @@ typedef struct _state_t {
 struct lp_struct;
 
 extern bool LogState(struct lp_struct *);
+extern void state_release(state_t *state);
 extern void RestoreState(struct lp_struct *, state_t * restore_state);
 extern void rollback(struct lp_struct *);
 extern state_t *find_time_barrier(struct lp_struct *, simtime_t time);
@@ -84,3 +92,4 @@ extern void rebuild_state(struct lp_struct *, state_t * state_pointer, simtime_t
 extern void set_checkpoint_period(struct lp_struct *, int period);
 extern void force_LP_checkpoint(struct lp_struct *);
 extern unsigned int silent_execution(struct lp_struct *, msg_t * evt, msg_t * final_evt);
+extern unsigned int reverse_execution(struct lp_struct *, msg_t * final_evt);
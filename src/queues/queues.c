@@ -122,6 +122,88 @@ void insert_bottom_half(msg_t * msg)
 #ifdef HAVE_PREEMPTION
 	update_min_in_transit(lp->worker_thread, msg->timestamp);
 #endif
+
+	wake_worker_thread(lp->worker_thread);
+}
+
+/**
+* Delete a message matched by an antimessage. If it has already been processed
+* by an LP relying on reverse computation, it must be undone first: rollback()
+* will delete it.
+*/
+static void delete_cancelled_msg(struct lp_struct *receiver, msg_t *msg)
+{
+	if (msg->processed) {
+		msg->message_kind = negative;
+	} else {
+		list_delete_by_content(receiver->queue_in, msg);
+		msg_release(msg);
+	}
+}
+
+/**
+* Cancel the messages listed in a cancel set, i.e. a negative message whose
+* payload is the array of the marks of the messages to cancel (see
+* send_antimessages()). The input queue is scanned backwards only once,
+* and the receiver is rolled back at most once, to the earliest cancelled
+* message which has already been processed.
+*
+* @param receiver A pointer to the lp_struct of the LP receiving the cancel set
+* @param anti_msg The cancel set
+*/
+static void cancel_messages(struct lp_struct *receiver, msg_t *anti_msg)
+{
+	unsigned long long *marks = (unsigned long long *)anti_msg->event_content;
+	unsigned int n = anti_msg->size / sizeof(*marks);
+	unsigned int found = 0, i;
+	simtime_t receiver_lvt = lvt(receiver);
+	msg_t *matched_msg, *prev, *earliest = NULL;
+
+	statistics_post_data(receiver, STAT_ANTIMESSAGE, (double)n);
+
+	// Find the messages matching the marks, the earliest one is found last
+	for (matched_msg = list_tail(receiver->queue_in); matched_msg != NULL && found < n; matched_msg = prev) {
+		prev = list_prev(matched_msg);
+
+		for (i = found; i < n; i++) {
+			if (marks[i] == matched_msg->mark)
+				break;
+		}
+		if (i == n)
+			continue;
+
+		// Keep the marks still to be found at the end of the array
+		marks[i] = marks[found++];
+
+		// If the matched message is in the past, we have to rollback. The
+		// earliest such message is deleted only once the bound is moved.
+		if (matched_msg->timestamp <= receiver_lvt) {
+			if (earliest != NULL)
+				delete_cancelled_msg(receiver, earliest);
+			earliest = matched_msg;
+		} else {
+			delete_cancelled_msg(receiver, matched_msg);
+		}
+	}
+
+	// Sanity check
+	if (unlikely(found < n)) {
+		rootsim_error(false, "LP %d Received an antimessage, but %u marks have not been found!\n",
+			      receiver->gid.to_int, n - found);
+		dump_msg_content(anti_msg);
+		rootsim_error(true, "Aborting...\n");
+	}
+
+	if (earliest != NULL) {
+		receiver->bound = list_prev(earliest);
+		while ((receiver->bound != NULL)
+		       && D_EQUAL(receiver->bound->timestamp, earliest->timestamp)) {
+			receiver->bound = list_prev(receiver->bound);
+		}
+
+		receiver->state = LP_STATE_ROLLBACK;
+		delete_cancelled_msg(receiver, earliest);
+	}
 }
 
 /**
@@ -134,7 +216,6 @@ void process_bottom_halves(void)
 	struct lp_struct *receiver;
 
 	msg_t *msg_to_process;
-	msg_t *matched_msg;
 
 	foreach_bound_lp(lp) {
 
@@ -155,48 +236,14 @@ void process_bottom_halves(void)
 
 			switch (msg_to_process->message_kind) {
 
-				// It's an antimessage
+				// It's a set of antimessages
 			case negative:
-
-				statistics_post_data(receiver, STAT_ANTIMESSAGE, 1.0);
-
-				// Find the message matching the antimessage
-				matched_msg = list_tail(receiver->queue_in);
-				while (matched_msg != NULL
-				       && matched_msg->mark !=
-				       msg_to_process->mark) {
-					matched_msg = list_prev(matched_msg);
-				}
-
-				// Sanity check
-				if (unlikely(matched_msg == NULL)) {
-					rootsim_error(false,
-						      "LP %d Received an antimessage, but no such mark has been found!\n",
-						      receiver->gid.to_int);
-					dump_msg_content(msg_to_process);
-					rootsim_error(true, "Aborting...\n");
-				}
-				// If the matched message is in the past, we have to rollback
-				if (matched_msg->timestamp <= lvt(receiver)) {
-
-					receiver->bound = list_prev(matched_msg);
-					while ((receiver->bound != NULL)
-						&& D_EQUAL(receiver->bound->timestamp, msg_to_process->timestamp)) {
-						receiver->bound = list_prev(receiver->bound);
-					}
-					
-					receiver->state = LP_STATE_ROLLBACK;
-				}
+				cancel_messages(receiver, msg_to_process);
 #ifdef HAVE_MPI
 				register_incoming_msg(msg_to_process);
 #endif
-
-				// Delete the matched message
-				list_delete_by_content(receiver->queue_in,
-						       matched_msg);
-				msg_release(matched_msg);
-
-				break;
+				msg_release(msg_to_process);
+				continue;
 
 				// It's a positive message
 			case positive:
@@ -49,8 +49,6 @@
  * - public discussion board : https://groups.google.com/forum/#!forum/lz4c
  */
 
-#ifdef EXTRA_CHECKS
-
 //**************************************
 // Tuning parameters
 //**************************************
@@ -504,5 +502,3 @@ unsigned long long XXH64(const void *input, size_t len, unsigned long long seed)
 					  XXH_unaligned);
 #endif
 }
-
-#endif				/* EXTRA_CHECKS */
@@ -51,8 +51,6 @@
 
 #pragma once
 
-#ifdef EXTRA_CHECKS
-
 #include <stddef.h>		/* size_t */
 
 typedef enum { XXH_OK = 0, XXH_ERROR } XXH_errorcode;
@@ -65,5 +63,3 @@ typedef struct {
 
 unsigned int XXH32(const void *input, size_t length, unsigned seed);
 unsigned long long XXH64(const void *input, size_t length, unsigned long long seed);
-
-#endif
@@ -29,20 +29,39 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 #include <arch/atomic.h>
 #include <core/core.h>
 #include <core/timer.h>
+#include <datatypes/heap.h>
 #include <datatypes/list.h>
+#include <queues/queues.h>
 #include <scheduler/binding.h>
+#include <scheduler/elastic.h>
 #include <scheduler/process.h>
 #include <scheduler/scheduler.h>
 #include <statistics/statistics.h>
 #include <gvt/gvt.h>
+#include <communication/migration.h>
 
 #include <arch/thread.h>
 
-#define REBIND_INTERVAL 10.0
+/// Initial number of seconds between two rebindings
+#define REBIND_INTERVAL		10.0
+
+/// Rebindings get closer to each other, up to this period, while they pay off
+#define REBIND_INTERVAL_MIN	1.0
+
+/// Rebindings get farther from each other, up to this period, while they are useless
+#define REBIND_INTERVAL_MAX	60.0
+
+/// A new binding is installed only if it relieves the most loaded thread by this fraction
+#define REBIND_MIN_GAIN		0.1
+
+/// Fraction of the average thread load which can be exceeded to keep communicating LPs together
+#define REBIND_AFFINITY_SLACK	0.05
 
 struct lp_cost_id {
 	double workload_factor;
@@ -51,6 +70,12 @@ struct lp_cost_id {
 
 struct lp_cost_id *lp_cost;
 
+/// Load of a worker thread, as kept in the min-heap used by LP_balance()
+struct thread_load {
+	double load;
+	unsigned int tid;
+};
+
 /// A guard to know whether this is the first invocation or not
 static __thread bool first_lp_binding = true;
 
@@ -63,12 +88,46 @@ static __thread int local_binding_acquire_phase = 0;
 
 static int binding_phase = 0;
 static __thread int local_binding_phase = 0;
+
+/// Current period between two rebindings, adapted by LP_balance()
+static double rebinding_interval = REBIND_INTERVAL;
+
+/// Tells worker threads whether the last computed binding differs from the current one
+static bool binding_changed;
+
+/// Counts (up to zero) the worker threads which acknowledged an unchanged binding
+static atomic_t worker_thread_acquire;
+
+/// Workload of each LP at the time of the last local reduction
+static double *lp_workload_snapshot;
+
+/// Workload of each LP in the window which ended at the last local reduction
+static double *lp_workload_window;
+
+/// Value of a steal request slot when no worker thread is asking for an LP
+#define NO_STEAL_REQUEST	UINT_MAX
+
+/// For each worker thread, the id of the worker thread which asks it for an LP
+static volatile uint32_t *steal_request;
+
+/// For each worker thread, an LP which another worker thread has handed off to it
+static struct lp_struct *volatile *handoff_inbox;
+
+/// For each worker thread, how many of its LPs had events to process at the last scheduling
+static volatile unsigned int *ready_LPs;
+
+/// Number of LPs which have left a worker thread and not yet reached their new one
+static atomic_t handoffs_in_flight;
+
+/// The worker thread which the current one has asked for an LP, if any
+static __thread unsigned int steal_victim = NO_STEAL_REQUEST;
 #endif
 
 static atomic_t worker_thread_reduction;
 
 /**
-* Performs a (deterministic) block allocation between LPs and WTs
+* Performs a (deterministic) block allocation between LPs and WTs.
+* Parked worker threads are given no LP.
 *
 * @author Alessandro Pellegrini
 */
@@ -80,8 +139,8 @@ static inline void LPs_block_binding(void)
 	unsigned int block_leftover;
 	struct lp_struct *lp;
 
-	buf1 = (n_prc / n_cores);
-	block_leftover = n_prc - buf1 * n_cores;
+	buf1 = (n_prc / n_active_cores);
+	block_leftover = n_prc - buf1 * n_active_cores;
 
 	if (block_leftover > 0) {
 		buf1++;
@@ -110,9 +169,12 @@ static inline void LPs_block_binding(void)
 	}
 }
 
+#ifdef HAVE_LP_REBINDING
+
 /**
 * Convenience function to compare two elements of struct lp_cost_id.
-* This is used for sorting the LP vector in LP_knapsack()
+* This is used for sorting the LP vector in LP_balance() by decreasing
+* workload. Ties are broken on the local id to keep the order deterministic.
 *
 * @author Alessandro Pellegrini
 *
@@ -123,111 +185,166 @@ static inline void LPs_block_binding(void)
 */
 static int compare_lp_cost(const void *a, const void *b)
 {
-	struct lp_cost_id *A = (struct lp_cost_id *)a;
-	struct lp_cost_id *B = (struct lp_cost_id *)b;
-
-	return (B->workload_factor - A->workload_factor);
+	const struct lp_cost_id *A = a;
+	const struct lp_cost_id *B = b;
+
+	if (A->workload_factor > B->workload_factor)
+		return -1;
+	if (A->workload_factor < B->workload_factor)
+		return 1;
+	return (A->id > B->id) - (A->id < B->id);
 }
 
+/// Order thread loads in the min-heap, ties are broken on the thread id
+#define cmp_thread_load(a, b) ((a).load < (b).load ? -1 : (a).load > (b).load ? 1 : \
+				(int)(a).tid - (int)(b).tid)
+
 /**
-* Implements the knapsack load sharing policy in:
+* Computes a new binding of LPs to worker threads, which is installed only if
+* it is noticeably better than the current one.
 *
-* Roberto Vitali, Alessandro Pellegrini and Francesco Quaglia
-* A Load Sharing Architecture for Optimistic Simulations on Multi-Core Machines
-* In Proceedings of the 19th International Conference on High Performance Computing (HiPC)
-* Pune, India, IEEE Computer Society, December 2012.
+* LPs are assigned according to the Longest Processing Time first rule: they
+* are sorted by decreasing workload and each one is given to the currently
+* least loaded thread, which is found in a min-heap of thread loads. An LP
+* rather follows the LP it mostly sends messages to, if this does not load
+* the partner's thread much above the average.
 *
+* The period between two rebindings is adapted as well: it is shortened
+* whenever a new binding is installed, and it is lengthened otherwise.
 *
 * @author Alessandro Pellegrini
 */
-static inline void LP_knapsack(void)
+static void LP_balance(void)
 {
-	register unsigned int i, j;
-	double reference_knapsack = 0;
-	bool assigned;
-	double assignments[n_cores];
+	unsigned int i, lid, tid, partner;
+	double total = 0.0, current_max = 0.0, new_max = 0.0, target, cost;
+	double current_load[n_active_cores], new_load[n_active_cores];
+	unsigned int *assignment, *local_lid;
+	rootsim_heap(struct thread_load) heap;
+	struct thread_load entry;
 
-	if (!master_thread())
-		return;
+	binding_changed = false;
 
-	// Estimate the reference knapsack
-	for (i = 0; i < n_prc; i++) {
-		reference_knapsack += lp_cost[i].workload_factor;
+	bzero(current_load, sizeof(double) * n_active_cores);
+	bzero(new_load, sizeof(double) * n_active_cores);
+	foreach_lp(lp) {
+		lid = lp->lid.to_int;
+		lp_cost[lid].id = lid;
+		lp_cost[lid].workload_factor = lp_workload_window[lid];
+
+		current_load[lp->worker_thread] += lp_cost[lid].workload_factor;
+		total += lp_cost[lid].workload_factor;
+	}
+	for (tid = 0; tid < n_active_cores; tid++) {
+		current_max = fmax(current_max, current_load[tid]);
 	}
-	reference_knapsack /= n_cores;
 
-	// Sort the expected times
-	qsort(lp_cost, n_prc, sizeof(struct lp_cost_id), compare_lp_cost);
+	if (total <= 0.0)
+		goto out;
+	target = total / n_active_cores;
 
-	// At least one LP per thread
-	bzero(assignments, sizeof(double) * n_cores);
-	j = 0;
-	for (i = 0; i < n_cores; i++) {
-		assignments[j] += lp_cost[i].workload_factor;
-		new_LPS_binding[i] = j;
-		j++;
+	// Local id of the LPs hosted here, to find where communication partners are placed
+	local_lid = rsalloc(sizeof(unsigned int) * n_prc_tot);
+	memset(local_lid, 0xff, sizeof(unsigned int) * n_prc_tot);
+	assignment = rsalloc(sizeof(unsigned int) * n_prc);
+	memset(assignment, 0xff, sizeof(unsigned int) * n_prc);
+	foreach_lp(lp) {
+		local_lid[lp->gid.to_int] = lp->lid.to_int;
 	}
 
-	// Very suboptimal approximation of knapsack
-	for (; i < n_prc; i++) {
-		assigned = false;
-
-		for (j = 0; j < n_cores; j++) {
-			// Simulate assignment
-			if (assignments[j] + lp_cost[i].workload_factor <=
-			    reference_knapsack) {
-				assignments[j] += lp_cost[i].workload_factor;
-				new_LPS_binding[i] = j;
-				assigned = true;
-				break;
+	qsort(lp_cost, n_prc, sizeof(struct lp_cost_id), compare_lp_cost);
+
+	heap_init(heap);
+	for (i = 0; i < n_prc; i++) {
+		lid = lp_cost[i].id;
+		cost = lp_cost[i].workload_factor;
+
+		if (i < n_active_cores) {
+			// At least one LP per thread
+			tid = i;
+		} else {
+			// The heap has no decrease key: skip entries which are outdated
+			do {
+				entry = heap_extract(heap, cmp_thread_load);
+			} while (entry.load != new_load[entry.tid]);
+			tid = entry.tid;
+
+			if (lps_blocks[lid]->comm_partner_weight > 0) {
+				partner = local_lid[lps_blocks[lid]->comm_partner.to_int];
+				if (partner != UINT_MAX && assignment[partner] != UINT_MAX && assignment[partner] != tid &&
+				    new_load[assignment[partner]] + cost <= target * (1.0 + REBIND_AFFINITY_SLACK)) {
+					heap_insert(heap, entry, cmp_thread_load);
+					tid = assignment[partner];
+				}
 			}
 		}
 
-		if (assigned == false)
-			break;
+		assignment[lid] = tid;
+		new_load[tid] += cost;
+		entry.load = new_load[tid];
+		entry.tid = tid;
+		heap_insert(heap, entry, cmp_thread_load);
 	}
+	array_fini(heap);
 
-	// Check for leftovers
-	if (i < n_prc) {
-		j = 0;
-		for (; i < n_prc; i++) {
-			new_LPS_binding[i] = j;
-			j = (j + 1) % n_cores;
-		}
+	for (tid = 0; tid < n_active_cores; tid++) {
+		new_max = fmax(new_max, new_load[tid]);
 	}
-}
 
-#ifdef HAVE_LP_REBINDING
+	// Do not shuffle LPs around for a marginal gain
+	if (new_max < current_max * (1.0 - REBIND_MIN_GAIN)) {
+		memcpy(new_LPS_binding, assignment, sizeof(unsigned int) * n_prc);
+		binding_changed = true;
+	}
 
+	rsfree(assignment);
+	rsfree(local_lid);
+
+    out:
+	if (binding_changed)
+		rebinding_interval = fmax(rebinding_interval / 2, REBIND_INTERVAL_MIN);
+	else
+		rebinding_interval = fmin(rebinding_interval * 2, REBIND_INTERVAL_MAX);
+}
+
+/**
+* Posts the workload of the LPs bound to the calling worker thread in the
+* window since the previous reduction. The workload accounts for the time
+* spent in events which are later rolled back, and in recovering from them.
+* An LP which is being handed off when its threads post their reduction
+* keeps the workload of its previous window.
+*/
 static void post_local_reduction(void)
 {
-	unsigned int i = 0;
-	msg_t *first_evt, *last_evt;
+	unsigned int lid;
+	double workload;
 
 	foreach_bound_lp(lp) {
-		first_evt = list_head(lp->queue_in);
-		last_evt = list_tail(lp->queue_in);
-
-		lp_cost[lp->lid.to_int].id = i++;	// TODO: do we really need this?
-		lp_cost[lp->lid.to_int].workload_factor =
-		    list_sizeof(lp->queue_in);
-		lp_cost[lp->lid.to_int].workload_factor *=
-		    statistics_get_lp_data(lp, STAT_GET_EVENT_TIME_LP);
-		lp_cost[lp->lid.to_int].workload_factor /= (last_evt->
-							    timestamp -
-							    first_evt->
-							    timestamp);
+		lid = lp->lid.to_int;
+		workload = statistics_get_lp_data(lp, STAT_GET_WORKLOAD_LP);
+
+		lp_workload_window[lid] = workload - lp_workload_snapshot[lid];
+		lp_workload_snapshot[lid] = workload;
 	}
 }
 
-static void install_binding(void)
+#ifdef HAVE_MPI
+/// Restart the workload window of the bound LPs, whose local ids might have changed
+static void reset_workload_window(void)
 {
-	unsigned int i = 0;
+	foreach_bound_lp(lp) {
+		lp_workload_snapshot[lp->lid.to_int] = statistics_get_lp_data(lp, STAT_GET_WORKLOAD_LP);
+		lp_workload_window[lp->lid.to_int] = 0.0;
+	}
+}
+#endif
 
+static void install_binding(void)
+{
 	n_prc_per_thread = 0;
 
 	foreach_lp(lp) {
-		if (new_LPS_binding[i++] == local_tid) {
+		if (new_LPS_binding[lp->lid.to_int] == local_tid) {
 			LPS_bound_set(n_prc_per_thread++, lp);
 
 			if (local_tid != lp->worker_thread) {
@@ -239,13 +356,209 @@ static void install_binding(void)
 
 #endif
 
+/**
+* Tells whether a rebinding of LPs to worker threads is in progress, i.e.
+* whether some worker thread has posted its local reduction but the new
+* binding has not yet been installed by all of them.
+*
+* @return true if a rebinding is in progress, false otherwise
+*/
+bool binding_in_progress(void)
+{
+#ifdef HAVE_LP_REBINDING
+	return binding_phase != binding_acquire_phase ||
+	    atomic_read(&worker_thread_reduction) != (int)n_active_cores;
+#else
+	return false;
+#endif
+}
+
+/**
+* Tells whether some LP has been handed off by a worker thread, and the
+* worker thread which stole it has not yet added it to its bound LPs.
+*
+* @return true if some LP is not bound to any worker thread, false otherwise
+*/
+bool handoff_in_progress(void)
+{
+#ifdef HAVE_LP_REBINDING
+	return atomic_read(&handoffs_in_flight) != 0;
+#else
+	return false;
+#endif
+}
+
+/**
+* Publishes how many LPs bound to the calling worker thread have events to
+* process. This is used by idle worker threads to pick whom to steal from.
+*
+* @param ready The number of bound LPs which have events to process
+*/
+void report_ready_LPs(unsigned int ready)
+{
+#ifdef HAVE_LP_REBINDING
+	ready_LPs[local_tid] = ready;
+#else
+	(void)ready;
+#endif
+}
+
+/**
+* Asks the worker thread having the most LPs with events to process to hand
+* one of them off to the calling worker thread, which has nothing to do.
+* The request is served by the victim the next time it calls rebind_LPs().
+*/
+void steal_LP(void)
+{
+#ifdef HAVE_LP_REBINDING
+	unsigned int i;
+	unsigned int victim = NO_STEAL_REQUEST;
+	unsigned int most_ready = 1;
+
+	if (n_active_cores == 1 || handoff_inbox[local_tid] != NULL)
+		return;
+
+	// Wait for the previous request to be either served or denied
+	if (steal_victim != NO_STEAL_REQUEST) {
+		if (steal_request[steal_victim] == local_tid)
+			return;
+		steal_victim = NO_STEAL_REQUEST;
+	}
+
+	// LPs cannot change thread now anyway
+	if (gvt_round_in_progress() || binding_in_progress() || thread_resize_pending())
+		return;
+
+	// The victim must keep at least one LP with events to process
+	for (i = 0; i < n_active_cores; i++) {
+		if (i != local_tid && ready_LPs[i] > most_ready) {
+			most_ready = ready_LPs[i];
+			victim = i;
+		}
+	}
+
+	if (victim != NO_STEAL_REQUEST && iCAS(&steal_request[victim], NO_STEAL_REQUEST, local_tid))
+		steal_victim = victim;
+#endif
+}
+
+#ifdef HAVE_LP_REBINDING
+
+/**
+* Picks the bound LP to hand off to a thief. The LP with the most urgent
+* event is kept, as it is the one which will be scheduled next here. The
+* thief is given the LP with the second most urgent event, so that it does
+* not run far ahead of the GVT.
+*
+* @return The index of the LP in the bound LPs, or -1 if no LP can be given away
+*/
+static int LP_to_hand_off(void)
+{
+	unsigned int i;
+	int first = -1, second = -1;
+	simtime_t evt_time, first_time = INFTY, second_time = INFTY;
+	struct lp_struct *lp;
+
+	for (i = 0; i < n_prc_per_thread; i++) {
+		lp = lps_bound_blocks[i];
+
+		if (is_blocked_state(lp->state) || lp->state == LP_STATE_READY_FOR_SYNCH)
+			continue;
+
+		evt_time = next_event_timestamp(lp);
+		if (evt_time >= INFTY)
+			continue;
+
+		if (evt_time < first_time) {
+			second = first;
+			second_time = first_time;
+			first = i;
+			first_time = evt_time;
+		} else if (evt_time < second_time) {
+			second = i;
+			second_time = evt_time;
+		}
+	}
+
+	return second;
+}
+
+/**
+* Serves a steal request posted to the calling worker thread, if any.
+*
+* The handoff does not require worker threads to synchronize: the victim
+* removes the LP from its bound LPs and places it in the thief's inbox,
+* from which the thief takes it in adopt_LP(). In the meanwhile the LP is
+* accounted in handoffs_in_flight, which prevents GVT rounds, rebindings,
+* migrations and changes in the number of worker threads (which all rely
+* on bound LPs) from being started.
+* Conversely, no handoff is started while any of them is in progress. The
+* counter is incremented before checking this, so that either the victim
+* sees them in progress or they see the handoff.
+*/
+static void serve_steal_request(void)
+{
+	unsigned int thief = steal_request[local_tid];
+	struct lp_struct *lp;
+	int i;
+
+	if (thief == NO_STEAL_REQUEST)
+		return;
+
+	atomic_inc(&handoffs_in_flight);
+
+	i = -1;
+	if (!gvt_round_in_progress() && !binding_in_progress() && !thread_resize_pending() && handoff_inbox[thief] == NULL
+#ifdef HAVE_MPI
+	    && !lp_migration_pending()
+#endif
+	    )
+		i = LP_to_hand_off();
+
+	if (i >= 0) {
+		lp = lps_bound_blocks[i];
+		lps_bound_blocks[i] = lps_bound_blocks[--n_prc_per_thread];
+
+		// From now on, bottom halves to the LP account their timestamp
+		// in the thief's minimum in transit
+		lp->worker_thread = thief;
+		handoff_inbox[thief] = lp;
+		wake_worker_thread(thief);
+	} else {
+		atomic_dec(&handoffs_in_flight);
+	}
+
+	steal_request[local_tid] = NO_STEAL_REQUEST;
+}
+
+/**
+* Binds to the calling worker thread the LP which another worker thread
+* has handed off to it, if any. Bottom halves which were queued while the
+* LP was in flight are processed here next.
+*/
+static void adopt_LP(void)
+{
+	struct lp_struct *lp = handoff_inbox[local_tid];
+
+	if (lp == NULL)
+		return;
+
+	handoff_inbox[local_tid] = NULL;
+	LPS_bound_set(n_prc_per_thread++, lp);
+	steal_victim = NO_STEAL_REQUEST;
+
+	atomic_dec(&handoffs_in_flight);
+}
+
+#endif
+
 /**
 * This function is used to create a temporary binding between LPs and KLT.
 * The first time this function is called, each worker thread sets up its data
 * structures, and the performs a (deterministic) block allocation. This is
 * because no runtime data is available at the time, so we "share" the load
 * as the number of LPs.
-* Then, successive invocations, will use the knapsack load sharing policy
+* Then, successive invocations, will use the load sharing policy in LP_balance()
 
 * @author Alessandro Pellegrini
 */
@@ -262,27 +575,107 @@ void rebind_LPs(void)
 		timer_start(rebinding_timer);
 
 		if (master_thread()) {
-			new_LPS_binding = rsalloc(sizeof(int) * n_prc);
+			new_LPS_binding = rsalloc(sizeof(int) * n_prc_max);
 
-			lp_cost = rsalloc(sizeof(struct lp_cost_id) * n_prc);
+			lp_cost = rsalloc(sizeof(struct lp_cost_id) * n_prc_max);
+
+#ifdef HAVE_LP_REBINDING
+			lp_workload_snapshot = rsalloc(sizeof(double) * n_prc_max);
+			bzero(lp_workload_snapshot, sizeof(double) * n_prc_max);
+			lp_workload_window = rsalloc(sizeof(double) * n_prc_max);
+			bzero(lp_workload_window, sizeof(double) * n_prc_max);
+
+			steal_request = rsalloc(sizeof(uint32_t) * n_cores);
+			handoff_inbox = rsalloc(sizeof(struct lp_struct *) * n_cores);
+			ready_LPs = rsalloc(sizeof(unsigned int) * n_cores);
+			for (unsigned int i = 0; i < n_cores; i++) {
+				steal_request[i] = NO_STEAL_REQUEST;
+				handoff_inbox[i] = NULL;
+				ready_LPs[i] = 0;
+			}
+#endif
 
 			atomic_set(&worker_thread_reduction, n_cores);
 		}
 
 		return;
 	}
+
+	// Change the number of active worker threads. A worker thread which has
+	// just been woken up must go through this before looking for migrations,
+	// as it has missed the ones carried out while it was parked
+	if (master_thread() && thread_resize_pending() && !binding_in_progress() && !handoff_in_progress()
+#ifdef HAVE_MPI
+	    && !lp_migration_pending()
+#endif
+	    )
+		thread_resize_start();
+
+	if (thread_resize_started()) {
+		if (resize_worker_threads()) {
+			LPs_block_binding();
+
+#ifdef HAVE_LP_REBINDING
+			// Worker threads might have been parked while binding phases went on
+			local_binding_phase = binding_phase;
+			local_binding_acquire_phase = binding_acquire_phase;
+
+			steal_victim = NO_STEAL_REQUEST;
+			steal_request[local_tid] = NO_STEAL_REQUEST;
+			ready_LPs[local_tid] = 0;
+
+			if (master_thread())
+				atomic_set(&worker_thread_reduction, n_active_cores);
+#endif
+
+#ifdef HAVE_PREEMPTION
+			reset_min_in_transit(local_tid);
+#endif
+			thread_resize_complete();
+		}
+		return;
+	}
+
+#ifdef HAVE_MPI
+	// The set of local LPs changes during a migration, so no rebinding
+	// must be in progress when worker threads are told to start it
+	if (master_thread() && lp_migration_pending() && !binding_in_progress() && !handoff_in_progress())
+		lp_migration_start();
+
+	if (lp_migration_started()) {
+		migrate_LPs();
+
+		// Local ids have changed, start again with a block allocation
+		LPs_block_binding();
+#ifdef HAVE_LP_REBINDING
+		reset_workload_window();
+#endif
+
+		thread_barrier(&all_thread_barrier);
+		if (master_thread())
+			lp_migration_complete();
+		return;
+	}
+#endif
+
 #ifdef HAVE_LP_REBINDING
 	if (master_thread()) {
 		if (unlikely
-		    (timer_value_seconds(rebinding_timer) >= REBIND_INTERVAL)) {
+		    (timer_value_seconds(rebinding_timer) >= rebinding_interval) && !binding_in_progress() &&
+		    !thread_resize_pending()) {
 			timer_restart(rebinding_timer);
 			binding_phase++;
 		}
 
-		if (atomic_read(&worker_thread_reduction) == 0) {
+		// GVT is reduced over bound LPs: a round which was started before
+		// all threads posted their reduction must complete first.
+		// Threads which acknowledge an unchanged binding do not wait for the others
+		if (atomic_read(&worker_thread_reduction) == 0 && binding_acquire_phase != binding_phase &&
+		    !gvt_round_in_progress() && !handoff_in_progress()) {
 
-			LP_knapsack();
+			LP_balance();
 
+			atomic_set(&worker_thread_acquire, -(int)n_active_cores);
 			binding_acquire_phase++;
 		}
 	}
@@ -296,16 +689,24 @@ void rebind_LPs(void)
 	if (local_binding_acquire_phase < binding_acquire_phase) {
 		local_binding_acquire_phase = binding_acquire_phase;
 
-		install_binding();
+		if (binding_changed) {
+			install_binding();
 
 #ifdef HAVE_PREEMPTION
-		reset_min_in_transit(local_tid);
+			reset_min_in_transit(local_tid);
 #endif
 
-		if (thread_barrier(&all_thread_barrier)) {
-			atomic_set(&worker_thread_reduction, n_cores);
+			if (thread_barrier(&all_thread_barrier)) {
+				atomic_set(&worker_thread_reduction, n_active_cores);
+			}
+		} else if (atomic_inc_and_test(&worker_thread_acquire)) {
+			// No LP changes thread, so there is no need to stop everybody
+			atomic_set(&worker_thread_reduction, n_active_cores);
 		}
 
 	}
+
+	adopt_LP();
+	serve_steal_request();
 #endif
 }
@@ -30,3 +30,7 @@
 
 extern void rebind_LPs(void);
 extern void force_rebind_GLP(void);
+extern bool binding_in_progress(void);
+extern bool handoff_in_progress(void);
+extern void report_ready_LPs(unsigned int ready);
+extern void steal_LP(void);
@@ -0,0 +1,295 @@
+/**
+* @file scheduler/elastic.c
+*
+* @brief Elastic number of worker threads
+*
+* When many events are rolled back, additional worker threads mostly
+* produce wasted work. This module periodically measures the fraction of
+* processed events which are committed and, if it falls below the threshold
+* set with --elastic, parks the worker thread with the highest id. Parked
+* threads sleep on a futex and their LPs are bound to the remaining ones.
+* When the efficiency gets well above the threshold, a parked worker thread
+* is woken up again. The master thread is never parked.
+*
+* Changes in the number of worker threads are decided at the end of a GVT
+* round, and they are carried out by all active worker threads together
+* when no GVT round, rebinding, LP handoff or LP migration is in progress.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdio.h>
+
+#include <arch/atomic.h>
+#include <arch/thread.h>
+#include <core/core.h>
+#include <core/init.h>
+#include <gvt/gvt.h>
+#include <scheduler/binding.h>
+#include <scheduler/elastic.h>
+#include <statistics/statistics.h>
+#include <communication/gvt.h>
+#include <communication/migration.h>
+
+/// Number of GVT rounds since the last efficiency check
+static unsigned int gvt_rounds;
+
+/// Committed events at the beginning of the current window
+static double last_committed;
+
+/// Processed events at the beginning of the current window
+static double last_tot_events;
+
+/// Set when the number of worker threads must change
+static volatile bool resize_pending;
+
+/// The number of worker threads which will be active after the change
+static unsigned int resize_target;
+
+/// Number of active worker threads before the last change
+static unsigned int resize_from;
+
+/// Tells worker threads whether the current attempt to change their number goes on
+static bool resize_go;
+
+/// The master thread increments this to let worker threads change their number
+static volatile unsigned int resize_phase;
+
+/// The last resize phase joined by the worker thread
+static __thread unsigned int local_resize_phase;
+
+/// Parked worker threads sleep on this counter, which is incremented to wake them up
+static atomic_t wakeup_count;
+
+/// Set when parked worker threads must take part to the simulation shutdown
+static volatile bool shutting_down;
+
+/// Tells whether the calling worker thread is parked
+static __thread bool parked;
+
+
+/**
+ * @brief Decide whether the number of active worker threads should change
+ *
+ * This is called at the end of a GVT round by a single worker thread, when
+ * all of them have dumped the statistics of the round. Every ELASTIC_PERIOD
+ * rounds, the efficiency of the last window is compared with the threshold.
+ * A worker thread is parked if it is below it, and one is woken up if it is
+ * closer to one than to the threshold. The window grows until enough events
+ * have been processed to tell.
+ *
+ * @param gvt The newly reduced GVT
+ */
+void elastic_check(simtime_t gvt)
+{
+	double committed, events, efficiency, threshold;
+
+	if (!elastic_enabled())
+		return;
+
+	if (++gvt_rounds % ELASTIC_PERIOD != 0)
+		return;
+
+	// Do not stop all worker threads if the simulation is about to end
+	if (rootsim_config.simulation_time != 0 && (int)gvt >= rootsim_config.simulation_time)
+		return;
+
+	committed = statistics_get_kernel_data(STAT_GET_COMMITTED_EVENTS);
+	events = statistics_get_kernel_data(STAT_GET_TOT_EVENTS);
+	if (events - last_tot_events < ELASTIC_MIN_EVENTS)
+		return;
+
+	efficiency = (committed - last_committed) / (events - last_tot_events);
+	last_committed = committed;
+	last_tot_events = events;
+
+	threshold = rootsim_config.elastic_threshold / 100.0;
+	if (efficiency < threshold && n_active_cores > 1) {
+		resize_target = n_active_cores - 1;
+	} else if (efficiency > (1.0 + threshold) / 2 && n_active_cores < n_cores && n_active_cores < n_prc) {
+		resize_target = n_active_cores + 1;
+	} else {
+		return;
+	}
+
+	resize_pending = true;
+}
+
+
+/**
+ * @brief Tell whether the number of active worker threads must change
+ *
+ * While this is the case, no new GVT reduction can be started, LPs are not
+ * handed off between worker threads, and the simulation cannot be halted.
+ *
+ * @return @c true if a change is pending, @c false otherwise
+ */
+bool thread_resize_pending(void)
+{
+	return resize_pending;
+}
+
+
+/**
+ * @brief Let worker threads carry out a pending change in their number
+ *
+ * This is called by the master thread when a change is pending and no
+ * other operation involving all worker threads is in progress.
+ */
+void thread_resize_start(void)
+{
+	if (resize_phase == local_resize_phase)
+		resize_phase++;
+}
+
+
+/**
+ * @brief Tell whether the calling worker thread should join a change in
+ * the number of active worker threads
+ *
+ * @return @c true if the worker thread must call resize_worker_threads()
+ */
+bool thread_resize_started(void)
+{
+	return local_resize_phase != resize_phase;
+}
+
+
+/**
+ * @brief Change the number of active worker threads
+ *
+ * This is called by all active worker threads, and by those which have just
+ * been woken up. The active ones first check that no GVT round and no LP
+ * handoff has been started in the meanwhile, otherwise the change is
+ * attempted again later. The all_thread_barrier is then resized, and the
+ * worker threads which are needed again are woken up.
+ *
+ * When this returns true, the calling worker thread must recompute its LP
+ * binding according to n_active_cores, and then call thread_resize_complete().
+ *
+ * @return @c true if the number of active worker threads has changed
+ */
+bool resize_worker_threads(void)
+{
+	local_resize_phase = resize_phase;
+
+	// Everything has been set up by the active worker threads
+	if (parked) {
+		parked = false;
+#ifdef HAVE_MPI
+		rejoin_phase_colour();
+		lp_migration_rejoin();
+#endif
+		return true;
+	}
+
+	// Wait for all active worker threads to stop processing events
+	if (thread_barrier(&all_thread_barrier)) {
+		resize_go = !gvt_round_in_progress() && !handoff_in_progress();
+		if (resize_go) {
+			resize_from = n_active_cores;
+			n_active_cores = resize_target;
+			barrier_resize(&all_thread_barrier, resize_target);
+		}
+	}
+
+	// The new number of participants is adopted when this barrier is reset
+	if (thread_barrier(&all_thread_barrier) && resize_go && n_active_cores > resize_from) {
+		atomic_inc(&wakeup_count);
+		futex_wake_all(&wakeup_count.count);
+	}
+
+	return resize_go;
+}
+
+
+/**
+ * @brief Complete a change in the number of active worker threads
+ *
+ * Worker threads which are left with no LP are marked as parked, and they
+ * go to sleep in park_worker_thread(). The other ones wait for each other
+ * to have recomputed their LP binding.
+ */
+void thread_resize_complete(void)
+{
+	if (local_tid >= n_active_cores) {
+		parked = true;
+		return;
+	}
+
+	thread_barrier(&all_thread_barrier);
+
+	if (master_thread()) {
+		resize_pending = false;
+
+		if (rootsim_config.verbose == VERBOSE_INFO || rootsim_config.verbose == VERBOSE_DEBUG)
+			printf("Kernel %u is running %u worker threads out of %u\n", kid, n_active_cores, n_cores);
+	}
+}
+
+
+/**
+ * @brief Put the calling worker thread to sleep, if it has been parked
+ *
+ * This is called at every iteration of the main simulation loop.
+ *
+ * @return @c false if the worker thread has been woken up to shut down the
+ *         simulation, @c true otherwise
+ */
+bool park_worker_thread(void)
+{
+	int count;
+
+	if (likely(!parked))
+		return true;
+
+	while (true) {
+		count = atomic_read(&wakeup_count);
+
+		if (shutting_down)
+			return false;
+
+		if (local_tid < n_active_cores)
+			return true;
+
+		futex_wait(&wakeup_count.count, count);
+	}
+}
+
+
+/**
+ * @brief Wake up parked worker threads to shut down the simulation
+ *
+ * This is called by all worker threads when they leave the main simulation
+ * loop, so that the parked ones take part to the final barriers as well.
+ */
+void release_worker_threads(void)
+{
+	if (parked || n_active_cores == n_cores)
+		return;
+
+	if (thread_barrier(&all_thread_barrier))
+		barrier_resize(&all_thread_barrier, n_cores);
+
+	if (thread_barrier(&all_thread_barrier)) {
+		shutting_down = true;
+		atomic_inc(&wakeup_count);
+		futex_wake_all(&wakeup_count.count);
+	}
+}
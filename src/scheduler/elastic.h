@@ -0,0 +1,53 @@
+/**
+* @file scheduler/elastic.h
+*
+* @brief Elastic number of worker threads
+*
+* This module parks worker threads when the simulation efficiency, i.e. the
+* fraction of processed events which get committed, is low, and wakes them
+* up again when it improves. Changes are decided at the end of GVT rounds
+* and carried out by all worker threads together.
+*
+* @copyright
+* Copyright (C) 2008-2019 HPDCS Group
+* https://hpdcs.github.io
+*
+* This file is part of ROOT-Sim (ROme OpTimistic Simulator).
+*
+* ROOT-Sim is free software; you can redistribute it and/or modify it under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation; only version 3 of the License applies.
+*
+* ROOT-Sim is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+* A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* ROOT-Sim; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <core/core.h>
+#include <core/init.h>
+
+/// Number of GVT reductions between two checks of the simulation efficiency
+#define ELASTIC_PERIOD		5
+
+/// Efficiency is not evaluated over windows with less processed events than this
+#define ELASTIC_MIN_EVENTS	1000.0
+
+/// Tells whether the number of worker threads can change in the current run
+#define elastic_enabled() (rootsim_config.elastic_threshold > 0 && n_cores > 1)
+
+extern void elastic_check(simtime_t gvt);
+extern bool thread_resize_pending(void);
+extern void thread_resize_start(void);
+extern bool thread_resize_started(void);
+extern bool resize_worker_threads(void);
+extern void thread_resize_complete(void);
+extern bool park_worker_thread(void);
+extern void release_worker_threads(void);
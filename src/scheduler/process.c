@@ -35,6 +35,9 @@
 #include <core/init.h>
 #include <scheduler/process.h>
 #include <scheduler/scheduler.h>
+#include <mm/mm.h>
+#include <mm/state.h>
+#include <gvt/gvt.h>
 
 // TODO: see issue #121 to see how to make this ugly hack disappear
 __thread unsigned int __lp_counter = 0;
@@ -51,15 +54,99 @@ __thread struct lp_struct **lps_bound_blocks = NULL;
 void initialize_binding_blocks(void)
 {
 	lps_bound_blocks =
-	    (struct lp_struct **)rsalloc(n_prc * sizeof(struct lp_struct *));
-	bzero(lps_bound_blocks, sizeof(struct lp_struct *) * n_prc);
+	    (struct lp_struct **)rsalloc(n_prc_max * sizeof(struct lp_struct *));
+	bzero(lps_bound_blocks, sizeof(struct lp_struct *) * n_prc_max);
 }
 
-void initialize_lps(void)
+/**
+* This function creates and initializes the control block of a locally-hosted LP.
+* It is used both when setting up the LPs at simulation startup, and when
+* an LP is migrated towards this kernel instance.
+*
+* @param gid The global id of the LP
+* @param lid The local id which is assigned to the LP
+* @return A pointer to the newly-created lp_struct
+*/
+struct lp_struct *initialize_lp(GID_t gid, unsigned int lid)
 {
-	unsigned int i, j;
-	unsigned int lid = 0;
+	unsigned int j;
 	struct lp_struct *lp;
+
+	// Initialize the control block for the current lp
+	lp = (struct lp_struct *)rsalloc(sizeof(struct lp_struct));
+	bzero(lp, sizeof(struct lp_struct));
+
+	// We sequentially assign lids, and use the current gid.
+	// The memory map relies on the gid, so set it beforehand.
+	lp->lid.to_int = lid;
+	lp->gid = gid;
+
+	// Initialize memory map
+	initialize_memory_map(lp);
+
+	// Allocate memory for the outgoing buffer
+	lp->outgoing_buffer.max_size = INIT_OUTGOING_MSG;
+	lp->outgoing_buffer.outgoing_msgs =
+	    rsalloc(sizeof(msg_t *) * INIT_OUTGOING_MSG);
+
+	// Initialize bottom halves msg channel
+	lp->bottom_halves = init_channel();
+
+	// Which version of OnGVT and ProcessEvent should we use?
+	// Soft-dirty bits do not need an instrumented version of the model
+	if (rootsim_config.snapshot == SNAPSHOT_FULL || rootsim_config.snapshot == SNAPSHOT_INCREMENTAL) {
+		lp->OnGVT = &OnGVT_light;
+		lp->ProcessEvent = &ProcessEvent_light;
+	}		// TODO: add here an else for ISS
+
+	// Allocate LP stack
+	lp->stack = get_ult_stack(LP_STACK_SIZE);
+
+	// Set the initial checkpointing period for this LP.
+	// If the checkpointing period is fixed, this will not change during the
+	// execution. Otherwise, new calls to this function will (locally) update
+	// this.
+	set_checkpoint_period(lp, rootsim_config.ckpt_period);
+
+	// Initially, every LP is ready
+	lp->state = LP_STATE_READY;
+
+	// There is no current state layout at the beginning
+	lp->current_base_pointer = NULL;
+
+	// Initialize the queues
+	lp->queue_in = new_list(msg_t);
+	lp->queue_out = new_list(msg_hdr_t);
+	lp->queue_lazy = new_list(msg_hdr_t);
+	lp->queue_states = new_list(state_t);
+	lp->fossil_barrier = -INFTY;
+	lp->rendezvous_queue = new_list(msg_t);
+
+	// No event has been processed so far
+	lp->bound = NULL;
+
+	// We have no information about messages still to be delivered to this LP
+	lp->outgoing_buffer.min_in_transit = rsalloc(sizeof(simtime_t) * n_cores);
+	for (j = 0; j < n_cores; j++) {
+		lp->outgoing_buffer.min_in_transit[j] = INFTY;
+	}
+
+#ifdef HAVE_CROSS_STATE
+	// No read/write dependencies open so far for the LP. The current lp is always opened
+	lp->ECS_index = 0;
+	lp->ECS_synch_table[0] = LidToGid(lp);	// LidToGid for distributed ECS
+#endif
+
+	// Create User-Level Thread
+	context_create(&lp->context, LP_main_loop, NULL, lp->stack,
+		       LP_STACK_SIZE);
+
+	return lp;
+}
+
+void initialize_lps(void)
+{
+	unsigned int i;
 	unsigned int local = 0;
 	GID_t gid;
 
@@ -68,9 +155,11 @@ void initialize_lps(void)
 	distribute_lps_on_kernels();
 
 	// We now know how many LPs should be locally hosted. Prepare
-	// the place for their control blocks.
+	// the place for their control blocks. If LPs can be migrated,
+	// there must be room for the ones which might arrive later.
 	lps_blocks =
-	    (struct lp_struct **)rsalloc(n_prc * sizeof(struct lp_struct *));
+	    (struct lp_struct **)rsalloc(n_prc_max * sizeof(struct lp_struct *));
+	bzero(lps_blocks, sizeof(struct lp_struct *) * n_prc_max);
 
 	// We now iterate over all LP Gids. Everytime that we find an LP
 	// which should be locally hosted, we create the local lp_struct
@@ -80,77 +169,67 @@ void initialize_lps(void)
 		if (find_kernel_by_gid(gid) != kid)
 			continue;
 
-		// Initialize the control block for the current lp
-		lp = (struct lp_struct *)rsalloc(sizeof(struct lp_struct));
-		bzero(lp, sizeof(struct lp_struct));
-		lps_blocks[local++] = lp;
-
-		if (local > n_prc) {
+		if (local >= n_prc) {
 			printf("reached local %d\n", local);
 			fflush(stdout);
 			abort();
 		}
-		// Initialize memory map
-		initialize_memory_map(lp);
-
-		// Allocate memory for the outgoing buffer
-		lp->outgoing_buffer.max_size = INIT_OUTGOING_MSG;
-		lp->outgoing_buffer.outgoing_msgs =
-		    rsalloc(sizeof(msg_t *) * INIT_OUTGOING_MSG);
-
-		// Initialize bottom halves msg channel
-		lp->bottom_halves = init_channel();
-
-		// We sequentially assign lids, and use the current gid
-		lp->lid.to_int = lid++;
-		lp->gid = gid;
-
-		// Which version of OnGVT and ProcessEvent should we use?
-		if (rootsim_config.snapshot == SNAPSHOT_FULL) {
-			lp->OnGVT = &OnGVT_light;
-			lp->ProcessEvent = &ProcessEvent_light;
-		}		// TODO: add here an else for ISS
-
-		// Allocate LP stack
-		lp->stack = get_ult_stack(LP_STACK_SIZE);
-
-		// Set the initial checkpointing period for this LP.
-		// If the checkpointing period is fixed, this will not change during the
-		// execution. Otherwise, new calls to this function will (locally) update
-		// this.
-		set_checkpoint_period(lp, rootsim_config.ckpt_period);
-
-		// Initially, every LP is ready
-		lp->state = LP_STATE_READY;
-
-		// There is no current state layout at the beginning
-		lp->current_base_pointer = NULL;
-
-		// Initialize the queues
-		lp->queue_in = new_list(msg_t);
-		lp->queue_out = new_list(msg_hdr_t);
-		lp->queue_states = new_list(state_t);
-		lp->rendezvous_queue = new_list(msg_t);
-
-		// No event has been processed so far
-		lp->bound = NULL;
-
-		// We have no information about messages still to be delivered to this LP
-		lp->outgoing_buffer.min_in_transit = rsalloc(sizeof(simtime_t) * n_cores);
-		for (j = 0; j < n_cores; j++) {
-			lp->outgoing_buffer.min_in_transit[j] = INFTY;
-		}
 
-#ifdef HAVE_CROSS_STATE
-		// No read/write dependencies open so far for the LP. The current lp is always opened
-		lp->ECS_index = 0;
-		lp->ECS_synch_table[0] = LidToGid(lp);	// LidToGid for distributed ECS
-#endif
+		lps_blocks[local] = initialize_lp(gid, local);
+		local++;
+	}
+}
 
-		// Create User-Level Thread
-		context_create(&lp->context, LP_main_loop, NULL, lp->stack,
-			       LP_STACK_SIZE);
+/**
+* This function releases all the resources held by a locally-hosted LP,
+* including its control block. It is used when an LP leaves this kernel
+* instance because of a migration. Messages and antimessages kept in
+* the LP slab go away together with the LP memory map.
+*
+* @param lp A pointer to the lp_struct of the LP to release
+*/
+void finalize_lp(struct lp_struct *lp)
+{
+	msg_t *msg, *next_msg;
+	state_t *state, *next_state;
+
+	// Fossils are kept in LP memory as well
+	release_fossils(lp, false);
+
+	// Messages which did not fit in a slab buffer must be released explicitly
+	msg = list_head(lp->queue_in);
+	while (msg != NULL) {
+		next_msg = list_next(msg);
+		if (sizeof(msg_t) + msg->size > SLAB_MSG_SIZE)
+			rsfree(msg);
+		msg = next_msg;
 	}
+
+	state = list_head(lp->queue_states);
+	while (state != NULL) {
+		next_state = list_next(state);
+		state_release(state);
+		state = next_state;
+	}
+
+	rsfree(lp->queue_in);
+	rsfree(lp->queue_out);
+	rsfree(lp->queue_lazy);
+	rsfree(lp->queue_states);
+	rsfree(lp->rendezvous_queue);
+
+	fini_channel(lp->bottom_halves);
+	rsfree(lp->outgoing_buffer.outgoing_msgs);
+	rsfree(lp->outgoing_buffer.min_in_transit);
+	rsfree(lp->stack);
+
+	if (lp->topology != NULL)
+		rsfree(lp->topology);
+	if (lp->region != NULL)
+		abm_region_fini(lp->region);
+
+	finalize_memory_map(lp);
+	rsfree(lp);
 }
 
 // This works only for locally-hosted LPs!
@@ -84,6 +84,12 @@ struct lp_struct {
 	/// ID of the worker thread towards which the LP is bound
 	unsigned int worker_thread;
 
+	/// LP which receives most of the messages sent by this LP
+	GID_t comm_partner;
+
+	/// Weight of comm_partner in the frequent receiver estimate
+	unsigned int comm_partner_weight;
+
 	/// Current execution state of the LP
 	short unsigned int state;
 
@@ -96,6 +102,9 @@ struct lp_struct {
 	/// If this variable is set, the next invocation to LogState() takes a new state log, independently of the checkpointing interval
 	bool state_log_forced;
 
+	/// Minimum delay of the events sent to other LPs, as declared by the model via SetLookahead()
+	simtime_t lookahead;
+
 	/// The current state base pointer (updated by SetState())
 	void *current_base_pointer;
 
@@ -105,12 +114,26 @@ struct lp_struct {
 	/// Pointer to the last correctly processed event
 	msg_t *bound;
 
+	/// Pointer to the last processed event, which is past the bound until a pending rollback is done (reverse computation only)
+	msg_t *last_processed;
+
 	/// Output messages queue
 	 list(msg_hdr_t) queue_out;
 
+	/// Messages sent by rolled back events, which lazy cancellation has not annihilated yet
+	 list(msg_hdr_t) queue_lazy;
+
 	/// Saved states queue
 	 list(state_t) queue_states;
 
+	/// States, input messages and output headers detached by fossil collection, which are released incrementally
+	state_t *fossil_states;
+	msg_t *fossil_msgs;
+	msg_hdr_t *fossil_hdrs;
+
+	/// Time barrier of the last fossil collection, -INFTY once unused memory buffers have been released
+	simtime_t fossil_barrier;
+
 	/// Bottom halves
 	msg_channel *bottom_halves;
 
@@ -137,6 +160,15 @@ struct lp_struct {
 			     void *event_content, unsigned int size,
 			     void *state);
 
+	/**
+	 * Handler which undoes the effects of an event, registered by the
+	 * model via RegisterReverseEvent(). If set, the LP is rolled back
+	 * by reverse computation rather than by restoring a checkpoint.
+	 */
+	void (*ReverseEvent)(unsigned int me, simtime_t now, int event_type,
+			     void *event_content, unsigned int size,
+			     void *state);
+
 #ifdef HAVE_CROSS_STATE
 	GID_t ECS_synch_table[MAX_CROSS_STATE_DEPENDENCIES];
 	unsigned int ECS_index;
@@ -181,4 +213,6 @@ extern __thread unsigned int __lp_bound_counter;
 
 extern void initialize_binding_blocks(void);
 extern void initialize_lps(void);
+extern struct lp_struct *initialize_lp(GID_t gid, unsigned int lid);
+extern void finalize_lp(struct lp_struct *lp);
 extern struct lp_struct *find_lp_by_gid(GID_t);
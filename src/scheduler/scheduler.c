@@ -36,6 +36,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <datatypes/list.h>
 #include <datatypes/msgchannel.h>
@@ -46,6 +47,7 @@
 #include <arch/thread.h>
 #include <core/init.h>
 #include <scheduler/binding.h>
+#include <scheduler/elastic.h>
 #include <scheduler/process.h>
 #include <scheduler/scheduler.h>
 #include <scheduler/stf.h>
@@ -65,9 +67,34 @@
 #include <arch/x86/linux/cross_state_manager/cross_state_manager.h>
 #include <queues/xxhash.h>
 
+/// Number of consecutive idle iterations in which a worker thread busy-waits, for exponentially longer
+#define IDLE_SPIN_ROUNDS	8
+
+/// Sleeping time in the first idle iteration in which a worker thread sleeps, in microseconds
+#define IDLE_SLEEP_MIN		8
+
+/// Maximum sleeping time of an idle worker thread, in microseconds
+#define IDLE_SLEEP_MAX		1024
+
 /// This is used to keep track of how many LPs were bound to the current KLT
 __thread unsigned int n_prc_per_thread;
 
+/// Number of consecutive main loop iterations in which the worker thread had nothing to do
+static __thread unsigned int idle_rounds;
+
+/// For each worker thread, a counter which is incremented to wake it up while it is idle
+static atomic_t *idle_wakeup;
+
+/// What an idle worker thread is doing
+enum idle_states {
+	IDLE_RUNNING,	///< The worker thread is not backing off
+	IDLE_SPINNING,	///< The worker thread is busy-waiting
+	IDLE_SLEEPING	///< The worker thread is sleeping on its idle_wakeup counter
+};
+
+/// For each worker thread, one of idle_states
+static atomic_t *idle_state;
+
 /// This is a per-thread variable pointing to the block state of the LP currently scheduled
 __thread struct lp_struct *current;
 
@@ -92,6 +119,15 @@ __thread msg_t *current_evt;
 */
 void scheduler_init(void)
 {
+	unsigned int i;
+
+	idle_wakeup = rsalloc(sizeof(atomic_t) * n_cores);
+	idle_state = rsalloc(sizeof(atomic_t) * n_cores);
+	for (i = 0; i < n_cores; i++) {
+		atomic_set(&idle_wakeup[i], 0);
+		atomic_set(&idle_state[i], IDLE_RUNNING);
+	}
+
 #ifdef HAVE_PREEMPTION
 	preempt_init();
 #endif
@@ -111,6 +147,7 @@ void scheduler_fini(void)
 	foreach_lp(lp) {
 		rsfree(lp->queue_in);
 		rsfree(lp->queue_out);
+		rsfree(lp->queue_lazy);
 		rsfree(lp->queue_states);
 		rsfree(lp->bottom_halves);
 		rsfree(lp->rendezvous_queue);
@@ -123,6 +160,81 @@ void scheduler_fini(void)
 
 	rsfree(lps_blocks);
 	rsfree(lps_bound_blocks);
+	rsfree(idle_wakeup);
+	rsfree(idle_state);
+}
+
+/**
+* Backs off a worker thread which has found no event to process. The longer
+* the worker thread stays idle, the more it backs off: it first busy-waits
+* for exponentially longer times, and then it sleeps for exponentially longer
+* times, up to IDLE_SLEEP_MAX. In both cases, it gets back to work as soon as
+* a bottom half or an LP is delivered to it, or a GVT round is started.
+*
+* The CPU is not simply yielded to other threads: the worker thread would
+* then stay off for a whole time slice, and the LPs bound to it would lag
+* behind, causing rollbacks to the other ones when they receive messages.
+*
+* A worker thread never sleeps if other worker threads are waiting for it,
+* nor in a distributed run, where remote messages are only seen by polling.
+*/
+void idle_backoff(void)
+{
+	unsigned int i, usec;
+	int count;
+
+	if (gvt_round_in_progress())
+		return;
+
+	count = atomic_read(&idle_wakeup[local_tid]);
+
+	if (idle_rounds < IDLE_SPIN_ROUNDS || n_ker > 1 || binding_in_progress() || thread_resize_pending()) {
+		atomic_set(&idle_state[local_tid], IDLE_SPINNING);
+		i = 1U << (idle_rounds < IDLE_SPIN_ROUNDS ? idle_rounds : IDLE_SPIN_ROUNDS);
+		while (i-- > 0 && atomic_read(&idle_wakeup[local_tid]) == count)
+			cpu_relax();
+	} else {
+		i = idle_rounds - IDLE_SPIN_ROUNDS;
+		usec = IDLE_SLEEP_MAX;
+		if (i < 16 && (IDLE_SLEEP_MIN << i) < IDLE_SLEEP_MAX)
+			usec = IDLE_SLEEP_MIN << i;
+
+		// Who delivers work to us after this sees that we are sleeping
+		atomic_set(&idle_state[local_tid], IDLE_SLEEPING);
+		__sync_synchronize();
+		futex_wait_timeout(&idle_wakeup[local_tid].count, count, usec);
+	}
+
+	atomic_set(&idle_state[local_tid], IDLE_RUNNING);
+
+	if (idle_rounds < UINT_MAX)
+		idle_rounds++;
+}
+
+/**
+* Tells that the worker thread has found some work to do, so that it will
+* not back off when it is idle again for a short time.
+*/
+void idle_backoff_reset(void)
+{
+	idle_rounds = 0;
+}
+
+/**
+* Wakes up a worker thread, if it is backing off because it is idle.
+*
+* @param thread The local id of the worker thread to wake up
+*/
+void wake_worker_thread(unsigned int thread)
+{
+	int state = atomic_read(&idle_state[thread]);
+
+	if (state == IDLE_RUNNING)
+		return;
+
+	atomic_inc(&idle_wakeup[thread]);
+	if (state == IDLE_SLEEPING)
+		futex_wake_all(&idle_wakeup[thread].count);
 }
 
 /**
@@ -236,6 +348,9 @@ void initialize_worker_thread(void)
 	// Worker Threads synchronization barrier: they all should start working together
 	thread_barrier(&all_thread_barrier);
 
+	// LPs have declared their lookahead while processing INIT
+	lookahead_init();
+
 #ifdef HAVE_PREEMPTION
 	if (!rootsim_config.disable_preemption)
 		enable_preemption();
@@ -317,11 +432,14 @@ bool check_rendevouz_request(struct lp_struct *lp)
 * and in turn activates it. This is used only to support forward execution.
 *
 * @author Alessandro Pellegrini
+*
+* @return false if no LP had anything to do, true otherwise
 */
-void schedule(void)
+bool schedule(void)
 {
 	struct lp_struct *next;
 	msg_t *event;
+	bool safe = false;
 
 #ifdef HAVE_CROSS_STATE
 	bool resume_execution = false;
@@ -341,19 +459,29 @@ void schedule(void)
 	// No logical process found with events to be processed
 	if (next == NULL) {
 		statistics_post_data(NULL, STAT_IDLE_CYCLES, 1.0);
-		return;
+		steal_LP();
+		return false;
 	}
 	// If we have to rollback
 	if (next->state == LP_STATE_ROLLBACK) {
 		rollback(next);
 		next->state = LP_STATE_READY;
 		send_outgoing_msgs(next);
-		return;
+		flush_lazy_antimessages(next);
+		return true;
 	}
 
 	if (!is_blocked_state(next->state)
 	    && next->state != LP_STATE_READY_FOR_SYNCH) {
 		event = advance_to_next_event(next);
+		safe = is_safe_event(event);
+
+		// Reverse computation will have to bring the numerical library back here
+		if (next->ReverseEvent != NULL && event != NULL) {
+			event->processed = true;
+			memcpy(&event->numerical, &next->numerical, sizeof(numerical_state_t));
+			next->last_processed = event;
+		}
 	} else {
 		event = next->bound;
 	}
@@ -369,7 +497,7 @@ void schedule(void)
 	}
 
 	if (unlikely(!process_control_msg(event))) {
-		return;
+		return true;
 	}
 #ifdef HAVE_CROSS_STATE
 	// In case we are resuming an interrupted execution, we keep track of this.
@@ -389,7 +517,11 @@ void schedule(void)
 
 	if (!is_blocked_state(next->state)) {
 		next->state = LP_STATE_READY;
-		send_outgoing_msgs(next);
+		if (safe)
+			send_committed_msgs(next);
+		else
+			send_outgoing_msgs(next);
+		flush_lazy_antimessages(next);
 	}
 #ifdef HAVE_CROSS_STATE
 	if (resume_execution && !is_blocked_state(next->state)) {
@@ -402,8 +534,19 @@ void schedule(void)
 	}
 #endif
 
-	// Log the state, if needed
-	LogState(next);
+	// Log the state, if needed. A safe event is never rolled back, so the
+	// state is logged only after the last one of a sequence of safe events,
+	// which is where a later rollback can bring the LP at most. Long
+	// sequences are logged once per GVT round as well, otherwise fossil
+	// collection would find no state to prune the queues.
+	if (!safe) {
+		LogState(next);
+	} else if (!is_safe_event(list_next(next->bound)) || list_tail(next->queue_states)->lvt < get_last_gvt()) {
+		force_LP_checkpoint(next);
+		LogState(next);
+	}
+
+	return true;
 }
 
 void schedule_on_init(struct lp_struct *next)
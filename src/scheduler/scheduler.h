@@ -57,7 +57,10 @@ enum {
 /* Functions invoked by other modules */
 extern void scheduler_init(void);
 extern void scheduler_fini(void);
-extern void schedule(void);
+extern bool schedule(void);
+extern void idle_backoff(void);
+extern void idle_backoff_reset(void);
+extern void wake_worker_thread(unsigned int thread);
 extern void schedule_on_init(struct lp_struct *next);
 extern void initialize_worker_thread(void);
 extern void activate_LP(struct lp_struct *, msg_t *);
@@ -35,6 +35,7 @@
 #include <arch/thread.h>
 #include <core/core.h>
 #include <queues/queues.h>
+#include <scheduler/binding.h>
 #include <scheduler/scheduler.h>
 #include <scheduler/process.h>
 #include <gvt/gvt.h>
@@ -54,6 +55,7 @@ struct lp_struct *smallest_timestamp_first(void)
 {
 	struct lp_struct *next_lp = NULL;
 	simtime_t evt_time, next_time = INFTY;
+	unsigned int ready = 0;
 
 	foreach_bound_lp(lp) {
 		// If waiting for synch, don't take into account the LP
@@ -69,11 +71,17 @@ struct lp_struct *smallest_timestamp_first(void)
 			evt_time = next_event_timestamp(lp);
 		}
 
+		if (evt_time < INFTY)
+			ready++;
+
 		if (evt_time < next_time && evt_time < INFTY) {
 			next_time = evt_time;
 			next_lp = lp;
 		}
 	}
 
+	// Let idle worker threads know whether there is something to steal here
+	report_ready_LPs(ready);
+
 	return next_lp;
 }
@@ -5,8 +5,11 @@
  *
  * This module implements the sequential execution of simulation models.
  * Here all the routines to support sequential simulations are implemented,
- * except for the event queue which uses the Calendar Queue implemented in
- * calqueue.c.
+ * except for the event queue which uses the Ladder Queue implemented in
+ * ladqueue.c.
+ *
+ * Termination predicates and the periodic output are not evaluated after
+ * each event, but once every SERIAL_CHECK_PERIOD events.
  *
  * @copyright
  * Copyright (C) 2008-2019 HPDCS Group
@@ -42,7 +45,7 @@
 #include <core/timer.h>
 #include <gvt/ccgs.h>
 #include <mm/mm.h>
-#include <datatypes/calqueue.h>
+#include <datatypes/ladqueue.h>
 #include <statistics/statistics.h>
 
 #ifdef EXTRA_CHECKS
@@ -51,10 +54,29 @@
 
 static bool serial_simulation_complete = false;
 static bool *serial_completed_simulation;
+static unsigned int serial_completed = 0;
 
-void SerialScheduleNewEvent(unsigned int rcv, simtime_t stamp,
-			    unsigned int event_type, void *event_content,
-			    unsigned int event_size)
+/// Tells whether an LP has executed events since the last termination check
+static bool *serial_touched;
+
+/// The LPs which have executed events since the last termination check
+static struct lp_struct **serial_touched_lps;
+static unsigned int serial_touched_count = 0;
+
+/**
+ * @brief Allocate an event for the serial scheduler, leaving its payload to be filled
+ *
+ * The event is not scheduled until it is passed to SerialCommitEvent(). This
+ * allows the platform to build large payloads in place.
+ *
+ * @param rcv The id of the receiver LP
+ * @param stamp The timestamp of the event
+ * @param event_type The type of the event
+ * @param event_size The size in bytes of the payload
+ * @return A pointer to the payload of the event
+ */
+void *SerialReserveEvent(unsigned int rcv, simtime_t stamp,
+			 unsigned int event_type, unsigned int event_size)
 {
 	GID_t receiver;
 	msg_t *event;
@@ -75,10 +97,31 @@ void SerialScheduleNewEvent(unsigned int rcv, simtime_t stamp,
 	event->send_time = lvt(current);
 	event->type = event_type;
 	event->size = event_size;
-	memcpy(event->event_content, event_content, event_size);
 
-	// Put the event in the Calenda Queue
-	calqueue_put(stamp, event);
+	return event->event_content;
+}
+
+/**
+ * @brief Schedule an event allocated by SerialReserveEvent()
+ *
+ * @param event_content A pointer to the payload of the event
+ */
+void SerialCommitEvent(void *event_content)
+{
+	msg_t *event = (msg_t *)((unsigned char *)event_content - offsetof(msg_t, event_content));
+
+	// Put the event in the Ladder Queue
+	ladqueue_put(event->timestamp, event);
+}
+
+void SerialScheduleNewEvent(unsigned int rcv, simtime_t stamp,
+			    unsigned int event_type, void *event_content,
+			    unsigned int event_size)
+{
+	void *content = SerialReserveEvent(rcv, stamp, event_type, event_size);
+
+	memcpy(content, event_content, event_size);
+	SerialCommitEvent(content);
 }
 
 void serial_init(void)
@@ -87,12 +130,15 @@ void serial_init(void)
 	if (unlikely(n_prc_tot == 0)) {
 		rootsim_error(true, "You must specify the total number of Logical Processes\n");
 	}
-	// Initialize the calendar queue
-	calqueue_init();
+	// Initialize the ladder queue
+	ladqueue_init();
 
 	// Initialize the per LP variables
 	serial_completed_simulation = rsalloc(sizeof(bool) * n_prc_tot);
 	bzero(serial_completed_simulation, sizeof(bool) * n_prc_tot);
+	serial_touched = rsalloc(sizeof(bool) * n_prc_tot);
+	bzero(serial_touched, sizeof(bool) * n_prc_tot);
+	serial_touched_lps = rsalloc(sizeof(struct lp_struct *) * SERIAL_CHECK_PERIOD);
 
 	// Generate the INIT events for all the LPs
 	foreach_lp(lp) {
@@ -104,13 +150,65 @@ void serial_init(void)
 	current = NULL;
 }
 
+/**
+ * @brief Let the LPs which executed events since the last check decide on termination
+ *
+ * @return @c true if all LPs agree on terminating the simulation
+ */
+static bool serial_check_termination(void)
+{
+	struct lp_struct *lp;
+	bool new_termination_decision;
+	unsigned int i, gid;
+
+	for (i = 0; i < serial_touched_count; i++) {
+		lp = serial_touched_lps[i];
+		gid = lp->gid.to_int;
+		serial_touched[gid] = false;
+
+		// Termination detection can happen only after the state is initialized
+		if (unlikely(lp->current_base_pointer == NULL))
+			continue;
+
+		// In incremental termination detection we are dealing with stable termination
+		// predicates. We can suppose that after that an LP decided to terminate the
+		// simulation, it will never change its mind.
+		if (rootsim_config.check_termination_mode == CKTRM_INCREMENTAL && serial_completed_simulation[gid])
+			continue;
+
+		// Normal and accurate termination detection policies are the same in sequential simulation.
+		// We have to be sure that, at the current time, all the LPs are agreeing on termination.
+		// We therefore keep track of past per-LP decisions and increment/decrement the termination counter depending
+		// on changed decision.
+		current = lp;
+		new_termination_decision = lp->OnGVT(gid, lp->current_base_pointer);
+
+		if (serial_completed_simulation[gid] != new_termination_decision) {
+			if (new_termination_decision) {
+				// Changed from false to true
+				serial_completed++;
+			} else {
+				// Changed from true to false
+				serial_completed--;
+			}
+		}
+
+		serial_completed_simulation[gid] = new_termination_decision;
+	}
+
+	serial_touched_count = 0;
+	current = NULL;
+
+	return serial_completed == n_prc_tot;
+}
+
 void serial_simulation(void)
 {
-	timer serial_event_execution;
+	timer serial_batch_execution;
 	timer serial_gvt_timer;
 	msg_t *event;
-	bool new_termination_decision;
-	unsigned int completed = 0;
+	unsigned int batch_events = 0;
+	simtime_t last_timestamp = 0.0;
 
 #ifdef EXTRA_CHECKS
 	unsigned long long hash1, hash2;
@@ -118,14 +216,15 @@ void serial_simulation(void)
 #endif
 
 	timer_start(serial_gvt_timer);
+	timer_start(serial_batch_execution);
 
 	statistics_start();
 
 	while (!serial_simulation_complete) {
 
-		// Pick an event from the calendar queue and use the
+		// Pick an event from the ladder queue and use the
 		// receiver as the current lp
-		event = (msg_t *) calqueue_get();
+		event = (msg_t *) ladqueue_get();
 		if (unlikely(event == NULL)) {
 			rootsim_error(true, "No events to process!\n");
 		}
@@ -140,7 +239,6 @@ void serial_simulation(void)
 		}
 #endif
 
-		timer_start(serial_event_execution);
 		if(&abm_settings){
 			ProcessEventABM();
 		}else if (&topology_settings){
@@ -152,7 +250,6 @@ void serial_simulation(void)
 		}
 
 		statistics_post_data_serial(STAT_EVENT, 1.0);
-		statistics_post_data_serial(STAT_EVENT_TIME, timer_value_seconds(serial_event_execution));
 
 #ifdef EXTRA_CHECKS
 		if (event->size > 0) {
@@ -166,45 +263,10 @@ void serial_simulation(void)
 		}
 #endif
 
-		// Termination detection can happen only after the state is initialized
-		if (likely(current->current_base_pointer != NULL)) {
-
-			// We have just executed a new event at some LP. Depending on the type of requested termination detection,
-			// we call or skip the termination detection for the current LP.
-			if(rootsim_config.check_termination_mode == CKTRM_INCREMENTAL) {
-				// In incremental termination detection we are dealing with stable termination
-				// predicates. We can suppose that after that an LP decided to terminate the
-				// simulation, it will never change its mind.
-				if (!serial_completed_simulation[event->receiver.to_int] && current->OnGVT(event->receiver.to_int, current->current_base_pointer)) {
-					completed++;
-					serial_completed_simulation[event->receiver.to_int] = true;
-					if (unlikely(completed == n_prc_tot)) {
-						serial_simulation_complete = true;
-					}
-				}
-			} else {
-				// Normal and accurate termination detection policies are the same in sequential simulation.
-				// We have to be sure that, at the current time, all the LPs are agreeing on termination.
-				// We therefore keep track of past per-LP decisions and increment/decrement the termination counter depending
-				// on changed decision.
-				new_termination_decision = current->OnGVT(event->receiver.to_int, current->current_base_pointer);
-
-				if(serial_completed_simulation[event->receiver.to_int] != new_termination_decision) {
-					if(new_termination_decision) {
-						// Changed from false to true
-						completed++;
-					} else {
-						// Changed from true to false
-						completed--;
-					}
-				}
-
-				serial_completed_simulation[event->receiver.to_int] = new_termination_decision;
-
-				if (unlikely(completed == n_prc_tot)) {
-					serial_simulation_complete = true;
-				}
-			}
+		// Remember the LP, its termination predicate is evaluated at the end of the batch
+		if (!serial_touched[event->receiver.to_int]) {
+			serial_touched[event->receiver.to_int] = true;
+			serial_touched_lps[serial_touched_count++] = current;
 		}
 
 		// Termination detection on reached LVT value
@@ -212,16 +274,30 @@ void serial_simulation(void)
 			serial_simulation_complete = true;
 		}
 
+		last_timestamp = event->timestamp;
+		current = NULL;
+
+		rsfree(event);
+
+		if (likely(++batch_events < SERIAL_CHECK_PERIOD && !serial_simulation_complete))
+			continue;
+
+		// The cost of events is measured over the whole batch, timers are too expensive for single events
+		statistics_post_data_serial(STAT_EVENT_TIME, (double)timer_value_micro(serial_batch_execution) / batch_events);
+		batch_events = 0;
+
+		if (serial_check_termination()) {
+			serial_simulation_complete = true;
+		}
+
 		// Print the time advancement periodically
 		if (timer_value_milli(serial_gvt_timer) > (int)rootsim_config.gvt_time_period) {
 			timer_restart(serial_gvt_timer);
-			printf("TIME BARRIER: %f\n", lvt(current));
-			statistics_on_gvt_serial(lvt(current));
+			printf("TIME BARRIER: %f\n", last_timestamp);
+			statistics_on_gvt_serial(last_timestamp);
 		}
 
-		current = NULL;
-
-		rsfree(event);
+		timer_restart(serial_batch_execution);
 	}
 
 	simulation_shutdown(EXIT_SUCCESS);
@@ -5,8 +5,8 @@
  *
  * This module implements the sequential execution of simulation models.
  * Here all the routines to support sequential simulations are implemented,
- * except for the event queue which uses the Calendar Queue implemented in
- * calqueue.c.
+ * except for the event queue which uses the Ladder Queue implemented in
+ * ladqueue.c.
  *
  * @copyright
  * Copyright (C) 2008-2019 HPDCS Group
@@ -32,9 +32,15 @@
 
 #include <ROOT-Sim.h>
 
+/// Number of events executed between two evaluations of the termination predicates
+#define SERIAL_CHECK_PERIOD	1024
+
 extern void SerialSetState(void *);
 extern void SerialScheduleNewEvent(unsigned int, simtime_t, unsigned int,
 				   void *, unsigned int);
+extern void *SerialReserveEvent(unsigned int, simtime_t, unsigned int,
+				unsigned int);
+extern void SerialCommitEvent(void *);
 
 extern void serial_init(void);
 extern void serial_simulation(void) __attribute__((noreturn));
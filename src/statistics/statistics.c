@@ -245,11 +245,14 @@ static void print_config_to_file(FILE *f)
 		"Scheduler: %s\n"
 		#ifdef HAVE_MPI
 		"MPI multithread support: %s\n"
+		"LP Migration Period: %u GVT rounds\n"
 		#endif
 		"GVT Time Period: %.2f seconds\n"
 		"Checkpointing Type: %s\n"
 		"Checkpointing Period: %d\n"
 		"Snapshot Reconstruction Type: %s\n"
+		"Cancellation Type: %s\n"
+		"Checkpoint Compression: %s\n"
 		"Halt Simulation After: %d\n"
 		"LPs Distribution Mode across Kernels: %s\n"
 		"Check Termination Mode: %s\n"
@@ -262,11 +265,14 @@ static void print_config_to_file(FILE *f)
 		param_to_text[PARAM_SCHEDULER][rootsim_config.scheduler],
 		#ifdef HAVE_MPI
 		((mpi_support_multithread)? "yes":"no"),
+		rootsim_config.migration_period,
 		#endif
 		rootsim_config.gvt_time_period / 1000.0,
 		param_to_text[PARAM_STATE_SAVING][rootsim_config.checkpointing],
 		rootsim_config.ckpt_period,
 		param_to_text[PARAM_SNAPSHOT][rootsim_config.snapshot],
+		param_to_text[PARAM_CANCELLATION][rootsim_config.cancellation],
+		param_to_text[PARAM_CKPT_COMPRESSION][rootsim_config.ckpt_compression],
 		rootsim_config.simulation_time,
 		param_to_text[PARAM_LPS_DISTRIBUTION][rootsim_config.lps_distribution],
 		param_to_text[PARAM_CKTRM_MODE][rootsim_config.check_termination_mode],
@@ -367,6 +373,8 @@ static void print_common_stats(FILE *f, struct stat_t *stats_p, bool want_thread
 	fprintf(f, "TOTAL REPROCESSED EVENTS... : %.0f \n",		stats_p->reprocessed_events);
 	fprintf(f, "TOTAL ROLLBACKS EXECUTED... : %.0f \n",		stats_p->tot_rollbacks);
 	fprintf(f, "TOTAL ANTIMESSAGES......... : %.0f \n",		stats_p->tot_antimessages);
+	if(rootsim_config.cancellation == CANCELLATION_LAZY)
+		fprintf(f, "LAZY CANCELLATION HITS..... : %.0f \n",	stats_p->lazy_hits);
 	fprintf(f, "ROLLBACK FREQUENCY......... : %.2f %%\n",		rollback_frequency * 100);
 	fprintf(f, "ROLLBACK LENGTH............ : %.2f events\n",	rollback_length);
 	fprintf(f, "EFFICIENCY................. : %.2f %%\n",		efficiency);
@@ -375,6 +383,12 @@ static void print_common_stats(FILE *f, struct stat_t *stats_p, bool want_thread
 	fprintf(f, "AVERAGE CHECKPOINT COST.... : %.2f us\n",		stats_p->ckpt_time / stats_p->tot_ckpts);
 	fprintf(f, "AVERAGE RECOVERY COST...... : %.2f us\n",		(stats_p->tot_recoveries > 0 ? stats_p->recovery_time / stats_p->tot_recoveries : 0));
 	fprintf(f, "AVERAGE LOG SIZE........... : %s\n",		format_size(stats_p->ckpt_mem / stats_p->tot_ckpts));
+	if(rootsim_config.ckpt_compression != CKPT_COMPRESSION_NONE)
+		fprintf(f, "LOG COMPRESSION SAVINGS.... : %.2f %%\n",	(stats_p->ckpt_mem > 0 ? stats_p->ckpt_saved / (stats_p->ckpt_mem + stats_p->ckpt_saved) * 100 : 0));
+	fprintf(f, "AVERAGE CKPT ARENA SIZE.... : %s\n",		format_size(stats_p->arena_mem / stats_p->gvt_computations));
+	fprintf(f, "CKPT ARENA FRAGMENTATION... : %.2f %%\n",		(stats_p->arena_mem > 0 ? (1 - stats_p->arena_live / stats_p->arena_mem) * 100 : 0));
+	if(!want_thread_stats)
+		fprintf(f, "PEAK CKPT ARENA SIZE....... : %s\n",	format_size(stats_p->arena_peak));
 	fprintf(f, "\n");
 	fprintf(f, "IDLE CYCLES................ : %.0f\n",		stats_p->idle_cycles);
 	if(!want_thread_stats){
@@ -512,7 +526,9 @@ void statistics_stop(int exit_code)
 		foreach_bound_lp(lp) {
 			thread_stats[local_tid].vec += lp_stats[lp->lid.to_int].vec;
 		}
-		thread_stats[local_tid].exponential_event_time /= n_prc_per_thread;
+		// Parked worker threads might be left with no LP at all
+		if(n_prc_per_thread > 0)
+			thread_stats[local_tid].exponential_event_time /= n_prc_per_thread;
 
 		// Compute derived statistics and dump everything
 		f = thread_files[STAT_FILE_T_THREAD][local_tid];
@@ -530,6 +546,7 @@ void statistics_stop(int exit_code)
 			}
 			system_wide_stats.exponential_event_time /= n_cores;
 			system_wide_stats.max_resident_set = getPeakRSS();
+			system_wide_stats.arena_peak = ckpt_arena_peak();
 			// GVT computations are the same for all threads
 			system_wide_stats.gvt_computations /= n_cores;
 
@@ -717,10 +734,10 @@ void statistics_init(void)
 	}
 
 	// Initialize data structures to keep information
-	lp_stats = rsalloc(n_prc * sizeof(struct stat_t));
-	bzero(lp_stats, n_prc * sizeof(struct stat_t));
-	lp_stats_gvt = rsalloc(n_prc * sizeof(struct stat_t));
-	bzero(lp_stats_gvt, n_prc * sizeof(struct stat_t));
+	lp_stats = rsalloc(n_prc_max * sizeof(struct stat_t));
+	bzero(lp_stats, n_prc_max * sizeof(struct stat_t));
+	lp_stats_gvt = rsalloc(n_prc_max * sizeof(struct stat_t));
+	bzero(lp_stats_gvt, n_prc_max * sizeof(struct stat_t));
 	thread_stats = rsalloc(n_cores * sizeof(struct stat_t));
 	bzero(thread_stats, n_cores * sizeof(struct stat_t));
 }
@@ -834,6 +851,22 @@ void statistics_post_data(struct lp_struct *lp, enum stat_msg_t type, double dat
 			lp_stats_gvt[lid].reprocessed_events += data;
 			break;
 
+		case STAT_LAZY_HIT:
+			lp_stats_gvt[lid].lazy_hits += 1.0;
+			break;
+
+		case STAT_ARENA_MEM:
+			lp_stats_gvt[lid].arena_mem += data;
+			break;
+
+		case STAT_ARENA_LIVE:
+			lp_stats_gvt[lid].arena_live += data;
+			break;
+
+		case STAT_CKPT_SAVED:
+			lp_stats_gvt[lid].ckpt_saved += data;
+			break;
+
 		case STAT_GVT_ROUND_TIME:
 			system_wide_stats.gvt_round_time_min = fmin(data, system_wide_stats.gvt_round_time_min);
 			system_wide_stats.gvt_round_time_max = fmax(data, system_wide_stats.gvt_round_time_max);
@@ -848,13 +881,120 @@ void statistics_post_data(struct lp_struct *lp, enum stat_msg_t type, double dat
 
 double statistics_get_lp_data(struct lp_struct *lp, unsigned int type)
 {
+	struct stat_t *stats_p;
+
 	switch(type) {
 
 		case STAT_GET_EVENT_TIME_LP:
 			return lp_stats[lp->lid.to_int].exponential_event_time;
 
+		case STAT_GET_COMMITTED_LP:
+			return lp_stats[lp->lid.to_int].committed_events;
+
+		case STAT_GET_WORKLOAD_LP:
+			// Time spent on the LP, including work wasted because of rollbacks
+			stats_p = &lp_stats[lp->lid.to_int];
+			if (stats_p->tot_events == 0.0)
+				return 0.0;
+			return stats_p->event_time + stats_p->ckpt_time + stats_p->recovery_time +
+			    stats_p->reprocessed_events * stats_p->event_time / stats_p->tot_events;
+
 		default:
 			rootsim_error(true, "Wrong statistics get type: %d. Aborting...\n", type);
 	}
 	return 0.0;
 }
+
+
+double statistics_get_kernel_data(unsigned int type)
+{
+	unsigned int i;
+	double ret = 0.0;
+
+	switch(type) {
+
+		case STAT_GET_IDLE_CYCLES:
+			for(i = 0; i < n_cores; i++) {
+				ret += thread_stats[i].idle_cycles;
+			}
+			break;
+
+		case STAT_GET_TOT_EVENTS:
+			// Threads keep the events of LPs which have left this kernel
+			for(i = 0; i < n_cores; i++) {
+				ret += thread_stats[i].tot_events;
+			}
+			foreach_lp(lp) {
+				ret += lp_stats[lp->lid.to_int].tot_events;
+			}
+			break;
+
+		case STAT_GET_COMMITTED_EVENTS:
+			for(i = 0; i < n_cores; i++) {
+				ret += thread_stats[i].committed_events;
+			}
+			foreach_lp(lp) {
+				ret += lp_stats[lp->lid.to_int].committed_events;
+			}
+			break;
+
+		default:
+			rootsim_error(true, "Wrong statistics get type: %d. Aborting...\n", type);
+	}
+	return ret;
+}
+
+
+/**
+* Account the statistics of an LP which is leaving this kernel instance
+* to the worker thread which was hosting it, so that they still show up
+* in the thread and node statistics at the end of the simulation.
+*
+* @param lp A pointer to the lp_struct of the departing LP
+*/
+void statistics_lp_departure(struct lp_struct *lp)
+{
+	unsigned int lid = lp->lid.to_int;
+
+	lp_stats[lid].vec += lp_stats_gvt[lid].vec;
+	lp_stats[lid].exponential_event_time = 0.0;
+	thread_stats[lp->worker_thread].vec += lp_stats[lid].vec;
+
+	bzero(&lp_stats[lid], sizeof(struct stat_t));
+	bzero(&lp_stats_gvt[lid], sizeof(struct stat_t));
+}
+
+
+/**
+* Move the statistics of an LP when it is assigned a different local id.
+*
+* @param from The old local id of the LP
+* @param to The new local id of the LP
+*/
+void statistics_lp_relocate(unsigned int from, unsigned int to)
+{
+	lp_stats[to] = lp_stats[from];
+	lp_stats_gvt[to] = lp_stats_gvt[from];
+
+	bzero(&lp_stats[from], sizeof(struct stat_t));
+	bzero(&lp_stats_gvt[from], sizeof(struct stat_t));
+}
+
+
+/**
+* Set up the statistics of an LP which has just been migrated to this
+* kernel instance. Counters start from scratch, while the estimate of
+* the event granularity is inherited from the source kernel.
+*
+* @param lp A pointer to the lp_struct of the arrived LP
+* @param exponential_event_time The event cost estimate on the source kernel
+*/
+void statistics_lp_arrival(struct lp_struct *lp, double exponential_event_time)
+{
+	unsigned int lid = lp->lid.to_int;
+
+	bzero(&lp_stats[lid], sizeof(struct stat_t));
+	bzero(&lp_stats_gvt[lid], sizeof(struct stat_t));
+	lp_stats[lid].exponential_event_time = exponential_event_time;
+	lp_stats_gvt[lid].exponential_event_time = exponential_event_time;
+}
@@ -97,9 +97,18 @@ enum stat_msg_t {
 	STAT_EVENT_TIME,
 	STAT_IDLE_CYCLES,
 	STAT_SILENT,
+	STAT_LAZY_HIT,
+	STAT_ARENA_MEM,
+	STAT_ARENA_LIVE,
+	STAT_CKPT_SAVED,
 	STAT_GVT_ROUND_TIME,
 	STAT_GET_SIMTIME_ADVANCEMENT,	//xxx totally unused
-	STAT_GET_EVENT_TIME_LP
+	STAT_GET_EVENT_TIME_LP,
+	STAT_GET_COMMITTED_LP,
+	STAT_GET_IDLE_CYCLES,
+	STAT_GET_TOT_EVENTS,
+	STAT_GET_COMMITTED_EVENTS,
+	STAT_GET_WORKLOAD_LP
 };
 
 enum stats_levels {
@@ -111,7 +120,7 @@ enum stats_levels {
 };
 
 // this is used in order to have more efficient stats additions during gvt reductions
-typedef double vec_double __attribute__((vector_size(16 * sizeof(double))));
+typedef double vec_double __attribute__((vector_size(32 * sizeof(double))));
 
 // Structure to keep track of (incremental) statistics
 struct stat_t {
@@ -131,13 +140,18 @@ struct stat_t {
 			    idle_cycles,
 			    memory_usage,
 			    simtime_advancement,
-			    gvt_computations, exponential_event_time;
+			    gvt_computations, exponential_event_time,
+			    lazy_hits,
+			    arena_mem,
+			    arena_live,
+			    ckpt_saved;
 		};
 		vec_double vec;
 	};
 	double gvt_time,
 	    gvt_round_time,
-	    gvt_round_time_min, gvt_round_time_max, max_resident_set;
+	    gvt_round_time_min, gvt_round_time_max, max_resident_set,
+	    arena_peak;
 };
 
 extern void _mkdir(const char *path);
@@ -157,4 +171,9 @@ extern inline void statistics_post_data(struct lp_struct *, enum stat_msg_t type
 extern inline void statistics_post_data_serial(enum stat_msg_t type, double data);
 
 extern double statistics_get_lp_data(struct lp_struct *, unsigned int type);
+extern double statistics_get_kernel_data(unsigned int type);
+
+extern void statistics_lp_departure(struct lp_struct *);
+extern void statistics_lp_relocate(unsigned int from, unsigned int to);
+extern void statistics_lp_arrival(struct lp_struct *, double exponential_event_time);
 
@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#define actual_malloc(siz) malloc(siz)
+#define actual_free(ptr) free(ptr)
+
+#include <mm/mm.h>
+#include <core/init.h>
+
+#include "common.h"
+
+#define print(...) printf(__VA_ARGS__); fflush(stdout)
+
+/* Number of chunks allocated for each test */
+#define CHUNKS		MIN_NUM_CHUNKS
+
+/* Number of objects larger than MAX_CHUNK_SIZE, enough to grow the array of malloc_areas */
+#define LARGE_OBJECTS	(INITIAL_NUM_AREAS - NUM_AREAS + 8)
+
+/* Bytes logged for each measurement, to have stable timings */
+#define BYTES_PER_RUN	(256ULL << 20)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned char *chunks[CHUNKS];
+
+
+/* The log and restore functions post statistics, which are not collected here */
+void statistics_post_data(struct lp_struct *lp, enum stat_msg_t type, double data)
+{
+	(void)lp;
+	(void)type;
+	(void)data;
+}
+
+
+static uint64_t random64(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void pattern_fill(unsigned char *ptr, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		ptr[i] = (unsigned char)(((uintptr_t)ptr + i) * 31);
+}
+
+
+static bool pattern_check(unsigned char *ptr, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (ptr[i] != (unsigned char)(((uintptr_t)ptr + i) * 31))
+			return false;
+	}
+	return true;
+}
+
+
+/* The log as it was taken copying one chunk at a time */
+static size_t reference_log(unsigned char *buffer)
+{
+	malloc_state *m_state = context.mm->m_state;
+	unsigned char *ptr = buffer;
+	malloc_area *m_area;
+	size_t bitmap_size, chunk_size;
+	int i;
+
+	memcpy(ptr, m_state, sizeof(malloc_state));
+	((malloc_state *)ptr)->timestamp = lvt(current);
+	ptr += sizeof(malloc_state);
+
+	for (i = 0; i < m_state->num_areas; i++) {
+		m_area = &m_state->areas[i];
+		if (m_area->alloc_chunks == 0)
+			continue;
+
+		bitmap_size = bitmap_required_size(m_area->num_chunks);
+		memcpy(ptr, m_area, sizeof(malloc_area));
+		ptr += sizeof(malloc_area);
+		memcpy(ptr, m_area->use_bitmap, bitmap_size);
+		ptr += bitmap_size;
+
+		chunk_size = UNTAGGED_CHUNK_SIZE(m_area);
+
+#define copy_from_area(x) ({\
+		memcpy(ptr, (unsigned char *)m_area->area + ((x) * chunk_size), chunk_size);\
+		ptr += chunk_size;})
+
+		bitmap_foreach_set(m_area->use_bitmap, bitmap_size, copy_from_area);
+
+#undef copy_from_area
+	}
+
+	return ptr - buffer;
+}
+
+
+/* The restore as it was carried out copying one chunk at a time */
+static void reference_restore(unsigned char *buffer)
+{
+	malloc_state *m_state = context.mm->m_state;
+	unsigned char *ptr = buffer + sizeof(malloc_state);
+	malloc_area *m_area;
+	size_t bitmap_size, chunk_size;
+	int i;
+
+	for (i = 0; i < m_state->num_areas; i++) {
+		m_area = &m_state->areas[i];
+		if (m_area->alloc_chunks == 0)
+			continue;
+
+		bitmap_size = bitmap_required_size(m_area->num_chunks);
+		ptr += sizeof(malloc_area) + bitmap_size;
+		chunk_size = UNTAGGED_CHUNK_SIZE(m_area);
+
+#define copy_to_area(x) ({\
+		memcpy((unsigned char *)m_area->area + ((x) * chunk_size), ptr, chunk_size);\
+		ptr += chunk_size;})
+
+		bitmap_foreach_set(m_area->use_bitmap, bitmap_size, copy_to_area);
+
+#undef copy_to_area
+	}
+}
+
+
+/* Allocate CHUNKS chunks of the given size, and release them at random
+ * until only the given fraction is left */
+static unsigned int populate(size_t chunk_size, double occupancy)
+{
+	unsigned int i, kept = 0;
+	size_t size = chunk_size - sizeof(long long);
+
+	for (i = 0; i < CHUNKS; i++) {
+		chunks[i] = __wrap_malloc(size);
+		pattern_fill(chunks[i], size);
+	}
+
+	for (i = 0; i < CHUNKS; i++) {
+		if ((double)(random64() % 1000) >= occupancy * 1000) {
+			__wrap_free(chunks[i]);
+			chunks[i] = NULL;
+		} else {
+			kept++;
+		}
+	}
+
+	return kept;
+}
+
+
+static void depopulate(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < CHUNKS; i++) {
+		if (chunks[i] != NULL)
+			__wrap_free(chunks[i]);
+		chunks[i] = NULL;
+	}
+}
+
+
+static bool measure(size_t chunk_size, double occupancy)
+{
+	unsigned char *reference, *buffer;
+	void *ckpt;
+	size_t size, ref_size, i;
+	unsigned int kept, reps, r;
+	double start, ref_log_time, log_time, ref_restore_time, restore_time;
+	bool passed = true;
+
+	kept = populate(chunk_size, occupancy);
+
+	reference = rsalloc(get_log_size(context.mm->m_state));
+	ref_size = reference_log(reference);
+
+	// The log must be the very same one taken chunk by chunk
+	ckpt = log_full(&context);
+	size = get_log_size(ckpt);
+	if (size != ref_size || memcmp(ckpt, reference, size) != 0)
+		passed = false;
+
+	// Restoring it must bring back the content of the chunks
+	for (i = 0; i < CHUNKS; i++) {
+		if (chunks[i] != NULL)
+			memset(chunks[i], 0, chunk_size - sizeof(long long));
+	}
+	restore_full(&context, ckpt);
+	for (i = 0; i < CHUNKS; i++) {
+		if (chunks[i] != NULL && !pattern_check(chunks[i], chunk_size - sizeof(long long)))
+			passed = false;
+	}
+	log_delete(ckpt);
+
+	reps = BYTES_PER_RUN / size + 1;
+
+	// Both variants take each log in a new buffer, as the simulator does
+	start = now();
+	for (r = 0; r < reps; r++) {
+		buffer = rsalloc(size);
+		reference_log(buffer);
+		rsfree(buffer);
+	}
+	ref_log_time = now() - start;
+
+	start = now();
+	for (r = 0; r < reps; r++)
+		log_delete(log_full(&context));
+	log_time = now() - start;
+
+	start = now();
+	for (r = 0; r < reps; r++)
+		reference_restore(reference);
+	ref_restore_time = now() - start;
+
+	ckpt = log_full(&context);
+	start = now();
+	for (r = 0; r < reps; r++)
+		restore_full(&context, ckpt);
+	restore_time = now() - start;
+	log_delete(ckpt);
+
+	print("\t%6zu B chunks, %3.0f%% used (%3u chunks, %8zu B log): log %6.2f us -> %6.2f us (%4.2fx), restore %6.2f us -> %6.2f us (%4.2fx)\n",
+	      chunk_size, occupancy * 100, kept, size,
+	      ref_log_time * 1e6 / reps, log_time * 1e6 / reps, ref_log_time / log_time,
+	      ref_restore_time * 1e6 / reps, restore_time * 1e6 / reps, ref_restore_time / restore_time);
+
+	rsfree(reference);
+	depopulate();
+
+	return passed;
+}
+
+
+static bool test_checkpoint(void)
+{
+	size_t sizes[] = {128, 1024, 8192, 65536};
+	double occupancies[] = {0.1, 0.5, 0.9, 1.0};
+	unsigned int s, o;
+	bool passed = true;
+
+	print("\n");
+	for (s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		for (o = 0; o < sizeof(occupancies) / sizeof(*occupancies); o++)
+			passed &= measure(sizes[s], occupancies[o]);
+	}
+	print("Log and restore of model state... ");
+
+	return passed;
+}
+
+
+/* Objects larger than MAX_CHUNK_SIZE get their own malloc_area: they must be
+ * logged and restored as the other chunks, and released at GVT once free'd */
+static bool test_large(void)
+{
+	unsigned char *objects[LARGE_OBJECTS], *others[LARGE_OBJECTS];
+	size_t sizes[LARGE_OBJECTS];
+	malloc_state *m_state = context.mm->m_state;
+	void *ckpt;
+	unsigned int i;
+	int j;
+	bool passed = true;
+
+	for (i = 0; i < LARGE_OBJECTS; i++) {
+		sizes[i] = MAX_CHUNK_SIZE + random64() % MAX_CHUNK_SIZE;
+		objects[i] = __wrap_malloc(sizes[i]);
+		pattern_fill(objects[i], sizes[i]);
+	}
+
+	ckpt = log_full(&context);
+
+	// Change everything after the log, so that the restore has to bring it back
+	for (i = 0; i < LARGE_OBJECTS; i++) {
+		if (i % 2) {
+			__wrap_free(objects[i]);
+			others[i] = __wrap_malloc(sizes[i]);
+		} else {
+			others[i] = NULL;
+		}
+		memset(objects[i], 0, sizes[i]);
+	}
+
+	restore_full(&context, ckpt);
+	log_delete(ckpt);
+
+	for (i = 0; i < LARGE_OBJECTS; i++)
+		passed &= pattern_check(objects[i], sizes[i]);
+
+	for (i = 0; i < LARGE_OBJECTS; i++)
+		__wrap_free(objects[i]);
+	passed &= m_state->busy_areas == 0;
+
+	// The objects allocated after the log are gone, so all the extents can be released
+	clean_buffers_on_gvt(&context, 1.0);
+	for (j = 0; j < m_state->num_areas; j++)
+		passed &= UNTAGGED_CHUNK_SIZE(&m_state->areas[j]) <= MAX_CHUNK_SIZE;
+
+	return passed;
+}
+
+
+#define do_test(desc, function, ...) do {\
+					print(desc);	\
+					passed = function(__VA_ARGS__); \
+					if(passed) { \
+						print("passed\n"); \
+					} else { \
+						print("failed\n"); \
+						ret = 1; \
+					} \
+				} while(0)
+
+int main(void)
+{
+	bool passed = true;
+	int ret = 0;
+
+	n_prc_tot = 1;
+	rootsim_config.ckpt_compression = CKPT_COMPRESSION_NONE;
+	segment_init();
+
+	context.bound = actual_malloc(sizeof(msg_t));
+	context.bound->timestamp = 0.0;
+	initialize_memory_map(&context);
+	current = &context;
+
+	do_test("Checkpoint microbenchmark... ", test_checkpoint);
+	do_test("Large objects... ", test_large);
+
+	finalize_memory_map(&context);
+	actual_free(context.bound);
+
+	return ret;
+}
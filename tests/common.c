@@ -6,6 +6,7 @@
 
 #define actual_malloc(siz) malloc(siz)
 #define actual_free(ptr) free(ptr)
+#define actual_realloc(ptr, siz) realloc(ptr, siz)
 
 #include "common.h"
 
@@ -15,6 +16,7 @@ __thread struct lp_struct context;
 simulation_configuration rootsim_config = { 0 };
 unsigned int n_prc_tot;
 unsigned int n_prc;
+unsigned int n_cores;
 __thread unsigned int __lp_counter = 0;
 
 void _mkdir(const char *path) {
@@ -52,9 +54,7 @@ void __real_free(void *ptr)
 
 void *__real_realloc(void *ptr, size_t size)
 {
-	(void)ptr;
-	(void)size;
-	abort();
+	return actual_realloc(ptr, size);
 }
 
 void *__real_calloc(size_t nmemb, size_t size)
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+#include <mm/mm.h>
+
+#define print(...) printf(__VA_ARGS__); fflush(stdout)
+
+#define MAX_SIZE	(1 << 20)
+
+enum _content {
+	ZEROES,
+	RANDOM,
+	RUNS,
+	RECORDS,
+	NUM_CONTENTS
+};
+
+static const char *content_names[] = {
+	"zeroes",
+	"random",
+	"runs",
+	"records"
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned char *original, *compressed, *decompressed;
+
+
+static uint64_t random64(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* Fill a buffer with data resembling what can be found in a log */
+static void fill(unsigned char *buffer, size_t size, enum _content content)
+{
+	size_t i, run;
+	unsigned char value;
+	struct {
+		double timestamp;
+		unsigned int id;
+		unsigned int counter;
+		void *next;
+	} record;
+
+	switch(content) {
+		case ZEROES:
+			memset(buffer, 0, size);
+			break;
+
+		case RANDOM:
+			for (i = 0; i < size; i++)
+				buffer[i] = (unsigned char)random64();
+			break;
+
+		case RUNS:
+			for (i = 0; i < size; i += run) {
+				run = 1 + random64() % 300;
+				if (run > size - i)
+					run = size - i;
+				value = random64() % 4 == 0 ? (unsigned char)random64() : 0;
+				memset(buffer + i, value, run);
+			}
+			break;
+
+		case RECORDS:
+			memset(&record, 0, sizeof(record));
+			for (i = 0; i + sizeof(record) <= size; i += sizeof(record)) {
+				record.timestamp += (double)(random64() % 1000) / 100.0;
+				record.id = (unsigned int)(i / sizeof(record)) % 64;
+				record.counter += random64() % 3;
+				record.next = (random64() % 2) ? NULL : (void *)(buffer + i + sizeof(record));
+				memcpy(buffer + i, &record, sizeof(record));
+			}
+			memset(buffer + i, 0, size - i);
+			break;
+
+		default:
+			print("Error: unknown content\n");
+			exit(EXIT_FAILURE);
+	}
+}
+
+
+static bool round_trip(size_t size, enum _content content, size_t *compressed_size)
+{
+	size_t c, d;
+
+	fill(original, size, content);
+
+	c = lz_compress(original, size, compressed, 2 * size + 16);
+	if (c == 0 && size > 0)
+		return false;
+
+	memset(decompressed, 0xAA, size);
+	d = lz_decompress(compressed, c, decompressed, size);
+	if (d != size || memcmp(original, decompressed, size) != 0)
+		return false;
+
+	if (compressed_size != NULL)
+		*compressed_size = c;
+
+	return true;
+}
+
+
+/* All the contents, with all the sizes around the block boundaries */
+static bool test_small_sizes(void)
+{
+	size_t size;
+	unsigned int content;
+
+	for (content = 0; content < NUM_CONTENTS; content++) {
+		for (size = 1; size < 600; size++) {
+			if (!round_trip(size, content, NULL))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+static bool test_ratio(void)
+{
+	size_t sizes[] = {4096, 65536, 100000, MAX_SIZE};
+	size_t c = 0;
+	unsigned int content, s;
+	double start, elapsed;
+
+	print("\n");
+	for (content = 0; content < NUM_CONTENTS; content++) {
+		for (s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+			start = now();
+			if (!round_trip(sizes[s], content, &c))
+				return false;
+			elapsed = now() - start;
+
+			print("\t%-8s %8zu bytes: %6.2f %% of the original size, %.1f MB/s round trip\n",
+			      content_names[content], sizes[s], c * 100.0 / sizes[s], sizes[s] / elapsed / 1e6);
+		}
+	}
+	print("Compression ratio... ");
+
+	return true;
+}
+
+
+/* Compression must give up as soon as the output would not fit */
+static bool test_capacity(void)
+{
+	size_t c;
+
+	fill(original, 65536, RANDOM);
+	if (lz_compress(original, 65536, compressed, 65536 - 1) != 0)
+		return false;
+
+	fill(original, 65536, RUNS);
+	c = lz_compress(original, 65536, compressed, 65536);
+	if (c == 0)
+		return false;
+
+	return lz_compress(original, 65536, compressed, c - 1) == 0 &&
+	       lz_compress(original, 65536, compressed, c) == c;
+}
+
+
+/* Corrupted streams must not be decompressed past the output buffer */
+static bool test_corrupted(void)
+{
+	size_t c, i;
+
+	fill(original, 65536, RECORDS);
+	c = lz_compress(original, 65536, compressed, 2 * 65536);
+	if (c == 0)
+		return false;
+
+	if (lz_decompress(compressed, c, decompressed, 65536 - 1) != 0)
+		return false;
+
+	for (i = 0; i < 1000; i++) {
+		memcpy(decompressed, compressed, c);
+		decompressed[random64() % c] ^= 1 << (random64() % 8);
+		if (lz_decompress(decompressed, c, original, 65536) > 65536)
+			return false;
+	}
+
+	return true;
+}
+
+
+#define do_test(desc, function, ...) do {\
+					print(desc);	\
+					passed = function(__VA_ARGS__); \
+					if(passed) { \
+						print("passed\n"); \
+					} else { \
+						print("failed\n"); \
+						ret = 1; \
+					} \
+				} while(0)
+
+int main(void)
+{
+	bool passed = true;
+	int ret = 0;
+
+	original = rsalloc(2 * MAX_SIZE + 16);
+	compressed = rsalloc(2 * MAX_SIZE + 16);
+	decompressed = rsalloc(2 * MAX_SIZE + 16);
+
+	do_test("Round trip of small buffers... ", test_small_sizes);
+	do_test("Round trip of large buffers... ", test_ratio);
+	do_test("Compression bounded by the output size... ", test_capacity);
+	do_test("Decompression of corrupted streams... ", test_corrupted);
+
+	rsfree(original);
+	rsfree(compressed);
+	rsfree(decompressed);
+
+	return ret;
+}
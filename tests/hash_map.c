@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+#include <datatypes/hash_map.h>
+#include <mm/mm.h>
+
+#define print(...) printf(__VA_ARGS__); fflush(stdout)
+
+#define RANDOM_OPERATIONS	2000000
+#define BENCH_OPERATIONS	4000000
+
+struct elem {
+	unsigned long long key;
+	unsigned long long value;
+};
+
+typedef rootsim_hash_map(struct elem) map_t;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void insert(map_t *map, unsigned long long key)
+{
+	struct elem *e = hash_map_reserve_elem(*map, key);
+
+	e->key = key;
+	e->value = ~key;
+}
+
+
+/* Every element must be found at its position in the elements array */
+static bool check_all(map_t *map)
+{
+	struct elem *e;
+	unsigned int i;
+
+	for (i = 0; i < hash_map_count(*map); i++) {
+		e = &array_get_at(map->elems, i);
+		if (hash_map_lookup(*map, e->key) != e || e->value != ~e->key)
+			return false;
+	}
+	return true;
+}
+
+
+/* Random insertions, deletions, swaps and lookups, also of missing keys.
+ * The range of the keys changes over time, so that the table grows, shrinks
+ * and is full of tombstones along the way.
+ */
+static bool test_random(void)
+{
+	static bool present[1 << 16];
+	unsigned long long key;
+	struct elem *e;
+	map_t map;
+	unsigned int i, j, k, count = 0;
+	bool passed = true;
+
+	hash_map_init(map);
+
+	for (i = 0; i < RANDOM_OPERATIONS && passed; i++) {
+		key = rng() % ((i / 200000) % 2 ? (1 << 16) : (1 << 8));
+		e = hash_map_lookup(map, key);
+		if ((e != NULL) != present[key] || (e != NULL && e->key != key)) {
+			passed = false;
+			break;
+		}
+
+		switch (rng() % 4) {
+			case 0:
+			case 1:
+				if (!present[key]) {
+					insert(&map, key);
+					present[key] = true;
+					count++;
+				}
+				break;
+			case 2:
+				if (present[key]) {
+					hash_map_delete_elem(map, e);
+					present[key] = false;
+					count--;
+				}
+				break;
+			default:
+				if (count > 1) {
+					j = rng() % count;
+					k = rng() % count;
+					hash_map_swap_elems(map, j, k);
+				}
+				break;
+		}
+
+		passed = hash_map_count(map) == count && (i % 10000 || check_all(&map));
+	}
+
+	for (key = 0; key < (1 << 16) && passed; key++)
+		passed = (hash_map_lookup(map, key) != NULL) == present[key];
+
+	passed = passed && check_all(&map);
+	hash_map_fini(map);
+	return passed;
+}
+
+
+/* A loaded dump must hold the same elements, and skipping it must land after it */
+static bool test_dump(void)
+{
+	unsigned char *buffer, *ptr;
+	map_t map, loaded;
+	struct elem *e;
+	unsigned int i;
+	size_t size;
+	bool passed;
+
+	hash_map_init(map);
+	for (i = 0; i < 10000; i++)
+		insert(&map, rng());
+	for (i = 0; i < 3000; i++) {
+		e = &array_get_at(map.elems, rng() % hash_map_count(map));
+		hash_map_delete_elem(map, e);
+	}
+
+	size = hash_map_dump_size(map);
+	buffer = ptr = rsalloc(size);
+	hash_map_dump(map, ptr);
+	passed = ptr == buffer + size;
+
+	ptr = buffer;
+	hash_map_load(loaded, ptr);
+	passed &= ptr == buffer + size;
+	passed &= hash_map_count(loaded) == hash_map_count(map) && check_all(&loaded);
+
+	ptr = buffer + array_dump_size(map.elems);
+	hash_map_skip_table(ptr);
+	passed &= ptr == buffer + size;
+
+	// the loaded map must keep working on its own
+	for (i = 0; i < 10000; i++)
+		insert(&loaded, rng());
+	passed &= check_all(&loaded);
+
+	hash_map_fini(loaded);
+	hash_map_fini(map);
+	rsfree(buffer);
+	return passed;
+}
+
+
+/* The time spent in the operations of the ABM layer on maps of the given size:
+ * lookups of present and missing keys, replacement of elements as agents come
+ * and go, and dumps as in region checkpoints.
+ */
+static void bench(unsigned int size)
+{
+	unsigned long long *keys, sum = 0;
+	unsigned char *buffer, *ptr;
+	struct elem *e;
+	double start, hit, miss, churn, dump;
+	unsigned int i, j, rounds;
+	map_t map;
+
+	keys = rsalloc(sizeof(*keys) * size);
+	hash_map_init(map);
+	for (i = 0; i < size; i++) {
+		keys[i] = rng();
+		insert(&map, keys[i]);
+	}
+
+	start = now();
+	for (i = 0; i < BENCH_OPERATIONS; i++)
+		sum += hash_map_lookup(map, keys[rng() % size])->value;
+	hit = now() - start;
+
+	start = now();
+	for (i = 0; i < BENCH_OPERATIONS; i++)
+		sum += hash_map_lookup(map, rng()) != NULL;
+	miss = now() - start;
+
+	start = now();
+	for (i = 0; i < BENCH_OPERATIONS; i++) {
+		j = rng() % size;
+		e = hash_map_lookup(map, keys[j]);
+		hash_map_delete_elem(map, e);
+		keys[j] = rng();
+		insert(&map, keys[j]);
+	}
+	churn = now() - start;
+
+	rounds = BENCH_OPERATIONS / size / 4 + 1;
+	buffer = rsalloc(hash_map_dump_size(map));
+	start = now();
+	for (i = 0; i < rounds; i++) {
+		ptr = buffer;
+		hash_map_dump(map, ptr);
+		sum += *(ptr - 1);
+	}
+	dump = now() - start;
+
+	print("\t%7u elements: lookup hit %.1f ns, lookup miss %.1f ns, remove+insert %.1f ns, dump %.1f ns/element (%llu)\n",
+	      size, hit * 1e9 / BENCH_OPERATIONS, miss * 1e9 / BENCH_OPERATIONS,
+	      churn * 1e9 / BENCH_OPERATIONS, dump * 1e9 / rounds / size, sum % 10);
+
+	rsfree(buffer);
+	hash_map_fini(map);
+	rsfree(keys);
+}
+
+
+static bool test_bench(void)
+{
+	unsigned int sizes[] = {10, 100, 1000, 10000, 100000, 1000000};
+	unsigned int s;
+
+	print("\n");
+	for (s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+		bench(sizes[s]);
+	print("Hash map operations... ");
+
+	return true;
+}
+
+
+#define do_test(desc, function, ...) do {\
+					print(desc);	\
+					passed = function(__VA_ARGS__); \
+					if(passed) { \
+						print("passed\n"); \
+					} else { \
+						print("failed\n"); \
+						ret = 1; \
+					} \
+				} while(0)
+
+int main(void)
+{
+	bool passed = true;
+	int ret = 0;
+
+	do_test("Random operations against a reference... ", test_random);
+	do_test("Dump and load... ", test_dump);
+	do_test("Benchmark... ", test_bench);
+
+	return ret;
+}
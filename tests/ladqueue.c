@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+
+#include <datatypes/calqueue.h>
+#include <datatypes/ladqueue.h>
+#include <mm/mm.h>
+
+#define print(...) printf(__VA_ARGS__); fflush(stdout)
+
+#define HOLD_OPERATIONS	2000000
+
+
+enum _dis {
+	EXPONENTIAL,
+	UNIFORM,
+	BIMODAL,
+	TRIANGULAR
+};
+
+static const char *dis_names[] = {
+	"exponential",
+	"uniform",
+	"bimodal",
+	"triangular"
+};
+
+struct event_queue {
+	const char *name;
+	void (*init)(void);
+	void (*put)(double, void *);
+	void *(*get)(void);
+};
+
+static struct event_queue queues[] = {
+	{"calendar queue", calqueue_init, calqueue_put, calqueue_get},
+	{"ladder queue", ladqueue_init, ladqueue_put, ladqueue_get}
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+
+static double uniform(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (double)(rng_state >> 11) / (double)(1ULL << 53);
+}
+
+
+/* Increments of the hold model, all having mean 1.0 */
+static double get_increment(enum _dis distr)
+{
+	switch(distr) {
+		case EXPONENTIAL:
+			return -log(1.0 - uniform());
+
+		case UNIFORM:
+			return 2.0 * uniform();
+
+		case BIMODAL:
+			return uniform() < 0.9 ? 0.2 * uniform() : 18.2 * uniform();
+
+		case TRIANGULAR:
+			return 1.5 * sqrt(uniform());
+
+		default:
+			print("Error: unknown distribution\n");
+			exit(EXIT_FAILURE);
+	}
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* Run the hold model on a queue of the given size. Each hold extracts
+ * the minimum and reinserts it with a random increment. Returns false if
+ * events are not extracted in non-decreasing timestamp order.
+ */
+static bool hold(struct event_queue *q, unsigned int size, enum _dis distr, double *elapsed)
+{
+	double *events, *ev, last = 0.0;
+	unsigned int i;
+	bool passed = true;
+	double start;
+
+	events = rsalloc(sizeof(double) * size);
+	rng_state = 0x9E3779B97F4A7C15ULL + size + distr;
+
+	q->init();
+	for (i = 0; i < size; i++) {
+		events[i] = get_increment(distr);
+		q->put(events[i], &events[i]);
+	}
+
+	start = now();
+	for (i = 0; i < HOLD_OPERATIONS; i++) {
+		ev = q->get();
+		if (ev == NULL || *ev < last) {
+			passed = false;
+			break;
+		}
+		last = *ev;
+		*ev += get_increment(distr);
+		q->put(*ev, ev);
+	}
+	*elapsed = now() - start;
+
+	// Drain the queue, this checks the order as well
+	for (i = 0; i < size; i++) {
+		ev = q->get();
+		if (ev == NULL || *ev < last)
+			passed = false;
+		else
+			last = *ev;
+	}
+	if (q->get() != NULL)
+		passed = false;
+
+	rsfree(events);
+	return passed;
+}
+
+
+/* Both queues must return the same timestamps in the same order, also
+ * when many events share the same timestamp.
+ */
+static bool test_same_order(void)
+{
+	double stamps[20000], order[2][20000];
+	double *ev;
+	unsigned int i, j;
+
+	for (j = 0; j < 2; j++) {
+		rng_state = 42;
+		queues[j].init();
+		for (i = 0; i < 20000; i++) {
+			stamps[i] = (double)(int)(100.0 * uniform());
+			queues[j].put(stamps[i], &stamps[i]);
+		}
+		for (i = 0; i < 20000; i++) {
+			ev = queues[j].get();
+			if (ev == NULL)
+				return false;
+			order[j][i] = *ev;
+		}
+		if (queues[j].get() != NULL)
+			return false;
+	}
+
+	for (i = 0; i < 20000; i++) {
+		if (order[0][i] != order[1][i])
+			return false;
+		if (i > 0 && order[1][i] < order[1][i - 1])
+			return false;
+	}
+
+	return true;
+}
+
+
+static bool test_hold(void)
+{
+	unsigned int sizes[] = {100, 1000, 10000, 100000};
+	double elapsed[2];
+	unsigned int s, d, j;
+	bool passed = true;
+
+	print("\n");
+	for (d = 0; d < sizeof(dis_names) / sizeof(*dis_names); d++) {
+		for (s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+			for (j = 0; j < 2; j++)
+				passed &= hold(&queues[j], sizes[s], d, &elapsed[j]);
+
+			print("\t%-12s %7u events: %s %.1f ns/hold, %s %.1f ns/hold\n",
+			      dis_names[d], sizes[s],
+			      queues[0].name, elapsed[0] * 1e9 / HOLD_OPERATIONS,
+			      queues[1].name, elapsed[1] * 1e9 / HOLD_OPERATIONS);
+		}
+	}
+	print("Hold model... ");
+
+	return passed;
+}
+
+
+#define do_test(desc, function, ...) do {\
+					print(desc);	\
+					passed = function(__VA_ARGS__); \
+					if(passed) { \
+						print("passed\n"); \
+					} else { \
+						print("failed\n"); \
+						ret = 1; \
+					} \
+				} while(0)
+
+int main(void)
+{
+	bool passed = true;
+	int ret = 0;
+
+	do_test("Extraction order with many ties... ", test_same_order);
+	do_test("Hold model on calendar and ladder queues... ", test_hold);
+
+	ladqueue_fini();
+
+	return ret;
+}